@@ -0,0 +1,77 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "ccontrol/ChunkSpecExecutor.h"
+
+// System headers
+#include <chrono>
+#include <stdexcept>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.ChunkSpecExecutor");
+
+using lsst::qserv::util::StatsRegistry;
+auto const histQueueWait = StatsRegistry::get().histogram("ccontrol.ChunkSpecExecutor.queueWait");
+}
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+ChunkSpecExecutor& ChunkSpecExecutor::get() {
+    static ChunkSpecExecutor executor;
+    return executor;
+}
+
+
+void ChunkSpecExecutor::configure(int threads) {
+    LOGS(_log, LOG_LVL_INFO, "chunk spec threads=" << threads);
+    // Submitting threads wait for the specs already queued.
+    _pool.configure(threads);
+}
+
+
+int ChunkSpecExecutor::getThreads() const {
+    return _pool.getThreads();
+}
+
+
+void ChunkSpecExecutor::queue(std::function<void()> const& func) {
+    auto queuedTime = std::chrono::steady_clock::now();
+    auto cmd = std::make_shared<util::Command>([func, queuedTime](util::CmdData*) {
+        histQueueWait->recordSince(queuedTime);
+        func();
+    });
+    if (!_pool.queCmd(cmd)) {
+        throw std::logic_error("ChunkSpecExecutor::queue called without threads");
+    }
+}
+
+}}} // namespace lsst::qserv::ccontrol
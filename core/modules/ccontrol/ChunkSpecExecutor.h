@@ -0,0 +1,64 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_CCONTROL_CHUNKSPECEXECUTOR_H
+#define LSST_QSERV_CCONTROL_CHUNKSPECEXECUTOR_H
+
+// System headers
+#include <functional>
+
+// Qserv headers
+#include "util/ConfigurablePool.h"
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+/// ChunkSpecExecutor builds the chunk query specs of user queries on a
+/// czar-wide pool of threads, so that submitting a query with many chunks,
+/// or many subchunks per chunk, is not limited to one core. The submitting
+/// thread hands each spec to the Executive as soon as it is built.
+class ChunkSpecExecutor {
+public:
+    static ChunkSpecExecutor& get();
+
+    ChunkSpecExecutor(ChunkSpecExecutor const&) = delete;
+    ChunkSpecExecutor& operator=(ChunkSpecExecutor const&) = delete;
+
+    /// @param threads - number of threads, 0 to build specs on the submitting thread.
+    void configure(int threads);
+
+    /// @return the number of threads, 0 if specs are built on the submitting thread.
+    int getThreads() const;
+
+    /// Queue func to run on one of the threads.
+    void queue(std::function<void()> const& func);
+
+private:
+    ChunkSpecExecutor() = default;
+
+    util::ConfigurablePool _pool;
+};
+
+}}} // namespace lsst::qserv::ccontrol
+
+#endif // LSST_QSERV_CCONTROL_CHUNKSPECEXECUTOR_H
@@ -0,0 +1,152 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "ccontrol/MergeExecutor.h"
+
+// System headers
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.MergeExecutor");
+
+using lsst::qserv::util::StatsRegistry;
+auto const histQueueWait = StatsRegistry::get().histogram("ccontrol.MergeExecutor.queueWait");
+}
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+MergeExecutor& MergeExecutor::get() {
+    static MergeExecutor executor;
+    return executor;
+}
+
+
+void MergeExecutor::configure(int threads, int maxQueuedPerQuery) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _maxQueuedPerQuery = std::max(1, maxQueuedPerQuery);
+    }
+    LOGS(_log, LOG_LVL_INFO, "merge threads=" << threads
+         << " maxQueuedPerQuery=" << maxQueuedPerQuery);
+    // Merges that are already queued still have to run.
+    _pool.configure(threads);
+}
+
+
+bool MergeExecutor::isEnabled() const {
+    return _pool.getThreads() > 0;
+}
+
+
+void MergeExecutor::queue(void const* key, std::function<void()> const& func) {
+    // Held while queuing, so the merge can not finish before it is counted.
+    std::lock_guard<std::mutex> lock(_mtx);
+    int queued = ++_queued[key];
+    auto queuedTime = std::chrono::steady_clock::now();
+    auto cmd = std::make_shared<util::Command>([this, key, func, queuedTime](util::CmdData*) {
+        histQueueWait->recordSince(queuedTime);
+        // The merge has to be counted as done however it ends, or the
+        // query would stay backlogged.
+        try {
+            func();
+        } catch (std::exception const& exc) {
+            LOGS(_log, LOG_LVL_ERROR, "merge of " << key << " failed: " << exc.what());
+        } catch (...) {
+            LOGS(_log, LOG_LVL_ERROR, "merge of " << key << " failed");
+        }
+        _mergeDone(key);
+    });
+    if (!_pool.queCmd(cmd)) {
+        if (--_queued[key] <= 0) {
+            _queued.erase(key);
+        }
+        throw std::logic_error("MergeExecutor::queue called without merge threads");
+    }
+    LOGS(_log, LOG_LVL_TRACE, "queued " << key << " count=" << queued);
+}
+
+
+int MergeExecutor::getQueued(void const* key) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _queued.find(key);
+    return (iter == _queued.end()) ? 0 : iter->second;
+}
+
+
+bool MergeExecutor::isBacklogged(void const* key) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _queued.find(key);
+    return iter != _queued.end() && iter->second >= _maxQueuedPerQuery;
+}
+
+
+bool MergeExecutor::deferWhileBacklogged(void const* key, std::function<bool()> const& resume) {
+    // Checked and deferred under one lock, so a merge finishing in between
+    // can not miss the read.
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _queued.find(key);
+    if (iter == _queued.end() || iter->second < _maxQueuedPerQuery) return false;
+    _deferred[key].push_back(resume);
+    LOGS(_log, LOG_LVL_DEBUG, "read of " << key << " deferred, count=" << iter->second);
+    return true;
+}
+
+
+void MergeExecutor::_mergeDone(void const* key) {
+    bool countDone = false;
+    while (true) {
+        std::function<bool()> resume;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            int queued = 0;
+            auto iter = _queued.find(key);
+            if (iter != _queued.end()) {
+                if (!countDone) --(iter->second);
+                queued = iter->second;
+                if (queued <= 0) _queued.erase(iter);
+            }
+            countDone = true;
+            if (queued >= _maxQueuedPerQuery) return;
+            auto dIter = _deferred.find(key);
+            if (dIter == _deferred.end()) return;
+            resume = std::move(dIter->second.front());
+            dIter->second.pop_front();
+            if (dIter->second.empty()) _deferred.erase(dIter);
+        }
+        // Called without the lock, as resuming may queue more merges.
+        if (resume()) return;
+    }
+}
+
+}}} // namespace lsst::qserv::ccontrol
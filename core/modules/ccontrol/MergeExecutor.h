@@ -0,0 +1,95 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_CCONTROL_MERGEEXECUTOR_H
+#define LSST_QSERV_CCONTROL_MERGEEXECUTOR_H
+
+// System headers
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+
+// Qserv headers
+#include "util/ConfigurablePool.h"
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+/// MergeExecutor decodes and merges result messages on its own threads, so
+/// the XrdSsi callback threads that receive the messages only hand them off
+/// and go back to reading. The number of merge threads is configured
+/// independently of the XrdSsi callback threads.
+///
+/// The messages waiting to be merged are counted per user query, keyed by
+/// the object the query merges into. A query with too many of them is
+/// backlogged, and reading more of its results waits until it catches up:
+/// each merge of the query that finishes resumes one deferred read.
+class MergeExecutor {
+public:
+    static MergeExecutor& get();
+
+    MergeExecutor(MergeExecutor const&) = delete;
+    MergeExecutor& operator=(MergeExecutor const&) = delete;
+
+    /// @param threads - number of merge threads, 0 to merge on the callback threads.
+    /// @param maxQueuedPerQuery - number of queued messages at which a query
+    ///                            is backlogged.
+    void configure(int threads, int maxQueuedPerQuery);
+
+    /// @return true if merges should be queued.
+    bool isEnabled() const;
+
+    /// Queue func to run on a merge thread on behalf of the query identified by key.
+    void queue(void const* key, std::function<void()> const& func);
+
+    /// @return the number of messages of the query identified by key that
+    ///         are queued or being merged.
+    int getQueued(void const* key) const;
+
+    /// @return true if the query identified by key has too many queued messages.
+    bool isBacklogged(void const* key) const;
+
+    /// If the query identified by key is backlogged, call resume on a merge
+    /// thread once one of its merges has finished. resume returns false if
+    /// it no longer had anything to read, and the next deferred read of the
+    /// query is resumed in its place.
+    /// @return true if resume will be called.
+    bool deferWhileBacklogged(void const* key, std::function<bool()> const& resume);
+
+private:
+    MergeExecutor() = default;
+
+    void _mergeDone(void const* key);
+
+    util::ConfigurablePool _pool;
+    mutable std::mutex _mtx; ///< Protects _maxQueuedPerQuery, _queued and _deferred.
+    int _maxQueuedPerQuery{1};
+    std::map<void const*, int> _queued; ///< Only queries with queued messages have entries.
+    /// Reads deferred while their query was backlogged, in the order they were deferred.
+    std::map<void const*, std::deque<std::function<bool()>>> _deferred;
+};
+
+}}} // namespace lsst::qserv::ccontrol
+
+#endif // LSST_QSERV_CCONTROL_MERGEEXECUTOR_H
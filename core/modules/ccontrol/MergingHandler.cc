@@ -31,6 +31,7 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "ccontrol/MergeExecutor.h"
 #include "ccontrol/msgCode.h"
 #include "global/Bug.h"
 #include "global/debugUtil.h"
@@ -39,6 +40,8 @@
 #include "proto/ProtoImporter.h"
 #include "proto/WorkerResponse.h"
 #include "qdisp/JobQuery.h"
+#include "qdisp/MemoryGovernor.h"
+#include "qdisp/WorkerLoadTable.h"
 #include "rproc/InfileMerger.h"
 #include "util/common.h"
 #include "util/StringHash.h"
@@ -57,7 +60,6 @@ namespace lsst {
 namespace qserv {
 namespace ccontrol {
 
-std::atomic<std::int64_t> MergeBuffer::_totalBytes{0};
 std::atomic<int> MergeBuffer::_sequence{0};
 
 ////////////////////////////////////////////////////////////////////////
@@ -99,6 +101,13 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
             // Worker sent corrupted data, or there is some other error.
         }
     }
+    {
+        std::lock_guard<std::mutex> lock(_queuedMtx);
+        if (_queuedFailed) {
+            LOGS(_log, LOG_LVL_WARN, "From:" << _wName << " flush after a queued merge failed");
+            return false;
+        }
+    }
     switch(_state) {
     case MsgState::HEADER_SIZE_WAIT:
         _response->headerSize = static_cast<unsigned char>((_mBuf.getBuffer())[0]);
@@ -111,6 +120,7 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
         if (_wName == "~") {
             _wName = _response->protoHeader.wname();
         }
+        _recordWorkerLoad();
 
         LOGS(_log, LOG_LVL_DEBUG, "HEADER_SIZE_WAIT: From:" << _wName
              << "Resizing buffer to " <<  _response->protoHeader.size());
@@ -121,13 +131,19 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
         return true;
 
     case MsgState::RESULT_WAIT:
+        if (_response->protoHeader.has_continues() && MergeExecutor::get().isEnabled()) {
+            return _queueMerge(last, largeResult);
+        }
         if (!_verifyResult()) { return false; }
         if (!_setResult()) { return false; } // set _response->result
         largeResult = _response->result.largeresult();
         LOGS(_log, LOG_LVL_DEBUG, "From:" << _wName << " _mBuf "
              << util::prettyCharList(_mBuf.getBuffer(), 5));
-        _mBuf.zero(); // not needed after _response->result set.
         {
+            // The decoded result is about as large as the buffer, and is held
+            // until it has been merged.
+            qdisp::MemoryGovernor::Reservation resultMem(_mBuf.getSize());
+            _mBuf.zero(); // not needed after _response->result set.
             bool msgContinues = _response->result.continues();
             _state = MsgState::RESULT_RECV;
             if (msgContinues) {
@@ -141,7 +157,11 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
             LOGS(_log, LOG_LVL_DEBUG, "Flushed msgContinues=" << msgContinues
                  << " last=" << last << " for tableName=" << _tableName);
 
-            auto success = _merge();
+            auto success = _merge(_response);
+            if (!success) {
+                _state = MsgState::RESULT_ERR;
+            }
+            _response.reset();
             if (msgContinues) {
                 _response.reset(new WorkerResponse());
             }
@@ -154,6 +174,7 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
             _state = MsgState::HEADER_ERR;
             return false;
         }
+        _recordWorkerLoad();
         largeResult = _response->protoHeader.largeresult();
         LOGS(_log, LOG_LVL_DEBUG, "RESULT_EXTRA: Resizing buffer to "
              << _response->protoHeader.size() << " largeResult=" << largeResult);
@@ -223,7 +244,7 @@ void MergingHandler::_initState() {
     _setError(0, "");
 }
 
-bool MergingHandler::_merge() {
+bool MergingHandler::_merge(std::shared_ptr<WorkerResponse> const& response) {
     if (auto job = getJobQuery().lock()) {
         if (job->isQueryCancelled()) {
             LOGS(_log, LOG_LVL_WARN, "MergingRequester::_merge(), but already cancelled");
@@ -232,20 +253,111 @@ bool MergingHandler::_merge() {
         if (_flushed) {
             throw Bug("MergingRequester::_merge : already flushed");
         }
-        bool success = _infileMerger->merge(_response);
+        bool success = _infileMerger->merge(response);
         if (!success) {
             LOGS(_log, LOG_LVL_WARN, "_merge() failed");
             rproc::InfileMergerError const& err = _infileMerger->getError();
             _setError(ccontrol::MSG_RESULT_ERROR, err.getMsg());
-            _state = MsgState::RESULT_ERR;
         }
-        _response.reset();
         return success;
     }
     LOGS(_log, LOG_LVL_ERROR, "MergingHandler::_merge() failed, jobQuery was NULL");
     return false;
 }
 
+/// Hand the message in _mBuf to MergeExecutor, and prepare for the next
+/// message, or the end of the response, as announced by the header.
+bool MergingHandler::_queueMerge(bool& last, bool& largeResult) {
+    largeResult = _response->protoHeader.largeresult();
+    bool msgContinues = _response->protoHeader.continues();
+    std::shared_ptr<MergeBuffer::bufType> buf(_mBuf.release());
+    std::shared_ptr<WorkerResponse> response(std::move(_response));
+    if (msgContinues) {
+        _state = MsgState::RESULT_EXTRA;
+        _mBuf.setTargetSize(proto::ProtoHeaderWrap::PROTO_HEADER_SIZE);
+        _response.reset(new WorkerResponse());
+    } else {
+        _state = MsgState::RESULT_RECV;
+        last = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_queuedMtx);
+        ++_queuedMerges;
+    }
+    LOGS(_log, LOG_LVL_DEBUG, "From:" << _wName << " queued merge of " << buf->size()
+         << " bytes msgContinues=" << msgContinues << " for tableName=" << _tableName);
+    // The message, and then its decoded result, which is about as large,
+    // count against the memory budget from now on, not only once merged.
+    auto mem = std::make_shared<qdisp::MemoryGovernor::Reservation>(2 * static_cast<std::int64_t>(buf->size()));
+    auto self = shared_from_this();
+    MergeExecutor::get().queue(_infileMerger.get(), [self, response, buf, mem]() mutable {
+        self->_mergeQueued(response, std::move(buf), std::move(mem));
+    });
+    return true;
+}
+
+
+/// Verify, decode and merge a message on a MergeExecutor thread.
+void MergingHandler::_mergeQueued(std::shared_ptr<WorkerResponse> const& response,
+                                  std::shared_ptr<MergeBuffer::bufType> buf,
+                                  std::shared_ptr<qdisp::MemoryGovernor::Reservation> mem) {
+    bool success = false;
+    {
+        if (response->protoHeader.md5() != util::StringHash::getMd5(buf->data(), buf->size())) {
+            _setError(ccontrol::MSG_RESULT_MD5, "Result message MD5 mismatch");
+        } else if (!ProtoImporter<proto::Result>::setMsgFrom(response->result, buf->data(), buf->size())) {
+            _setError(ccontrol::MSG_RESULT_DECODE, "Error decoding result msg");
+        } else {
+            buf.reset();
+            success = _merge(response);
+        }
+        response->result.Clear();
+        mem.reset();
+    }
+    std::function<void(bool)> func;
+    bool allMerged = false;
+    {
+        std::lock_guard<std::mutex> lock(_queuedMtx);
+        if (!success) {
+            _queuedFailed = true;
+        }
+        if (--_queuedMerges == 0 && _whenMergedFunc) {
+            func.swap(_whenMergedFunc);
+            allMerged = !_queuedFailed;
+        }
+    }
+    if (func) {
+        func(allMerged);
+    }
+}
+
+
+void MergingHandler::whenMerged(std::function<void(bool)> const& func) {
+    bool allMerged = false;
+    {
+        std::lock_guard<std::mutex> lock(_queuedMtx);
+        if (_queuedMerges > 0) {
+            _whenMergedFunc = func;
+            return;
+        }
+        allMerged = !_queuedFailed;
+    }
+    func(allMerged);
+}
+
+
+bool MergingHandler::deferWhileBacklogged(std::function<bool()> const& resume) {
+    return MergeExecutor::get().deferWhileBacklogged(_infileMerger.get(), resume);
+}
+
+
+void MergingHandler::_recordWorkerLoad() {
+    auto const& header = _response->protoHeader;
+    if (header.has_load() && header.has_wname()) {
+        qdisp::WorkerLoadTable::get().update(header.wname(), header.load());
+    }
+}
+
 void MergingHandler::_setError(int code, std::string const& msg) {
     LOGS(_log, LOG_LVL_DEBUG, "_setErr: code: " << code << ", message: " << msg);
     std::lock_guard<std::mutex> lock(_errorMutex);
@@ -278,9 +390,20 @@ bool MergingHandler::_verifyResult() {
 
 MergeBuffer::~MergeBuffer() {
     if (_buff != nullptr && _buff->size() != 0) {
-        _totalBytes -= _buff->size();
-        LOGS(_log, LOG_LVL_DEBUG, _id << " ~ totalBytes=" << _totalBytes);
+        auto& governor = qdisp::MemoryGovernor::get();
+        governor.add(-static_cast<std::int64_t>(_buff->size()));
+        LOGS(_log, LOG_LVL_DEBUG, _id << " ~ totalBytes=" << governor.getUsed());
+    }
+}
+
+
+std::unique_ptr<MergeBuffer::bufType> MergeBuffer::release() {
+    if (_buff != nullptr && _buff->size() != 0) {
+        qdisp::MemoryGovernor::get().add(-static_cast<std::int64_t>(_buff->size()));
     }
+    std::unique_ptr<bufType> buff(std::move(_buff));
+    zero();
+    return buff;
 }
 
 
@@ -314,8 +437,9 @@ void MergeBuffer::resizeToTargetSize() {
 void MergeBuffer::zero() {
     setTargetSize(0);
     if (_buff != nullptr && _buff->size() != 0) {
-        _totalBytes -= _buff->size();
-        LOGS(_log, LOG_LVL_DEBUG, _id << " zero totalBytes=" << _totalBytes);
+        auto& governor = qdisp::MemoryGovernor::get();
+        governor.add(-static_cast<std::int64_t>(_buff->size()));
+        LOGS(_log, LOG_LVL_DEBUG, _id << " zero totalBytes=" << governor.getUsed());
     }
     // Just resizing to 0 would not guarantee freeing the memory.
     _buff.reset(new bufType(0));
@@ -323,12 +447,14 @@ void MergeBuffer::zero() {
 
 
  void MergeBuffer::_resize(int sz) {
+     auto& governor = qdisp::MemoryGovernor::get();
      if (sz != (int)_buff->size()) {
-         _totalBytes += sz - _buff->size();
+         governor.add(sz - static_cast<std::int64_t>(_buff->size()));
          _buff->resize(sz);
-         LOGS(_log, LOG_LVL_DEBUG, _id << " resize totalBytes=" << _totalBytes);
+         LOGS(_log, LOG_LVL_DEBUG, _id << " resize totalBytes=" << governor.getUsed());
      } else if (sz != 0) {
-         LOGS(_log, LOG_LVL_WARN, _id << " resize called twice sz=" << sz << " totalBytes=" << _totalBytes);
+         LOGS(_log, LOG_LVL_WARN, _id << " resize called twice sz=" << sz
+              << " totalBytes=" << governor.getUsed());
      }
  }
 
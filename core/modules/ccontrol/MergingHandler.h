@@ -25,10 +25,13 @@
 
 // System headers
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 // Qserv headers
+#include "qdisp/MemoryGovernor.h"
 #include "qdisp/ResponseHandler.h"
 
 // Forward decl
@@ -51,6 +54,7 @@ namespace ccontrol {
 /// set using setTargetSize(int sz), and the buffer of that size is
 /// created by calling resizeToTargetSize(). When a buffer is no longer
 /// needed, zero() should be called to free the memory.
+/// The bytes held are accounted for by qdisp::MemoryGovernor.
 class MergeBuffer {
 public:
     using bufType = std::vector<char>;
@@ -64,6 +68,9 @@ public:
 
     /// @return a reference to the contents of the buffer.
     bufType& getBuffer();
+    /// @return the buffer, leaving this empty. The caller becomes responsible
+    ///         for accounting for its memory.
+    std::unique_ptr<bufType> release();
     size_t getSize(); ///< @return the current size of the buffer.
     /// @return the size the buffer needs to be when data is ready.
     size_t getTargetSize() { return _targetSize; }
@@ -78,7 +85,6 @@ private:
     std::string _id;
     std::unique_ptr<bufType> _buff;
     int _targetSize{0};
-    static std::atomic<std::int64_t> _totalBytes; ///< number of bytes held by all instances.
     static std::atomic<int> _sequence;
 };
 
@@ -89,7 +95,12 @@ private:
 /// fragment instead of performing buffer size and offset
 /// management. Fully-constructed protocol messages are then passed towards an
 /// InfileMerger.
-class MergingHandler : public qdisp::ResponseHandler {
+///
+/// When MergeExecutor is enabled and the header says whether more messages
+/// follow, the message is verified, decoded and merged on a merge thread,
+/// and flush() returns as soon as it has been handed off.
+class MergingHandler : public qdisp::ResponseHandler,
+                       public std::enable_shared_from_this<MergingHandler> {
 public:
     /// Possible MergingHandler message state
     enum class MsgState { INVALID, HEADER_SIZE_WAIT,
@@ -129,6 +140,11 @@ public:
     /// Signal an unrecoverable error condition. No further calls are expected.
     void errorFlush(std::string const& msg, int code) override;
 
+    void whenMerged(std::function<void(bool)> const& func) override;
+
+    /// Defer reading while the query has too many messages waiting to be merged.
+    bool deferWhileBacklogged(std::function<bool()> const& resume) override;
+
     /// @return true if the receiver has completed its duties.
     bool finished() const override;
 
@@ -148,7 +164,12 @@ public:
 
 private:
     void _initState();
-    bool _merge();
+    bool _merge(std::shared_ptr<proto::WorkerResponse> const& response);
+    bool _queueMerge(bool& last, bool& largeResult);
+    void _mergeQueued(std::shared_ptr<proto::WorkerResponse> const& response,
+                      std::shared_ptr<MergeBuffer::bufType> buf,
+                      std::shared_ptr<qdisp::MemoryGovernor::Reservation> mem);
+    void _recordWorkerLoad(); ///< Pass the worker load in the current header to WorkerLoadTable.
     void _setError(int code, std::string const& msg);
     bool _setResult();
     bool _verifyResult();
@@ -163,6 +184,11 @@ private:
     std::shared_ptr<proto::WorkerResponse> _response; ///< protobufs msg buf
     bool _flushed {false}; ///< flushed to InfileMerger?
     std::string _wName {"~"}; /// worker name
+
+    std::mutex _queuedMtx; ///< Protects the members below.
+    int _queuedMerges{0}; ///< Messages handed to MergeExecutor and not yet merged.
+    bool _queuedFailed{false}; ///< True if a queued merge failed.
+    std::function<void(bool)> _whenMergedFunc; ///< Set by whenMerged() until merges are done.
 };
 
 }}} // namespace lsst::qserv::qdisp
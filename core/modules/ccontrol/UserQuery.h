@@ -32,6 +32,7 @@
   */
 
 // System headers
+#include <functional>
 #include <memory>
 
 // Third-party headers
@@ -71,6 +72,12 @@ public:
     /// @return the final execution state.
     virtual QueryState join() = 0;
 
+    /// Call onComplete, once, when join() will not have to wait, which may
+    /// be right away, on the calling thread, or later on any thread.
+    /// Call this after submit(). The default is for queries that complete
+    /// in submit().
+    virtual void notifyOnComplete(std::function<void()> const& onComplete) { onComplete(); }
+
     /// Stop a query in progress (for immediate shutdowns)
     virtual void kill() = 0;
 
@@ -105,6 +112,13 @@ public:
 
     /// @return True if query is async query
     virtual bool isAsync() const { return false; }
+
+    /// @return true if the query is interactive, false if it scans tables,
+    ///         which decides its priority for admission.
+    virtual bool isInteractive() const { return true; }
+
+    /// @return the util::Tracer trace id of this query, 0 if it is not traced.
+    virtual uint64_t getTraceId() const { return 0; }
 };
 
 }}} // namespace lsst::qserv:ccontrol
@@ -49,7 +49,7 @@ namespace ccontrol {
 UserQueryAsyncResult::UserQueryAsyncResult(QueryId queryId,
                                            qmeta::CzarId qMetaCzarId,
                                            std::shared_ptr<qmeta::QMeta> const& qMeta,
-                                           sql::SqlConnection* resultDbConn)
+                                           std::shared_ptr<sql::SqlConnection> const& resultDbConn)
     : UserQuery(), _qMetaCzarId(qMetaCzarId),
       _resultDbConn(resultDbConn),
       _messageStore(std::make_shared<qdisp::MessageStore>()) {
@@ -23,6 +23,7 @@
 #define LSST_QSERV_CCONTROL_USERQUERYASYNCRESULT_H
 
 // System headers
+#include <memory>
 
 // Third-party headers
 
@@ -65,12 +66,12 @@ public:
      *  @param queryId:       Query ID for which to return result
      *  @param qMetaCzarId:   ID for current czar
      *  @param qMetaSelect:   QMetaSelect instance
-     *  @param resultDbConn:  Connection to results database
+     *  @param resultDbConn:  Connection to results database, owned by this query
      */
     UserQueryAsyncResult(QueryId queryId,
                          qmeta::CzarId qMetaCzarId,
                          std::shared_ptr<qmeta::QMeta> const& qMeta,
-                         sql::SqlConnection* resultDbConn);
+                         std::shared_ptr<sql::SqlConnection> const& resultDbConn);
 
     // Destructor
     ~UserQueryAsyncResult();
@@ -119,7 +120,7 @@ private:
     QueryId _queryId;
     qmeta::CzarId _qMetaCzarId;
     std::shared_ptr<qmeta::QMeta> _qMeta;
-    sql::SqlConnection* _resultDbConn;
+    std::shared_ptr<sql::SqlConnection> _resultDbConn;
     qmeta::QInfo _qInfo;
     std::shared_ptr<qdisp::MessageStore> _messageStore;
     QueryState _qState = UNKNOWN;
@@ -52,7 +52,7 @@ namespace ccontrol {
 UserQueryDrop::UserQueryDrop(std::shared_ptr<css::CssAccess> const& css,
                              std::string const& dbName,
                              std::string const& tableName,
-                             sql::SqlConnection* resultDbConn,
+                             std::shared_ptr<sql::SqlConnection> const& resultDbConn,
                              std::shared_ptr<qmeta::QMeta> const& queryMetadata,
                              qmeta::CzarId qMetaCzarId)
     : _css(css), _dbName(dbName), _tableName(tableName),
@@ -0,0 +1,194 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "ccontrol/UserQueryExecutor.h"
+
+// System headers
+#include <algorithm>
+#include <exception>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.UserQueryExecutor");
+
+using lsst::qserv::util::StatsRegistry;
+auto const histQueueWait = StatsRegistry::get().histogram("ccontrol.UserQueryExecutor.queueWait");
+auto const ctrWaited = StatsRegistry::get().counter("ccontrol.UserQueryExecutor.waited");
+}
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+UserQueryExecutor& UserQueryExecutor::get() {
+    static UserQueryExecutor executor;
+    return executor;
+}
+
+
+void UserQueryExecutor::configure(int threads, int maxRunning, int interactiveSlots) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _threads = std::max(1, threads);
+    _maxRunning = std::max(1, maxRunning);
+    _interactiveSlots = std::max(0, interactiveSlots);
+    if (_pool != nullptr) {
+        _pool->resize(_threads);
+        _finishPool->resize(_threads);
+        _admit();
+    }
+    LOGS(_log, LOG_LVL_INFO, "user query threads=" << _threads << " maxRunning=" << _maxRunning
+         << " interactiveSlots=" << _interactiveSlots);
+}
+
+
+/// Create the pool if it does not exist yet. _mtx must be held.
+void UserQueryExecutor::_startPool() {
+    if (_pool == nullptr) {
+        _queue = std::make_shared<util::CommandQueue>();
+        _pool = util::ThreadPool::newThreadPool(_threads, _queue);
+        _finishQueue = std::make_shared<util::CommandQueue>();
+        _finishPool = util::ThreadPool::newThreadPool(_threads, _finishQueue);
+    }
+}
+
+
+void UserQueryExecutor::queue(UserQuery::Ptr const& uq, FinishFunc const& finish) {
+    bool const interactive = uq->isInteractive();
+    std::lock_guard<std::mutex> lock(_mtx);
+    _startPool();
+    auto& waiting = interactive ? _interactive : _scans;
+    waiting.push_back(Entry{uq, interactive, finish, std::chrono::steady_clock::now()});
+    _admit();
+    if (!waiting.empty() && waiting.back().uq == uq) {
+        ctrWaited->add();
+        LOGS(_log, LOG_LVL_INFO, uq->getQueryIdString() << " waiting for admission, "
+             << (interactive ? "interactive" : "scan") << " running=" << _running
+             << " queued=" << (_interactive.size() + _scans.size()));
+    }
+}
+
+
+bool UserQueryExecutor::expedite(UserQuery::Ptr const& uq) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto waiting : {&_interactive, &_scans}) {
+        auto iter = std::find_if(waiting->begin(), waiting->end(),
+                                 [&uq](Entry const& e) { return e.uq == uq; });
+        if (iter != waiting->end()) {
+            Entry entry = *iter;
+            waiting->erase(iter);
+            _start(entry);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int UserQueryExecutor::getQueued() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _interactive.size() + _scans.size();
+}
+
+
+int UserQueryExecutor::getRunning() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _running;
+}
+
+
+/// Admit queries while fewer than _maxRunning are running, and scans while
+/// they leave _interactiveSlots. _mtx must be held.
+void UserQueryExecutor::_admit() {
+    int const maxScans = std::max(1, _maxRunning - _interactiveSlots);
+    while (_running < _maxRunning) {
+        std::deque<Entry>* waiting = &_interactive;
+        if (_interactive.empty()) {
+            if (_scans.empty() || _runningScans >= maxScans) {
+                return;
+            }
+            waiting = &_scans;
+        }
+        Entry entry = waiting->front();
+        waiting->pop_front();
+        _start(entry);
+    }
+}
+
+
+/// Queue the submission of an admitted query. _mtx must be held.
+void UserQueryExecutor::_start(Entry const& entry) {
+    ++_running;
+    if (!entry.interactive) {
+        ++_runningScans;
+    }
+    histQueueWait->recordSince(entry.queuedTime);
+    std::chrono::duration<double> waited = std::chrono::steady_clock::now() - entry.queuedTime;
+    LOGS(_log, (waited.count() >= 1.0 ? LOG_LVL_INFO : LOG_LVL_DEBUG),
+         entry.uq->getQueryIdString() << " admitted after " << waited.count() << "s, running=" << _running);
+    _queue->queCmd(std::make_shared<util::Command>([this, entry](util::CmdData*) {
+        _run(entry);
+    }));
+}
+
+
+void UserQueryExecutor::_run(Entry const& entry) {
+    LOGS(_log, LOG_LVL_DEBUG, entry.uq->getQueryIdString() << " submitting new query");
+    try {
+        entry.uq->submit();
+    } catch (std::exception const& exc) {
+        LOGS(_log, LOG_LVL_ERROR, entry.uq->getQueryIdString() << " submit failed: " << exc.what());
+    }
+    // The query may complete on any thread, which should not be held up by
+    // the merging and cleanup that follow.
+    entry.uq->notifyOnComplete([this, entry]() {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _finishQueue->queCmd(std::make_shared<util::Command>([this, entry](util::CmdData*) {
+            _finish(entry);
+        }));
+    });
+}
+
+
+void UserQueryExecutor::_finish(Entry const& entry) {
+    QueryState state = ERROR;
+    try {
+        state = entry.uq->join();
+    } catch (std::exception const& exc) {
+        LOGS(_log, LOG_LVL_ERROR, entry.uq->getQueryIdString() << " join failed: " << exc.what());
+    }
+    entry.finish(state);
+    std::lock_guard<std::mutex> lock(_mtx);
+    --_running;
+    if (!entry.interactive) {
+        --_runningScans;
+    }
+    _admit();
+}
+
+}}} // namespace lsst::qserv::ccontrol
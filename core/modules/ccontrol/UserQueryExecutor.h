@@ -0,0 +1,117 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_CCONTROL_USERQUERYEXECUTOR_H
+#define LSST_QSERV_CCONTROL_USERQUERYEXECUTOR_H
+
+// System headers
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// Qserv headers
+#include "ccontrol/QueryState.h"
+#include "ccontrol/UserQuery.h"
+#include "util/EventThread.h"
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+/// UserQueryExecutor runs the user queries of the czar on fixed pools of
+/// threads, instead of a thread per query that waits in join() until the
+/// query completes. At most maxRunning queries are running at a time, and
+/// the others wait for admission, interactive queries ahead of scans, each
+/// class in the order queued. Scans are only admitted while more than
+/// interactiveSlots are left, so that they can not keep interactive queries
+/// waiting.
+///
+/// A submit thread submits an admitted query and moves on. Once the query
+/// completes, UserQuery::notifyOnComplete() queues its join(), which no
+/// longer blocks, and the finish function, on a finish thread, so that
+/// finishing is not held up by the submission of large queries. The query
+/// is running until the finish function returns.
+class UserQueryExecutor {
+public:
+    /// Called with the state join() returned.
+    using FinishFunc = std::function<void(QueryState)>;
+
+    static UserQueryExecutor& get();
+
+    UserQueryExecutor(UserQueryExecutor const&) = delete;
+    UserQueryExecutor& operator=(UserQueryExecutor const&) = delete;
+
+    /// @param threads - number of threads submitting queries, and of threads
+    ///                  finishing them.
+    /// @param maxRunning - number of queries that can run at the same time.
+    /// @param interactiveSlots - number of those that scans can not take.
+    void configure(int threads, int maxRunning, int interactiveSlots);
+
+    /// Queue uq to be submitted once it is admitted, and finish to be called
+    /// once it completes.
+    void queue(UserQuery::Ptr const& uq, FinishFunc const& finish);
+
+    /// Admit uq right away if it is still queued, whatever the number of
+    /// queries running, as when it was killed and submit() has nothing to do.
+    /// @return true if uq was queued.
+    bool expedite(UserQuery::Ptr const& uq);
+
+    /// @return the number of queries waiting for admission.
+    int getQueued() const;
+
+    /// @return the number of queries admitted and not finished.
+    int getRunning() const;
+
+private:
+    struct Entry {
+        UserQuery::Ptr uq;
+        bool interactive;
+        FinishFunc finish;
+        std::chrono::steady_clock::time_point queuedTime;
+    };
+
+    UserQueryExecutor() = default;
+
+    void _startPool();
+    void _admit();
+    void _start(Entry const& entry);
+    void _run(Entry const& entry);
+    void _finish(Entry const& entry);
+
+    mutable std::mutex _mtx; ///< Protects all members.
+    util::CommandQueue::Ptr _queue; ///< Submissions.
+    util::ThreadPool::Ptr _pool;
+    util::CommandQueue::Ptr _finishQueue; ///< join() and finish functions.
+    util::ThreadPool::Ptr _finishPool;
+    int _threads{10};
+    int _maxRunning{50};
+    int _interactiveSlots{0};
+    int _running{0};
+    int _runningScans{0};
+    std::deque<Entry> _interactive; ///< Interactive queries waiting for admission.
+    std::deque<Entry> _scans; ///< Scans waiting for admission.
+};
+
+}}} // namespace lsst::qserv::ccontrol
+
+#endif // LSST_QSERV_CCONTROL_USERQUERYEXECUTOR_H
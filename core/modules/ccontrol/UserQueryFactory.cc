@@ -25,9 +25,13 @@
 #include "ccontrol/UserQueryFactory.h"
 
 // System headers
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
+#include <map>
 #include <string>
+#include <vector>
 
 // Third-party headers
 
@@ -35,6 +39,7 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "ccontrol/ChunkSpecExecutor.h"
 #include "ccontrol/ConfigError.h"
 #include "ccontrol/ConfigMap.h"
 #include "ccontrol/UserQueryAsyncResult.h"
@@ -43,6 +48,7 @@
 #include "ccontrol/UserQueryInvalid.h"
 #include "ccontrol/UserQueryProcessList.h"
 #include "ccontrol/UserQuerySelect.h"
+#include "ccontrol/UserQueryStats.h"
 #include "ccontrol/UserQueryType.h"
 #include "css/CssAccess.h"
 #include "css/KvInterfaceImplMem.h"
@@ -52,14 +58,17 @@
 #include "parser/SelectParser.h"
 #include "qdisp/Executive.h"
 #include "qdisp/MessageStore.h"
+#include "qdisp/WorkerSelector.h"
 #include "qmeta/QMetaMysql.h"
 #include "qmeta/QMetaSelect.h"
+#include "qproc/QueryPlanCache.h"
 #include "qproc/QuerySession.h"
 #include "qproc/SecondaryIndex.h"
 #include "query/FromList.h"
 #include "query/SelectStmt.h"
 #include "rproc/InfileMerger.h"
-#include "sql/SqlConnection.h"
+#include "sql/SqlConnectionPool.h"
+#include "util/Tracer.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.UserQueryFactory");
@@ -74,7 +83,11 @@ namespace ccontrol {
 class UserQueryFactory::Impl {
 public:
 
-    Impl(czar::CzarConfig const& czarConfig);
+    /// @param qMeta: QMeta to use, nullptr to connect to the one in czarConfig.
+    Impl(czar::CzarConfig const& czarConfig, std::shared_ptr<qmeta::QMeta> const& qMeta);
+
+    /// Reload the chunk replica map of dbName in the background if it is stale.
+    void refreshReplicas(std::string const& dbName);
 
     /// State shared between UserQueries
     qdisp::Executive::Config::Ptr executiveConfig;
@@ -83,14 +96,62 @@ public:
     std::shared_ptr<qproc::SecondaryIndex> secondaryIndex;
     std::shared_ptr<qmeta::QMeta> queryMetadata;
     std::shared_ptr<qmeta::QMetaSelect> qMetaSelect;
-    std::unique_ptr<sql::SqlConnection> resultDbConn;
+    sql::SqlConnectionPool::Ptr resultDbPool; ///< Each simple UserQuery leases a connection
+    qproc::QueryPlanCache::Ptr planCache; ///< nullptr if disabled
     qmeta::CzarId qMetaCzarId = {0};   ///< Czar ID in QMeta database
+    int maxMergeShards{1};             ///< Upper limit on result merge tables per query
+    int aggregateMaxGroups{0};         ///< Upper limit on in-memory aggregate groups
+    int topKMaxRows{0};                ///< Upper limit on in-memory ORDER BY LIMIT rows
+    bool subChunkTemplates{false};     ///< Workers build subchunk queries from templates
+
+    // Chunk replica map for qdisp::WorkerSelector. It is loaded on a thread of
+    // its own, through its own CssAccess.
+    bool replicaDispatch{false};
+    std::chrono::seconds replicaRefresh{600};
+    std::map<std::string, std::string> const cssConfigMap;
+    std::string const emptyChunkPath;
 };
 
+namespace {
+
+/// Build the chunk to replica host map of dbName from CSS. Chunks of all the
+/// partitioned tables of a database are placed together, so the first table
+/// with chunk information is used. Inactive nodes are left out.
+qdisp::WorkerSelector::ChunkHosts loadChunkHosts(css::CssAccess& css, std::string const& dbName) {
+    qdisp::WorkerSelector::ChunkHosts chunkHosts;
+    auto const nodes = css.getAllNodeParams();
+    for (auto const& table : css.getTableNames(dbName)) {
+        if (!css.getPartTableParams(dbName, table).isChunked()) continue;
+        auto const chunks = css.getChunks(dbName, table);
+        if (chunks.empty()) continue;
+        for (auto const& chunk : chunks) {
+            auto& hosts = chunkHosts[chunk.first];
+            for (auto const& nodeName : chunk.second) {
+                auto iter = nodes.find(nodeName);
+                if (iter == nodes.end()) {
+                    hosts.push_back(nodeName);
+                } else if (iter->second.isActive()) {
+                    hosts.push_back(iter->second.host.empty() ? nodeName : iter->second.host);
+                }
+            }
+        }
+        break;
+    }
+    return chunkHosts;
+}
+
+} // anonymous namespace
+
 ////////////////////////////////////////////////////////////////////////
 UserQueryFactory::UserQueryFactory(czar::CzarConfig const& czarConfig,
                                    std::string const& czarName)
-    :  _impl(std::make_shared<Impl>(czarConfig)) {
+    :  UserQueryFactory(czarConfig, czarName, nullptr) {
+}
+
+UserQueryFactory::UserQueryFactory(czar::CzarConfig const& czarConfig,
+                                   std::string const& czarName,
+                                   std::shared_ptr<qmeta::QMeta> const& queryMetadata)
+    :  _impl(std::make_shared<Impl>(czarConfig, queryMetadata)) {
 
     ::putenv((char*)"XRDDEBUG=1");
 
@@ -132,50 +193,80 @@ UserQueryFactory::newUserQuery(std::string const& aQuery,
         // Processing regular select query
         bool sessionValid = true;
         std::string errorExtra;
+        uint64_t const traceId = util::Tracer::get().newTraceId(); // 0 when tracing is off
 
-        // Parse SELECT
-        std::shared_ptr<query::SelectStmt> stmt;
-        try {
-            auto parser = parser::SelectParser::newInstance(query);
-            parser->setup();
-            stmt = parser->getSelectStmt();
-        } catch(parser::ParseException const& e) {
-            return std::make_shared<UserQueryInvalid>(std::string("ParseException:") + e.what());
-        }
-
-        // handle special database/table names
-        auto&& tblRefList = stmt->getFromList().getTableRefList();
-        if (tblRefList.size() == 1) {
-            auto&& tblRef = tblRefList[0];
-            std::string const db = tblRef->getDb().empty() ? defaultDb : tblRef->getDb();
-            if (UserQueryType::isProcessListTable(db, tblRef->getTable())) {
-                if (async) {
-                    // no point supporting async for these
-                    auto uq = std::make_shared<UserQueryInvalid>("SUBMIT is not allowed with query: " + aQuery);
-                    return uq;
-                }
-                LOGS(_log, LOG_LVL_DEBUG, "SELECT query is a PROCESSLIST");
-                try {
-                    return std::make_shared<UserQueryProcessList>(stmt, _impl->resultDbConn.get(),
-                            _impl->qMetaSelect, _impl->qMetaCzarId, userQueryId);
-                } catch(std::exception const& exc) {
-                    return std::make_shared<UserQueryInvalid>(exc.what());
-                }
+        // Look for the plan of an earlier analysis of the query. Plans are
+        // made for the CSS data version they are looked up with.
+        std::vector<std::string> literals;
+        std::string planKey;
+        qproc::QuerySession::Plan::Ptr plan;
+        if (_impl->planCache) {
+            try {
+                auto const normalized = qproc::QueryPlanCache::normalize(query, literals);
+                planKey = qproc::QueryPlanCache::makeKey(normalized, defaultDb, _impl->css->getDataVersion());
+                plan = _impl->planCache->find(planKey, literals);
+            } catch (std::exception const& exc) {
+                LOGS(_log, LOG_LVL_WARN, "Query plan cache not used: " << exc.what());
+                planKey.clear();
             }
         }
 
-        // This is a regular SELECT for qserv
-
         // Currently using the database for results to get schema information.
         auto qs = std::make_shared<qproc::QuerySession>(_impl->css,
                                                         _impl->mysqlResultConfig,
                                                         defaultDb);
-        try {
-            qs->analyzeQuery(query, stmt);
-        } catch (...) {
-            errorExtra = "Unknown failure occurred setting up QuerySession (query is invalid).";
-            LOGS(_log, LOG_LVL_ERROR, errorExtra);
-            sessionValid = false;
+        qs->setTraceId(traceId);
+        if (plan) {
+            LOGS(_log, LOG_LVL_DEBUG, "SELECT query set up from cached plan");
+            qs->analyzeQuery(query, *plan, literals);
+        } else {
+            auto const compileStart = std::chrono::steady_clock::now();
+
+            // Parse SELECT
+            std::shared_ptr<query::SelectStmt> stmt;
+            try {
+                util::TraceSpan span(traceId, "UserQueryFactory::parse");
+                auto parser = parser::SelectParser::newInstance(query);
+                parser->setup();
+                stmt = parser->getSelectStmt();
+            } catch(parser::ParseException const& e) {
+                return std::make_shared<UserQueryInvalid>(std::string("ParseException:") + e.what());
+            }
+
+            // handle special database/table names
+            auto&& tblRefList = stmt->getFromList().getTableRefList();
+            if (tblRefList.size() == 1) {
+                auto&& tblRef = tblRefList[0];
+                std::string const db = tblRef->getDb().empty() ? defaultDb : tblRef->getDb();
+                if (UserQueryType::isProcessListTable(db, tblRef->getTable())) {
+                    if (async) {
+                        // no point supporting async for these
+                        auto uq = std::make_shared<UserQueryInvalid>("SUBMIT is not allowed with query: " + aQuery);
+                        return uq;
+                    }
+                    LOGS(_log, LOG_LVL_DEBUG, "SELECT query is a PROCESSLIST");
+                    try {
+                        return std::make_shared<UserQueryProcessList>(stmt, _impl->resultDbPool->acquire(),
+                                _impl->qMetaSelect, _impl->qMetaCzarId, userQueryId);
+                    } catch(std::exception const& exc) {
+                        return std::make_shared<UserQueryInvalid>(exc.what());
+                    }
+                }
+            }
+
+            // This is a regular SELECT for qserv
+            try {
+                qs->analyzeQuery(query, stmt);
+            } catch (...) {
+                errorExtra = "Unknown failure occurred setting up QuerySession (query is invalid).";
+                LOGS(_log, LOG_LVL_ERROR, errorExtra);
+                sessionValid = false;
+            }
+            if (sessionValid && !planKey.empty() && qs->getError().empty()) {
+                auto const compileTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - compileStart);
+                _impl->planCache->insert(planKey, qs->makePlan(literals), compileTime);
+            }
         }
         if (!qs->getError().empty()) {
             LOGS(_log, LOG_LVL_ERROR, "Invalid query: " << qs->getError());
@@ -189,20 +280,27 @@ UserQueryFactory::newUserQuery(std::string const& aQuery,
             executive = qdisp::Executive::newExecutive(_impl->executiveConfig, messageStore,
                                                        largeResultMgr);
             infileMergerConfig = std::make_shared<rproc::InfileMergerConfig>(_impl->mysqlResultConfig);
+            infileMergerConfig->maxMergeShards = _impl->maxMergeShards;
+            infileMergerConfig->aggregateMaxGroups = std::max(0, _impl->aggregateMaxGroups);
+            infileMergerConfig->topKMaxRows = std::max(0, _impl->topKMaxRows);
         }
         auto uq = std::make_shared<UserQuerySelect>(qs, messageStore, executive, infileMergerConfig,
                                                     _impl->secondaryIndex, _impl->queryMetadata,
                                                     _impl->qMetaCzarId, largeResultMgr,
                                                     errorExtra, async);
         if (sessionValid) {
+            uq->setSubChunkTemplates(_impl->subChunkTemplates);
             uq->qMetaRegister(resultLocation, msgTableName);
             uq->setupChunking();
+            if (_impl->replicaDispatch) {
+                _impl->refreshReplicas(qs->getDominantDb());
+            }
         }
         return uq;
     } else if (UserQueryType::isSelectResult(query, userJobId)) {
         auto uq = std::make_shared<UserQueryAsyncResult>(userJobId, _impl->qMetaCzarId,
                                                          _impl->queryMetadata,
-                                                         _impl->resultDbConn.get());
+                                                         _impl->resultDbPool->acquire());
         LOGS(_log, LOG_LVL_DEBUG, "make UserQueryAsyncResult: userJobId=" << userJobId);
         return uq;
     } else if (UserQueryType::isDropTable(query, dbName, tableName)) {
@@ -211,30 +309,33 @@ UserQueryFactory::newUserQuery(std::string const& aQuery,
             dbName = defaultDb;
         }
         auto uq = std::make_shared<UserQueryDrop>(_impl->css, dbName, tableName,
-                                                  _impl->resultDbConn.get(),
+                                                  _impl->resultDbPool->acquire(),
                                                   _impl->queryMetadata, _impl->qMetaCzarId);
         LOGS(_log, LOG_LVL_DEBUG, "make UserQueryDrop: " << dbName << "." << tableName);
         return uq;
     } else if (UserQueryType::isDropDb(query, dbName)) {
         // processing DROP DATABASE
         auto uq = std::make_shared<UserQueryDrop>(_impl->css, dbName, std::string(),
-                                                  _impl->resultDbConn.get(),
+                                                  _impl->resultDbPool->acquire(),
                                                   _impl->queryMetadata, _impl->qMetaCzarId);
         LOGS(_log, LOG_LVL_DEBUG, "make UserQueryDrop: db=" << dbName);
         return uq;
     } else if (UserQueryType::isFlushChunksCache(query, dbName)) {
         auto uq = std::make_shared<UserQueryFlushChunksCache>(_impl->css, dbName,
-                                                              _impl->resultDbConn.get());
+                                                              _impl->resultDbPool->acquire());
         LOGS(_log, LOG_LVL_DEBUG, "make UserQueryFlushChunksCache: " << dbName);
         return uq;
     } else if (UserQueryType::isShowProcessList(query, full)) {
         LOGS(_log, LOG_LVL_DEBUG, "make UserQueryProcessList: full=" << (full ? 'y' : 'n'));
         try {
-            return std::make_shared<UserQueryProcessList>(full, _impl->resultDbConn.get(),
+            return std::make_shared<UserQueryProcessList>(full, _impl->resultDbPool->acquire(),
                     _impl->qMetaSelect, _impl->qMetaCzarId, userQueryId);
         } catch(std::exception const& exc) {
             return std::make_shared<UserQueryInvalid>(exc.what());
         }
+    } else if (UserQueryType::isShowStats(query)) {
+        LOGS(_log, LOG_LVL_DEBUG, "make UserQueryStats");
+        return std::make_shared<UserQueryStats>(_impl->resultDbPool->acquire(), userQueryId);
     } else {
         // something that we don't recognize
         auto uq = std::make_shared<UserQueryInvalid>("Invalid or unsupported query: " + query);
@@ -242,20 +343,65 @@ UserQueryFactory::newUserQuery(std::string const& aQuery,
     }
 }
 
-UserQueryFactory::Impl::Impl(czar::CzarConfig const& czarConfig)
-    : mysqlResultConfig(czarConfig.getMySqlResultConfig()) {
+UserQueryFactory::Impl::Impl(czar::CzarConfig const& czarConfig,
+                             std::shared_ptr<qmeta::QMeta> const& qMeta)
+    : mysqlResultConfig(czarConfig.getMySqlResultConfig()),
+      queryMetadata(qMeta),
+      maxMergeShards(czarConfig.getMaxMergeShards()),
+      aggregateMaxGroups(czarConfig.getAggregateMaxGroups()),
+      topKMaxRows(czarConfig.getTopKMaxRows()),
+      subChunkTemplates(czarConfig.getSubChunkTemplates()),
+      replicaDispatch(czarConfig.getReplicaDispatch()),
+      replicaRefresh(czarConfig.getReplicaRefreshSecs()),
+      cssConfigMap(czarConfig.getCssConfigMap()),
+      emptyChunkPath(czarConfig.getEmptyChunkPath()) {
 
     executiveConfig = std::make_shared<qdisp::Executive::Config>(czarConfig.getXrootdFrontendUrl());
+    executiveConfig->chunksPerRequest = czarConfig.getChunksPerRequest();
     secondaryIndex = std::make_shared<qproc::SecondaryIndex>(mysqlResultConfig);
 
-    // make one dedicated connection for results database
-    resultDbConn.reset(new sql::SqlConnection(mysqlResultConfig));
+    // connections to results database, one per UserQuery that needs it
+    resultDbPool = sql::SqlConnectionPool::create(mysqlResultConfig);
 
-    queryMetadata = std::make_shared<qmeta::QMetaMysql>(czarConfig.getMySqlQmetaConfig());
+    if (czarConfig.getPlanCacheSize() > 0) {
+        planCache = std::make_shared<qproc::QueryPlanCache>(czarConfig.getPlanCacheSize());
+    }
+
+    if (queryMetadata == nullptr) {
+        queryMetadata = std::make_shared<qmeta::QMetaMysql>(czarConfig.getMySqlQmetaConfig());
+    }
     qMetaSelect = std::make_shared<qmeta::QMetaSelect>(czarConfig.getMySqlQmetaConfig());
 
     // create CssAccess instance
     css = css::CssAccess::createFromConfig(czarConfig.getCssConfigMap(), czarConfig.getEmptyChunkPath());
 }
 
+
+void UserQueryFactory::Impl::refreshReplicas(std::string const& dbName) {
+    if (dbName.empty() || !qdisp::WorkerSelector::get().beginRefresh(dbName, replicaRefresh)) {
+        return;
+    }
+    // Reading every chunk's replicas can take a while for a large database,
+    // and jobs go through the redirector until it is done. It runs on the
+    // chunk spec threads, or holds up this query if there are none.
+    auto configMap = cssConfigMap;
+    auto chunkPath = emptyChunkPath;
+    auto loader = [dbName, configMap, chunkPath]() {
+        auto& selector = qdisp::WorkerSelector::get();
+        try {
+            auto cssAccess = css::CssAccess::createFromConfig(configMap, chunkPath);
+            selector.setReplicas(dbName, loadChunkHosts(*cssAccess, dbName));
+        } catch (std::exception const& exc) {
+            LOGS(_log, LOG_LVL_WARN, "Failed to load chunk replicas of " << dbName << ": " << exc.what());
+            selector.abortRefresh(dbName);
+        }
+    };
+    auto& executor = ChunkSpecExecutor::get();
+    if (executor.getThreads() > 0) {
+        executor.queue(loader);
+    } else {
+        loader();
+    }
+}
+
 }}} // lsst::qserv::ccontrol
@@ -49,6 +49,9 @@ namespace qserv {
 namespace czar {
 class CzarConfig;
 }
+namespace qmeta {
+class QMeta;
+}
 
 namespace ccontrol {
 
@@ -56,12 +59,22 @@ namespace ccontrol {
 ///  creation/configuration of the factory and construction of the
 ///  UserQuery. This facilitates re-use of initialized state that is usually
 ///  constant between successive user queries.
+///
+///  newUserQuery() may be called from several threads at once: the state
+///  shared between user queries is either read-only or synchronized, and
+///  database connections are leased from pools.
 class UserQueryFactory : private boost::noncopyable {
 public:
 
     UserQueryFactory(czar::CzarConfig const& czarConfig,
                      std::string const& czarName);
 
+    /// Like the above, but keeps query metadata in queryMetadata instead of
+    /// the QMeta database of czarConfig. Meant for tests.
+    UserQueryFactory(czar::CzarConfig const& czarConfig,
+                     std::string const& czarName,
+                     std::shared_ptr<qmeta::QMeta> const& queryMetadata);
+
     /// @param query:       Query text
     /// @param defaultDb:   Default database name, may be empty
     /// @param largeResultMgr: Manager instance for large results
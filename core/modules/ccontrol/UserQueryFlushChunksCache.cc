@@ -46,7 +46,7 @@ namespace ccontrol {
 // Constructor
 UserQueryFlushChunksCache::UserQueryFlushChunksCache(std::shared_ptr<css::CssAccess> const& css,
                                                      std::string const& dbName,
-                                                     sql::SqlConnection* resultDbConn)
+                                                     std::shared_ptr<sql::SqlConnection> const& resultDbConn)
     : _css(css), _dbName(dbName), _resultDbConn(resultDbConn),
       _qState(UNKNOWN), _messageStore(std::make_shared<qdisp::MessageStore>()) {
 }
@@ -58,11 +58,11 @@ public:
     /**
      *  @param css:           CSS interface
      *  @param dbName:        Name of the database where table is
-     *  @param resultDbConn:  Connection to results database
+     *  @param resultDbConn:  Connection to results database, owned by this query
      */
     UserQueryFlushChunksCache(std::shared_ptr<css::CssAccess> const& css,
                               std::string const& dbName,
-                              sql::SqlConnection* resultDbConn);
+                              std::shared_ptr<sql::SqlConnection> const& resultDbConn);
 
     UserQueryFlushChunksCache(UserQueryFlushChunksCache const&) = delete;
     UserQueryFlushChunksCache& operator=(UserQueryFlushChunksCache const&) = delete;
@@ -96,7 +96,7 @@ private:
 
     std::shared_ptr<css::CssAccess> const _css;
     std::string const _dbName;
-    sql::SqlConnection* _resultDbConn;
+    std::shared_ptr<sql::SqlConnection> _resultDbConn;
     QueryState _qState;
     std::shared_ptr<qdisp::MessageStore> _messageStore;
 
@@ -64,7 +64,7 @@ namespace ccontrol {
 
 // Constructor
 UserQueryProcessList::UserQueryProcessList(std::shared_ptr<query::SelectStmt> const& statement,
-        sql::SqlConnection* resultDbConn,
+        std::shared_ptr<sql::SqlConnection> const& resultDbConn,
         std::shared_ptr<qmeta::QMetaSelect> const& qMetaSelect,
         qmeta::CzarId qMetaCzarId,
         std::string const& userQueryId)
@@ -101,7 +101,7 @@ UserQueryProcessList::UserQueryProcessList(std::shared_ptr<query::SelectStmt> co
 }
 
 UserQueryProcessList::UserQueryProcessList(bool full,
-        sql::SqlConnection* resultDbConn,
+        std::shared_ptr<sql::SqlConnection> const& resultDbConn,
         std::shared_ptr<qmeta::QMetaSelect> const& qMetaSelect,
         qmeta::CzarId qMetaCzarId,
         std::string const& userQueryId)
@@ -190,7 +190,7 @@ void UserQueryProcessList::submit() {
     }
 
     // copy stuff over to result table
-    sql::SqlBulkInsert bulkInsert(_resultDbConn, _resultTableName, resColumns);
+    sql::SqlBulkInsert bulkInsert(_resultDbConn.get(), _resultTableName, resColumns);
     for (auto& row: *results) {
 
         std::vector<std::string> values;
@@ -61,13 +61,13 @@ public:
      *  Constructor for "SELECT ... FROM  INFORMATION_SCHEMA.PROCESSLIST ...".
      *
      *  @param statement:     Parsed SELECT statement
-     *  @param resultDbConn:  Connection to results database
+     *  @param resultDbConn:  Connection to results database, owned by this query
      *  @param qMetaSelect:   QMetaSelect instance
      *  @param qMetaCzarId:   Czar ID for QMeta queries
      *  @param userQueryId:   Unique string identifying query
      */
     UserQueryProcessList(std::shared_ptr<query::SelectStmt> const& statement,
-            sql::SqlConnection* resultDbConn,
+            std::shared_ptr<sql::SqlConnection> const& resultDbConn,
             std::shared_ptr<qmeta::QMetaSelect> const& qMetaSelect,
             qmeta::CzarId qMetaCzarId,
             std::string const& userQueryId);
@@ -76,13 +76,13 @@ public:
      *  Constructor for "SHOW [FULL] PROCESSLIST".
      *
      *  @param full:          True if FULL is in query
-     *  @param resultDbConn:  Connection to results database
+     *  @param resultDbConn:  Connection to results database, owned by this query
      *  @param qMetaSelect:   QMetaSelect instance
      *  @param qMetaCzarId:   Czar ID for QMeta queries
      *  @param userQueryId:   Unique string identifying query
      */
     UserQueryProcessList(bool full,
-            sql::SqlConnection* resultDbConn,
+            std::shared_ptr<sql::SqlConnection> const& resultDbConn,
             std::shared_ptr<qmeta::QMetaSelect> const& qMetaSelect,
             qmeta::CzarId qMetaCzarId,
             std::string const& userQueryId);
@@ -124,7 +124,7 @@ public:
 
 private:
 
-    sql::SqlConnection* _resultDbConn;
+    std::shared_ptr<sql::SqlConnection> _resultDbConn;
     std::shared_ptr<qmeta::QMetaSelect> _qMetaSelect;
     qmeta::CzarId const _qMetaCzarId;   ///< Czar ID in QMeta database
     QueryState _qState = UNKNOWN;
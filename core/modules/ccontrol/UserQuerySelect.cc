@@ -66,6 +66,9 @@
 // System headers
 #include <cassert>
 #include <chrono>
+#include <deque>
+#include <future>
+#include <iterator>
 #include <memory>
 
 // Third-party headers
@@ -75,6 +78,7 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "ccontrol/ChunkSpecExecutor.h"
 #include "ccontrol/MergingHandler.h"
 #include "ccontrol/TmpTableName.h"
 #include "ccontrol/UserQueryError.h"
@@ -83,6 +87,7 @@
 #include "proto/worker.pb.h"
 #include "proto/ProtoImporter.h"
 #include "qdisp/Executive.h"
+#include "qdisp/JobStartExecutor.h"
 #include "qdisp/LargeResultMgr.h"
 #include "qdisp/MessageStore.h"
 #include "qmeta/QMeta.h"
@@ -95,10 +100,21 @@
 #include "query/SelectStmt.h"
 #include "rproc/InfileMerger.h"
 #include "util/Callable.h"
+#include "util/Histogram.h"
 #include "util/IterableFormatter.h"
+#include "util/Tracer.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.UserQuerySelect");
+
+using lsst::qserv::util::StatsRegistry;
+auto const histSubmit = StatsRegistry::get().histogram("ccontrol.UserQuerySelect.submit");
+auto const histChunkQuerySpec = StatsRegistry::get().histogram("ccontrol.UserQuerySelect.chunkQuerySpec");
+auto const histJobCreate = StatsRegistry::get().histogram("ccontrol.UserQuerySelect.jobCreate");
+auto const histWaitJobsStart = StatsRegistry::get().histogram("ccontrol.UserQuerySelect.waitJobsStart");
+auto const histJoin = StatsRegistry::get().histogram("ccontrol.UserQuerySelect.join");
+auto const ctrQueriesSubmitted = StatsRegistry::get().counter("ccontrol.UserQuerySelect.queriesSubmitted");
+auto const ctrJobsSubmitted = StatsRegistry::get().counter("ccontrol.UserQuerySelect.jobsSubmitted");
 }
 
 namespace lsst {
@@ -154,6 +170,9 @@ UserQuerySelect::UserQuerySelect(std::shared_ptr<qproc::QuerySession> const& qs,
        _infileMergerConfig(infileMergerConfig), _secondaryIndex(secondaryIndex),
        _queryMetadata(queryMetadata), _qMetaCzarId(czarId), _largeResultMgr(largeResultMgr),
        _errorExtra(errorExtra), _async(async) {
+    if (_qSession) {
+        _traceId = _qSession->getTraceId();
+    }
 }
 
 std::string UserQuerySelect::getError() const {
@@ -186,6 +205,7 @@ UserQuerySelect::getProxyOrderBy() const {
 
 /// Begin running on all chunks added so far.
 void UserQuerySelect::submit() {
+    util::TraceSpan span(_traceId, "UserQuerySelect::submit");
     _qSession->finalize();
 
     // has to be done after result table name
@@ -196,78 +216,82 @@ void UserQuerySelect::submit() {
     LOGS(_log, LOG_LVL_DEBUG, getQueryIdString() << " UserQuerySelect beginning submission");
     assert(_infileMerger);
 
-    auto taskMsgFactory = std::make_shared<qproc::TaskMsgFactory>(_qMetaQueryId);
+    auto taskMsgFactory = std::make_shared<qproc::TaskMsgFactory>(_qMetaQueryId, _traceId);
     TmpTableName ttn(_qMetaQueryId, _qSession->getOriginal());
     std::vector<int> chunks;
     int msgCount = 0;
     int sequence = 0;
 
-    auto timeDiff = [](std::chrono::time_point<std::chrono::system_clock> const& begin, // TEMPORARY-timing
-            std::chrono::time_point<std::chrono::system_clock> const& end) -> int {
-        auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
-        return diff.count();
-    };
-
-    int endQSpecQSJSum=0, pushTimeSum=0,
-        resourceTimeSum=0, jobTimeSum=0, addTimeSum=0; // TEMPORARY-timing
-
     // Writing query for each chunk, stop if query is cancelled.
-    auto startAllQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
-
-    auto queryTemplates = _qSession->makeQueryTemplates();
-    for(auto i = _qSession->cQueryBegin(), e = _qSession->cQueryEnd();
-            i != e && !_executive->getCancelled(); ++i) {
-        auto startChunkQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
-        auto& chunkSpec = *i;
-        auto cs = _qSession->buildChunkQuerySpec(queryTemplates, chunkSpec);
-        auto endQSpecQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
+    // The chunk query specs are built on the ChunkSpecExecutor threads, up to
+    // maxPending ahead of the chunk whose job is being added, and the jobs are
+    // added in chunk order as soon as their specs are ready.
+    util::HistogramTimer submitTimer(histSubmit);
+    auto queryTemplates = std::make_shared<query::QueryTemplate::Vect>(_qSession->makeQueryTemplates());
+    auto qSession = _qSession;
+    bool const subChunkTemplates = _subChunkTemplates;
+    auto buildSpec = [qSession, queryTemplates, subChunkTemplates](qproc::ChunkSpec const& chunkSpec) {
+        auto startChunk = std::chrono::steady_clock::now();
+        // If enabled, subchunk queries are built by the workers from templates.
+        auto cs = qSession->buildChunkQuerySpec(*queryTemplates, chunkSpec, subChunkTemplates);
+        histChunkQuerySpec->recordSince(startChunk);
+        return cs;
+    };
+    using SpecPromise = std::promise<std::shared_ptr<qproc::ChunkQuerySpec>>;
+    size_t const maxPending = 4 * ChunkSpecExecutor::get().getThreads();
+    std::deque<std::future<std::shared_ptr<qproc::ChunkQuerySpec>>> pending;
+    auto i = _qSession->cQueryBegin();
+    auto const e = _qSession->cQueryEnd();
+    while (!_executive->getCancelled()) {
+        for (; i != e && pending.size() < maxPending; ++i) {
+            auto promise = std::make_shared<SpecPromise>();
+            pending.push_back(promise->get_future());
+            qproc::ChunkSpec chunkSpec = *i;
+            ChunkSpecExecutor::get().queue([promise, buildSpec, chunkSpec]() {
+                try {
+                    promise->set_value(buildSpec(chunkSpec));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+        std::shared_ptr<qproc::ChunkQuerySpec> cs;
+        if (!pending.empty()) {
+            cs = pending.front().get();
+            pending.pop_front();
+        } else if (i != e) {
+            cs = buildSpec(*i); // No ChunkSpecExecutor threads.
+            ++i;
+        } else {
+            break;
+        }
         chunks.push_back(cs->chunkId);
         std::string chunkResultName = ttn.make(cs->chunkId);
         ++msgCount;
-        auto endChunkPushQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
 
+        auto startJob = std::chrono::steady_clock::now();
         std::shared_ptr<ChunkMsgReceiver> cmr = ChunkMsgReceiver::newInstance(cs->chunkId, _messageStore);
         ResourceUnit ru;
         ru.setAsDbChunk(cs->db, cs->chunkId);
-        auto endChunkResourceQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
         qdisp::JobDescription::Ptr jobDesc = qdisp::JobDescription::create(
                 _executive->getId(), sequence, ru,
                 std::make_shared<MergingHandler>(cmr, _infileMerger, chunkResultName),
                 taskMsgFactory, cs, chunkResultName);
-        auto endChunkJobQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
+        histJobCreate->recordSince(startJob);
         _executive->add(jobDesc);
-        auto endChunkAddQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
         ++sequence;
-        { // TEMPORARY-timing
-            endQSpecQSJSum += timeDiff(startChunkQSJ, endQSpecQSJ);
-            pushTimeSum += timeDiff(endQSpecQSJ, endChunkPushQSJ);
-            resourceTimeSum += timeDiff(endChunkPushQSJ, endChunkResourceQSJ);
-            jobTimeSum += timeDiff(endChunkResourceQSJ, endChunkJobQSJ);
-            addTimeSum += timeDiff(endChunkJobQSJ, endChunkAddQSJ);
-        }
     }
 
     LOGS(_log, LOG_LVL_DEBUG, getQueryIdString() <<" total jobs in query=" << sequence);
     _largeResultMgr->incrOutGoingQueries();
-    _executive->waitForAllJobsToStart();
-    _largeResultMgr->decrOutGoingQueries();
-    auto endAllQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
-    { // TEMPORARY-timing
-        std::lock_guard<std::mutex> sumLock(_executive->sumMtx);
-        LOGS(_log, LOG_LVL_DEBUG, getQueryIdString() << "QSJ Total=" <<  timeDiff(startAllQSJ, endAllQSJ)
-                << "\nQSJ **sequenc=" << sequence
-                << "\nQSJ   endQSpecQSJSum  =" << endQSpecQSJSum
-                << "\nQSJ   pushTimeSum     =" << pushTimeSum
-                << "\nQSJ   resourceTimeSum =" << resourceTimeSum
-                << "\nQSJ   jobTimeSum      =" << jobTimeSum
-                << "\nQSJ   addTimeSum      =" << addTimeSum
-                << "\nQSJ     cancelLockQSEASum =" << _executive->cancelLockQSEASum
-                << "\nQSJ     jobQueryQSEASum   =" << _executive->jobQueryQSEASum
-                << "\nQSJ     addJobQSEASum     =" << _executive->addJobQSEASum
-                << "\nQSJ     trackQSEASum      =" << _executive->trackQSEASum
-                << "\nQSJ     endQSEASum        =" << _executive->endQSEASum );
-
+    {
+        util::HistogramTimer startTimer(histWaitJobsStart);
+        _executive->waitForAllJobsToStart();
     }
+    _largeResultMgr->decrOutGoingQueries();
+    submitTimer.stop();
+    ctrQueriesSubmitted->add();
+    ctrJobsSubmitted->add(sequence);
 
     // we only care about per-chunk info for ASYNC queries
     if (_async) {
@@ -279,12 +303,34 @@ void UserQuerySelect::submit() {
 /// Block until a submit()'ed query completes.
 /// @return the QueryState indicating success or failure
 QueryState UserQuerySelect::join() {
+    util::TraceSpan span(_traceId, "UserQuerySelect::join");
+    util::HistogramTimer joinTimer(histJoin);
     bool successful = _executive->join(); // Wait for all data
-    _infileMerger->finalize(); // Since all data are in, run final SQL commands like GROUP BY.
+    if (_infileMerger == nullptr) {
+        // submit() failed before there was anything to merge into.
+        LOGS(_log, LOG_LVL_ERROR, getQueryIdString() << " Joined a query that was not submitted");
+        _messageStore->addErrorMessage("Query submission failed");
+        _qMetaUpdateStatus(qmeta::QInfo::FAILED);
+        return ERROR;
+    }
+    // Since all data are in, run final SQL commands like GROUP BY.
+    if (!_infileMerger->finalize()) {
+        auto const& err = _infileMerger->getError();
+        LOGS(_log, LOG_LVL_ERROR, getQueryIdString() << " finalize failed " << err.getMsg());
+        if (successful) {
+            _messageStore->addErrorMessage("Failed to finalize results: " + err.getMsg());
+        }
+        successful = false;
+    }
+    size_t const resultSize = _infileMerger->getResultSize();
+    if (span.active()) {
+        span.setDetail("resultBytes=" + std::to_string(resultSize));
+    }
     _discardMerger();
     if (successful) {
         _qMetaUpdateStatus(qmeta::QInfo::COMPLETED);
-        LOGS(_log, LOG_LVL_DEBUG, getQueryIdString() << " Joined everything (success)");
+        LOGS(_log, LOG_LVL_DEBUG, getQueryIdString() << " Joined everything (success) resultBytes="
+             << resultSize);
         return SUCCESS;
     } else {
         _qMetaUpdateStatus(qmeta::QInfo::FAILED);
@@ -302,6 +348,15 @@ void UserQuerySelect::_discardMerger() {
     _infileMerger.reset();
 }
 
+void UserQuerySelect::notifyOnComplete(std::function<void()> const& onComplete) {
+    _executive->notifyOnComplete(onComplete);
+}
+
+
+bool UserQuerySelect::isInteractive() const {
+    return _qSession != nullptr && _qSession->getScanInteractive();
+}
+
 /// Release resources.
 void UserQuerySelect::discard() {
     {
@@ -331,7 +386,29 @@ void UserQuerySelect::_setupMerger() {
     LOGS(_log, LOG_LVL_TRACE, getQueryIdString() << " Setup merger");
     _infileMergerConfig->targetTable = _resultTable;
     _infileMergerConfig->mergeStmt = _qSession->getMergeStmt();
+    _infileMergerConfig->traceId = _traceId;
+    // Used to decide how many tables results are loaded into.
+    _infileMergerConfig->expectedChunks = std::distance(_qSession->cQueryBegin(), _qSession->cQueryEnd());
+    auto const& stmtParallel = _qSession->getStmtParallel();
+    if (!stmtParallel.empty() && stmtParallel.front()->hasLimit()) {
+        _infileMergerConfig->chunkRowLimit = stmtParallel.front()->getLimit();
+    }
     _infileMerger = std::make_shared<rproc::InfileMerger>(*_infileMergerConfig);
+    // Unordered LIMIT queries are complete as soon as enough rows are merged.
+    // Squash on a job start thread, as this is called while merging a
+    // response that the squash will cancel. It is queued under the merger,
+    // so it takes its own turn rather than waiting behind the job starts of
+    // the query that it cancels.
+    std::weak_ptr<qdisp::Executive> execWeak = _executive;
+    void const* squashKey = _infileMerger.get();
+    _infileMerger->setLimitReachedFunc([execWeak, squashKey]() {
+        qdisp::JobStartExecutor::get().queue(squashKey, [execWeak]() {
+            auto exec = execWeak.lock();
+            if (exec != nullptr) {
+                exec->squashSuperfluous();
+            }
+        });
+    });
 }
 
 void UserQuerySelect::setupChunking() {
@@ -452,6 +529,7 @@ void UserQuerySelect::qMetaRegister(std::string const& resultLocation, std::stri
 
     if (_executive != nullptr) {
         _executive->setQueryId(_qMetaQueryId);
+        _executive->setTraceId(_traceId);
     } else {
         LOGS(_log, LOG_LVL_WARN, "No Executive, assuming invalid query");
     }
@@ -112,6 +112,9 @@ public:
     /// @return the final execution state.
     virtual QueryState join() override;
 
+    /// Call onComplete once all the jobs of the query are complete.
+    virtual void notifyOnComplete(std::function<void()> const& onComplete) override;
+
     /// Stop a query in progress (for immediate shutdowns)
     virtual void kill() override;
 
@@ -139,8 +142,17 @@ public:
     /// @return True if query is async query
     virtual bool isAsync() const override { return _async; }
 
+    /// @return true unless the query was found to scan tables by setupChunking().
+    virtual bool isInteractive() const override;
+
+    virtual uint64_t getTraceId() const override { return _traceId; }
+
     void setupChunking();
 
+    /// Have workers build the queries of subchunked chunks from templates.
+    /// Off by default, as workers that predate the templates fail them.
+    void setSubChunkTemplates(bool subChunkTemplates) { _subChunkTemplates = subChunkTemplates; }
+
 private:
     void _setupMerger();
     void _discardMerger();
@@ -167,6 +179,8 @@ private:
     std::string _resultTable;   ///< Result table name
     std::string _resultLoc;     ///< Result location
     bool _async;                ///< true for async query
+    uint64_t _traceId{0};       ///< util::Tracer trace id, 0 if not traced
+    bool _subChunkTemplates{false}; ///< See setSubChunkTemplates()
 };
 
 }}} // namespace lsst::qserv:ccontrol
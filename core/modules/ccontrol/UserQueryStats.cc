@@ -0,0 +1,104 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <https://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "ccontrol/UserQueryStats.h"
+
+// System headers
+#include <vector>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "qdisp/MessageStore.h"
+#include "sql/SqlBulkInsert.h"
+#include "sql/SqlConnection.h"
+#include "sql/SqlErrorObject.h"
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.UserQueryStats");
+}
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+UserQueryStats::UserQueryStats(std::shared_ptr<sql::SqlConnection> const& resultDbConn, std::string const& userQueryId)
+    : _resultDbConn(resultDbConn),
+      _messageStore(std::make_shared<qdisp::MessageStore>()),
+      _resultTableName("qserv_result_stats_" + userQueryId) {
+}
+
+void UserQueryStats::_fail(std::string const& message) {
+    LOGS(_log, LOG_LVL_ERROR, message);
+    _messageStore->addMessage(-1, 1051, "Internal failure, " + message, MessageSeverity::MSG_ERROR);
+    _qState = ERROR;
+}
+
+void UserQueryStats::submit() {
+    sql::SqlErrorObject errObj;
+    std::string const createTable = "CREATE TABLE " + _resultTableName +
+        " (Name VARCHAR(255), Kind VARCHAR(16), Count BIGINT, Mean DOUBLE,"
+        " P50 BIGINT, P90 BIGINT, P99 BIGINT, Max BIGINT)";
+    LOGS(_log, LOG_LVL_DEBUG, "creating result table: " << createTable);
+    if (!_resultDbConn->runQuery(createTable, errObj)) {
+        _fail("failed to create result table: " + errObj.errMsg());
+        return;
+    }
+
+    std::vector<std::string> const resColumns{"Name", "Kind", "Count", "Mean", "P50", "P90", "P99", "Max"};
+    sql::SqlBulkInsert bulkInsert(_resultDbConn.get(), _resultTableName, resColumns);
+    auto& registry = util::StatsRegistry::get();
+    for (auto const& ctr : registry.getCounters()) {
+        std::vector<std::string> values{"'" + _resultDbConn->escapeString(ctr->getName()) + "'",
+                                        "'counter'", std::to_string(ctr->get()),
+                                        "NULL", "NULL", "NULL", "NULL", "NULL"};
+        if (!bulkInsert.addRow(values, errObj)) {
+            _fail("error updating result table: " + errObj.errMsg());
+            return;
+        }
+    }
+    for (auto const& hist : registry.getHistograms()) {
+        auto snap = hist->snapshot();
+        std::vector<std::string> values{"'" + _resultDbConn->escapeString(hist->getName()) + "'",
+                                        "'histogram'", std::to_string(snap.count),
+                                        std::to_string(snap.mean()),
+                                        std::to_string(snap.percentile(0.50)),
+                                        std::to_string(snap.percentile(0.90)),
+                                        std::to_string(snap.percentile(0.99)),
+                                        std::to_string(snap.max)};
+        if (!bulkInsert.addRow(values, errObj)) {
+            _fail("error updating result table: " + errObj.errMsg());
+            return;
+        }
+    }
+    if (!bulkInsert.flush(errObj)) {
+        _fail("error updating result table: " + errObj.errMsg());
+        return;
+    }
+    _qState = SUCCESS;
+}
+
+}}} // lsst::qserv::ccontrol
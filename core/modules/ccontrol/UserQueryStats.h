@@ -0,0 +1,102 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <https://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_CCONTROL_USERQUERYSTATS_H
+#define LSST_QSERV_CCONTROL_USERQUERYSTATS_H
+
+// System headers
+#include <memory>
+#include <string>
+
+// Qserv headers
+#include "ccontrol/UserQuery.h"
+
+// Forward decl
+namespace lsst {
+namespace qserv {
+namespace sql {
+class SqlConnection;
+}}}
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+/// UserQueryStats : implementation of the UserQuery for SHOW QSERV_STATS.
+///
+/// Copies every counter and histogram in util::StatsRegistry into a result
+/// table, one row per instrument. Histogram values are in microseconds.
+class UserQueryStats : public UserQuery {
+public:
+
+    /**
+     *  @param resultDbConn:  Connection to results database, owned by this query
+     *  @param userQueryId:   Unique string identifying query
+     */
+    UserQueryStats(std::shared_ptr<sql::SqlConnection> const& resultDbConn, std::string const& userQueryId);
+
+    UserQueryStats(UserQueryStats const&) = delete;
+    UserQueryStats& operator=(UserQueryStats const&) = delete;
+
+    // Accessors
+
+    /// @return a non-empty string describing the current error state
+    /// Returns an empty string if no errors have been detected.
+    std::string getError() const override { return std::string(); }
+
+    /// Write the current statistics to the result table.
+    void submit() override;
+
+    /// @return the final execution state.
+    QueryState join() override { return _qState; }
+
+    /// Nothing to stop.
+    void kill() override {}
+
+    /// Nothing to release.
+    void discard() override {}
+
+    // Delegate objects
+    std::shared_ptr<qdisp::MessageStore> getMessageStore() override {
+        return _messageStore; }
+
+    /// @return Name of the result table for this query, can be empty
+    std::string getResultTableName() const override { return _resultTableName; }
+
+    /// @return Result location for this query, can be empty
+    std::string getResultLocation() const override { return "table:" + _resultTableName; }
+
+    /// @return ORDER BY part of SELECT statement to be executed by proxy
+    std::string getProxyOrderBy() const override { return "ORDER BY Name"; }
+
+private:
+    void _fail(std::string const& message);
+
+    std::shared_ptr<sql::SqlConnection> _resultDbConn;
+    QueryState _qState = UNKNOWN;
+    std::shared_ptr<qdisp::MessageStore> _messageStore;
+    std::string _resultTableName;
+};
+
+}}} // namespace lsst::qserv:ccontrol
+
+#endif // LSST_QSERV_CCONTROL_USERQUERYSTATS_H
@@ -67,6 +67,11 @@ boost::regex _flushEmptyRe(R"(^flush\s+qserv_chunks_cache(\s+for\s+(["`]?)(\w+)\
 boost::regex _showProcessListRe(R"(^show\s+(full\s+)?processlist$)",
                                 boost::regex::ECMAScript | boost::regex::icase | boost::regex::optimize);
 
+// regex for SHOW QSERV_STATS
+// Note that parens around whole string are not part of the regex but raw string literal
+boost::regex _showStatsRe(R"(^show\s+qserv_stats\s*;?\s*$)",
+                          boost::regex::ECMAScript | boost::regex::icase | boost::regex::optimize);
+
 // regex for SUBMIT ...
 // group 1 is the query without SUBMIT prefix
 // Note that parens around whole string are not part of the regex but raw string literal
@@ -153,6 +158,13 @@ UserQueryType::isShowProcessList(std::string const& query, bool& full) {
     return match;
 }
 
+/// Returns true if query is SHOW QSERV_STATS
+bool
+UserQueryType::isShowStats(std::string const& query) {
+    LOGS(_log, LOG_LVL_DEBUG, "isShowStats: " << query);
+    return boost::regex_match(query, _showStatsRe);
+}
+
 /// Returns true if table name refers to PROCESSLIST table
 bool
 UserQueryType::isProcessListTable(std::string const& dbName, std::string const& tblName) {
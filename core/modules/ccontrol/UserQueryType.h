@@ -67,6 +67,9 @@ public:
      */
     static bool isShowProcessList(std::string const& query, bool& full);
 
+    /// Returns true if query is SHOW QSERV_STATS
+    static bool isShowStats(std::string const& query);
+
     /**
      *  Returns true if database/table name refers to PROCESSLIST table in
      *  INFORMATION_SCHEMA pseudo-database.
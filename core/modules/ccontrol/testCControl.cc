@@ -22,7 +22,12 @@
  */
 
 // System headers
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <unistd.h>
 
 // Boost unit test header
@@ -30,11 +35,71 @@
 #include "boost/test/included/unit_test.hpp"
 
 // Qserv headers
+#include "ccontrol/ChunkSpecExecutor.h"
+#include "ccontrol/MergeExecutor.h"
+#include "ccontrol/UserQueryExecutor.h"
 #include "ccontrol/UserQueryType.h"
+#include "tests/ReleaseGate.h"
 
 namespace test = boost::test_tools;
 using namespace lsst::qserv;
 
+namespace {
+
+/// A user query that completes when the test says so.
+class FakeUserQuery : public ccontrol::UserQuery {
+public:
+    FakeUserQuery(std::string const& name, bool interactive, std::string& submitted, std::mutex& mtx)
+        : _name(name), _interactive(interactive), _submitted(submitted), _mtx(mtx) {}
+
+    std::string getError() const override { return std::string(); }
+    void submit() override {
+        std::shared_future<void> gate;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _submitted += _name;
+            gate = _submitGate;
+        }
+        if (gate.valid()) gate.wait();
+    }
+    ccontrol::QueryState join() override { return ccontrol::SUCCESS; }
+    void notifyOnComplete(std::function<void()> const& onComplete) override {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _onComplete = onComplete;
+    }
+    void kill() override {}
+    void discard() override {}
+    std::shared_ptr<qdisp::MessageStore> getMessageStore() override { return nullptr; }
+    bool isInteractive() const override { return _interactive; }
+
+    /// Make submit() wait for gate.
+    void holdSubmit(std::shared_future<void> const& gate) { _submitGate = gate; }
+
+    /// @return true once submitted.
+    bool isSubmitted() {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _onComplete != nullptr;
+    }
+    void complete() {
+        std::function<void()> onComplete;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            onComplete.swap(_onComplete);
+        }
+        onComplete();
+    }
+
+private:
+    std::string const _name;
+    bool const _interactive;
+    std::string& _submitted;
+    std::mutex& _mtx;
+    std::function<void()> _onComplete;
+    std::shared_future<void> _submitGate;
+};
+
+} // anonymous namespace
+
 BOOST_AUTO_TEST_SUITE(Suite)
 
 BOOST_AUTO_TEST_CASE(testUserQueryType) {
@@ -200,6 +265,11 @@ BOOST_AUTO_TEST_CASE(testUserQueryType) {
         BOOST_CHECK(not UserQueryType::isShowProcessList(test, full));
     }
 
+    BOOST_CHECK(UserQueryType::isShowStats("SHOW QSERV_STATS"));
+    BOOST_CHECK(UserQueryType::isShowStats("show   qserv_stats;"));
+    BOOST_CHECK(not UserQueryType::isShowStats("SHOW STATS"));
+    BOOST_CHECK(not UserQueryType::isShowStats("SHOW QSERV_STATS FOO"));
+
     struct {
         const char* db;
         const char* table;
@@ -225,4 +295,160 @@ BOOST_AUTO_TEST_CASE(testUserQueryType) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(testChunkSpecExecutor) {
+    using lsst::qserv::ccontrol::ChunkSpecExecutor;
+    auto& executor = ChunkSpecExecutor::get();
+    BOOST_CHECK_EQUAL(executor.getThreads(), 0);
+    BOOST_CHECK_THROW(executor.queue([]() {}), std::logic_error);
+    executor.configure(2);
+    BOOST_CHECK_EQUAL(executor.getThreads(), 2);
+
+    // Specs are built concurrently.
+    tests::ReleaseGate gate;
+    std::atomic<int> started{0};
+    std::atomic<int> built{0};
+    for (int j = 0; j < 2; ++j) {
+        executor.queue([&gate, &started, &built]() { ++started; gate.wait(); ++built; });
+    }
+    while (started.load() < 2) {
+        std::this_thread::yield();
+    }
+    executor.queue([&built]() { ++built; });
+    gate.release();
+    // Turning the threads off runs everything still queued.
+    executor.configure(0);
+    BOOST_CHECK_EQUAL(executor.getThreads(), 0);
+    BOOST_CHECK_EQUAL(built.load(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(testUserQueryExecutor) {
+    using lsst::qserv::ccontrol::UserQueryExecutor;
+    auto& executor = UserQueryExecutor::get();
+    executor.configure(2, 1, 0);
+
+    std::mutex mtx;
+    std::string submitted;
+    std::atomic<int> finished{0};
+    auto finish = [&finished](ccontrol::QueryState state) {
+        BOOST_CHECK_EQUAL(state, ccontrol::SUCCESS);
+        ++finished;
+    };
+    auto waitFor = [](std::function<bool()> const& cond) {
+        while (!cond()) {
+            std::this_thread::yield();
+        }
+    };
+    auto scanA = std::make_shared<FakeUserQuery>("A", false, submitted, mtx);
+    auto scanB = std::make_shared<FakeUserQuery>("B", false, submitted, mtx);
+    auto interactiveC = std::make_shared<FakeUserQuery>("C", true, submitted, mtx);
+    auto scanD = std::make_shared<FakeUserQuery>("D", false, submitted, mtx);
+
+    executor.queue(scanA, finish);
+    waitFor([&scanA]() { return scanA->isSubmitted(); });
+    // A running query does not hold a thread, the others wait for admission.
+    executor.queue(scanB, finish);
+    executor.queue(interactiveC, finish);
+    BOOST_CHECK_EQUAL(executor.getRunning(), 1);
+    BOOST_CHECK_EQUAL(executor.getQueued(), 2);
+
+    // The interactive query is admitted first.
+    scanA->complete();
+    waitFor([&interactiveC]() { return interactiveC->isSubmitted(); });
+    BOOST_CHECK_EQUAL(finished.load(), 1);
+    interactiveC->complete();
+    waitFor([&scanB]() { return scanB->isSubmitted(); });
+
+    // A query can be admitted ahead of its turn.
+    executor.queue(scanD, finish);
+    BOOST_CHECK(executor.expedite(scanD));
+    BOOST_CHECK(not executor.expedite(scanD));
+    waitFor([&scanD]() { return scanD->isSubmitted(); });
+    BOOST_CHECK_EQUAL(executor.getRunning(), 2);
+    scanB->complete();
+    scanD->complete();
+    waitFor([&finished]() { return finished.load() == 4; });
+    waitFor([&executor]() { return executor.getRunning() == 0; });
+    BOOST_CHECK_EQUAL(executor.getQueued(), 0);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        BOOST_CHECK_EQUAL(submitted, "ACBD");
+    }
+
+    // Scans leave the interactive slots, and a query that is slow to submit
+    // does not hold up finishing the others.
+    executor.configure(1, 3, 1);
+    auto scanE = std::make_shared<FakeUserQuery>("E", false, submitted, mtx);
+    auto scanF = std::make_shared<FakeUserQuery>("F", false, submitted, mtx);
+    auto scanG = std::make_shared<FakeUserQuery>("G", false, submitted, mtx);
+    auto interactiveH = std::make_shared<FakeUserQuery>("H", true, submitted, mtx);
+    tests::ReleaseGate gate;
+    scanF->holdSubmit(gate.released());
+    executor.queue(scanE, finish);
+    waitFor([&scanE]() { return scanE->isSubmitted(); });
+    executor.queue(scanF, finish);
+    executor.queue(scanG, finish);
+    BOOST_CHECK_EQUAL(executor.getRunning(), 2);
+    BOOST_CHECK_EQUAL(executor.getQueued(), 1);
+    scanE->complete();
+    waitFor([&finished]() { return finished.load() == 5; });
+    gate.release();
+    waitFor([&scanF]() { return scanF->isSubmitted(); });
+    waitFor([&scanG]() { return scanG->isSubmitted(); });
+    executor.queue(interactiveH, finish);
+    waitFor([&interactiveH]() { return interactiveH->isSubmitted(); });
+    BOOST_CHECK_EQUAL(executor.getRunning(), 3);
+    for (auto const& uq : {scanF, scanG, interactiveH}) {
+        uq->complete();
+    }
+    waitFor([&finished]() { return finished.load() == 8; });
+    waitFor([&executor]() { return executor.getRunning() == 0; });
+}
+
+BOOST_AUTO_TEST_CASE(testMergeExecutor) {
+    using lsst::qserv::ccontrol::MergeExecutor;
+    auto& executor = MergeExecutor::get();
+    BOOST_CHECK(not executor.isEnabled());
+    executor.configure(2, 2);
+    BOOST_CHECK(executor.isEnabled());
+
+    int queryA = 0;
+    int queryB = 0;
+    tests::ReleaseGate gate;
+    std::atomic<int> merged{0};
+    auto merge = [&gate, &merged]() { gate.wait(); ++merged; };
+    executor.queue(&queryA, merge);
+    BOOST_CHECK(not executor.isBacklogged(&queryA));
+    executor.queue(&queryA, merge);
+    executor.queue(&queryB, merge);
+    // Backlogs are counted per query.
+    BOOST_CHECK_EQUAL(executor.getQueued(&queryA), 2);
+    BOOST_CHECK(executor.isBacklogged(&queryA));
+    BOOST_CHECK(not executor.isBacklogged(&queryB));
+
+    // Reads of a backlogged query are resumed as its merges finish. A read
+    // with nothing left to read passes its turn to the next one.
+    std::atomic<int> gone{0};
+    std::atomic<int> resumed{0};
+    BOOST_CHECK(executor.deferWhileBacklogged(&queryA, [&gone]() { ++gone; return false; }));
+    BOOST_CHECK(executor.deferWhileBacklogged(&queryA, [&resumed]() { ++resumed; return true; }));
+    BOOST_CHECK(not executor.deferWhileBacklogged(&queryB, [&resumed]() { ++resumed; return true; }));
+    BOOST_CHECK_EQUAL(resumed.load(), 0);
+
+    gate.release();
+    // Turning the threads off runs everything still queued.
+    executor.configure(0, 2);
+    BOOST_CHECK(not executor.isEnabled());
+    BOOST_CHECK_EQUAL(merged.load(), 3);
+    BOOST_CHECK_EQUAL(executor.getQueued(&queryA), 0);
+    BOOST_CHECK_EQUAL(gone.load(), 1);
+    BOOST_CHECK_EQUAL(resumed.load(), 1);
+
+    // A merge that fails still counts as done.
+    executor.configure(1, 1);
+    executor.queue(&queryB, []() { throw std::runtime_error("merge failed"); });
+    executor.configure(0, 1);
+    BOOST_CHECK_EQUAL(executor.getQueued(&queryB), 0);
+    BOOST_CHECK(not executor.isBacklogged(&queryB));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,236 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Boost unit test header
+#define BOOST_TEST_MODULE UserQueryFactory_1
+#include "boost/test/included/unit_test.hpp"
+
+// Qserv headers
+#include "ccontrol/UserQuery.h"
+#include "ccontrol/UserQueryFactory.h"
+#include "czar/CzarConfig.h"
+#include "qdisp/Executive.h"
+#include "qdisp/LargeResultMgr.h"
+#include "qmeta/QMeta.h"
+#include "util/ConfigStore.h"
+
+namespace test = boost::test_tools;
+using namespace lsst::qserv;
+
+namespace {
+
+/// Keeps registered queries in memory, the way QMetaMysql would in its tables.
+class FakeQMeta : public qmeta::QMeta {
+public:
+    typedef std::map<QueryId, qmeta::QInfo> QueryMap;
+
+    FakeQMeta() = default;
+
+    qmeta::CzarId getCzarID(std::string const&) override { return 1; }
+    qmeta::CzarId registerCzar(std::string const&) override { return 1; }
+    void setCzarActive(qmeta::CzarId, bool) override {}
+    QueryId registerQuery(qmeta::QInfo const& qInfo, TableNames const&) override {
+        std::lock_guard<std::mutex> lock(_mtx);
+        QueryId const queryId = ++_lastQueryId;
+        _queries.insert(std::make_pair(queryId, qInfo));
+        return queryId;
+    }
+    void addChunks(QueryId, std::vector<int> const&) override {}
+    void assignChunk(QueryId, int, std::string const&) override {}
+    void finishChunk(QueryId, int) override {}
+    void completeQuery(QueryId, qmeta::QInfo::QStatus) override {}
+    void finishQuery(QueryId) override {}
+    std::vector<QueryId> findQueries(qmeta::CzarId, qmeta::QInfo::QType, std::string const&,
+                                     std::vector<qmeta::QInfo::QStatus> const&, int, int) override {
+        return std::vector<QueryId>();
+    }
+    std::vector<QueryId> getPendingQueries(qmeta::CzarId) override { return std::vector<QueryId>(); }
+    qmeta::QInfo getQueryInfo(QueryId queryId) override {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _queries.at(queryId);
+    }
+    std::vector<QueryId> getQueriesForDb(std::string const&) override { return std::vector<QueryId>(); }
+    std::vector<QueryId> getQueriesForTable(std::string const&, std::string const&) override {
+        return std::vector<QueryId>();
+    }
+
+    QueryMap getQueries() const {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _queries;
+    }
+
+private:
+    mutable std::mutex _mtx;
+    QueryId _lastQueryId{0};
+    QueryMap _queries;
+};
+
+// One partitioned and one unpartitioned table, in the format of KvInterfaceImplMem.
+std::string const cssData =
+    "/\t\\N\n"
+    "/css_meta\t\\N\n"
+    "/css_meta/version\t1\n"
+    "/DBS\t\\N\n"
+    "/DBS/LSST\tREADY\n"
+    "/DBS/LSST/partitioningId\t0000000000\n"
+    "/DBS/LSST/TABLES\t\\N\n"
+    "/DBS/LSST/TABLES/Filter\tREADY\n"
+    "/DBS/LSST/TABLES/Object\tREADY\n"
+    "/DBS/LSST/TABLES/Object/partitioning\t\\N\n"
+    "/DBS/LSST/TABLES/Object/partitioning/dirColName\tobjectId\n"
+    "/DBS/LSST/TABLES/Object/partitioning/dirTable\tObject\n"
+    "/DBS/LSST/TABLES/Object/partitioning/latColName\tdecl\n"
+    "/DBS/LSST/TABLES/Object/partitioning/lonColName\tra\n"
+    "/DBS/LSST/TABLES/Object/partitioning/subChunks\t1\n"
+    "/PARTITIONING\t\\N\n"
+    "/PARTITIONING/_0000000000\t\\N\n"
+    "/PARTITIONING/_0000000000/nStripes\t60\n"
+    "/PARTITIONING/_0000000000/nSubStripes\t18\n"
+    "/PARTITIONING/_0000000000/overlap\t0.025\n";
+
+struct Fixture {
+    Fixture() {
+        // No chunk of LSST is empty.
+        char dirTemplate[] = "/tmp/testUserQueryFactory.XXXXXX";
+        BOOST_REQUIRE(mkdtemp(dirTemplate) != nullptr);
+        emptyChunkDir = dirTemplate;
+        std::ofstream(emptyChunkDir + "/empty_LSST.txt");
+
+        // Nothing connects to the databases unless a query needs its schema
+        // or results, and the mock XrdSsi service is used for dispatch.
+        util::ConfigStore configStore(std::map<std::string, std::string>{
+            {"resultdb.passwd", ""},
+            {"resultdb.host", "localhost"},
+            {"resultdb.port", "0"},
+            {"resultdb.unix_socket", "/nonexistent/mysql.sock"},
+            {"css.technology", "mem"},
+            {"css.data", cssData},
+            {"partitioner.emptyChunkPath", emptyChunkDir},
+            {"frontend.xrootd", qdisp::Executive::Config::getMockStr()}
+        });
+        czarConfig = std::make_shared<czar::CzarConfig>(configStore);
+        factory = std::make_shared<ccontrol::UserQueryFactory>(*czarConfig, "czar", qMeta);
+    }
+
+    ~Fixture() {
+        std::remove((emptyChunkDir + "/empty_LSST.txt").c_str());
+        rmdir(emptyChunkDir.c_str());
+    }
+
+    /// Make a user query and return its template as registered in QMeta,
+    /// or the error. Called from several threads, so it does not use the
+    /// Boost.Test checks.
+    std::string newUserQuery(std::string const& query, std::string const& id) {
+        auto uq = factory->newUserQuery(query, "LSST", largeResultMgr, id, "message_" + id);
+        if (!uq->getError().empty()) return "error: " + uq->getError();
+        if (uq->getQueryId() == 0) throw std::runtime_error("query not registered: " + query);
+        return qMeta->getQueryInfo(uq->getQueryId()).queryTemplate();
+    }
+
+    std::string emptyChunkDir;
+    std::shared_ptr<FakeQMeta> qMeta = std::make_shared<FakeQMeta>();
+    std::shared_ptr<czar::CzarConfig> czarConfig;
+    std::shared_ptr<ccontrol::UserQueryFactory> factory;
+    std::shared_ptr<qdisp::LargeResultMgr> largeResultMgr = std::make_shared<qdisp::LargeResultMgr>();
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(Suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(ConcurrentNewUserQuery) {
+    // Clients submit queries concurrently, and the czar builds their
+    // UserQueries without holding its mutex. Each one must be set up and
+    // registered as if it was the only one.
+    std::vector<std::string> const queries = {
+        "SELECT objectId FROM Object WHERE qserv_areaspec_box(0,0,1,1)",
+        "SELECT COUNT(*) FROM LSST.Object",
+        "SELECT objectId, ra FROM Object WHERE qserv_areaspec_box(10,-5,11,-4) ORDER BY ra",
+        "SELECT * FROM Filter",
+        "SELECT objectId FROM Object WHERE" // not parsed, not registered
+    };
+    std::vector<std::string> expected;
+    for (auto const& query : queries) {
+        expected.push_back(newUserQuery(query, "serial"));
+    }
+    for (size_t j = 0; j + 1 < queries.size(); ++j) {
+        BOOST_CHECK(expected[j].compare(0, 6, "error:") != 0);
+    }
+    BOOST_CHECK(expected.back().compare(0, 6, "error:") == 0);
+    size_t const serialCount = qMeta->getQueries().size();
+    BOOST_CHECK_EQUAL(serialCount, queries.size() - 1);
+
+    int const threadCount = 8;
+    int const rounds = 10;
+    std::atomic<int> mismatches{0};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int r = 0; r < rounds; ++r) {
+                // Threads go through the queries in different orders.
+                size_t j = (t + r) % queries.size();
+                std::string const id = std::to_string(t) + "_" + std::to_string(r);
+                try {
+                    if (newUserQuery(queries[j], id) != expected[j]) ++mismatches;
+                } catch (...) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    BOOST_CHECK_EQUAL(failures.load(), 0);
+    BOOST_CHECK_EQUAL(mismatches.load(), 0);
+
+    // Every valid query was registered once, with an ID of its own.
+    size_t validCount = 0;
+    for (int t = 0; t < threadCount; ++t) {
+        for (int r = 0; r < rounds; ++r) {
+            if ((t + r) % queries.size() + 1 != queries.size()) ++validCount;
+        }
+    }
+    auto const registered = qMeta->getQueries();
+    BOOST_CHECK_EQUAL(registered.size(), serialCount + validCount);
+    std::set<std::string> msgTables;
+    for (auto const& entry : registered) {
+        msgTables.insert(entry.second.msgTableName());
+    }
+    BOOST_CHECK_EQUAL(msgTables.size(), validCount + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
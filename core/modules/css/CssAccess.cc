@@ -25,11 +25,13 @@
 
 // System headers
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <map>
 #include <sstream>
 
 // Third-party headers
+#include "boost/algorithm/string.hpp"
 #include "boost/lexical_cast.hpp"
 #include "boost/property_tree/ptree.hpp"
 #include "boost/property_tree/json_parser.hpp"
@@ -55,6 +57,22 @@ LOG_LOGGER _log = LOG_GET("lsst.qserv.css.CssAccess");
 // Name of sub-key used for packed data
 std::string const _packedKeyName(".packed.json");
 
+// Returns the path of the chunk replicas, /DBS/<db>/TABLES/<table>/CHUNKS,
+// below key as KvInterface::getSubtree() takes it, or an empty string if
+// there are none below key.
+std::string chunksPathBelow(std::string const& key, std::string const& prefix) {
+    std::vector<std::string> const chunksPath{"DBS", "*", "TABLES", "*", "CHUNKS"};
+    if (key == prefix) return boost::join(chunksPath, "/");
+    if (not boost::starts_with(key, prefix + "/")) return std::string();
+    std::vector<std::string> parts;
+    boost::split(parts, key.substr(prefix.size() + 1), boost::is_any_of("/"));
+    if (parts.size() >= chunksPath.size()) return std::string();
+    for (size_t i = 0; i != parts.size(); ++i) {
+        if (chunksPath[i] != "*" and chunksPath[i] != parts[i]) return std::string();
+    }
+    return boost::join(std::vector<std::string>(chunksPath.begin() + parts.size(), chunksPath.end()), "/");
+}
+
 }
 
 namespace lsst {
@@ -88,13 +106,14 @@ CssAccess::createFromConfig(std::map<std::string, std::string> const& config,
                             bool readOnly) {
     css::CssConfig cssConfig(config);
     LOGS(_log, LOG_LVL_DEBUG, "Create CSS instance from config map");
+    std::shared_ptr<CssAccess> css;
     if (cssConfig.getTechnology() == "mem") {
         // optional data or file keys
         std::string iterData = cssConfig.getData();
         std::string iterFile = cssConfig.getFile();
         if (not cssConfig.getData().empty()) {
             // data is in a string
-            return createFromData(cssConfig.getData(), emptyChunkPath, readOnly);
+            css = createFromData(cssConfig.getData(), emptyChunkPath, readOnly);
         } else if (not cssConfig.getFile().empty()) {
             // read data from file
             std::ifstream f(cssConfig.getFile());
@@ -105,23 +124,25 @@ CssAccess::createFromConfig(std::map<std::string, std::string> const& config,
             LOGS(_log, LOG_LVL_DEBUG,
                  "Create CSS instance with memory store from data file " << cssConfig.getFile());
             auto kvi = std::make_shared<KvInterfaceImplMem>(f, readOnly);
-            return std::shared_ptr<CssAccess>(new CssAccess(kvi,
-                                                            std::make_shared<EmptyChunks>(emptyChunkPath)));
+            css = std::shared_ptr<CssAccess>(new CssAccess(kvi,
+                                                           std::make_shared<EmptyChunks>(emptyChunkPath)));
         } else {
             // no initial data
             LOGS(_log, LOG_LVL_DEBUG, "Create CSS instance with empty memory store");
             auto kvi = std::make_shared<KvInterfaceImplMem>(readOnly);
-            return std::shared_ptr<CssAccess>(new CssAccess(kvi,
-                                                            std::make_shared<EmptyChunks>(emptyChunkPath)));
+            css = std::shared_ptr<CssAccess>(new CssAccess(kvi,
+                                                           std::make_shared<EmptyChunks>(emptyChunkPath)));
         }
     } else if (cssConfig.getTechnology() == "mysql") {
         LOGS(_log, LOG_LVL_DEBUG, "Create CSS instance with mysql store " << cssConfig.getMySqlConfig());
         auto kvi = std::make_shared<KvInterfaceImplMySql>(cssConfig.getMySqlConfig(), readOnly);
-        return std::shared_ptr<CssAccess>(new CssAccess(kvi, std::make_shared<EmptyChunks>(emptyChunkPath)));
+        css = std::shared_ptr<CssAccess>(new CssAccess(kvi, std::make_shared<EmptyChunks>(emptyChunkPath)));
     } else {
         LOGS(_log, LOG_LVL_DEBUG, "Unexpected value of \"technology\" key: " << cssConfig.getTechnology());
         throw ConfigError("Unexpected value of \"technology\" key: " + cssConfig.getTechnology());
     }
+    css->setSnapshotCheckInterval(std::chrono::milliseconds(cssConfig.getSnapshotCheckIntervalMs()));
+    return css;
 }
 
 // Construct from KvInterface instance and empty chunk list instance
@@ -162,12 +183,104 @@ CssAccess::_checkVersion(bool mustExist) const {
     }
 }
 
+std::string
+CssAccess::getDataVersion() const {
+    _checkVersion();
+    auto snapshot = _getSnapshot();
+    if (snapshot != nullptr) return snapshot->dataVersion;
+    return _kvI->get(_prefix + DATA_VERSION_KEY, "");
+}
+
+void
+CssAccess::_bumpDataVersion() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto version = std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+    LOGS(_log, LOG_LVL_DEBUG, "_bumpDataVersion: " << version);
+    _kvI->set(_prefix + DATA_VERSION_KEY, version);
+
+    // do not wait for the next check to see our own change
+    std::lock_guard<std::mutex> lock(_snapshotMtx);
+    _snapshot.reset();
+    _snapshotChecked = std::chrono::steady_clock::time_point();
+    ++_snapshotGeneration;
+}
+
+void
+CssAccess::setSnapshotCheckInterval(std::chrono::milliseconds checkInterval) {
+    LOGS(_log, LOG_LVL_DEBUG, "setSnapshotCheckInterval(" << checkInterval.count() << " ms)");
+    std::lock_guard<std::mutex> lock(_snapshotMtx);
+    _snapshotCheckInterval = checkInterval;
+    if (checkInterval.count() <= 0) _snapshot.reset();
+    _snapshotChecked = std::chrono::steady_clock::time_point();
+    ++_snapshotGeneration;
+}
+
+std::shared_ptr<KvInterface>
+CssAccess::_metadataKvI() const {
+    auto snapshot = _getSnapshot();
+    return snapshot != nullptr ? snapshot->kvI : _kvI;
+}
+
+std::shared_ptr<CssAccess::Snapshot const>
+CssAccess::_getSnapshot() const {
+    std::shared_ptr<Snapshot const> current;
+    unsigned generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(_snapshotMtx);
+        if (_snapshotCheckInterval.count() <= 0) return nullptr;
+        auto const now = std::chrono::steady_clock::now();
+        // While another thread checks or loads, the current snapshot is used
+        // as between checks, and the storage if there is none.
+        if (_snapshotLoading or now - _snapshotChecked < _snapshotCheckInterval) return _snapshot;
+        _snapshotLoading = true;
+        current = _snapshot;
+        generation = _snapshotGeneration;
+    }
+
+    // Storage is read without holding the mutex, so other threads carry on.
+    auto snapshot = current;
+    try {
+        if (current == nullptr or _kvI->get(_prefix + DATA_VERSION_KEY, "") != current->dataVersion) {
+            snapshot = _loadSnapshot();
+        }
+    } catch (std::exception const& exc) {
+        // storage is read directly until the next attempt
+        LOGS(_log, LOG_LVL_WARN, "Failed to load CSS snapshot: " << exc.what());
+        snapshot.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(_snapshotMtx);
+    _snapshotLoading = false;
+    if (generation != _snapshotGeneration) {
+        // changed or disabled meanwhile, what was read may be out of date
+        return nullptr;
+    }
+    _snapshot = snapshot;
+    _snapshotChecked = std::chrono::steady_clock::now();
+    return _snapshot;
+}
+
+std::shared_ptr<CssAccess::Snapshot const>
+CssAccess::_loadSnapshot() const {
+    // Everything is read with one request, so the data version in it
+    // matches the rest of it. Chunk replicas are the bulk of CSS and are not
+    // needed, they are left out by the storage.
+    auto kvMap = _kvI->getSubtree(_prefix.empty() ? "/" : _prefix, ::chunksPathBelow(_prefix, _prefix));
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->kvI = std::make_shared<KvInterfaceImplMem>(kvMap, true);
+    snapshot->dataVersion = snapshot->kvI->get(_prefix + DATA_VERSION_KEY, "");
+    LOGS(_log, LOG_LVL_INFO, "Loaded CSS snapshot of " << kvMap.size()
+         << " keys, data version \"" << snapshot->dataVersion << "\"");
+    return snapshot;
+}
+
 std::vector<std::string>
 CssAccess::getDbNames() const {
     _checkVersion();
 
     std::string p = _prefix + "/DBS";
-    auto names = _kvI->getChildren(p);
+    auto names = _metadataKvI()->getChildren(p);
 
     // databases cannot be packed, but just in case remove packed key if any
     auto it = std::remove(names.begin(), names.end(), ::_packedKeyName);
@@ -181,7 +294,7 @@ CssAccess::getDbStatus() const {
     _checkVersion();
 
     std::string p = _prefix + "/DBS";
-    auto kvs = _kvI->getChildrenValues(p);
+    auto kvs = _metadataKvI()->getChildrenValues(p);
 
     // databases cannot be packed, but just in case remove packed key if any
     kvs.erase(::_packedKeyName);
@@ -194,9 +307,11 @@ CssAccess::setDbStatus(std::string const& dbName, std::string const& status) {
     LOGS(_log, LOG_LVL_DEBUG, "setDbStatus(" << dbName << ", " << status << ")");
     _checkVersion();
 
-    _assertDbExists(dbName);
+    // check the storage, snapshot may be out of date
     std::string const dbKey = _prefix + "/DBS/" + dbName;
+    if (not _kvI->exists(dbKey)) throw NoSuchDb(dbName);
     _kvI->set(dbKey, status);
+    _bumpDataVersion();
 }
 
 bool
@@ -207,7 +322,7 @@ CssAccess::containsDb(std::string const& dbName) const {
         return false;
     }
     std::string p = _prefix + "/DBS/" + dbName;
-    bool ret = _kvI->exists(p);
+    bool ret = _metadataKvI()->exists(p);
     LOGS(_log, LOG_LVL_DEBUG, "containsDb(" << dbName << "): " << ret);
     return ret;
 }
@@ -218,18 +333,20 @@ CssAccess::getDbStriping(std::string const& dbName) const {
     _checkVersion();
 
     StripingParams striping;
-    auto dbMap = _getSubkeys(_prefix + "/DBS/" + dbName, {"partitioningId"});
+    auto const kvI = _metadataKvI();
+    bool dbExists = false;
+    auto dbMap = _getSubkeys(*kvI, _prefix + "/DBS/" + dbName, {"partitioningId"}, &dbExists);
     auto const& partId = dbMap["partitioningId"];
     if (partId.empty()) {
         // if database is not defined throw an exception, otherwise return default values
-        _assertDbExists(dbName);
+        if (not dbExists) throw NoSuchDb(dbName);
         return striping;
     }
 
     // get all keys
     std::string pKey = _prefix + "/PARTITIONING/_" + partId;
     std::vector<std::string> subKeys{"nStripes", "nSubStripes", "overlap"};
-    auto const keyMap = _getSubkeys(pKey, subKeys);
+    auto const keyMap = _getSubkeys(*kvI, pKey, subKeys);
 
     // fill the structure
     try {
@@ -291,6 +408,7 @@ CssAccess::createDb(std::string const& dbName,
     std::string const dbKey = _prefix + "/DBS/" + dbName;
     _storePacked(dbKey, dbMap);
     _kvI->set(dbKey, KEY_STATUS_READY);
+    _bumpDataVersion();
 }
 
 void
@@ -300,16 +418,18 @@ CssAccess::createDbLike(std::string const& dbName,
     _checkVersion();
 
     std::vector<std::string> subKeys{"partitioningId", "releaseStatus", "storageClass"};
-    auto dbMap = _getSubkeys(_prefix + "/DBS/" + templateDbName, subKeys);
+    std::string const templateKey = _prefix + "/DBS/" + templateDbName;
+    auto dbMap = _getSubkeys(*_kvI, templateKey, subKeys);
     if (dbMap.empty()) {
         // nothing is found, check whether db exists
-        _assertDbExists(templateDbName);
+        if (not _kvI->exists(templateKey)) throw NoSuchDb(templateDbName);
     }
 
     // make new database with the copy of all parameters
     std::string const dbKey = _prefix + "/DBS/" + dbName;
     _storePacked(dbKey, dbMap);
     _kvI->set(dbKey, KEY_STATUS_READY);
+    _bumpDataVersion();
 }
 
 void
@@ -327,6 +447,7 @@ CssAccess::dropDb(std::string const& dbName) {
         LOGS(_log, LOG_LVL_DEBUG, "dropDb: key is not found: " << key);
         throw NoSuchDb(dbName);
     }
+    _bumpDataVersion();
 }
 
 std::vector<std::string>
@@ -334,27 +455,12 @@ CssAccess::getTableNames(std::string const& dbName, bool readyOnly) const {
     LOGS(_log, LOG_LVL_DEBUG, "getTableNames(" << dbName << ")");
     _checkVersion();
 
-    std::string key = _prefix + "/DBS/" + dbName + "/TABLES";
+    // names and statuses come together, status is used to filter names
+    auto const tableStatuses = getTableStatus(dbName);
     std::vector<std::string> names;
-    try {
-        names = _kvI->getChildren(key);
-    } catch (NoSuchKey const& exc) {
-        LOGS(_log, LOG_LVL_DEBUG, "getTableNames: key is not found: " << key);
-        _assertDbExists(dbName);
-    }
-
-    // tables cannot be packed, but just in case remove packed key if any
-    auto it = std::remove(names.begin(), names.end(), ::_packedKeyName);
-    names.erase(it, names.end());
-
-    if (readyOnly and not names.empty()) {
-        // filter out names with status other than READY
-        auto const tableStatuses = _getSubkeys(key, names);
-        names.clear();
-        for (auto& kv: tableStatuses) {
-            if (kv.second == "READY") {
-                names.push_back(kv.first);
-            }
+    for (auto& kv: tableStatuses) {
+        if (not readyOnly or kv.second == "READY") {
+            names.push_back(kv.first);
         }
     }
     return names;
@@ -368,7 +474,7 @@ CssAccess::getTableStatus(std::string const& dbName) const {
     std::string key = _prefix + "/DBS/" + dbName + "/TABLES";
     std::map<std::string, std::string> kvs;
     try {
-        kvs = _kvI->getChildrenValues(key);
+        kvs = _metadataKvI()->getChildrenValues(key);
     } catch (NoSuchKey const& exc) {
         LOGS(_log, LOG_LVL_DEBUG, "getTableNames: key is not found: " << key);
         _assertDbExists(dbName);
@@ -392,6 +498,7 @@ CssAccess::setTableStatus(std::string const& dbName,
     std::string const tableKey = _prefix + "/DBS/" + dbName + "/TABLES/" + tableName;
     if (not _kvI->exists(tableKey)) throw NoSuchTable(dbName, tableName);
     _kvI->set(tableKey, status);
+    _bumpDataVersion();
 }
 
 bool
@@ -401,7 +508,7 @@ CssAccess::containsTable(std::string const& dbName, std::string const& tableName
 
     std::string const key = _prefix + "/DBS/" + dbName + "/TABLES/" + tableName;
     // If key is not there pretend that its value is not "READY"
-    std::string const val = _kvI->get(key, "DOES_NOT_EXIST");
+    std::string const val = _metadataKvI()->get(key, "DOES_NOT_EXIST");
     if (val == "DOES_NOT_EXIST") {
         // table key is not there at all, throw if database name is not good
         _assertDbExists(dbName);
@@ -421,11 +528,13 @@ CssAccess::getTableSchema(std::string const& dbName, std::string const& tableNam
     _checkVersion();
 
     std::string const tableKey = _prefix + "/DBS/" + dbName + "/TABLES/" + tableName;
-    auto kvMap = _getSubkeys(tableKey, {"schema"});
+    auto const kvI = _metadataKvI();
+    bool tableExists = false;
+    auto kvMap = _getSubkeys(*kvI, tableKey, {"schema"}, &tableExists);
     auto const schema = kvMap["schema"];
     if (schema.empty()) {
         // check table key
-        if (not _kvI->exists(tableKey)) throw NoSuchTable(dbName, tableName);
+        if (not tableExists) throw NoSuchTable(dbName, tableName);
     }
     return schema;
 }
@@ -442,10 +551,12 @@ CssAccess::getMatchTableParams(std::string const& dbName,
 
     std::vector<std::string> subKeys{"match/dirTable1", "match/dirColName1", "match/dirTable2",
             "match/dirColName2", "match/flagColName"};
-    auto paramMap = _getSubkeys(tableKey, subKeys);
+    auto const kvI = _metadataKvI();
+    bool tableExists = false;
+    auto paramMap = _getSubkeys(*kvI, tableKey, subKeys, &tableExists);
     if (paramMap.empty()) {
         // check table key
-        if (not _kvI->exists(tableKey)) throw NoSuchTable(dbName, tableName);
+        if (not tableExists) throw NoSuchTable(dbName, tableName);
         return params;
     }
 
@@ -466,10 +577,12 @@ CssAccess::getPartTableParams(std::string const& dbName,
     std::vector<std::string> subKeys{"partitioning", "partitioning/subChunks",
         "partitioning/dirDb", "partitioning/dirTable", "partitioning/dirColName", "partitioning/latColName",
         "partitioning/lonColName", "partitioning/overlap", "partitioning/secIndexColName"};
-    auto paramMap = _getSubkeys(tableKey, subKeys);
+    auto const kvI = _metadataKvI();
+    bool tableExists = false;
+    auto paramMap = _getSubkeys(*kvI, tableKey, subKeys, &tableExists);
     if (paramMap.empty()) {
         // check table key
-        if (not _kvI->exists(tableKey)) throw NoSuchTable(dbName, tableName);
+        if (not tableExists) throw NoSuchTable(dbName, tableName);
         return params;
     }
 
@@ -488,10 +601,12 @@ CssAccess::getScanTableParams(std::string const& dbName,
     ScanTableParams params;
 
     std::vector<std::string> subKeys{"sharedScan/lockInMem", "sharedScan/scanRating"};
-    auto paramMap = _getSubkeys(tableKey, subKeys);
+    auto const kvI = _metadataKvI();
+    bool tableExists = false;
+    auto paramMap = _getSubkeys(*kvI, tableKey, subKeys, &tableExists);
     if (paramMap.empty()) {
         // check table key
-        if (not _kvI->exists(tableKey)) throw NoSuchTable(dbName, tableName);
+        if (not tableExists) throw NoSuchTable(dbName, tableName);
         return params;
     }
 
@@ -514,10 +629,12 @@ CssAccess::getTableParams(std::string const& dbName, std::string const& tableNam
         "sharedScann/lockInMem", "sharedScan/scanRating",
         "match/dirTable1", "match/dirColName1", "match/dirTable2", "match/dirColName2",
         "match/flagColName", "partitioning"};
-    auto paramMap = _getSubkeys(tableKey, subKeys);
+    auto const kvI = _metadataKvI();
+    bool tableExists = false;
+    auto paramMap = _getSubkeys(*kvI, tableKey, subKeys, &tableExists);
     if (paramMap.empty()) {
         // check table key
-        if (not _kvI->exists(tableKey)) throw NoSuchTable(dbName, tableName);
+        if (not tableExists) throw NoSuchTable(dbName, tableName);
         return params;
     }
 
@@ -582,6 +699,7 @@ CssAccess::createTable(std::string const& dbName,
 
     // done
     _kvI->set(tableKey, KEY_STATUS_READY);
+    _bumpDataVersion();
 }
 
 void
@@ -622,6 +740,7 @@ CssAccess::createMatchTable(std::string const& dbName,
 
     // done, can mark table as ready
     _kvI->set(tableKey, KEY_STATUS_READY);
+    _bumpDataVersion();
 }
 
 void
@@ -639,6 +758,7 @@ CssAccess::dropTable(std::string const& dbName, std::string const& tableName) {
         LOGS(_log, LOG_LVL_DEBUG, "dropTable: key is not found: " << key);
         throw NoSuchTable(dbName, tableName);
     }
+    _bumpDataVersion();
 }
 
 std::vector<std::string>
@@ -664,7 +784,7 @@ CssAccess::getNodeParams(std::string const& nodeName) const {
     NodeParams params;
 
     std::vector<std::string> subKeys{nodeName, nodeName + "/type", nodeName + "/host", nodeName + "/port"};
-    auto paramMap = _getSubkeys(key, subKeys);
+    auto paramMap = _getSubkeys(*_kvI, key, subKeys);
     if (paramMap.empty()) {
         // check node key
         if (not _kvI->exists(key + "/" + nodeName)) throw NoSuchNode(nodeName);
@@ -870,7 +990,7 @@ CssAccess::getChunks(std::string const& dbName, std::string const& tableName) {
 
         auto& nodes = result[chunkId];
         for (auto& replica: replicas) {
-            auto nodeMap = _getSubkeys(replicasKey + "/" + replica, {"nodeName"});
+            auto nodeMap = _getSubkeys(*_kvI, replicasKey + "/" + replica, {"nodeName"});
             auto iter = nodeMap.find("nodeName");
             if (iter != nodeMap.end()) {
                 nodes.push_back(iter->second);
@@ -890,14 +1010,11 @@ CssAccess::_assertDbExists(std::string const& dbName) const {
 }
 
 std::map<std::string, std::string>
-CssAccess::_getSubkeys(std::string const& key, std::vector<std::string> const& subKeys) const {
+CssAccess::_getSubkeys(KvInterface& kvI, std::string const& key,
+                       std::vector<std::string> const& subKeys, bool* keyExists) const {
     LOGS(_log, LOG_LVL_DEBUG, "_getSubkeys(" << key << ", " << util::printable(subKeys) << ")");
 
     std::set<std::string> parentKeys;
-
-    // construct full set of keys to look at, this includes a packed key
-    // plus all explicit key names
-    std::vector<std::string> allKeys;
     for (auto& subKey: subKeys) {
 
         // find actual parent of the key (everything before last slash)
@@ -907,21 +1024,24 @@ CssAccess::_getSubkeys(std::string const& key, std::vector<std::string> const& s
             parentKey += "/";
             parentKey += subKey.substr(0, p);
         }
-
-        if (parentKeys.count(parentKey) == 0) {
-            parentKeys.insert(parentKey);
-            allKeys.push_back(parentKey + "/" + ::_packedKeyName);
-        }
-
-        allKeys.push_back(key + "/" + subKey);
+        parentKeys.insert(parentKey);
     }
     LOGS(_log, LOG_LVL_DEBUG, "_getSubkeys: parent keys: " << util::printable(parentKeys));
-    LOGS(_log, LOG_LVL_DEBUG, "_getSubkeys: looking for keys: " << util::printable(allKeys));
 
-    // get everything in one call from KV store, this is
-    // supposed to be consistent set of values
-    auto keyMap = _kvI->getMany(allKeys);
-    LOGS(_log, LOG_LVL_DEBUG, "_getSubkeys: kvI returned: " << util::printable(keyMap));
+    // key with empty last component (e.g. empty table name) can not exist
+    bool const checkKey = not key.empty() and key.back() != '/';
+
+    // get the key and everything below it, packed keys included, in one
+    // request to the KV store, which is supposed to be a consistent set of
+    // values. Chunk lists can be large and are never needed here.
+    std::map<std::string, std::string> keyMap;
+    if (checkKey) {
+        keyMap = kvI.getSubtree(key, ::chunksPathBelow(key, _prefix));
+    }
+    LOGS(_log, LOG_LVL_DEBUG, "_getSubkeys: kvI returned " << keyMap.size() << " keys");
+    if (keyExists != nullptr) {
+        *keyExists = keyMap.count(key) > 0;
+    }
 
     // unpack packed guys, and add unpacked keys to a key map, this does not overwrite
     // existing keys (meaning that regular key overrides same packed key)
@@ -23,8 +23,11 @@
 #define LSST_QSERV_CSS_CSSACCESS_H
 
 // System headers
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -121,6 +124,8 @@ public:
      *       'username': mysql user name
      *       'password': user password
      *       'database': database name
+     *  For any technology optional 'snapshotCheckIntervalMs' key is passed to
+     *  setSnapshotCheckInterval().
      *
      *  @param config:  configuration map
      *  @param emptyChunkPath:  path to empty chunk list file
@@ -140,6 +145,30 @@ public:
      */
     static int cssVersion();
 
+    /**
+     *  Returns the version of database and table definitions. The value is
+     *  opaque, it changes every time a database or a table is created,
+     *  dropped or changes status. Empty string is returned if nothing was
+     *  changed since CSS was initialized.
+     *
+     *  @throws CssError: for all CSS errors
+     */
+    std::string getDataVersion() const;
+
+    /**
+     *  Read database and table definitions from an in-memory snapshot of CSS
+     *  instead of the KV storage. The snapshot is loaded on first use and
+     *  reloaded when the data version changes, which is checked at most once
+     *  per checkInterval, so in between no requests are made to the storage.
+     *  Changes made through this instance are seen right away, changes made
+     *  by others after up to checkInterval. Nodes and chunks are always read
+     *  from the storage, and so is everything else while the snapshot is
+     *  first loaded, or if loading it fails.
+     *
+     *  @param checkInterval:  zero disables the snapshot, which is the default
+     */
+    void setSnapshotCheckInterval(std::chrono::milliseconds checkInterval);
+
     /**
      * @brief Returns the list of known databases.
      */
@@ -511,12 +540,21 @@ protected:
     void _assertDbExists(std::string const& dbName) const;
 
     /**
-     * Get values of specified sub-keys of a given key. This method knows how to unpack
-     * packed keys. Returned map has sub-key names as keys, if sub-key is missing then
-     * its key is not present in returned map.
+     * Get values of specified sub-keys of a given key from kvI. This method knows how
+     * to unpack packed keys. Returned map has sub-key names as keys, if sub-key is
+     * missing then its key is not present in returned map. If keyExists is not null
+     * it is set to true if the key itself exists. Everything is read with a single
+     * getSubtree() request, which leaves out the chunk lists of tables.
      */
-    std::map<std::string, std::string> _getSubkeys(std::string const& key,
-                                                   std::vector<std::string> const& subKeys) const;
+    std::map<std::string, std::string> _getSubkeys(KvInterface& kvI, std::string const& key,
+                                                   std::vector<std::string> const& subKeys,
+                                                   bool* keyExists=nullptr) const;
+
+    /**
+     *  Returns the store to read database and table definitions from, which
+     *  is the snapshot if it is enabled and the KV storage otherwise.
+     */
+    std::shared_ptr<KvInterface> _metadataKvI() const;
 
     /**
      * Unpack json string into key-value map, only one-level nesting
@@ -538,8 +576,25 @@ protected:
      */
     void _checkVersion(bool mustExist=true) const;
 
+    /**
+     *  Store new unique value of data version, called after every change
+     *  to database or table definitions.
+     */
+    void _bumpDataVersion();
+
 private:
 
+    /// Read-only copy of CSS, without chunk replicas.
+    struct Snapshot {
+        std::shared_ptr<KvInterface> kvI;
+        std::string dataVersion;
+    };
+
+    /// @return current snapshot, or nullptr if snapshot is disabled or
+    ///         could not be loaded, then the KV storage is to be read.
+    std::shared_ptr<Snapshot const> _getSnapshot() const;
+    std::shared_ptr<Snapshot const> _loadSnapshot() const;
+
     void _fillPartTableParams(std::map<std::string, std::string>& paramMap,
                               PartTableParams& params,
                               std::string const& tableKey) const;
@@ -554,7 +609,14 @@ private:
     std::shared_ptr<KvInterface> _kvI;
     std::shared_ptr<EmptyChunks> _emptyChunks;
     std::string _prefix;    // optional prefix, for isolating tests from production
-    mutable bool _versionOk;   // True if version is checked (and is OK)
+    mutable std::atomic<bool> _versionOk;   // True if version is checked (and is OK)
+
+    mutable std::mutex _snapshotMtx; ///< Protects the members below.
+    std::chrono::milliseconds _snapshotCheckInterval{0}; ///< Zero if snapshot is disabled.
+    mutable std::shared_ptr<Snapshot const> _snapshot;
+    mutable std::chrono::steady_clock::time_point _snapshotChecked; ///< Last data version check.
+    mutable bool _snapshotLoading{false}; ///< True while a thread checks or loads the snapshot.
+    unsigned _snapshotGeneration{0}; ///< Changes when the snapshot is dropped.
 };
 
 }}} // namespace lsst::qserv::css
@@ -100,6 +100,16 @@ public:
         return _technology;
     }
 
+    /* Get interval between checks of CSS snapshot version
+     *
+     * @see CssAccess::setSnapshotCheckInterval()
+     *
+     * @return interval in milliseconds, 0 if snapshot is not used
+     */
+    int getSnapshotCheckIntervalMs() const {
+        return _snapshotCheckIntervalMs;
+    }
+
 private:
 
     CssConfig(util::ConfigStore const& configStore);
@@ -113,6 +123,8 @@ private:
     // used by "mysql" technology
     mysql::MySqlConfig const _mySqlConfig;
 
+    int const _snapshotCheckIntervalMs;
+
 };
 
 }}} // namespace lsst::qserv::css
@@ -129,6 +129,21 @@ public:
      */
     virtual std::map<std::string, std::string> getChildrenValues(std::string const& key) = 0;
 
+    /**
+     * Returns a key and all keys below it, at any depth, together with values.
+     * Everything is read with a single request. Returned map has full key
+     * names, it is empty if the key does not exist. For the root key "/" all
+     * keys are returned, except for the root key itself. If skipPath is not
+     * empty, the keys at that path below the key are left out, together with
+     * all keys below them. In skipPath "*" stands for any one path element,
+     * e.g. below the root key the path with elements DBS, "*", TABLES, "*"
+     * and CHUNKS skips the chunk lists of all tables.
+     * @throws CssError if there are any problems (e.g., a connection error
+     * is detected).
+     */
+    virtual std::map<std::string, std::string> getSubtree(std::string const& key,
+                                                          std::string const& skipPath=std::string()) = 0;
+
     /**
      * Delete a key, and all of its children (if they exist)
      * @throws NoSuchKey on failure.
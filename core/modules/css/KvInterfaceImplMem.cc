@@ -34,6 +34,7 @@
 #include "css/KvInterfaceImplMem.h"
 
 // System headers
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -100,6 +101,7 @@ KvInterfaceImplMem::create(string const& key, string const& value, bool unique)
         throw ReadonlyCss();
     }
 
+    std::lock_guard<std::mutex> lock(_mapMutex);
     string path = key;
     if (unique) {
         // append unique suffix, in-memory KVI is not meant for large-scale
@@ -111,7 +113,7 @@ KvInterfaceImplMem::create(string const& key, string const& value, bool unique)
             path = key + str.str();
         } while (_kvMap.count(path));
     }
-    if (exists(path)) {
+    if (_exists(path)) {
         throw KeyExistsError(path);
     }
     // create all parents
@@ -136,6 +138,7 @@ KvInterfaceImplMem::set(string const& key, string const& value) {
         throw ReadonlyCss();
     }
 
+    std::lock_guard<std::mutex> lock(_mapMutex);
     // create all parents
     string parent = key;
     for (string::size_type p = parent.rfind('/'); p != string::npos; p = parent.rfind('/')) {
@@ -150,6 +153,12 @@ KvInterfaceImplMem::set(string const& key, string const& value) {
 
 bool
 KvInterfaceImplMem::exists(string const& key) {
+    std::lock_guard<std::mutex> lock(_mapMutex);
+    return _exists(key);
+}
+
+bool
+KvInterfaceImplMem::_exists(string const& key) const {
     bool ret = _kvMap.find(key) != _kvMap.end();
     LOGS(_log, LOG_LVL_DEBUG, "exists(" << key << "): " << (ret?"YES":"NO"));
     return ret;
@@ -158,6 +167,7 @@ KvInterfaceImplMem::exists(string const& key) {
 std::map<std::string, std::string>
 KvInterfaceImplMem::getMany(std::vector<std::string> const& keys) {
     std::map<std::string, std::string> result;
+    std::lock_guard<std::mutex> lock(_mapMutex);
     for (auto& key: keys) {
         auto iter = _kvMap.find(key);
         if (iter != _kvMap.end()) {
@@ -172,13 +182,15 @@ KvInterfaceImplMem::_get(string const& key,
                          string const& defaultValue,
                          bool throwIfKeyNotFound) {
     LOGS(_log, LOG_LVL_DEBUG, "get(" << key << ")");
-    if ( !exists(key) ) {
+    std::lock_guard<std::mutex> lock(_mapMutex);
+    auto iter = _kvMap.find(key);
+    if (iter == _kvMap.end()) {
         if (throwIfKeyNotFound) {
             throw NoSuchKey(key);
         }
         return defaultValue;
     }
-    string s = _kvMap[key];
+    string s = iter->second;
     LOGS(_log, LOG_LVL_DEBUG, "got: '" << s << "'");
     return s;
 }
@@ -186,21 +198,20 @@ KvInterfaceImplMem::_get(string const& key,
 vector<string>
 KvInterfaceImplMem::getChildren(string const& key) {
     LOGS(_log, LOG_LVL_DEBUG, "getChildren(), key: " << key);
-    if ( ! exists(key) ) {
+    std::lock_guard<std::mutex> lock(_mapMutex);
+    if ( ! _exists(key) ) {
         throw NoSuchKey(key);
     }
     const string pfx(key == "/" ? key : key + "/");
     vector<string> retV;
-    map<string, string>::const_iterator itrM;
-    for (itrM=_kvMap.begin() ; itrM!=_kvMap.end() ; itrM++) {
-        string fullKey = itrM->first;
-        LOGS(_log, LOG_LVL_DEBUG, "fullKey: " << fullKey);
-        if (boost::starts_with(fullKey, pfx)) {
-            string theChild = fullKey.substr(pfx.length());
-            if (!theChild.empty() && (theChild.find("/") == string::npos)) {
-                LOGS(_log, LOG_LVL_DEBUG, "child: " << theChild);
-                retV.push_back(theChild);
-            }
+    // keys below the key are all together in the sorted map, starting at pfx
+    for (auto itrM = _kvMap.lower_bound(pfx); itrM != _kvMap.end(); ++itrM) {
+        string const& fullKey = itrM->first;
+        if (!boost::starts_with(fullKey, pfx)) break;
+        string theChild = fullKey.substr(pfx.length());
+        if (!theChild.empty() && (theChild.find("/") == string::npos)) {
+            LOGS(_log, LOG_LVL_DEBUG, "child: " << theChild);
+            retV.push_back(theChild);
         }
     }
     LOGS(_log, LOG_LVL_DEBUG, "got: " << retV.size() << " children: " << util::printable(retV));
@@ -210,26 +221,62 @@ KvInterfaceImplMem::getChildren(string const& key) {
 std::map<std::string, std::string>
 KvInterfaceImplMem::getChildrenValues(std::string const& key) {
     LOGS(_log, LOG_LVL_DEBUG, "getChildrenValues(), key: " << key);
-    if ( ! exists(key) ) {
+    std::lock_guard<std::mutex> lock(_mapMutex);
+    if ( ! _exists(key) ) {
         throw NoSuchKey(key);
     }
     const string pfx(key == "/" ? key : key + "/");
     std::map<std::string, std::string> retV;
-    for (auto const& pair: _kvMap) {
-        auto& fullKey = pair.first;
-        LOGS(_log, LOG_LVL_DEBUG, "fullKey: " << fullKey);
-        if (boost::starts_with(fullKey, pfx)) {
-            string theChild(fullKey, pfx.length());
-            if (!theChild.empty() && (theChild.find("/") == string::npos)) {
-                LOGS(_log, LOG_LVL_DEBUG, "child: " << theChild);
-                retV.insert(std::make_pair(theChild, pair.second));
-            }
+    for (auto itr = _kvMap.lower_bound(pfx); itr != _kvMap.end(); ++itr) {
+        auto& fullKey = itr->first;
+        if (!boost::starts_with(fullKey, pfx)) break;
+        string theChild(fullKey, pfx.length());
+        if (!theChild.empty() && (theChild.find("/") == string::npos)) {
+            LOGS(_log, LOG_LVL_DEBUG, "child: " << theChild);
+            retV.insert(std::make_pair(theChild, itr->second));
         }
     }
     LOGS(_log, LOG_LVL_DEBUG, "got: " << retV.size() << " children: " << util::printable(retV));
     return retV;
 }
 
+std::map<std::string, std::string>
+KvInterfaceImplMem::getSubtree(std::string const& key, std::string const& skipPath) {
+    LOGS(_log, LOG_LVL_DEBUG, "getSubtree(), key: " << key << " skipPath: " << skipPath);
+    std::vector<std::string> skipParts;
+    if (!skipPath.empty()) {
+        boost::split(skipParts, skipPath, boost::is_any_of("/"));
+    }
+    // true if full key k, after pfx, is at skipPath or below it
+    auto skip = [&skipParts](string const& k, string::size_type pfxSize) {
+        if (skipParts.empty()) return false;
+        std::vector<std::string> parts;
+        boost::split(parts, k.substr(pfxSize), boost::is_any_of("/"));
+        if (parts.size() < skipParts.size()) return false;
+        for (size_t i = 0; i != skipParts.size(); ++i) {
+            if (skipParts[i] != "*" && skipParts[i] != parts[i]) return false;
+        }
+        return true;
+    };
+    std::lock_guard<std::mutex> lock(_mapMutex);
+    std::map<std::string, std::string> retV;
+    if (key == "/") {
+        for (auto const& kv: _kvMap) {
+            if (kv.first != key && !skip(kv.first, 1)) retV.insert(retV.end(), kv);
+        }
+    } else if (_kvMap.count(key) != 0) {
+        // keys below the key are all together in the sorted map, after the key itself
+        const string pfx(key + "/");
+        retV.insert(*_kvMap.find(key));
+        for (auto itr = _kvMap.lower_bound(pfx); itr != _kvMap.end(); ++itr) {
+            if (!boost::starts_with(itr->first, pfx)) break;
+            if (!skip(itr->first, pfx.size())) retV.insert(retV.end(), *itr);
+        }
+    }
+    LOGS(_log, LOG_LVL_DEBUG, "got: " << retV.size() << " keys");
+    return retV;
+}
+
 void
 KvInterfaceImplMem::deleteKey(string const& key) {
     LOGS(_log, LOG_LVL_DEBUG, "deleteKey(" << key << ")");
@@ -238,6 +285,7 @@ KvInterfaceImplMem::deleteKey(string const& key) {
         throw ReadonlyCss();
     }
 
+    std::lock_guard<std::mutex> lock(_mapMutex);
     auto iter = _kvMap.find(key);
     if (iter == _kvMap.end()) {
         throw NoSuchKey(key);
@@ -259,6 +307,7 @@ KvInterfaceImplMem::deleteKey(string const& key) {
 
 std::string KvInterfaceImplMem::dumpKV() {
     std::string result;
+    std::lock_guard<std::mutex> lock(_mapMutex);
     for (auto& pair: _kvMap) {
         if (not result.empty()) result += '\n';
         result += pair.first;
@@ -295,6 +344,7 @@ void KvInterfaceImplMem::_init(std::istream& mapStream) {
 std::shared_ptr<KvInterfaceImplMem>
 KvInterfaceImplMem::clone() const {
     std::shared_ptr<KvInterfaceImplMem> newOne = std::make_shared<KvInterfaceImplMem>();
+    std::lock_guard<std::mutex> lock(_mapMutex);
     newOne->_kvMap = _kvMap;
     return newOne;
 }
@@ -36,6 +36,7 @@
 // System headers
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -52,6 +53,9 @@ public:
     explicit KvInterfaceImplMem(bool readOnly=false) : _readOnly(readOnly) {}
     explicit KvInterfaceImplMem(std::istream& mapStream, bool readOnly=false);
     explicit KvInterfaceImplMem(std::string const& filename, bool readOnly=false);
+    /// Make an instance holding kvMap, which must include all parent keys.
+    explicit KvInterfaceImplMem(std::map<std::string, std::string> const& kvMap, bool readOnly=false)
+        : _kvMap(kvMap), _readOnly(readOnly) {}
 
     virtual ~KvInterfaceImplMem();
 
@@ -62,6 +66,8 @@ public:
     virtual std::map<std::string, std::string> getMany(std::vector<std::string> const& keys) override;
     virtual std::vector<std::string> getChildren(std::string const& key) override;
     virtual std::map<std::string, std::string> getChildrenValues(std::string const& key) override;
+    virtual std::map<std::string, std::string> getSubtree(std::string const& key,
+                                                          std::string const& skipPath=std::string()) override;
     virtual void deleteKey(std::string const& key) override;
     virtual std::string dumpKV() override;
 
@@ -74,6 +80,10 @@ protected:
 
 private:
     void _init(std::istream& mapStream);
+    /// @return true if key exists, _mapMutex must be held.
+    bool _exists(std::string const& key) const;
+
+    mutable std::mutex _mapMutex; ///< Protects _kvMap.
     std::map<std::string, std::string> _kvMap;
     bool _readOnly;
 };
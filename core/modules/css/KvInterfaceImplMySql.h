@@ -41,7 +41,7 @@
 // Local headers
 #include "css/KvInterface.h"
 #include "mysql/MySqlConfig.h"
-#include "sql/SqlConnection.h"
+#include "sql/SqlConnectionPool.h"
 
 namespace lsst {
 namespace qserv {
@@ -71,6 +71,9 @@ public:
 
     virtual std::map<std::string, std::string> getChildrenValues(std::string const& key) override;
 
+    virtual std::map<std::string, std::string> getSubtree(std::string const& key,
+                                                          std::string const& skipPath=std::string()) override;
+
     virtual void deleteKey(std::string const& key) override;
 
     virtual std::string dumpKV() override;
@@ -129,13 +132,15 @@ private:
     /**
      * @brief Escape a string for sql.
      * @param value will be escaped as needed
-     * Will connect to the local connection if needed.
+     * Will connect the connection of the transaction if needed.
      * @throws CssErrror if connection fails
      * @return the escaped string
      */
-    std::string _escapeSqlString(std::string const& str);
+    std::string _escapeSqlString(std::string const& str, KvTransaction const& transaction);
 
-    sql::SqlConnection _conn;
+    /// Every transaction leases its own connection, so that concurrent
+    /// callers do not share one.
+    sql::SqlConnectionPool::Ptr _pool;
     bool _readOnly;
 };
 
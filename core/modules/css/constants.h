@@ -40,6 +40,12 @@ int const VERSION = 1; ///< Current supported version (integer)
 // conversions I define this string once and use it with kvInterface
 char const VERSION_STR[] = "1"; ///< Current supported version
 
+// Version of the database and table definitions. It is replaced with a new
+// unique value by every CssAccess method that changes a database or a table,
+// so that clients can tell whether anything they derived from those
+// definitions is still current. It is stored under the CssAccess prefix.
+char const DATA_VERSION_KEY[] = "/css_meta/dataVersion"; ///< Path to data version
+
 // Set of values used for database and table status.
 
 /// This status means CSS data is in inconsistent state, do not use.
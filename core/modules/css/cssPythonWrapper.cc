@@ -63,6 +63,7 @@ PYBIND11_PLUGIN(cssLib) {
         .def("getMany", &KvInterface::getMany)
         .def("getChildren", &KvInterface::getChildren)
         .def("getChildrenValues", &KvInterface::getChildrenValues)
+        .def("getSubtree", &KvInterface::getSubtree, "key"_a, "skipPath"_a=std::string())
         .def("deleteKey", &KvInterface::deleteKey)
         .def("dumpKV", &KvInterface::dumpKV)
         ;
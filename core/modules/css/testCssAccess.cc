@@ -11,8 +11,10 @@
 
 // System headers
 #include <algorithm>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -223,6 +225,140 @@ BOOST_AUTO_TEST_CASE(testSetDbStatus) {
     BOOST_CHECK_EQUAL(statMap["dbC"], "");
 }
 
+BOOST_AUTO_TEST_CASE(testDataVersion) {
+    auto const v0 = getDataVersion();
+    BOOST_CHECK_EQUAL(v0, "");
+
+    // reading does not change version
+    getDbStatus();
+    getTableNames("dbA");
+    BOOST_CHECK_EQUAL(getDataVersion(), v0);
+
+    setDbStatus("dbB", KEY_STATUS_READY);
+    auto const v1 = getDataVersion();
+    BOOST_CHECK(v1 != v0);
+
+    setTableStatus("dbA", "Object", KEY_STATUS_READY);
+    auto const v2 = getDataVersion();
+    BOOST_CHECK(v2 != v1);
+
+    dropTable("dbA", "Object");
+    BOOST_CHECK(getDataVersion() != v2);
+
+    // failed change does not change version either
+    auto const v3 = getDataVersion();
+    BOOST_CHECK_THROW(dropTable("dbA", "Object"), NoSuchTable);
+    BOOST_CHECK_EQUAL(getDataVersion(), v3);
+}
+
+BOOST_AUTO_TEST_CASE(testSnapshot) {
+    auto kvI = getKvI();
+    setSnapshotCheckInterval(chrono::hours(1));
+    auto const v0 = getDataVersion();
+    BOOST_CHECK_EQUAL(getDbStatus()["dbB"], "Bdb");
+
+    // changes made elsewhere are not seen until next check
+    kvI->set("/DBS/dbB", "Changed");
+    kvI->create("/DBS/dbA/TABLES/NewTable", KEY_STATUS_READY);
+    BOOST_CHECK_EQUAL(getDbStatus()["dbB"], "Bdb");
+    BOOST_CHECK(not containsTable("dbA", "NewTable"));
+
+    // even with new data version
+    kvI->set(DATA_VERSION_KEY, "other");
+    BOOST_CHECK_EQUAL(getDataVersion(), v0);
+    BOOST_CHECK(not containsTable("dbA", "NewTable"));
+
+    setSnapshotCheckInterval(chrono::milliseconds(10));
+    this_thread::sleep_for(chrono::milliseconds(20));
+    BOOST_CHECK_EQUAL(getDataVersion(), "other");
+    BOOST_CHECK_EQUAL(getDbStatus()["dbB"], "Changed");
+    BOOST_CHECK(containsTable("dbA", "NewTable"));
+
+    // same data version, no reload after interval
+    kvI->set("/DBS/dbB", "Bdb");
+    this_thread::sleep_for(chrono::milliseconds(20));
+    BOOST_CHECK_EQUAL(getDbStatus()["dbB"], "Changed");
+
+    // new data version is seen after interval
+    kvI->set(DATA_VERSION_KEY, "other2");
+    BOOST_CHECK_EQUAL(getDbStatus()["dbB"], "Changed");
+    this_thread::sleep_for(chrono::milliseconds(20));
+    BOOST_CHECK_EQUAL(getDbStatus()["dbB"], "Bdb");
+
+    // own changes are seen right away
+    setSnapshotCheckInterval(chrono::hours(1));
+    setDbStatus("dbA", "DEAD");
+    BOOST_CHECK_EQUAL(getDbStatus()["dbA"], "DEAD");
+    dropTable("dbA", "NewTable");
+    BOOST_CHECK(not containsTable("dbA", "NewTable"));
+    BOOST_CHECK_THROW(getTableParams("dbA", "NewTable"), NoSuchTable);
+    BOOST_CHECK_EQUAL(getTableParams("dbA", "Object").partitioning.dirColName, "objectId");
+    StripingParams striping = getDbStriping("dbA");
+    BOOST_CHECK_EQUAL(striping.stripes, 60);
+
+    // chunks are always read from storage
+    kvI->create("/DBS/dbA/TABLES/Exposure/CHUNKS/999/REPLICAS/0000000001/.packed.json",
+                R"({"nodeName": "worker3"})");
+    auto chunks = getChunks("dbA", "Exposure");
+    BOOST_CHECK_EQUAL(chunks.size(), 3U);
+    BOOST_CHECK_EQUAL(chunks[999].size(), 1U);
+
+    // values are copied as they are, whatever characters they have
+    std::string const schema = "(\n\ta INT\tNOT NULL,\n\tb \\N\n)";
+    kvI->create("/DBS/dbA/TABLES/Tabbed", KEY_STATUS_READY);
+    kvI->create("/DBS/dbA/TABLES/Tabbed/schema", schema);
+    kvI->set(DATA_VERSION_KEY, "other3");
+    setSnapshotCheckInterval(chrono::hours(1));
+    BOOST_CHECK_EQUAL(getTableSchema("dbA", "Tabbed"), schema);
+    auto const tables = getTableNames("dbA");
+    BOOST_CHECK_EQUAL(std::count(tables.begin(), tables.end(), "Tabbed"), 1);
+    BOOST_CHECK_EQUAL(tables.size(), 5U);
+
+    // only chunk replicas are left out, not what is named like them
+    kvI->create("/DBS/CHUNKS", KEY_STATUS_READY);
+    kvI->create("/DBS/CHUNKS/TABLES/CHUNKS", KEY_STATUS_READY);
+    kvI->create("/DBS/CHUNKS/TABLES/CHUNKS/schema", "(a INT)");
+    kvI->create("/DBS/CHUNKS/TABLES/CHUNKS/CHUNKS/1/REPLICAS/0000000001/.packed.json",
+                R"({"nodeName": "worker1"})");
+    kvI->set(DATA_VERSION_KEY, "other4");
+    setSnapshotCheckInterval(chrono::milliseconds(10));
+    this_thread::sleep_for(chrono::milliseconds(20));
+    BOOST_CHECK(containsDb("CHUNKS"));
+    BOOST_CHECK(containsTable("CHUNKS", "CHUNKS"));
+    BOOST_CHECK_EQUAL(getTableSchema("CHUNKS", "CHUNKS"), "(a INT)");
+    BOOST_CHECK_EQUAL(getChunks("CHUNKS", "CHUNKS").size(), 1U);
+}
+
+namespace {
+
+// Storage that can not be read at once
+class NoSubtreeKvI : public KvInterfaceImplMem {
+public:
+    using KvInterfaceImplMem::KvInterfaceImplMem;
+    std::map<std::string, std::string> getSubtree(std::string const&, std::string const&) override {
+        throw CssError("getSubtree failed");
+    }
+};
+
+class SnapshotCss : public CssAccess {
+public:
+    explicit SnapshotCss(std::shared_ptr<KvInterface> const& kvI)
+        : CssAccess(kvI, make_shared<EmptyChunks>()) {}
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(testSnapshotFailure) {
+    // without a snapshot, the storage is read
+    auto kvI = make_shared<NoSubtreeKvI>(getKvI()->getSubtree("/"));
+    SnapshotCss css(kvI);
+    css.setSnapshotCheckInterval(chrono::hours(1));
+    BOOST_CHECK_EQUAL(css.getDbStatus()["dbB"], "Bdb");
+    BOOST_CHECK(css.containsTable("dbA", "Object"));
+    kvI->set("/DBS/dbB", "Changed");
+    BOOST_CHECK_EQUAL(css.getDbStatus()["dbB"], "Changed");
+}
+
 BOOST_AUTO_TEST_CASE(testContainsDb) {
     BOOST_CHECK(containsDb("dbA"));
     BOOST_CHECK(containsDb("dbB"));
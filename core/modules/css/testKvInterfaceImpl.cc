@@ -80,6 +80,35 @@ struct KvInterfaceFixture {
         BOOST_CHECK(v[0]=="xyzA");
         BOOST_CHECK(v[1]=="xyzB");
 
+        // whole subtree, but not keys that only share prefix
+        kvI->create(k1 + "/sub/key", "subValue");
+        kvI->create(prefix + "_other", v2);
+        auto tree = kvI->getSubtree(prefix);
+        BOOST_CHECK_EQUAL(tree.size(), 5U);
+        BOOST_CHECK_EQUAL(tree[prefix], v1);
+        BOOST_CHECK_EQUAL(tree[k2], v2);
+        BOOST_CHECK_EQUAL(tree[k1 + "/sub"], "");
+        BOOST_CHECK_EQUAL(tree[k1 + "/sub/key"], "subValue");
+        BOOST_CHECK(kvI->getSubtree(k3).empty());
+        BOOST_CHECK_EQUAL(kvI->getSubtree("/").count(prefix + "_other"), 1U);
+
+        // keys at the skipped path, and everything below them
+        tree = kvI->getSubtree(prefix, "xyzA/sub");
+        BOOST_CHECK_EQUAL(tree.size(), 3U);
+        BOOST_CHECK_EQUAL(tree.count(k1 + "/sub"), 0U);
+        BOOST_CHECK_EQUAL(kvI->getSubtree(prefix, "*/sub").size(), 3U);
+        tree = kvI->getSubtree(prefix, "xyzA");
+        BOOST_CHECK_EQUAL(tree.size(), 2U);
+        BOOST_CHECK_EQUAL(tree.count(k1), 0U);
+        BOOST_CHECK_EQUAL(kvI->getSubtree(prefix, "xyz*").size(), 5U);
+        BOOST_CHECK_EQUAL(kvI->getSubtree(prefix, "xyzA/su").size(), 5U);
+        BOOST_CHECK_EQUAL(kvI->getSubtree("/", prefix.substr(1) + "/*/sub").count(k1 + "/sub/key"), 0U);
+        // but not the same name elsewhere
+        BOOST_CHECK_EQUAL(kvI->getSubtree(prefix, "sub").size(), 5U);
+        BOOST_CHECK_EQUAL(kvI->getSubtree("/", "*/sub").count(k1 + "/sub/key"), 1U);
+        kvI->deleteKey(prefix + "_other");
+        kvI->deleteKey(k1 + "/sub");
+
         kvI->deleteKey(k1);
         BOOST_CHECK(kvI->get(k1, "xyz4") == "xyz4");
 
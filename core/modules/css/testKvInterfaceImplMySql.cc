@@ -44,10 +44,12 @@
   */
 
 // System headers
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <unistd.h>
+#include <vector>
 
 // Boost headers
 #include <boost/algorithm/string/replace.hpp>
@@ -334,6 +336,97 @@ BOOST_AUTO_TEST_CASE(KeyTooLong) {
 }
 
 
+BOOST_AUTO_TEST_CASE(GetSubtree) {
+    CHECK_CONNECTION();
+
+    kvInterface->create("/GetSubtree/a/b", "ab");
+    kvInterface->create("/GetSubtree/a/c", "ac");
+    // LIKE wildcards in key must not match other keys
+    kvInterface->create("/GetSubtree_x/a", "x");
+    kvInterface->create("/GetSubtreeX", "X");
+    auto tree = kvInterface->getSubtree("/GetSubtree");
+    BOOST_CHECK_EQUAL(tree.size(), 4U);
+    BOOST_CHECK_EQUAL(tree["/GetSubtree"], "");
+    BOOST_CHECK_EQUAL(tree["/GetSubtree/a"], "");
+    BOOST_CHECK_EQUAL(tree["/GetSubtree/a/b"], "ab");
+    BOOST_CHECK_EQUAL(tree["/GetSubtree/a/c"], "ac");
+    BOOST_CHECK(kvInterface->getSubtree("/GetSubtree/b").empty());
+    BOOST_CHECK_EQUAL(kvInterface->getSubtree("/").count("/GetSubtreeX"), 1U);
+
+    // skipped keys are filtered by the server
+    kvInterface->create("/GetSubtree/a/b/CHUNKS/1", "1");
+    kvInterface->create("/GetSubtree/CHUNKS_x", "x");
+    tree = kvInterface->getSubtree("/GetSubtree", "CHUNKS");
+    BOOST_CHECK_EQUAL(tree.size(), 5U);
+    BOOST_CHECK_EQUAL(tree.count("/GetSubtree/a/b/CHUNKS"), 0U);
+    BOOST_CHECK_EQUAL(tree.count("/GetSubtree/CHUNKS_x"), 1U);
+    BOOST_CHECK_EQUAL(kvInterface->getSubtree("/", "CHUNKS").count("/GetSubtree/a/b/CHUNKS/1"), 0U);
+}
+
+
+// Times the requests CssAccess makes, as they were before getSubtree and as
+// they are now. Latencies are printed, not checked.
+BOOST_AUTO_TEST_CASE(CssLatency) {
+    CHECK_CONNECTION();
+
+    std::string const prefix = "/CssLatency";
+    std::string const dbKey = prefix + "/DBS/db";
+    std::string const objectKey = dbKey + "/TABLES/Object";
+    std::string const filterKey = dbKey + "/TABLES/Filter";
+    kvInterface->create(objectKey + "/schema", "value");
+    kvInterface->create(objectKey + "/partitioning/.packed.json", "{\"subChunks\": \"1\"}");
+    for (int chunk = 0; chunk != 500; ++chunk) {
+        kvInterface->create(objectKey + "/CHUNKS/" + std::to_string(chunk) + "/REPLICAS/1/nodeName",
+                            "worker");
+    }
+    kvInterface->create(filterKey + "/schema", "value");
+
+    // getPartTableParams of a partitioned table. It used to take a
+    // getMany() call for the sub-keys and an exists() call to tell missing
+    // sub-keys from a missing table, and is now one getSubtree() call that
+    // leaves out the chunk replicas.
+    std::vector<std::string> keys{objectKey + "/.packed.json", objectKey + "/partitioning",
+        objectKey + "/partitioning/.packed.json"};
+    for (auto const& subKey: {"subChunks", "dirDb", "dirTable", "dirColName", "latColName",
+                              "lonColName", "overlap", "secIndexColName"}) {
+        keys.push_back(objectKey + "/partitioning/" + subKey);
+    }
+    int const nLoops = 200;
+    auto const t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i != nLoops; ++i) {
+        BOOST_REQUIRE_EQUAL(kvInterface->getMany(keys).size(), 2U);
+        BOOST_REQUIRE(kvInterface->exists(objectKey));
+    }
+    auto const t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i != nLoops; ++i) {
+        auto const subtree = kvInterface->getSubtree(objectKey, "CHUNKS");
+        BOOST_REQUIRE(subtree.count(objectKey + "/partitioning/.packed.json") == 1
+                      and subtree.count(objectKey + "/CHUNKS") == 0);
+    }
+    auto const t2 = std::chrono::steady_clock::now();
+
+    // Loading the snapshot that the czar reads metadata from. It used to be
+    // the text dump of the whole store, chunk replicas included.
+    int const nLoads = 20;
+    for (int i = 0; i != nLoads; ++i) {
+        BOOST_REQUIRE(not kvInterface->dumpKV().empty());
+    }
+    auto const t3 = std::chrono::steady_clock::now();
+    for (int i = 0; i != nLoads; ++i) {
+        BOOST_REQUIRE_EQUAL(kvInterface->getSubtree(prefix, "CHUNKS").count(filterKey), 1U);
+    }
+    auto const t4 = std::chrono::steady_clock::now();
+
+    using usec = std::chrono::microseconds;
+    std::cout << "getPartTableParams, per call: getMany+exists "
+              << std::chrono::duration_cast<usec>(t1 - t0).count() / nLoops << " us, getSubtree "
+              << std::chrono::duration_cast<usec>(t2 - t1).count() / nLoops << " us" << std::endl;
+    std::cout << "snapshot, per load: dumpKV "
+              << std::chrono::duration_cast<usec>(t3 - t2).count() / nLoads << " us, getSubtree "
+              << std::chrono::duration_cast<usec>(t4 - t3).count() / nLoads << " us" << std::endl;
+}
+
+
 BOOST_AUTO_TEST_CASE(InvalidSql) {
     CHECK_CONNECTION();
 
@@ -24,8 +24,8 @@
 #include "czar/Czar.h"
 
 // System headers
+#include <chrono>
 #include <sys/time.h>
-#include <thread>
 
 // Third-party headers
 #include "boost/format.hpp"
@@ -35,12 +35,19 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "ccontrol/ChunkSpecExecutor.h"
 #include "ccontrol/ConfigMap.h"
+#include "ccontrol/MergeExecutor.h"
+#include "ccontrol/UserQueryExecutor.h"
 #include "czar/CzarErrors.h"
 #include "czar/MessageTable.h"
+#include "qdisp/JobStartExecutor.h"
+#include "qdisp/MemoryGovernor.h"
+#include "qdisp/WorkerSelector.h"
 #include "rproc/InfileMerger.h"
 #include "sql/SqlConnection.h"
 #include "util/IterableFormatter.h"
+#include "util/Tracer.h"
 #include "XrdSsi/XrdSsiProvider.hh"
 
 
@@ -94,12 +101,31 @@ Czar::Czar(std::string const& configPath, std::string const& czarName)
     LOGS(_log, LOG_LVL_INFO, "config largeResultConcurrent=" << largeResultConcurrent);
     _largeResultMgr = std::make_shared<qdisp::LargeResultMgr>(largeResultConcurrent);
 
+    int resultMemoryBudgetMB = _czarConfig.getResultMemoryBudgetMB();
+    LOGS(_log, LOG_LVL_INFO, "config resultMemoryBudgetMB=" << resultMemoryBudgetMB);
+    qdisp::MemoryGovernor::get().setBudget(static_cast<std::int64_t>(resultMemoryBudgetMB) << 20);
+
     int xrootdCBThreadsMax = _czarConfig.getXrootdCBThreadsMax();
     int xrootdCBThreadsInit = _czarConfig.getXrootdCBThreadsInit();
     LOGS(_log, LOG_LVL_INFO, "config xrootdCBThreadsMax=" << xrootdCBThreadsMax);
     LOGS(_log, LOG_LVL_INFO, "config xrootdCBThreadsInit=" << xrootdCBThreadsInit);
     XrdSsiProviderClient->SetCBThreads(xrootdCBThreadsMax, xrootdCBThreadsInit);
 
+    ccontrol::MergeExecutor::get().configure(_czarConfig.getMergeThreads(),
+                                             _czarConfig.getMaxQueuedMergesPerQuery());
+    qdisp::JobStartExecutor::get().configure(_czarConfig.getJobStartThreads());
+    ccontrol::ChunkSpecExecutor::get().configure(_czarConfig.getChunkSpecThreads());
+    ccontrol::UserQueryExecutor::get().configure(_czarConfig.getQueryThreads(),
+                                                 _czarConfig.getMaxRunningQueries(),
+                                                 _czarConfig.getInteractiveQuerySlots());
+
+    util::Tracer::get().configure(_czarConfig.getTraceEnabled(), _czarConfig.getTraceBufferSize());
+    LOGS(_log, LOG_LVL_INFO, "config traceEnabled=" << _czarConfig.getTraceEnabled());
+
+    qdisp::WorkerSelector::get().configure(_czarConfig.getReplicaDispatch(),
+            _czarConfig.getWorkerXrootdPort(),
+            std::chrono::seconds(_czarConfig.getWorkerLoadMaxAgeSecs()));
+
     LOGS(_log, LOG_LVL_INFO, "Creating czar instance with name " << czarName);
     LOGS(_log, LOG_LVL_DEBUG, "Czar config: " << _czarConfig);
 
@@ -145,13 +171,8 @@ Czar::submitQuery(std::string const& query,
     }
 
 
-    // make new UserQuery
-    // this is atomic
-    ccontrol::UserQuery::Ptr uq;
-    {
-        std::lock_guard<std::mutex> lock(_mutex);
-        uq = _uqFactory->newUserQuery(query, defaultDb, getLargeResultMgr(), userQueryId, msgTableName);
-    }
+    // make new UserQuery, the factory is safe to use from several threads
+    auto uq = _uqFactory->newUserQuery(query, defaultDb, getLargeResultMgr(), userQueryId, msgTableName);
     auto queryIdStr = uq->getQueryIdString();
 
     // check for errors
@@ -161,12 +182,18 @@ Czar::submitQuery(std::string const& query,
         return result;
     }
 
-    // spawn background thread to wait until query finishes to unlock,
-    // note that lambda stores copies of uq and msgTable.
-    auto finalizer = [uq, msgTable]() mutable {
-        LOGS(_log, LOG_LVL_DEBUG, uq->getQueryIdString() << " submitting new query");
-        uq->submit();
-        uq->join();
+    // queue the query, it is finished by the executor once it completes to
+    // unlock, note that lambda stores copies of uq and msgTable.
+    std::string const traceDumpDir = _czarConfig.getTraceDumpDir();
+    auto finalizer = [uq, msgTable, traceDumpDir](ccontrol::QueryState) mutable {
+        uint64_t const traceId = uq->getTraceId();
+        if (traceId != 0 && !traceDumpDir.empty()) {
+            std::string const traceFile = traceDumpDir + "/trace_" + std::to_string(uq->getQueryId())
+                                          + "_" + std::to_string(traceId) + ".json";
+            if (!util::Tracer::get().dumpChromeJsonFile(traceFile, traceId)) {
+                LOGS(_log, LOG_LVL_WARN, uq->getQueryIdString() << " failed to write " << traceFile);
+            }
+        }
         try {
             msgTable.unlock(uq);
             if (uq) uq->discard();
@@ -177,9 +204,8 @@ Czar::submitQuery(std::string const& query,
                  << " Query finalization failed (client likely hangs): " << exc.what());
         }
     };
-    LOGS(_log, LOG_LVL_DEBUG, queryIdStr << " starting finalizer thread for query");
-    std::thread finalThread(finalizer);
-    finalThread.detach();
+    LOGS(_log, LOG_LVL_DEBUG, queryIdStr << " queueing query");
+    ccontrol::UserQueryExecutor::get().queue(uq, finalizer);
 
     // update/cleanup query map
     _updateQueryHistory(clientId, threadId, uq);
@@ -254,6 +280,8 @@ Czar::killQuery(std::string const& query, std::string const& clientId) {
     LOGS(_log, LOG_LVL_DEBUG, "Killing query for thread: " << threadId);
     if (uq) {
         uq->kill();
+        // A query still waiting for admission has nothing left to run.
+        ccontrol::UserQueryExecutor::get().expedite(uq);
     }
 
     return std::string();
@@ -132,7 +132,7 @@ private:
     std::atomic<uint64_t> _idCounter;   ///< Query/task identifier for next query
     std::unique_ptr<ccontrol::UserQueryFactory> _uqFactory;
     ClientToQuery _clientToQuery;       ///< maps client ID to query
-    std::mutex _mutex;                  ///< protects both _uqFactory and _clientToQuery
+    std::mutex _mutex;                  ///< protects _clientToQuery
 
     qdisp::LargeResultMgr::Ptr _largeResultMgr; ///< Large result manager for all user queries.
 };
@@ -82,8 +82,29 @@ CzarConfig::CzarConfig(util::ConfigStore const& configStore)
        _xrootdFrontendUrl(configStore.get("frontend.xrootd", "localhost:1094")),
        _emptyChunkPath(configStore.get("partitioner.emptyChunkPath", ".")),
        _largeResultConcurrentMerges(configStore.getInt("tuning.largeResultConcurrentMerges", 3)),
+       _resultMemoryBudgetMB(configStore.getInt("tuning.resultMemoryBudgetMB", 4096)),
+       _maxMergeShards(configStore.getInt("resultdb.maxMergeShards", 4)),
+       _aggregateMaxGroups(configStore.getInt("resultdb.aggregateMaxGroups", 1000000)),
+       _topKMaxRows(configStore.getInt("resultdb.topKMaxRows", 100000)),
        _xrootdCBThreadsMax(configStore.getInt("tuning.xrootdCBThreadsMax", 500)),
-       _xrootdCBThreadsInit(configStore.getInt("tuning.xrootdCBThreadsInit", 50)) {
+       _xrootdCBThreadsInit(configStore.getInt("tuning.xrootdCBThreadsInit", 50)),
+       _mergeThreads(configStore.getInt("tuning.mergeThreads", 8)),
+       _maxQueuedMergesPerQuery(configStore.getInt("tuning.maxQueuedMergesPerQuery", 16)),
+       _jobStartThreads(configStore.getInt("tuning.jobStartThreads", 20)),
+       _chunkSpecThreads(configStore.getInt("tuning.chunkSpecThreads", 4)),
+       _queryThreads(configStore.getInt("tuning.queryThreads", 10)),
+       _maxRunningQueries(configStore.getInt("tuning.maxRunningQueries", 50)),
+       _interactiveQuerySlots(configStore.getInt("tuning.interactiveQuerySlots", 10)),
+       _planCacheSize(configStore.getInt("tuning.planCacheSize", 1000)),
+       _traceEnabled(configStore.getInt("tracing.enabled", 0) != 0),
+       _traceBufferSize(configStore.getInt("tracing.bufferSize", 100000)),
+       _traceDumpDir(configStore.get("tracing.dumpDir")),
+       _replicaDispatch(configStore.getInt("dispatch.replicaDispatch", 0) != 0),
+       _workerXrootdPort(configStore.getInt("dispatch.workerXrootdPort", 1094)),
+       _replicaRefreshSecs(configStore.getInt("dispatch.replicaRefreshSecs", 600)),
+       _workerLoadMaxAgeSecs(configStore.getInt("dispatch.workerLoadMaxAgeSecs", 30)),
+       _chunksPerRequest(configStore.getInt("dispatch.chunksPerRequest", 1)),
+       _subChunkTemplates(configStore.getInt("dispatch.subChunkTemplates", 0) != 0) {
 }
 
 std::ostream& operator<<(std::ostream &out, CzarConfig const& czarConfig) {
@@ -93,6 +114,10 @@ std::ostream& operator<<(std::ostream &out, CzarConfig const& czarConfig) {
            ", mySqlQmetaConfig=" << czarConfig._mySqlQmetaConfig <<
            ", mySqlResultConfig=" << czarConfig._mySqlResultConfig <<
            ", xrootdFrontendUrl=" << czarConfig._xrootdFrontendUrl <<
+           ", traceEnabled=" << czarConfig._traceEnabled <<
+           ", replicaDispatch=" << czarConfig._replicaDispatch <<
+           ", chunksPerRequest=" << czarConfig._chunksPerRequest <<
+           ", subChunkTemplates=" << czarConfig._subChunkTemplates <<
            "]";
 
     return out;
@@ -50,6 +50,9 @@ public:
         : CzarConfig(util::ConfigStore(configFileName)) {
     }
 
+    /// Use parameters that are already loaded, e.g. set by a test.
+    CzarConfig(util::ConfigStore const& ConfigStore);
+
     CzarConfig(CzarConfig const&) = delete;
     CzarConfig& operator=(CzarConfig const&) = delete;
 
@@ -120,6 +123,44 @@ public:
          return _largeResultConcurrentMerges;
     }
 
+    /* Get the memory budget for result data read from workers but not yet
+     * merged, shared by all user queries.
+     *
+     * @return the budget in MB, 0 for no limit.
+     */
+    int getResultMemoryBudgetMB() const {
+        return _resultMemoryBudgetMB;
+    }
+
+    /* Get the maximum number of tables, each loaded over its own connection,
+     * that the results of one user query are merged into.
+     *
+     * @return the maximum number of merge shards per query, 1 disables
+     *         parallel merging.
+     */
+    int getMaxMergeShards() const {
+        return _maxMergeShards;
+    }
+
+    /* Get the maximum number of groups an aggregate query can hold in czar
+     * memory before its partial results are handed to MySQL.
+     *
+     * @return the maximum number of in-memory groups per query, 0 disables
+     *         in-memory aggregation.
+     */
+    int getAggregateMaxGroups() const {
+        return _aggregateMaxGroups;
+    }
+
+    /* Get the largest LIMIT for which the czar keeps only the best rows of an
+     * ORDER BY ... LIMIT query in memory instead of sorting them with MySQL.
+     *
+     * @return the maximum number of rows kept per query, 0 disables it.
+     */
+    int getTopKMaxRows() const {
+        return _topKMaxRows;
+    }
+
     /* Get the maximum number of threads for xrootd to use.
      *
      * @return the maximum number of threads for xrootd to use.
@@ -136,9 +177,154 @@ public:
         return _xrootdCBThreadsInit;
     }
 
-private:
+    /* Get the number of threads that decode and merge result messages, apart
+     * from the xrootd callback threads that receive them.
+     *
+     * @return the number of merge threads, 0 to merge on the xrootd threads.
+     */
+    int getMergeThreads() const {
+        return _mergeThreads;
+    }
 
-    CzarConfig(util::ConfigStore const& ConfigStore);
+    /* Get the number of result messages of one user query that may wait to
+     * be merged before reading more of its results is held back.
+     *
+     * @return the maximum number of queued merges per query.
+     */
+    int getMaxQueuedMergesPerQuery() const {
+        return _maxQueuedMergesPerQuery;
+    }
+
+    /* Get the number of threads starting jobs, shared by all user queries.
+     *
+     * @return the number of job start threads.
+     */
+    int getJobStartThreads() const {
+        return _jobStartThreads;
+    }
+
+    /* Get the number of threads building the chunk queries of submitted
+     * user queries.
+     *
+     * @return the number of threads, 0 to build them on the submitting thread.
+     */
+    int getChunkSpecThreads() const {
+        return _chunkSpecThreads;
+    }
+
+    /* Get the number of threads submitting user queries and finishing them
+     * once they complete.
+     *
+     * @return the number of user query threads.
+     */
+    int getQueryThreads() const {
+        return _queryThreads;
+    }
+
+    /* Get the number of user queries that can run at the same time, more
+     * wait for admission.
+     *
+     * @return the maximum number of running user queries.
+     */
+    int getMaxRunningQueries() const {
+        return _maxRunningQueries;
+    }
+
+    /* Get the number of running user queries that are kept for interactive
+     * queries, scans are not admitted into them.
+     *
+     * @return the number of running queries scans can not take.
+     */
+    int getInteractiveQuerySlots() const {
+        return _interactiveQuerySlots;
+    }
+
+    /* Get the number of analyzed SELECT queries whose plans are kept, so that
+     * the same queries are not parsed and analyzed again.
+     *
+     * @return the maximum number of cached query plans, 0 disables the cache.
+     */
+    int getPlanCacheSize() const {
+        return _planCacheSize;
+    }
+
+    /* Get whether queries are traced with util::Tracer.
+     *
+     * @return true if tracing is enabled.
+     */
+    bool getTraceEnabled() const {
+        return _traceEnabled;
+    }
+
+    /* Get the number of spans kept in the trace ring buffer.
+     *
+     * @return trace ring buffer capacity, in spans.
+     */
+    int getTraceBufferSize() const {
+        return _traceBufferSize;
+    }
+
+    /* Get the directory where a Chrome trace-event JSON file is written for
+     * each traced query once it completes.
+     *
+     * @return directory for per-query trace files, empty if none are written.
+     */
+    std::string const& getTraceDumpDir() const {
+        return _traceDumpDir;
+    }
+
+    /* Get whether jobs are sent directly to a chosen replica of their chunk.
+     *
+     * @return true if the czar picks a worker for each job, false to always
+     *         let the xrootd redirector route jobs.
+     */
+    bool getReplicaDispatch() const {
+        return _replicaDispatch;
+    }
+
+    /* Get the xrootd port of the workers, used to address them directly.
+     *
+     * @return worker xrootd port
+     */
+    int getWorkerXrootdPort() const {
+        return _workerXrootdPort;
+    }
+
+    /* Get how often the chunk replica map of a database is reloaded from CSS.
+     *
+     * @return reload interval in seconds
+     */
+    int getReplicaRefreshSecs() const {
+        return _replicaRefreshSecs;
+    }
+
+    /* Get the age after which a worker's reported load is ignored.
+     *
+     * @return maximum age of a worker load report in seconds
+     */
+    int getWorkerLoadMaxAgeSecs() const {
+        return _workerLoadMaxAgeSecs;
+    }
+
+    /* Get the maximum number of chunks sent to a worker in one request.
+     *
+     * @return chunks per request, 1 or less to send each chunk on its own
+     */
+    int getChunksPerRequest() const {
+        return _chunksPerRequest;
+    }
+
+    /* Get whether workers build the queries of subchunked chunks from
+     * templates, instead of the czar sending every subchunk query.
+     *
+     * @return true to send subchunk query templates, which workers older
+     *         than the templates fail on.
+     */
+    bool getSubChunkTemplates() const {
+        return _subChunkTemplates;
+    }
+
+private:
 
     // Parameters below used in czar::Czar
     mysql::MySqlConfig const _mySqlResultConfig;
@@ -150,8 +336,31 @@ private:
     std::string const _xrootdFrontendUrl;
     std::string const _emptyChunkPath;
     int const _largeResultConcurrentMerges;
+    int const _resultMemoryBudgetMB;
+    int const _maxMergeShards;
+    int const _aggregateMaxGroups;
+    int const _topKMaxRows;
     int const _xrootdCBThreadsMax;
     int const _xrootdCBThreadsInit;
+    int const _mergeThreads;
+    int const _maxQueuedMergesPerQuery;
+    int const _jobStartThreads;
+    int const _chunkSpecThreads;
+    int const _queryThreads;
+    int const _maxRunningQueries;
+    int const _interactiveQuerySlots;
+    int const _planCacheSize;
+
+    bool const _traceEnabled;
+    int const _traceBufferSize;
+    std::string const _traceDumpDir;
+
+    bool const _replicaDispatch;
+    int const _workerXrootdPort;
+    int const _replicaRefreshSecs;
+    int const _workerLoadMaxAgeSecs;
+    int const _chunksPerRequest;
+    bool const _subChunkTemplates;
 };
 
 }}} // namespace lsst::qserv::czar
@@ -196,7 +196,8 @@ function queryType()
 
     -- Detects if query can be handled locally without sending it to qserv
     local isLocal = function(qU)
-        if (string.find(qU, "^SHOW ") and not string.find(qU, "^SHOW .*PROCESSLIST")) or
+        if (string.find(qU, "^SHOW ") and not string.find(qU, "^SHOW .*PROCESSLIST")
+                                      and not string.find(qU, "^SHOW QSERV_STATS")) or
            string.find(qU, "^SET ") or
            string.find(qU, "^DESCRIBE ") or
            string.find(qU, "^DESC ") or
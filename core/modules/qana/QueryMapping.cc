@@ -35,6 +35,8 @@
 #include "qana/QueryMapping.h"
 
 // System headers
+#include <algorithm>
+#include <cctype>
 #include <deque>
 #include <sstream>
 #include <stdexcept>
@@ -55,6 +57,11 @@ namespace {
 
 LOG_LOGGER _log = LOG_GET("lsst.qserv.query.QueryMapping");
 
+/// @return true if v is a number a compiled template can be generated with.
+bool isNumber(std::string const& v) {
+    return !v.empty() && std::all_of(v.begin(), v.end(), ::isdigit);
+}
+
 }
 
 namespace lsst {
@@ -170,19 +177,90 @@ private:
 QueryMapping::QueryMapping() {}
 
 std::string QueryMapping::apply(qproc::ChunkSpec const& s, query::QueryTemplate const& t) const {
-    Mapping m(_subs, s);
-    std::string str = t.generate(m);
+    std::string subChunk;
+    if (!s.subChunks.empty()) {
+        subChunk = boost::lexical_cast<std::string>(s.subChunks.front());
+    }
+    std::string str = _applyCompiled(boost::lexical_cast<std::string>(s.chunkId), subChunk, t);
+    if (str.empty()) {
+        Mapping m(_subs, s);
+        str = t.generate(m);
+    }
     return str;
 }
 
 
 std::string QueryMapping::apply(qproc::ChunkSpecSingle const& s, query::QueryTemplate const& t) const {
-    Mapping m(_subs, s);
-    std::string str = t.generate(m);
+    std::string str = _applyCompiled(boost::lexical_cast<std::string>(s.chunkId),
+                                     boost::lexical_cast<std::string>(s.subChunkId), t);
+    if (str.empty()) {
+        Mapping m(_subs, s);
+        str = t.generate(m);
+    }
     return str;
 }
 
 
+void QueryMapping::compile(query::QueryTemplate& t) const {
+    for (auto const& sub : _subs) {
+        if (sub.second != CHUNK && sub.second != SUBCHUNK) {
+            return;
+        }
+    }
+    // Mapping replaces the patterns in the order of _subs.
+    std::vector<std::string> patterns;
+    for (auto const& sub : _subs) {
+        patterns.push_back(sub.first);
+    }
+    t.compile(patterns);
+}
+
+
+bool QueryMapping::applyChunk(int chunkId, query::QueryTemplate const& t,
+                              std::vector<std::string>& pieces) const {
+    auto const* patterns = t.getCompiledPatterns();
+    std::string const chunk = boost::lexical_cast<std::string>(chunkId);
+    if (patterns == nullptr || patterns->size() != _subs.size() || !isNumber(chunk)) {
+        return false;
+    }
+    std::vector<std::string> values;
+    values.reserve(_subs.size());
+    auto pattern = patterns->begin();
+    for (auto const& sub : _subs) {
+        if (sub.first != *pattern++) {
+            return false;
+        }
+        // An empty value cuts the query.
+        values.push_back((sub.second == CHUNK) ? chunk : std::string());
+    }
+    pieces = t.generatePieces(values);
+    return true;
+}
+
+
+/// @return the query generated from compiled template t, or an empty
+///         string if t was not compiled for this mapping or the numbers are
+///         not plain digits, in which case t must be applied entry by entry.
+std::string QueryMapping::_applyCompiled(std::string const& chunk, std::string const& subChunk,
+                                         query::QueryTemplate const& t) const {
+    auto const* patterns = t.getCompiledPatterns();
+    if (patterns == nullptr || patterns->size() != _subs.size()) {
+        return std::string();
+    }
+    std::vector<std::string> values;
+    values.reserve(_subs.size());
+    auto pattern = patterns->begin();
+    for (auto const& sub : _subs) {
+        std::string const& value = (sub.second == CHUNK) ? chunk : subChunk;
+        if (sub.first != *pattern++ || !isNumber(value)) {
+            return std::string();
+        }
+        values.push_back(value);
+    }
+    return t.generate(values);
+}
+
+
 bool
 QueryMapping::hasParameter(Parameter p) const {
     ParameterMap::const_iterator i;
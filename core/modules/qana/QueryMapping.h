@@ -33,6 +33,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 // Qserv headers
 #include "global/DbTable.h"
@@ -87,6 +88,20 @@ public:
     std::string apply(qproc::ChunkSpecSingle const& s,
                       query::QueryTemplate const& t) const;
 
+    /// Compile t, once per user query, so that apply() substitutes chunk and
+    /// subchunk numbers into its precomputed text. Templates that cannot be
+    /// compiled for this mapping are left as they are, and are applied
+    /// entry by entry.
+    void compile(query::QueryTemplate& t) const;
+
+    /// Generate the query of compiled template t for chunk chunkId, cut at
+    /// the places where the subchunk number goes, so that the query of any
+    /// subchunk is the pieces joined with the subchunk number.
+    /// @return false if t was not compiled for this mapping, in which case
+    ///         the query of every subchunk must be generated with apply().
+    bool applyChunk(int chunkId, query::QueryTemplate const& t,
+                    std::vector<std::string>& pieces) const;
+
     // Modifiers
     void insertSubChunkTable(DbTable const& dbTable) { _subChunkTables.insert(dbTable); }
     void insertEntry(std::string const& s, Parameter p) { _subs[s] = p; }
@@ -100,6 +115,9 @@ public:
     DbTableSet const& getSubChunkTables() const { return _subChunkTables; }
 
 private:
+    std::string _applyCompiled(std::string const& chunk, std::string const& subChunk,
+                               query::QueryTemplate const& t) const;
+
     ParameterMap _subs;
     DbTableSet _subChunkTables;
 };
@@ -0,0 +1,387 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/BatchJobQuery.h"
+
+// System headers
+#include <algorithm>
+#include <thread>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "ccontrol/msgCode.h"
+#include "proto/ProtoHeaderWrap.h"
+#include "proto/worker.pb.h"
+#include "proto/WorkerResponse.h"
+#include "qdisp/JobStatus.h"
+#include "qdisp/QueryRequest.h"
+#include "qdisp/QueryResource.h"
+#include "util/Histogram.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.BatchJobQuery");
+
+using lsst::qserv::util::StatsRegistry;
+auto const ctrBatches = StatsRegistry::get().counter("qdisp.BatchJobQuery.batches");
+auto const ctrBatchedJobs = StatsRegistry::get().counter("qdisp.BatchJobQuery.batchedJobs");
+auto const ctrJobsRunAlone = StatsRegistry::get().counter("qdisp.BatchJobQuery.jobsRunAlone");
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+////////////////////////////////////////////////////////////////////////
+// BatchHandler
+////////////////////////////////////////////////////////////////////////
+BatchHandler::BatchHandler(std::vector<std::shared_ptr<JobQuery>> const& jobs) {
+    for (auto const& job : jobs) {
+        _members[job->getIdInt()].job = job;
+    }
+    _remaining = _members.size();
+}
+
+
+std::vector<char>& BatchHandler::nextBuffer() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_current == nullptr) {
+        _header.resize(proto::ProtoHeaderWrap::PROTO_HEADER_SIZE);
+        return _header;
+    }
+    if (_discard) {
+        return _discardBuf;
+    }
+    return _current->job->getDescription()->respHandler()->nextBuffer();
+}
+
+
+size_t BatchHandler::nextBufferSize() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_current == nullptr) {
+        return (_remaining > 0) ? proto::ProtoHeaderWrap::PROTO_HEADER_SIZE : 0;
+    }
+    if (_discard) {
+        return _discardBuf.size();
+    }
+    return _current->job->getDescription()->respHandler()->nextBufferSize();
+}
+
+
+bool BatchHandler::flush(int bLen, bool& last, bool& largeResult) {
+    std::shared_ptr<JobQuery> ended;
+    std::shared_ptr<JobQuery> failed;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_current == nullptr) {
+            if (bLen == 0 && last) {
+                // The worker ended the stream without another message, see
+                // wbase::SendChannel::newSharedStreamChannels().
+                return true;
+            }
+            if (_released) {
+                _setError(ccontrol::MSG_RESULT_ERROR, "Message after the batch released its jobs");
+                return false;
+            }
+            auto response = std::make_shared<proto::WorkerResponse>();
+            if (bLen != static_cast<int>(_header.size())
+                || !proto::ProtoHeaderWrap::unwrap(response, _header)) {
+                _setError(ccontrol::MSG_RESULT_DECODE, "Error decoding proto header of batch");
+                return false;
+            }
+            auto const& header = response->protoHeader;
+            auto iter = header.has_jobid() ? _members.find(header.jobid()) : _members.end();
+            if (iter == _members.end()) {
+                _setError(ccontrol::MSG_RESULT_ERROR, "Message for a job not in the batch, jobId="
+                          + std::to_string(header.jobid()));
+                return false;
+            }
+            Member& member = iter->second;
+            _current = &member;
+            _discard = member.ended;
+            if (!_discard) {
+                // Hand the header over as if it came on a stream of the job's own.
+                auto handler = member.job->getDescription()->respHandler();
+                bool memberLast = false;
+                bool ok = false;
+                if (handler->nextBufferSize() == _header.size()) {
+                    auto& buffer = handler->nextBuffer();
+                    std::copy(_header.begin(), _header.end(), buffer.begin());
+                    ok = handler->flush(bLen, memberLast, largeResult);
+                } else {
+                    handler->errorFlush("Unexpected header in batch", ccontrol::MSG_RESULT_ERROR);
+                }
+                member.job->getStatus()->updateInfo(JobStatus::RESPONSE_DATA);
+                if (!ok) {
+                    member.ended = true;
+                    --_remaining;
+                    _discard = true;
+                    failed = member.job;
+                }
+            }
+            if (_discard) {
+                _discardBuf.resize(header.size());
+            }
+        } else {
+            Member& member = *_current;
+            _current = nullptr;
+            if (_discard) {
+                // The Result of a job that already failed.
+                _discard = false;
+                std::vector<char>().swap(_discardBuf);
+            } else {
+                bool memberLast = false;
+                auto handler = member.job->getDescription()->respHandler();
+                if (!handler->flush(bLen, memberLast, largeResult)) {
+                    member.ended = true;
+                    --_remaining;
+                    failed = member.job;
+                } else if (memberLast) {
+                    member.ended = true;
+                    --_remaining;
+                    ended = member.job;
+                }
+            }
+        }
+        if (_remaining == 0 && _current == nullptr) {
+            last = true;
+        }
+    }
+    // Completing a job may squash the user query, which cancels this batch.
+    if (ended != nullptr) _jobEnded(ended);
+    if (failed != nullptr) _jobFailed(failed);
+    return true;
+}
+
+
+void BatchHandler::errorFlush(std::string const& msg, int code) {
+    LOGS(_log, LOG_LVL_WARN, "BatchHandler error receiving results code=" << code << " msg=" << msg);
+    std::lock_guard<std::mutex> lock(_mtx);
+    _setError(code, msg);
+}
+
+
+bool BatchHandler::deferWhileBacklogged(std::function<bool()> const& resume) {
+    // The jobs all merge into the same result.
+    if (_members.empty()) return false;
+    auto const& handler = _members.begin()->second.job->getDescription()->respHandler();
+    return handler->deferWhileBacklogged(resume);
+}
+
+
+bool BatchHandler::finished() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _remaining == 0;
+}
+
+
+std::ostream& BatchHandler::print(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return os << "BatchHandler(jobs=" << _members.size() << " remaining=" << _remaining << ")";
+}
+
+
+ResponseHandler::Error BatchHandler::getError() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _error;
+}
+
+
+std::vector<std::shared_ptr<JobQuery>> BatchHandler::releaseUnfinished() {
+    std::vector<std::shared_ptr<JobQuery>> jobs;
+    std::lock_guard<std::mutex> lock(_mtx);
+    _released = true;
+    _current = nullptr;
+    for (auto& entry : _members) {
+        Member& member = entry.second;
+        if (!member.ended) {
+            member.ended = true;
+            --_remaining;
+            jobs.push_back(member.job);
+        }
+    }
+    return jobs;
+}
+
+
+/// _mtx must be held.
+void BatchHandler::_setError(int code, std::string const& msg) {
+    LOGS(_log, LOG_LVL_DEBUG, "_setError: code: " << code << ", message: " << msg);
+    _error = Error(code, msg);
+}
+
+
+/// Complete job once everything it sent has been merged.
+void BatchHandler::_jobEnded(std::shared_ptr<JobQuery> const& job) {
+    job->getDescription()->respHandler()->whenMerged([job](bool merged) {
+        if (merged) {
+            job->getStatus()->updateInfo(JobStatus::COMPLETE);
+            job->getMarkCompleteFunc()->operator()(true);
+        } else {
+            _jobFailed(job);
+        }
+    });
+}
+
+
+/// Fail job, whose results could not be merged.
+void BatchHandler::_jobFailed(std::shared_ptr<JobQuery> const& job) {
+    ResponseHandler::Error err = job->getDescription()->respHandler()->getError();
+    LOGS(_log, LOG_LVL_DEBUG, job->getIdStr() << " batched job merge failed " << err.getMsg());
+    job->getStatus()->updateInfo(JobStatus::MERGE_ERROR, err.getCode(), err.getMsg());
+    job->getMarkCompleteFunc()->operator()(false);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// BatchJobQuery
+////////////////////////////////////////////////////////////////////////
+
+/// Called by QueryRequest when the batch is done, successfully or not.
+class BatchJobQuery::CompleteFunc : public MarkCompleteFunc {
+public:
+    CompleteFunc(Executive::Ptr const& executive, int batchId) : MarkCompleteFunc(executive, batchId) {}
+
+    void operator()(bool success) override {
+        auto b = batch.lock();
+        if (b != nullptr) {
+            b->_batchDone();
+        }
+    }
+
+    std::weak_ptr<BatchJobQuery> batch;
+};
+
+
+BatchJobQuery::Ptr BatchJobQuery::newBatchJobQuery(Executive::Ptr const& executive, int batchId,
+        std::string const& worker, std::vector<JobQuery::Ptr> const& jobs, QueryId qid) {
+    if (jobs.empty()) return nullptr;
+    proto::TaskMsg taskMsg;
+    for (auto const& job : jobs) {
+        auto const& payload = job->getDescription()->payload();
+        auto msg = (job == jobs.front()) ? &taskMsg : taskMsg.add_chunkmsg();
+        if (!msg->ParseFromString(payload)) {
+            LOGS(_log, LOG_LVL_WARN, job->getIdStr() << " payload is not a TaskMsg, not batching");
+            return nullptr;
+        }
+    }
+    std::string payload;
+    taskMsg.SerializeToString(&payload);
+
+    auto handler = std::make_shared<BatchHandler>(jobs);
+    auto desc = JobDescription::createWithPayload(qid, batchId, jobs.front()->getDescription()->resource(),
+                                                  handler, payload);
+    auto completeFunc = std::make_shared<CompleteFunc>(executive, batchId);
+    auto batch = std::make_shared<BatchJobQuery>(executive, desc, completeFunc, qid, worker, jobs, handler);
+    completeFunc->batch = batch;
+    batch->_setup();
+    ctrBatches->add();
+    ctrBatchedJobs->add(jobs.size());
+    return batch;
+}
+
+
+BatchJobQuery::BatchJobQuery(Executive::Ptr const& executive, JobDescription::Ptr const& jobDescription,
+                             std::shared_ptr<MarkCompleteFunc> const& markCompleteFunc, QueryId qid,
+                             std::string const& worker, std::vector<JobQuery::Ptr> const& jobs,
+                             BatchHandler::Ptr const& handler)
+    : JobQuery(executive, jobDescription, std::make_shared<JobStatus>(), markCompleteFunc, qid),
+      _worker(worker), _jobs(jobs), _handler(handler) {
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " batch of " << _jobs.size() << " jobs for "
+         << (_worker.empty() ? "redirector" : _worker));
+}
+
+
+bool BatchJobQuery::runJob() {
+    if (_sent.exchange(true)) {
+        LOGS(_log, LOG_LVL_DEBUG, _idStr << " batch is not retried, its jobs are");
+        return false;
+    }
+    auto executive = _executive.lock();
+    if (executive == nullptr) {
+        LOGS(_log, LOG_LVL_ERROR, _idStr << " runJob failed executive==nullptr");
+        return false;
+    }
+    std::lock_guard<std::recursive_mutex> lock(_rmutex);
+    _jobStatus->updateInfo(JobStatus::PROVISION);
+    auto qr = std::make_shared<QueryResource>(shared_from_this());
+    if (executive->xrdSsiProvision(_queryResourcePtr, qr, _worker)) {
+        for (auto const& job : _jobs) {
+            job->getStatus()->updateInfo(JobStatus::REQUEST);
+        }
+        return true;
+    }
+    LOGS(_log, LOG_LVL_WARN, _idStr << " runJob failed to provision, cancelled");
+    return false;
+}
+
+
+bool BatchJobQuery::cancel() {
+    if (_cancelled.exchange(true)) {
+        return false;
+    }
+    // The jobs are cancelled by the Executive. Cancelling the request
+    // completes the batch.
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " BatchJobQuery::cancel()");
+    auto qr = getQueryRequest();
+    if (qr != nullptr) {
+        qr->cancel();
+    }
+    return true;
+}
+
+
+void BatchJobQuery::provisioningFailed(std::string const& msg, int code) {
+    LOGS(_log, LOG_LVL_WARN, _idStr << " batch provisioning failed, msg=" << msg << " code=" << code);
+    _jobStatus->updateInfo(JobStatus::PROVISION_NACK, code, msg);
+    // Running in a separate thread as xrootd is waiting for this one to return.
+    auto batch = std::static_pointer_cast<BatchJobQuery>(shared_from_this());
+    std::thread retryThrd([batch]() { batch->_batchDone(); });
+    retryThrd.detach();
+}
+
+
+/// Run the jobs that did not finish in the batch individually.
+void BatchJobQuery::_batchDone() {
+    auto jobs = _handler->releaseUnfinished();
+    if (jobs.empty()) {
+        LOGS(_log, LOG_LVL_DEBUG, _idStr << " batch done");
+        return;
+    }
+    LOGS(_log, LOG_LVL_INFO, _idStr << " " << jobs.size() << " of " << _jobs.size()
+         << " jobs did not finish in the batch, running them individually");
+    ctrJobsRunAlone->add(jobs.size());
+    for (auto const& job : jobs) {
+        if (!job->runJob()) {
+            // Retry failed, nothing left to try.
+            LOGS(_log, LOG_LVL_DEBUG, job->getIdStr() << " retry of batched job failed");
+            job->getMarkCompleteFunc()->operator()(false);
+        }
+    }
+}
+
+}}} // namespace lsst::qserv::qdisp
@@ -0,0 +1,146 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_BATCHJOBQUERY_H
+#define LSST_QSERV_QDISP_BATCHJOBQUERY_H
+
+// System headers
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "qdisp/JobQuery.h"
+#include "qdisp/ResponseHandler.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// BatchHandler reads the result stream of a BatchJobQuery. Every message
+/// header names the job of the Result that follows, and the header and the
+/// Result are passed to the ResponseHandler of that job, as if they had
+/// come on a stream of its own. A job is complete once its last message
+/// has been merged, and fails, without retry, if its results cannot be
+/// merged, just like a job sent on its own.
+class BatchHandler : public ResponseHandler {
+public:
+    using Ptr = std::shared_ptr<BatchHandler>;
+
+    BatchHandler(std::vector<std::shared_ptr<JobQuery>> const& jobs);
+
+    std::vector<char>& nextBuffer() override;
+    size_t nextBufferSize() override;
+    bool flush(int bLen, bool& last, bool& largeResult) override;
+    void errorFlush(std::string const& msg, int code) override;
+    bool deferWhileBacklogged(std::function<bool()> const& resume) override;
+    bool finished() const override;
+    bool reset() override { return false; } ///< A batch is never retried, its jobs are.
+    std::ostream& print(std::ostream& os) const override;
+    Error getError() const override;
+    /// Each job scrubs its own attempts.
+    bool scrubResults(int jobId, int attempt) override { return true; }
+
+    /// Stop handling the jobs whose results have not ended. Anything that
+    /// arrives for them afterwards is an error.
+    /// @return those jobs.
+    std::vector<std::shared_ptr<JobQuery>> releaseUnfinished();
+
+private:
+    struct Member {
+        std::shared_ptr<JobQuery> job;
+        bool ended{false}; ///< True once the job's last message was read, or it failed.
+    };
+
+    void _setError(int code, std::string const& msg);
+    static void _jobEnded(std::shared_ptr<JobQuery> const& job);
+    static void _jobFailed(std::shared_ptr<JobQuery> const& job);
+
+    mutable std::mutex _mtx; ///< Protects all members.
+    std::map<int, Member> _members; ///< key is job id.
+    int _remaining; ///< Jobs whose results have not ended.
+    bool _released{false};
+    /// Job of the Result being read, nullptr while a header is expected.
+    Member* _current{nullptr};
+    bool _discard{false}; ///< True if the Result being read is of a job that failed.
+    std::vector<char> _header; ///< Buffer for the next message header.
+    std::vector<char> _discardBuf;
+    Error _error;
+};
+
+
+/// BatchJobQuery sends the jobs for several chunks on one worker as a single
+/// request, saving an XrdSsi provisioning, a request and a result stream for
+/// every chunk but one. The request is the TaskMsg of the first job with the
+/// TaskMsgs of the others in its chunkmsg field. The worker runs each chunk
+/// as its own Task and streams all the results back on one channel, read by
+/// a BatchHandler.
+///
+/// The jobs remain ordinary JobQuery objects tracked by the Executive, and
+/// each one completes, or fails, on its own. A batch itself is never
+/// retried: the jobs it did not finish, because the request failed or ended
+/// early, are run again individually with JobQuery::runJob(), which avoids
+/// the batch's worker and scrubs whatever part of their results was merged.
+/// A BatchJobQuery is not tracked by the Executive, and its negative id can
+/// not be mistaken for the id of a job.
+class BatchJobQuery : public JobQuery {
+public:
+    using Ptr = std::shared_ptr<BatchJobQuery>;
+
+    /// @param jobs - jobs whose attempts were prepared with
+    ///               JobQuery::startBatchedAttempt() to run on worker.
+    /// @return the batch, or nullptr if the payloads of jobs could not be
+    ///         combined.
+    static Ptr newBatchJobQuery(Executive::Ptr const& executive, int batchId, std::string const& worker,
+                                std::vector<JobQuery::Ptr> const& jobs, QueryId qid);
+
+    /// Send the request. It is only sent once.
+    bool runJob() override;
+    bool cancel() override;
+    /// Run the jobs individually.
+    void provisioningFailed(std::string const& msg, int code) override;
+
+    size_t getJobCount() const { return _jobs.size(); }
+
+    /// Do not call this directly, use newBatchJobQuery.
+    BatchJobQuery(Executive::Ptr const& executive, JobDescription::Ptr const& jobDescription,
+                  std::shared_ptr<MarkCompleteFunc> const& markCompleteFunc, QueryId qid,
+                  std::string const& worker, std::vector<JobQuery::Ptr> const& jobs,
+                  BatchHandler::Ptr const& handler);
+
+private:
+    class CompleteFunc;
+
+    void _batchDone();
+
+    std::string const _worker; ///< Empty to go through the redirector.
+    std::vector<JobQuery::Ptr> const _jobs;
+    BatchHandler::Ptr const _handler;
+    std::atomic<bool> _sent{false};
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_BATCHJOBQUERY_H
@@ -44,6 +44,8 @@
 #include <deque>
 #include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 
 // Third-party headers
@@ -59,12 +61,16 @@
 #include "ccontrol/msgCode.h"
 #include "global/Bug.h"
 #include "global/ResourceUnit.h"
+#include "qdisp/BatchJobQuery.h"
 #include "qdisp/JobQuery.h"
+#include "qdisp/JobStartExecutor.h"
 #include "qdisp/MessageStore.h"
 #include "qdisp/QueryResource.h"
 #include "qdisp/ResponseHandler.h"
+#include "qdisp/WorkerSelector.h"
 #include "qdisp/XrdSsiMocks.h"
-#include "util/EventThread.h"
+#include "util/Histogram.h"
+#include "util/Tracer.h"
 
 extern XrdSsiProvider *XrdSsiProviderClient;
 
@@ -72,6 +78,18 @@ namespace {
 
 LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.Executive");
 
+using lsst::qserv::util::StatsRegistry;
+auto const histAdd = StatsRegistry::get().histogram("qdisp.Executive.add");
+auto const histAddCancelLock = StatsRegistry::get().histogram("qdisp.Executive.add.cancelLockWait");
+auto const histProvision = StatsRegistry::get().histogram("qdisp.Executive.provision");
+auto const ctrJobsAdded = StatsRegistry::get().counter("qdisp.Executive.jobsAdded");
+auto const ctrSuperfluousSquashes = StatsRegistry::get().counter("qdisp.Executive.superfluousSquashes");
+
+/// XrdSsiService objects for individual workers, shared by all Executives.
+/// XrdSsi services are never released, so neither are these.
+std::mutex workerServicesMtx;
+std::map<std::string, XrdSsiService*> workerServices; ///< key is worker endpoint
+
 std::string getErrorText(XrdSsiErrInfo & e) {
     std::ostringstream os;
     int errCode;
@@ -98,6 +116,8 @@ Executive::Executive(Config::Ptr const& c, std::shared_ptr<MessageStore> const&
 Executive::~Executive() {
     // Real XrdSsiService objects are unowned, but mocks are allocated in _setup.
     delete dynamic_cast<XrdSsiServiceMock *>(_xrdSsiService);
+    // Starts are keyed by address, none may outlive this Executive.
+    JobStartExecutor::get().cancel(this);
 }
 
 
@@ -117,18 +137,16 @@ void Executive::setQueryId(QueryId id) {
 /// Add a new job to executive queue, if not already in. Not thread-safe.
 ///
 JobQuery::Ptr Executive::add(JobDescription::Ptr const& jobDesc) {
-    auto timeDiff = [](std::chrono::time_point<std::chrono::system_clock> const& begin, // TEMPORARY-timing
-            std::chrono::time_point<std::chrono::system_clock> const& end) -> int {
-        auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
-        return diff.count();
-    };
-    auto startQSEA = std::chrono::system_clock::now(); // TEMPORARY-timing
-    std::chrono::time_point<std::chrono::system_clock> cancelLockQSEA, jobQueryQSEA,
-                                                       addJobQSEA, trackQSEA; // TEMPORARY-timing
+    util::HistogramTimer addTimer(histAdd);
+    util::TraceSpan span(_traceId, "Executive::add", "qdisp");
+    if (span.active()) {
+        span.setDetail("jobId=" + std::to_string(jobDesc->id()));
+    }
+    auto lockStart = std::chrono::steady_clock::now();
     JobQuery::Ptr jobQuery;
     {
         std::lock_guard<std::recursive_mutex> lock(_cancelled.getMutex());
-        cancelLockQSEA = std::chrono::system_clock::now(); // // TEMPORARY-timing
+        histAddCancelLock->recordSince(lockStart);
         if (_cancelled) {
             LOGS(_log, LOG_LVL_DEBUG, "Executive already cancelled, ignoring add("
                     << jobDesc->id() << ")");
@@ -139,19 +157,16 @@ JobQuery::Ptr Executive::add(JobDescription::Ptr const& jobDesc) {
         Ptr thisPtr = shared_from_this();
         MarkCompleteFunc::Ptr mcf = std::make_shared<MarkCompleteFunc>(thisPtr, jobDesc->id());
         jobQuery = JobQuery::newJobQuery(thisPtr, jobDesc, jobStatus, mcf, _id);
-        jobQueryQSEA = std::chrono::system_clock::now(); // TEMPORARY-timing
 
         if (!_addJobToMap(jobQuery)) {
             LOGS(_log, LOG_LVL_ERROR, "Executive ignoring duplicate job add " << jobQuery->getIdStr());
             return jobQuery;
         }
-        addJobQSEA = std::chrono::system_clock::now(); // TEMPORARY-timing
 
         if (!_track(jobQuery->getIdInt(), jobQuery)) {
             LOGS(_log, LOG_LVL_ERROR, "Executive ignoring duplicate track add" << jobQuery->getIdStr());
             return jobQuery;
         }
-        trackQSEA = std::chrono::system_clock::now(); // TEMPORARY-timing
 
         if (_empty.exchange(false)) {
             LOGS(_log, LOG_LVL_DEBUG, "Flag _empty set to false by " << jobQuery->getIdStr());
@@ -161,32 +176,100 @@ JobQuery::Ptr Executive::add(JobDescription::Ptr const& jobDesc) {
     std::string msg = "Executive::add " + jobQuery->getIdStr() + " with path=" + jobDesc->resource().path();
     LOGS(_log, LOG_LVL_DEBUG, msg);
     //_messageStore->addMessage(jobDesc.resource().chunk(), ccontrol::MSG_MGR_ADD, msg); TODO: maybe relocate.
-    auto endQSEA = std::chrono::system_clock::now(); // TEMPORARY-timing
-    { // TEMPORARY-timing
-        std::lock_guard<std::mutex> sumLock(sumMtx);
-        cancelLockQSEASum += timeDiff(startQSEA, cancelLockQSEA);
-        jobQueryQSEASum += timeDiff(cancelLockQSEA, jobQueryQSEA);
-        addJobQSEASum += timeDiff(jobQueryQSEA, addJobQSEA);
-        trackQSEASum += timeDiff(addJobQSEA, trackQSEA);
-        endQSEASum += timeDiff(trackQSEA, endQSEA);
-    }
+    ctrJobsAdded->add();
     _queueJobStart(jobQuery);
     return jobQuery;
 }
 
 
 void Executive::_queueJobStart(JobQuery::Ptr const& job) {
-    std::function<void(util::CmdData*)> func = [job](util::CmdData*) {
-        job->runJob();
-    };
-    auto cmd = std::make_shared<util::Command>(func);
-    _startJobsQueue->queCmd(cmd);
+    uint64_t traceId = _traceId;
+    // Only jobs for chunks with known replicas can be batched, the others
+    // go through the redirector.
+    auto const& ru = job->getDescription()->resource();
+    bool batch = _config.chunksPerRequest > 1 && WorkerSelector::get().isEnabled()
+                 && !WorkerSelector::get().getReplicas(ru.db(), ru.chunk()).empty();
+    std::weak_ptr<Executive> weakExec = shared_from_this();
+    JobStartExecutor::get().queue(this, [job, traceId, batch, weakExec]() {
+        util::TraceSpan span(traceId, "JobQuery::runJob", "qdisp");
+        if (span.active()) {
+            span.setDetail(job->getIdStr());
+        }
+        auto exec = weakExec.lock();
+        if (batch && exec != nullptr) {
+            exec->_batchJob(job);
+        } else {
+            job->runJob();
+        }
+    });
+}
+
+
+/// Prepare an attempt of job and add it to the batch for its worker, sending
+/// the batch once it is full.
+void Executive::_batchJob(JobQuery::Ptr const& job) {
+    if (!job->startBatchedAttempt()) {
+        return;
+    }
+    std::string worker = job->getTargetWorker();
+    std::vector<JobQuery::Ptr> jobs;
+    if (worker.empty()) {
+        // Every replica was excluded, send it on its own through the redirector.
+        jobs.push_back(job);
+    } else {
+        std::lock_guard<std::mutex> lock(_batchMtx);
+        auto& open = _openBatches[worker];
+        open.push_back(job);
+        if (static_cast<int>(open.size()) < _config.chunksPerRequest) {
+            return;
+        }
+        jobs.swap(open);
+        _openBatches.erase(worker);
+    }
+    _sendBatch(worker, jobs);
+}
+
+
+void Executive::_sendBatch(std::string const& worker, std::vector<JobQuery::Ptr> const& jobs) {
+    int batchId;
+    {
+        std::lock_guard<std::mutex> lock(_batchMtx);
+        batchId = -(++_batchCount); // Never the id of a job.
+    }
+    auto batch = BatchJobQuery::newBatchJobQuery(shared_from_this(), batchId, worker, jobs, _id);
+    if (batch == nullptr) {
+        // The attempts were prepared, retrying them starts new ones.
+        for (auto const& job : jobs) {
+            job->runJob();
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_batchMtx);
+        _batches.push_back(batch);
+    }
+    LOGS(_log, LOG_LVL_DEBUG, getIdStr() << " sending " << jobs.size() << " jobs in batch "
+         << batchId << " to " << (worker.empty() ? "redirector" : worker));
+    batch->runJob();
+}
+
+
+/// Send the batches that are not full, once no more jobs will be added.
+void Executive::_sendOpenBatches() {
+    std::map<std::string, std::vector<JobQuery::Ptr>> openBatches;
+    {
+        std::lock_guard<std::mutex> lock(_batchMtx);
+        openBatches.swap(_openBatches);
+    }
+    for (auto const& entry : openBatches) {
+        _sendBatch(entry.first, entry.second);
+    }
 }
 
 
 void Executive::waitForAllJobsToStart() {
-    _startJobsPool->endAll();
-    _startJobsPool->waitForResize(0); // No time limit.
+    JobStartExecutor::get().waitFor(this); // No time limit.
+    _sendOpenBatches();
 }
 
 
@@ -194,17 +277,47 @@ void Executive::waitForAllJobsToStart() {
 /// sets jobQueryResource = sourceQR.
 /// @return true if Provision was called and sets jobQueryResource = sourceQR.
 bool Executive::xrdSsiProvision(std::shared_ptr<QueryResource> &jobQueryResource,
-                                std::shared_ptr<QueryResource> const& sourceQR) {
+                                std::shared_ptr<QueryResource> const& sourceQR,
+                                std::string const& worker) {
+    XrdSsiService* service = worker.empty() ? nullptr : _getWorkerService(worker);
+    if (service == nullptr) {
+        service = getXrdSsiService(); // Let the redirector route it.
+    }
     std::lock_guard<std::recursive_mutex> lock(_cancelled.getMutex());
     if (!_cancelled) {
         jobQueryResource = sourceQR;
-        getXrdSsiService()->Provision(jobQueryResource.get());
+        util::HistogramTimer provisionTimer(histProvision);
+        service->Provision(jobQueryResource.get());
         return true;
     }
     return false;
 }
 
 
+/// @return the XrdSsiService addressing worker directly, or nullptr if one
+///         could not be obtained. Unit tests always get the mock service.
+XrdSsiService* Executive::_getWorkerService(std::string const& worker) {
+    if (_config.serviceUrl.compare(_config.getMockStr()) == 0) {
+        return _xrdSsiService;
+    }
+    std::string const endpoint = WorkerSelector::get().getEndpoint(worker);
+    std::lock_guard<std::mutex> lock(workerServicesMtx);
+    auto iter = workerServices.find(endpoint);
+    if (iter != workerServices.end()) {
+        return iter->second;
+    }
+    XrdSsiErrInfo eInfo;
+    XrdSsiService* service = XrdSsiProviderClient->GetService(eInfo, endpoint.c_str());
+    if (service == nullptr) {
+        LOGS(_log, LOG_LVL_WARN, _idStr << " no XrdSsiService for " << endpoint << " "
+             << getErrorText(eInfo) << ", using redirector");
+        return nullptr; // Not cached so a later job can try again.
+    }
+    workerServices[endpoint] = service;
+    return service;
+}
+
+
 /// Add a JobQuery to this Executive.
 /// Return true if it was successfully added to the map.
 ///
@@ -238,8 +351,16 @@ bool Executive::join() {
         LOGS(_log, LOG_LVL_ERROR, "Query execution failed: " << _requestCount
              << " jobs dispatched, but only " << sCount << " jobs completed");
     }
-    _updateProxyMessages();
     bool empty = (sCount == _requestCount);
+    if (!empty && _superfluous) {
+        // Jobs were squashed once the result was complete, which is only a
+        // success if nothing failed before that.
+        std::lock_guard<std::mutex> lock(_errorsMutex);
+        empty = _multiError.empty();
+        LOGS(_log, LOG_LVL_DEBUG, "Query complete before all jobs: " << sCount
+             << " of " << _requestCount << " jobs completed, errors=" << _multiError.size());
+    }
+    _updateProxyMessages();
     _empty.store(empty);
     LOGS(_log, LOG_LVL_DEBUG, "Flag set to _empty=" << empty << ", sCount=" << sCount
          << ", requestCount=" << _requestCount);
@@ -251,6 +372,28 @@ void Executive::markCompleted(int jobId, bool success) {
     std::string idStr = QueryIdHelper::makeIdStr(_id, jobId);
     LOGS(_log, LOG_LVL_DEBUG, "Executive::markCompleted " << idStr
             << " " << success);
+    JobQuery::Ptr job;
+    {
+        std::lock_guard<std::recursive_mutex> lock(_jobsMutex);
+        auto iter = _jobMap.find(jobId);
+        if (iter != _jobMap.end()) job = iter->second;
+    }
+    if (job != nullptr) {
+        job->dispatchDone(success);
+    }
+    if (!success && _superfluous) {
+        // Cancelled because the result no longer needs it.
+        {
+            std::lock_guard<std::recursive_mutex> lock(_jobsMutex);
+            auto iter = _jobMap.find(jobId);
+            if (iter != _jobMap.end()) {
+                iter->second->getStatus()->updateInfo(JobStatus::CANCEL);
+            }
+        }
+        LOGS(_log, LOG_LVL_DEBUG, "Executive: " << idStr << " squashed as superfluous");
+        _unTrack(jobId);
+        return;
+    }
     if (!success) {
         {
             std::lock_guard<std::mutex> lock(_incompleteJobsMutex);
@@ -293,6 +436,18 @@ void Executive::markCompleted(int jobId, bool success) {
 }
 
 
+void Executive::notifyOnComplete(std::function<void()> const& onComplete) {
+    {
+        std::lock_guard<std::mutex> lock(_incompleteJobsMutex);
+        if (!_incompleteJobs.empty()) {
+            _onComplete.push_back(onComplete);
+            return;
+        }
+    }
+    onComplete();
+}
+
+
 void Executive::squash() {
     bool alreadyCancelled = _cancelled.exchange(true);
     if (alreadyCancelled) {
@@ -301,6 +456,8 @@ void Executive::squash() {
     }
 
     LOGS(_log, LOG_LVL_DEBUG, getIdStr() << " Executive::squash Trying to cancel all queries...");
+    // Jobs that have not started are cancelled without being started.
+    JobStartExecutor::get().cancel(this);
     std::deque<JobQuery::Ptr> jobsToCancel;
     {
         std::lock_guard<std::recursive_mutex> lock(_jobsMutex);
@@ -309,17 +466,44 @@ void Executive::squash() {
         }
     }
 
+    std::vector<std::shared_ptr<BatchJobQuery>> batchesToCancel;
+    {
+        std::lock_guard<std::mutex> lock(_batchMtx);
+        batchesToCancel = _batches;
+    }
+
     for (auto const& job : jobsToCancel) {
         job->cancel();
     }
+    for (auto const& batch : batchesToCancel) {
+        batch->cancel();
+    }
     LOGS_DEBUG(getIdStr() << " Executive::squash done");
 }
 
+void Executive::squashSuperfluous() {
+    if (_cancelled) {
+        LOGS(_log, LOG_LVL_DEBUG, getIdStr() << " Executive::squashSuperfluous() already cancelled");
+        return;
+    }
+    LOGS(_log, LOG_LVL_INFO, getIdStr() << " Executive::squashSuperfluous result complete, "
+         << getNumInflight() << " jobs in flight");
+    _superfluous = true;
+    ctrSuperfluousSquashes->add();
+    squash();
+}
+
 int Executive::getNumInflight() {
     std::unique_lock<std::mutex> lock(_incompleteJobsMutex);
     return _incompleteJobs.size();
 }
 
+double Executive::getCompletedFraction() {
+    std::lock_guard<std::mutex> lock(_incompleteJobsMutex);
+    if (_trackedCount == 0) return 0.0;
+    return static_cast<double>(_trackedCount - _incompleteJobs.size()) / _trackedCount;
+}
+
 std::string Executive::getProgressDesc() const {
     std::ostringstream os;
     {
@@ -377,6 +561,7 @@ bool Executive::_track(int jobId, std::shared_ptr<JobQuery> const& r) {
             return false;
         }
         _incompleteJobs[jobId] = r;
+        ++_trackedCount;
         size = _incompleteJobs.size();
     }
     LOGS(_log, LOG_LVL_DEBUG, "Success TRACKING " << idStr << " size=" << size);
@@ -386,13 +571,17 @@ bool Executive::_track(int jobId, std::shared_ptr<JobQuery> const& r) {
 void Executive::_unTrack(int jobId) {
     bool untracked = false;
     std::string s;
+    std::vector<std::function<void()>> onComplete;
     {
         std::lock_guard<std::mutex> lock(_incompleteJobsMutex);
         auto i = _incompleteJobs.find(jobId);
         if (i != _incompleteJobs.end()) {
             _incompleteJobs.erase(i);
             untracked = true;
-            if (_incompleteJobs.empty()) _allJobsComplete.notify_all();
+            if (_incompleteJobs.empty()) {
+                _allJobsComplete.notify_all();
+                onComplete.swap(_onComplete);
+            }
         }
         if (!untracked || LOG_CHECK_LVL(_log, LOG_LVL_DEBUG)) {
             // Log up to 5 incomplete jobs. Very useful when jobs do not finish.
@@ -402,6 +591,9 @@ void Executive::_unTrack(int jobId) {
     LOGS(_log, (untracked ? LOG_LVL_DEBUG : LOG_LVL_WARN),
          "Executive UNTRACKING " << QueryIdHelper::makeIdStr(_id, jobId)
              << " " << (untracked ? "success":"failed") << "::" << s);
+    for (auto const& func : onComplete) {
+        func();
+    }
 }
 
 
@@ -28,6 +28,9 @@
 
 // System headers
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <mutex>
 #include <sstream>
 #include <unordered_map>
@@ -40,7 +43,6 @@
 #include "qdisp/JobDescription.h"
 #include "qdisp/JobStatus.h"
 #include "qdisp/ResponseHandler.h"
-#include "util/EventThread.h"
 #include "util/InstanceCount.h"
 #include "util/MultiError.h"
 #include "util/threadSafe.h"
@@ -52,6 +54,7 @@ namespace lsst {
 namespace qserv {
 namespace qdisp {
 
+class BatchJobQuery;
 class JobQuery;
 class LargeResultMgr;
 class MessageStore;
@@ -72,6 +75,9 @@ public:
         Config(int,int) : serviceUrl(getMockStr()) {}
 
         std::string serviceUrl; ///< XrdSsi service URL, e.g. localhost:1094
+        /// Maximum number of jobs sent to a worker in one BatchJobQuery,
+        /// 1 or less to send every job on its own.
+        int chunksPerRequest{1};
         static std::string getMockStr() {return "Mock";};
     };
 
@@ -87,8 +93,9 @@ public:
     std::shared_ptr<JobQuery> add(JobDescription::Ptr const& s);
 
 
-    /// Waits for all jobs on _startJobsPool to start. This should not be called
-    /// before ALL jobs have been added to the pool.
+    /// Waits for all jobs on the JobStartExecutor to start, and sends the batches
+    /// that are not full. This should not be called before ALL jobs have been
+    /// added.
     void waitForAllJobsToStart();
 
 
@@ -96,23 +103,43 @@ public:
     /// @return true if execution was successful
     bool join();
 
+    /// Call onComplete, once, when all the jobs added so far are complete,
+    /// right away if they are, so that join() returns without waiting.
+    /// Otherwise it is called on the thread that completes the last job.
+    void notifyOnComplete(std::function<void()> const& onComplete);
+
     /// Notify the executive that an item has completed
     void markCompleted(int refNum, bool success);
 
     /// Squash all the jobs.
     void squash();
 
+    /// Squash the jobs that are still running because the result is already
+    /// complete, as when enough rows have been merged for a LIMIT. Jobs
+    /// cancelled this way are not errors and join() reports success.
+    void squashSuperfluous();
+
+    /// @return true if the remaining jobs were squashed as superfluous.
+    bool getSuperfluous() const { return _superfluous; }
+
     bool getEmpty() { return _empty; }
 
     void setQueryId(QueryId id);
     QueryId getId() const { return _id; }
     std::string const& getIdStr() const { return _idStr; }
 
+    /// Set the util::Tracer trace id for this query, 0 if it is not traced.
+    void setTraceId(uint64_t traceId) { _traceId = traceId; }
+    uint64_t getTraceId() const { return _traceId; }
+
     std::shared_ptr<JobQuery> getJobQuery(int id);
 
     /// @return number of items in flight.
     int getNumInflight(); // non-const, requires a mutex.
 
+    /// @return the fraction of the jobs added so far that are complete.
+    double getCompletedFraction();
+
     /// @return a description of the current execution progress.
     std::string getProgressDesc() const;
 
@@ -123,23 +150,22 @@ public:
 
     std::shared_ptr<LargeResultMgr> getLargeResultMgr() { return _largeResultMgr; }
 
+    /// @param worker - host to send the job to, empty to go through the redirector.
     bool xrdSsiProvision(std::shared_ptr<QueryResource> &jobQueryResource,
-                         std::shared_ptr<QueryResource> const& sourceQr);
-
-    std::mutex sumMtx; // TEMPORARY-timing
-    int cancelLockQSEASum{0}; // TEMPORARY-timing
-    int jobQueryQSEASum{0}; // TEMPORARY-timing
-    int addJobQSEASum{0}; // TEMPORARY-timing
-    int trackQSEASum{0}; // TEMPORARY-timing
-    int endQSEASum{0}; // TEMPORARY-timing
+                         std::shared_ptr<QueryResource> const& sourceQr,
+                         std::string const& worker=std::string());
 
 private:
     Executive(Config::Ptr const& c, std::shared_ptr<MessageStore> const& ms,
               std::shared_ptr<LargeResultMgr> const& largeResultMgr);
 
     void _setup();
+    XrdSsiService* _getWorkerService(std::string const& worker);
 
     void _queueJobStart(std::shared_ptr<JobQuery> const& job);
+    void _batchJob(std::shared_ptr<JobQuery> const& job);
+    void _sendBatch(std::string const& worker, std::vector<std::shared_ptr<JobQuery>> const& jobs);
+    void _sendOpenBatches();
     bool _track(int refNum, std::shared_ptr<JobQuery> const& r);
     void _unTrack(int refNum);
     bool _addJobToMap(std::shared_ptr<JobQuery> const& job);
@@ -158,6 +184,7 @@ private:
     XrdSsiService* _xrdSsiService; ///< RPC interface
     JobMap _jobMap; ///< Contains information about all jobs.
     JobMap _incompleteJobs; ///< Map of incomplete jobs.
+    int _trackedCount{0}; ///< Number of jobs ever tracked, protected by _incompleteJobsMutex.
     std::shared_ptr<LargeResultMgr> _largeResultMgr;
 
     /** Execution errors */
@@ -165,6 +192,7 @@ private:
 
     int _requestCount; ///< Count of submitted jobs
     util::Flag<bool> _cancelled {false}; ///< Has execution been cancelled.
+    std::atomic<bool> _superfluous{false}; ///< Were remaining jobs cancelled as not needed.
 
     // Mutexes
     std::mutex _incompleteJobsMutex; ///< protect incompleteJobs map.
@@ -173,14 +201,20 @@ private:
     mutable std::mutex _errorsMutex;
 
     std::condition_variable _allJobsComplete;
+    /// Called once _incompleteJobs is empty, protected by _incompleteJobsMutex.
+    std::vector<std::function<void()>> _onComplete;
     mutable std::recursive_mutex _jobsMutex;
 
     QueryId _id{0}; ///< Unique identifier for this query.
     std::string    _idStr{QueryIdHelper::makeIdStr(0, true)};
+    uint64_t _traceId{0}; ///< util::Tracer trace id, 0 if not traced.
     util::InstanceCount _instC{"Executive"};
 
-    util::CommandQueue::Ptr _startJobsQueue{std::make_shared<util::CommandQueue>()};
-    util::ThreadPool::Ptr _startJobsPool{util::ThreadPool::newThreadPool(10, _startJobsQueue)};
+    std::mutex _batchMtx; ///< Protects _openBatches, _batches and _batchCount.
+    /// Jobs waiting to be sent together, key is worker.
+    std::map<std::string, std::vector<std::shared_ptr<JobQuery>>> _openBatches;
+    std::vector<std::shared_ptr<BatchJobQuery>> _batches; ///< Batches sent, for squash().
+    int _batchCount{0};
 };
 
 class MarkCompleteFunc {
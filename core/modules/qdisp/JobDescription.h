@@ -69,6 +69,18 @@ public:
         return jd;
     }
 
+    /// @return a description of a request whose payload is built by the
+    ///         caller, as for a BatchJobQuery. It has a single attempt, and
+    ///         incrAttemptCountScrubResults() must not be called.
+    static JobDescription::Ptr createWithPayload(QueryId qId, int jobId, ResourceUnit const& resource,
+                std::shared_ptr<ResponseHandler> const& respHandler, std::string const& payload) {
+        JobDescription::Ptr jd(new JobDescription(qId, jobId, resource, respHandler,
+                                                  nullptr, nullptr, std::string()));
+        jd->_attemptCount = 0;
+        jd->_payloads[0] = payload;
+        return jd;
+    }
+
     JobDescription(JobDescription const&) = delete;
     JobDescription& operator=(JobDescription const&) = delete;
 
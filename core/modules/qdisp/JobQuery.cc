@@ -35,6 +35,7 @@
 #include "qdisp/Executive.h"
 #include "qdisp/QueryRequest.h"
 #include "qdisp/QueryResource.h"
+#include "qdisp/WorkerSelector.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.JobQuery");
@@ -59,6 +60,9 @@ JobQuery::JobQuery(Executive::Ptr const& executive, JobDescription::Ptr const& j
 
 JobQuery::~JobQuery() {
     LOGS(_log, LOG_LVL_DEBUG, "~JobQuery " << _idStr);
+    if (!_targetWorker.empty()) {
+        WorkerSelector::get().jobAbandoned(_targetWorker);
+    }
 }
 
 /** Attempt to run the job on a worker.
@@ -71,45 +75,80 @@ bool JobQuery::runJob() {
         LOGS(_log, LOG_LVL_ERROR, _idStr << "runJob failed executive==nullptr");
         return false;
     }
+    std::lock_guard<std::recursive_mutex> lock(_rmutex);
+    if (!_nextAttempt(executive)) {
+        return false;
+    }
+    auto qr = std::make_shared<QueryResource>(shared_from_this());
+    _jobStatus->updateInfo(JobStatus::PROVISION);
+    _selectWorker();
+
+    // To avoid a cancellation race condition, _queryResourcePtr = qr if and
+    // only if the executive has not already been cancelled. The cancellation
+    // procedure changes significantly once the executive calls xrootd's Provision().
+    // The only way xrdSsiProvision can fail is if the user query is cancelled.
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob try to provision");
+    if (executive->xrdSsiProvision(_queryResourcePtr, qr, getTargetWorker())) return true;
+    _releaseWorker(false);
+    LOGS(_log, LOG_LVL_WARN, _idStr << " runJob failed to provision, cancelled");
+    return false;
+}
+
+
+/// Prepare the next attempt of the job to be sent by a BatchJobQuery instead
+/// of runJob(). The worker is chosen the same way.
+/// @return false if the job can not setup or the maximum number of attempts has been reached.
+bool JobQuery::startBatchedAttempt() {
+    auto executive = _executive.lock();
+    if (executive == nullptr) {
+        LOGS(_log, LOG_LVL_ERROR, _idStr << "startBatchedAttempt failed executive==nullptr");
+        return false;
+    }
+    std::lock_guard<std::recursive_mutex> lock(_rmutex);
+    if (!_nextAttempt(executive)) {
+        return false;
+    }
+    _jobStatus->updateInfo(JobStatus::PROVISION);
+    _selectWorker();
+    return true;
+}
+
+
+/// Reset the response handler and build the payload of the next attempt,
+/// scrubbing the results of the previous one. _rmutex must be held.
+/// @return false if there is no next attempt, squashing the user query
+///         unless it was already cancelled.
+bool JobQuery::_nextAttempt(Executive::Ptr const& executive) {
     bool cancelled = executive->getCancelled();
     bool handlerReset = _jobDescription->respHandler()->reset();
-    if (!cancelled && handlerReset) {
-        auto criticalErr = [this, &executive](std::string const& msg) {
-            LOGS(_log, LOG_LVL_ERROR, _idStr << " " << msg << " "
-                 << _jobDescription << " Canceling user query!");
-            executive->squash(); // This should kill all jobs in this user query.
-        };
-
-        LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob checking attempt=" << _jobDescription->getAttemptCount());
-        auto qr = std::make_shared<QueryResource>(shared_from_this());
-        std::lock_guard<std::recursive_mutex> lock(_rmutex);
-        if (_jobDescription->getAttemptCount() < _getMaxAttempts()) {
-            bool okCount = _jobDescription->incrAttemptCountScrubResults();
-            if (!okCount) {
-                criticalErr("hit structural max of retries");
-                return false;
-            }
-            if (!_jobDescription->verifyPayload()) {
-                criticalErr("bad payload");
-                return false;
-            }
-        } else {
-            LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob max retries");
-            criticalErr("hit maximum number of retries");
+    if (cancelled || !handlerReset) {
+        LOGS(_log, LOG_LVL_WARN, _idStr << " runJob failed. cancelled=" << cancelled
+             << " reset=" << handlerReset);
+        return false;
+    }
+    auto criticalErr = [this, &executive](std::string const& msg) {
+        LOGS(_log, LOG_LVL_ERROR, _idStr << " " << msg << " "
+             << _jobDescription << " Canceling user query!");
+        executive->squash(); // This should kill all jobs in this user query.
+    };
+
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob checking attempt=" << _jobDescription->getAttemptCount());
+    if (_jobDescription->getAttemptCount() < _getMaxAttempts()) {
+        bool okCount = _jobDescription->incrAttemptCountScrubResults();
+        if (!okCount) {
+            criticalErr("hit structural max of retries");
             return false;
         }
-        _jobStatus->updateInfo(JobStatus::PROVISION);
-
-        // To avoid a cancellation race condition, _queryResourcePtr = qr if and
-        // only if the executive has not already been cancelled. The cancellation
-        // procedure changes significantly once the executive calls xrootd's Provision().
-        // The only way xrdSsiProvision can fail is if the user query is cancelled.
-        LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob try to provision");
-        if (executive->xrdSsiProvision(_queryResourcePtr, qr)) return true;
+        if (!_jobDescription->verifyPayload()) {
+            criticalErr("bad payload");
+            return false;
+        }
+    } else {
+        LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob max retries");
+        criticalErr("hit maximum number of retries");
+        return false;
     }
-    LOGS(_log, LOG_LVL_WARN, _idStr << " runJob failed. cancelled=" << cancelled
-              << " reset=" << handlerReset);
-    return false;
+    return true;
 }
 
 void JobQuery::provisioningFailed(std::string const& msg, int code) {
@@ -168,6 +207,45 @@ bool JobQuery::cancel() {
 }
 
 
+/// Choose the worker for this attempt. A previous attempt that is being
+/// retried counts as a failure on its worker, and the new attempt avoids
+/// workers already tried.
+void JobQuery::_selectWorker() {
+    _releaseWorker(false);
+    auto const& ru = _jobDescription->resource();
+    std::lock_guard<std::mutex> lock(_workerMtx);
+    _targetWorker = WorkerSelector::get().select(ru.db(), ru.chunk(), _triedWorkers);
+    if (!_targetWorker.empty()) {
+        _triedWorkers.insert(_targetWorker);
+        _dispatchTime = std::chrono::steady_clock::now();
+        WorkerSelector::get().jobStarted(_targetWorker);
+    }
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " target worker="
+         << (_targetWorker.empty() ? "redirector" : _targetWorker));
+}
+
+
+void JobQuery::_releaseWorker(bool success) {
+    std::lock_guard<std::mutex> lock(_workerMtx);
+    if (_targetWorker.empty()) return;
+    auto& selector = WorkerSelector::get();
+    if (success) {
+        selector.jobFinished(_targetWorker, std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - _dispatchTime));
+    } else if (_cancelled || isQueryCancelled()) {
+        selector.jobAbandoned(_targetWorker); // Not the worker's fault.
+    } else {
+        selector.jobFailed(_targetWorker);
+    }
+    _targetWorker.clear();
+}
+
+
+void JobQuery::dispatchDone(bool success) {
+    _releaseWorker(success);
+}
+
+
 /// Reset the QueryResource pointer, but only if called by the current QueryResource.
 void JobQuery::freeQueryResource(QueryResource* qr) {
     std::lock_guard<std::recursive_mutex> lock(_rmutex);
@@ -28,8 +28,11 @@
 
 // System headers
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <set>
+#include <string>
 
 // Qserv headers
 #include "qdisp/Executive.h"
@@ -63,6 +66,10 @@ public:
     virtual ~JobQuery();
     virtual bool runJob();
 
+    /// Prepare the next attempt to be sent as part of a BatchJobQuery.
+    /// @return false if the job cannot be run again.
+    bool startBatchedAttempt();
+
     int getIdInt() const { return _jobDescription->id(); }
     std::string const& getIdStr() const { return _idStr; }
     JobDescription::Ptr getDescription() { return _jobDescription; }
@@ -79,7 +86,7 @@ public:
 
     std::shared_ptr<MarkCompleteFunc> getMarkCompleteFunc() { return _markCompleteFunc; }
 
-    bool cancel();
+    virtual bool cancel();
     bool isQueryCancelled();
 
     void freeQueryResource(QueryResource* qr);
@@ -88,12 +95,23 @@ public:
 
     std::shared_ptr<LargeResultMgr> getLargeResultMgr() { return _largeResultMgr; }
 
-    void provisioningFailed(std::string const& msg, int code);
+    virtual void provisioningFailed(std::string const& msg, int code);
     std::shared_ptr<QueryResource> getQueryResource() {
         std::lock_guard<std::recursive_mutex> lock(_rmutex);
         return _queryResourcePtr;
     }
 
+    /// Called by the executive when the job is complete. Records the outcome
+    /// against the worker the job was sent to, if one was chosen.
+    void dispatchDone(bool success);
+
+    /// @return the worker the current attempt was sent to, empty if it went
+    ///         through the redirector.
+    std::string getTargetWorker() const {
+        std::lock_guard<std::mutex> lock(_workerMtx);
+        return _targetWorker;
+    }
+
     friend std::ostream& operator<<(std::ostream& os, JobQuery const& jq);
 
     /// Make a copy of the job description. JobQuery::_setup() must be called after creation.
@@ -111,6 +129,10 @@ protected:
         std::lock_guard<std::recursive_mutex> lock(_rmutex);
         return _jobDescription->getAttemptCount();
     }
+    bool _nextAttempt(Executive::Ptr const& executive);
+    void _selectWorker();
+    void _releaseWorker(bool success);
+
     int _getMaxAttempts() const { return 5; } // Arbitrary value until solid value with reason determined.
     int _getAttemptSleepSeconds() const { return 30; } // As above or until added to config file.
 
@@ -140,6 +162,12 @@ protected:
     util::InstanceCount _instC{"JobQuery"};
 
     std::shared_ptr<LargeResultMgr> _largeResultMgr;
+
+    // Worker selection, see WorkerSelector.
+    mutable std::mutex _workerMtx; ///< protects _targetWorker, _triedWorkers, _dispatchTime
+    std::string _targetWorker; ///< Worker of the current attempt, empty for the redirector.
+    std::set<std::string> _triedWorkers; ///< Workers chosen by earlier attempts.
+    std::chrono::steady_clock::time_point _dispatchTime;
 };
 
 }}} // end namespace
@@ -0,0 +1,196 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/JobStartExecutor.h"
+
+// System headers
+#include <algorithm>
+#include <chrono>
+#include <deque>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.JobStartExecutor");
+
+using lsst::qserv::util::StatsRegistry;
+auto const histQueueWait = StatsRegistry::get().histogram("qdisp.JobStartExecutor.queueWait");
+auto const ctrDropped = StatsRegistry::get().counter("qdisp.JobStartExecutor.dropped");
+
+/// A job start, and the query it belongs to.
+class StartCmd : public lsst::qserv::util::Command {
+public:
+    StartCmd(std::function<void(lsst::qserv::util::CmdData*)> func, void const* key_)
+        : Command(func), key(key_) {}
+    void const* const key;
+};
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// Queue handing out the starts of the queries in turn. Commands that are
+/// not a StartCmd, like the ones ending pool threads, form a query of their own.
+class JobStartExecutor::Queue : public util::CommandQueue {
+public:
+    void queCmd(util::Command::Ptr const& cmd) override {
+        auto startCmd = std::dynamic_pointer_cast<StartCmd>(cmd);
+        void const* key = (startCmd == nullptr) ? nullptr : startCmd->key;
+        std::lock_guard<std::mutex> lock(_mx);
+        auto& cmds = _queries[key];
+        if (cmds.empty()) {
+            _order.push_back(key);
+        }
+        cmds.push_back(cmd);
+        notify(false);
+    }
+
+    util::Command::Ptr getCmd(bool wait=true) override {
+        std::unique_lock<std::mutex> lock(_mx);
+        if (wait) {
+            _cv.wait(lock, [this](){ return !_order.empty(); });
+        }
+        if (_order.empty()) {
+            return nullptr;
+        }
+        void const* key = _order.front();
+        _order.pop_front();
+        auto iter = _queries.find(key);
+        auto cmd = iter->second.front();
+        iter->second.pop_front();
+        if (iter->second.empty()) {
+            _queries.erase(iter);
+        } else {
+            _order.push_back(key); // Its next start waits for the other queries.
+        }
+        return cmd;
+    }
+
+    /// @return the number of commands of key removed from the queue.
+    int drop(void const* key) {
+        std::lock_guard<std::mutex> lock(_mx);
+        auto iter = _queries.find(key);
+        if (iter == _queries.end()) {
+            return 0;
+        }
+        int count = iter->second.size();
+        _queries.erase(iter);
+        _order.erase(std::remove(_order.begin(), _order.end(), key), _order.end());
+        return count;
+    }
+
+private:
+    std::map<void const*, std::deque<util::Command::Ptr>> _queries; ///< Protected by _mx.
+    std::deque<void const*> _order; ///< Queries with queued commands, in turn. Protected by _mx.
+};
+
+
+JobStartExecutor& JobStartExecutor::get() {
+    static JobStartExecutor executor;
+    return executor;
+}
+
+
+void JobStartExecutor::configure(int threads) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _threads = std::max(1, threads);
+    if (_pool != nullptr) {
+        _pool->resize(_threads);
+    }
+    LOGS(_log, LOG_LVL_INFO, "job start threads=" << _threads);
+}
+
+
+/// Create the pool if it does not exist yet. _mtx must be held.
+void JobStartExecutor::_startPool() {
+    if (_pool == nullptr) {
+        _queue = std::make_shared<Queue>();
+        _pool = util::ThreadPool::newThreadPool(_threads, _queue);
+    }
+}
+
+
+void JobStartExecutor::queue(void const* key, std::function<void()> const& func) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _startPool();
+    ++_pending[key];
+    auto queuedTime = std::chrono::steady_clock::now();
+    auto cmd = std::make_shared<StartCmd>([this, key, func, queuedTime](util::CmdData*) {
+        histQueueWait->recordSince(queuedTime);
+        func();
+        _finished(key);
+    }, key);
+    _queue->queCmd(cmd);
+}
+
+
+int JobStartExecutor::cancel(void const* key) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_queue == nullptr) {
+        return 0;
+    }
+    // Holding _mtx keeps the dropped count and _pending consistent.
+    int dropped = _queue->drop(key);
+    if (dropped > 0) {
+        LOGS(_log, LOG_LVL_DEBUG, "dropped " << dropped << " job starts of " << key);
+        ctrDropped->add(dropped);
+        auto iter = _pending.find(key);
+        if (iter != _pending.end() && (iter->second -= dropped) <= 0) {
+            _pending.erase(iter);
+        }
+        _pendingCv.notify_all();
+    }
+    return dropped;
+}
+
+
+void JobStartExecutor::waitFor(void const* key) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    _pendingCv.wait(lock, [this, key](){ return _pending.find(key) == _pending.end(); });
+}
+
+
+int JobStartExecutor::getPending(void const* key) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _pending.find(key);
+    return (iter == _pending.end()) ? 0 : iter->second;
+}
+
+
+void JobStartExecutor::_finished(void const* key) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _pending.find(key);
+    if (iter != _pending.end() && --(iter->second) <= 0) {
+        _pending.erase(iter);
+        _pendingCv.notify_all();
+    }
+}
+
+}}} // namespace lsst::qserv::qdisp
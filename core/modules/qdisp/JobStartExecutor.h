@@ -0,0 +1,92 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_JOBSTARTEXECUTOR_H
+#define LSST_QSERV_QDISP_JOBSTARTEXECUTOR_H
+
+// System headers
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Qserv headers
+#include "util/EventThread.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// JobStartExecutor starts the jobs of all user queries on one czar-wide
+/// pool of threads, instead of a pool per Executive that is created and torn
+/// down with every query.
+///
+/// Starts are queued per user query, keyed by its Executive, and the threads
+/// take them from the queries in turn, so a query with many chunks does not
+/// hold back the jobs of the queries submitted after it. The starts still
+/// queued for a squashed query are dropped with cancel().
+class JobStartExecutor {
+public:
+    static JobStartExecutor& get();
+
+    JobStartExecutor(JobStartExecutor const&) = delete;
+    JobStartExecutor& operator=(JobStartExecutor const&) = delete;
+
+    /// @param threads - number of job start threads, at least 1.
+    void configure(int threads);
+
+    /// Queue func to run on a job start thread on behalf of the query
+    /// identified by key.
+    void queue(void const* key, std::function<void()> const& func);
+
+    /// Drop the starts of the query identified by key that have not begun.
+    /// @return the number of starts dropped.
+    int cancel(void const* key);
+
+    /// Wait until every start queued for the query identified by key has
+    /// run or been dropped.
+    void waitFor(void const* key);
+
+    /// @return the number of starts of the query identified by key that are
+    ///         queued or running.
+    int getPending(void const* key) const;
+
+private:
+    class Queue;
+
+    JobStartExecutor() = default;
+
+    void _startPool();
+    void _finished(void const* key);
+
+    mutable std::mutex _mtx; ///< Protects all members.
+    std::condition_variable _pendingCv; ///< Notified when a query has fewer pending starts.
+    std::shared_ptr<Queue> _queue;
+    util::ThreadPool::Ptr _pool;
+    int _threads{10};
+    std::map<void const*, int> _pending; ///< Only queries with pending starts have entries.
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_JOBSTARTEXECUTOR_H
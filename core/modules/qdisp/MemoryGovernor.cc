@@ -0,0 +1,136 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/MemoryGovernor.h"
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.MemoryGovernor");
+
+using lsst::qserv::util::StatsRegistry;
+auto const ctrDeferrals = StatsRegistry::get().counter("qdisp.MemoryGovernor.deferrals");
+
+/// Fraction of its jobs a query must have completed to use the reserve.
+double const NEARLY_COMPLETE = 0.9;
+/// Fraction of the budget reserved for nearly complete queries.
+double const RESERVE = 0.2;
+}
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+MemoryGovernor& MemoryGovernor::get() {
+    static MemoryGovernor governor;
+    return governor;
+}
+
+
+void MemoryGovernor::setBudget(std::int64_t bytes) {
+    _budget = (bytes > 0) ? bytes : 0;
+    LOGS(_log, LOG_LVL_INFO, "result memory budget=" << _budget);
+    _resumePool.configure(_budget > 0 ? 1 : 0);
+    // Without a budget nothing waits, a larger one may let reads go.
+    while (_resumeNext()) {}
+}
+
+
+void MemoryGovernor::add(std::int64_t bytes) {
+    std::int64_t used = (_used += bytes);
+    LOGS(_log, LOG_LVL_TRACE, "add " << bytes << " used=" << used);
+    if (bytes < 0) {
+        _resumeNext();
+    }
+}
+
+
+bool MemoryGovernor::_overLimit(std::int64_t bytes, double completedFraction) const {
+    std::int64_t budget = _budget;
+    std::int64_t used = _used;
+    if (budget == 0 || used <= 0) return false;
+    std::int64_t limit = budget;
+    if (completedFraction < NEARLY_COMPLETE) {
+        limit = static_cast<std::int64_t>(budget * (1.0 - RESERVE));
+    }
+    return used + bytes > limit;
+}
+
+
+bool MemoryGovernor::shouldDefer(std::int64_t bytes, double completedFraction) const {
+    if (!_overLimit(bytes, completedFraction)) return false;
+    ctrDeferrals->add();
+    LOGS(_log, LOG_LVL_DEBUG, "defer " << bytes << " used=" << _used << " budget=" << _budget
+         << " completed=" << completedFraction);
+    return true;
+}
+
+
+bool MemoryGovernor::deferUntilFreed(std::int64_t bytes, double completedFraction,
+                                     Resume const& resume) {
+    if (!shouldDefer(bytes, completedFraction)) return false;
+    std::lock_guard<std::mutex> lock(_mtx);
+    // add() looks for deferred reads after _used changes, and memory may have
+    // been freed before this one was in the queue.
+    if (!_overLimit(bytes, completedFraction)) return false;
+    _deferred.insert(std::make_pair(completedFraction, Deferred{bytes, resume}));
+    return true;
+}
+
+
+size_t MemoryGovernor::getDeferredCount() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _deferred.size();
+}
+
+
+bool MemoryGovernor::_resumeNext() {
+    Resume resume;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_deferred.empty()) return false;
+        auto iter = _deferred.begin();
+        if (_overLimit(iter->second.bytes, iter->first)) return false;
+        resume = std::move(iter->second.resume);
+        _deferred.erase(iter);
+    }
+    // add() is called with the locks of result handlers held, so the read
+    // is resumed on another thread.
+    auto cmd = std::make_shared<util::Command>([this, resume](util::CmdData*) {
+        if (!resume()) {
+            // Give its turn to the next one.
+            _resumeNext();
+        }
+    });
+    if (!_resumePool.queCmd(cmd)) {
+        cmd->runAction(nullptr);
+    }
+    return true;
+}
+
+}}} // namespace lsst::qserv::qdisp
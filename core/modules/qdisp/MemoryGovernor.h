@@ -0,0 +1,126 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_MEMORYGOVERNOR_H
+#define LSST_QSERV_QDISP_MEMORYGOVERNOR_H
+
+// System headers
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+
+// Qserv headers
+#include "util/ConfigurablePool.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// MemoryGovernor keeps the czar-wide total of memory held for result data
+/// that has been read from workers but not yet merged, and decides when
+/// reading more of a response should wait.
+///
+/// Merge buffers and decoded results add their bytes while they exist. Once
+/// the total is over the budget, QueryRequest defers reading the next block
+/// of a response, and the governor resumes the read when memory is freed.
+/// Part of the budget is kept for queries that are nearly complete, and their
+/// reads are resumed first, so they can finish and free all of their memory
+/// rather than wait behind queries that have just started.
+class MemoryGovernor {
+public:
+    /// Reserves bytes for as long as it exists.
+    class Reservation {
+    public:
+        explicit Reservation(std::int64_t bytes) : _bytes(bytes) { get().add(_bytes); }
+        ~Reservation() { get().add(-_bytes); }
+        Reservation(Reservation const&) = delete;
+        Reservation& operator=(Reservation const&) = delete;
+    private:
+        std::int64_t const _bytes;
+    };
+
+    static MemoryGovernor& get();
+
+    MemoryGovernor(MemoryGovernor const&) = delete;
+    MemoryGovernor& operator=(MemoryGovernor const&) = delete;
+
+    /// @param bytes - the budget, 0 for no limit.
+    void setBudget(std::int64_t bytes);
+    std::int64_t getBudget() const { return _budget; }
+
+    /// @return the number of bytes currently accounted for.
+    std::int64_t getUsed() const { return _used; }
+
+    /// Account for bytes more, or fewer if bytes is negative.
+    void add(std::int64_t bytes);
+
+    /// @param bytes - the size of the next block to be read.
+    /// @param completedFraction - the fraction of its query's jobs that are complete.
+    /// @return true if the read should wait until memory is freed. A read is
+    ///         never deferred when nothing is accounted for, so a block larger
+    ///         than the budget can still be read.
+    bool shouldDefer(std::int64_t bytes, double completedFraction) const;
+
+    /// Reads a deferred block. Returns false if the read is no longer wanted,
+    /// for example because its query was cancelled.
+    using Resume = std::function<bool()>;
+
+    /// Defer a read if shouldDefer() says so. Each time memory is freed, the
+    /// deferred read of the most complete query is resumed on a thread of the
+    /// governor, if it fits.
+    /// @return true if the read was deferred and resume will be called.
+    bool deferUntilFreed(std::int64_t bytes, double completedFraction, Resume const& resume);
+
+    /// @return the number of deferred reads.
+    size_t getDeferredCount() const;
+
+private:
+    MemoryGovernor() = default;
+
+    /// @return true if bytes more is over the limit for a query with
+    ///         completedFraction of its jobs complete.
+    bool _overLimit(std::int64_t bytes, double completedFraction) const;
+
+    /// Resume the first deferred read if it fits.
+    /// @return true if a read was resumed.
+    bool _resumeNext();
+
+    struct Deferred {
+        std::int64_t bytes;
+        Resume resume;
+    };
+
+    std::atomic<std::int64_t> _budget{0};
+    std::atomic<std::int64_t> _used{0};
+
+    mutable std::mutex _mtx; ///< Protects _deferred.
+    /// Deferred reads by completed fraction of their query, highest first,
+    /// and in the order they were deferred for the same fraction.
+    std::multimap<double, Deferred, std::greater<double>> _deferred;
+    util::ConfigurablePool _resumePool; ///< Has a thread while there is a budget.
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_MEMORYGOVERNOR_H
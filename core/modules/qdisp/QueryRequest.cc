@@ -43,6 +43,7 @@
 #include "czar/Czar.h"
 #include "qdisp/JobStatus.h"
 #include "qdisp/LargeResultMgr.h"
+#include "qdisp/MemoryGovernor.h"
 #include "qdisp/ResponseHandler.h"
 #include "util/common.h"
 
@@ -176,6 +177,54 @@ bool QueryRequest::_importStream(JobQuery::Ptr const& jq) {
     }
 }
 
+/// Defer reading the next block of the response while the czar holds too
+/// much result data, or while the query's merges are behind. The read is not
+/// held by XrdSsi, the next block is just not asked for until MemoryGovernor
+/// or MergeExecutor resumes it with _resumeRead().
+/// @return true if the read was deferred.
+bool QueryRequest::_deferRead(JobQuery::Ptr const& jq) {
+    auto self = jq->getQueryRequest();
+    if (self.get() != this) {
+        // Not expected, but then nothing would keep this alive while waiting.
+        return false;
+    }
+    std::weak_ptr<QueryRequest> weakSelf(self);
+    auto resume = [weakSelf, jq]() -> bool {
+        auto qr = weakSelf.lock();
+        return qr != nullptr && qr->_resumeRead(jq);
+    };
+    auto sz = jq->getDescription()->respHandler()->nextBufferSize();
+    double completed = 0.0;
+    if (auto exec = jq->getExecutive()) {
+        completed = exec->getCompletedFraction();
+    }
+    if (MemoryGovernor::get().deferUntilFreed(sz, completed, resume)) {
+        LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " read deferred for memory");
+        return true;
+    }
+    if (jq->getDescription()->respHandler()->deferWhileBacklogged(resume)) {
+        LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " read deferred for merges");
+        return true;
+    }
+    return false;
+}
+
+/// Ask for the next block of the response, unless it has to be deferred again.
+/// @return false if the job is no longer active and nothing was asked for.
+bool QueryRequest::_resumeRead(JobQuery::Ptr const& jq) {
+    {
+        std::lock_guard<std::mutex> lock(_finishStatusMutex);
+        if (_finishStatus != ACTIVE || _cancelled) return false;
+    }
+    if (_deferRead(jq)) return true;
+    LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " deferred read resumed");
+    std::vector<char>& buffer = jq->getDescription()->respHandler()->nextBuffer();
+    if (!GetResponseData(&buffer[0], buffer.size())) {
+        _errorFinish();
+    }
+    return true;
+}
+
 /// Process an incoming error.
 bool QueryRequest::_importError(std::string const& msg, int code) {
     auto jq = _jobQuery;
@@ -296,12 +345,27 @@ XrdSsiRequest::PRD_Xeq QueryRequest::ProcessResponseData(char *buff, int blen, b
                 LOGS(_log, LOG_LVL_WARN,
                      _jobIdStr << " Connection closed when more information expected sz=" << sz);
             }
-            jq->getStatus()->updateInfo(JobStatus::COMPLETE);
-            _finish();
             // At this point all blocks for this job have been read, there's no point in
-            // having XrdSsi wait for anything.
+            // having XrdSsi wait for anything. The job is complete once they are merged,
+            // which may be after this returns.
+            auto self = jq->getQueryRequest();
+            if (self.get() != this) {
+                // Not expected, but then nothing would keep this alive while waiting.
+                LOGS(_log, LOG_LVL_WARN, _jobIdStr << " QueryRequest is no longer the job's");
+                _mergeDone(jq, true);
+                return XrdSsiRequest::PRD_Normal;
+            }
+            jq->getDescription()->respHandler()->whenMerged([self, jq](bool merged) {
+                self->_mergeDone(jq, merged);
+            });
             return XrdSsiRequest::PRD_Normal;
         } else {
+            // Nothing more is read while the czar holds too much result
+            // data, or while the query's merges are behind.
+            if (_deferRead(jq)) {
+                return XrdSsiRequest::PRD_Normal;
+            }
+            // Large results wait for LargeResultMgr to let them continue.
             if (_largeResult) {
                 LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " being held");
                 if (_holdState == NO_HOLD0) {
@@ -335,6 +399,21 @@ XrdSsiRequest::PRD_Xeq QueryRequest::ProcessResponseData(char *buff, int blen, b
 }
 
 
+/// Complete the job once the last of its response has been merged.
+void QueryRequest::_mergeDone(JobQuery::Ptr const& jq, bool merged) {
+    if (merged) {
+        jq->getStatus()->updateInfo(JobStatus::COMPLETE);
+        _finish();
+        return;
+    }
+    LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " ProcessResponse data merge failed");
+    ResponseHandler::Error err = jq->getDescription()->respHandler()->getError();
+    jq->getStatus()->updateInfo(JobStatus::MERGE_ERROR, err.getCode(), err.getMsg());
+    _retried.store(true); // Do not retry
+    _errorFinish();
+}
+
+
 /// @return true if QueryRequest cancelled successfully.
 bool QueryRequest::cancel() {
     LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " QueryRequest::cancel");
@@ -147,6 +147,9 @@ public:
 private:
     void _callMarkComplete(bool success);
     bool _importStream(JobQuery::Ptr const& jq);
+    bool _deferRead(JobQuery::Ptr const& jq);
+    bool _resumeRead(JobQuery::Ptr const& jq);
+    void _mergeDone(JobQuery::Ptr const& jq, bool merged);
     bool _importError(std::string const& msg, int code);
     bool _errorFinish(bool shouldCancel=false);
     void _finish();
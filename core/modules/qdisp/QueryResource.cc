@@ -40,9 +40,13 @@
 // Qserv headers
 #include "qdisp/JobStatus.h"
 #include "qdisp/QueryRequest.h"
+#include "util/Histogram.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.QueryResource");
+
+auto const histProvisionDone =
+    lsst::qserv::util::StatsRegistry::get().histogram("qdisp.QueryResource.provisionDone");
 }
 
 namespace lsst {
@@ -73,6 +77,7 @@ QueryResource::~QueryResource() {
 /// xrootd land and will not catch any exceptions.
 void QueryResource::ProvisionDone(XrdSsiSession* s) {
     LOGS_DEBUG(_jobIdStr << " QueryResource::ProvisionDone");
+    histProvisionDone->recordSince(_createTime);
     struct Destroyer {
         Destroyer(JobQuery::Ptr const& job, QueryResource* qr)
         : _job{job},  _qr{qr} {}
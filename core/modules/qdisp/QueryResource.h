@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <functional>
 #include <memory>
+#include <chrono>
 #include <new>
 #include <string>
 #include <string.h>
@@ -76,6 +77,8 @@ private:
     XrdSsiSession* _xrdSsiSession {nullptr}; ///< unowned, do not delete.
     std::shared_ptr<JobQuery> _jobQuery;
     std::string const _jobIdStr; ///< for debugging only
+    /// Time this was created, used to measure provisioning latency.
+    std::chrono::steady_clock::time_point const _createTime{std::chrono::steady_clock::now()};
     util::InstanceCount _instC{"QueryResource"};
     char* _rNameHolder{nullptr};
 };
@@ -24,6 +24,7 @@
 #define LSST_QSERV_QDISP_RESPONSEHANDLER_H
 
 // System headers
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -70,6 +71,17 @@ public:
     /// Signal an unrecoverable error condition. No further calls are expected.
     virtual void errorFlush(std::string const& msg, int code) = 0;
 
+    /// Call func once everything flushed so far has been merged, with true
+    /// if it all merged successfully. Handlers that merge within flush()
+    /// call func right away.
+    virtual void whenMerged(std::function<void(bool)> const& func) { func(true); }
+
+    /// Defer reading more until merges have caught up, if they have to.
+    /// resume is called once reading can go on, and returns false if there
+    /// was nothing left to read.
+    /// @return true if resume will be called.
+    virtual bool deferWhileBacklogged(std::function<bool()> const& resume) { return false; }
+
     /// @return true if the receiver has completed its duties.
     virtual bool finished() const = 0;
     virtual bool reset() = 0; ///< Reset the state that a request can be retried.
@@ -0,0 +1,108 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/WorkerLoadTable.h"
+
+// System headers
+#include <cctype>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.WorkerLoadTable");
+}
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+WorkerLoadTable& WorkerLoadTable::get() {
+    static WorkerLoadTable table;
+    return table;
+}
+
+
+std::string WorkerLoadTable::workerKey(std::string const& host) {
+    bool const isAddress = host.find_first_not_of("0123456789.") == std::string::npos
+                           || host.find(':') != std::string::npos;
+    std::string key = isAddress ? host : host.substr(0, host.find('.'));
+    for (auto& c : key) {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+    return key;
+}
+
+
+void WorkerLoadTable::update(std::string const& worker, proto::WorkerLoad const& load) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& entry = _loads[workerKey(worker)];
+    entry.load.CopyFrom(load);
+    entry.updateTime = Clock::now();
+    ++entry.reports;
+    LOGS(_log, LOG_LVL_DEBUG, "load " << worker << " queued=" << entry.totalQueued()
+         << " active=" << load.activethreads() << " locked=" << load.lockedbytes()
+         << " outbound=" << load.outboundbytes());
+}
+
+
+bool WorkerLoadTable::getLoad(std::string const& worker, Load& load,
+                              std::chrono::milliseconds maxAge) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _loads.find(workerKey(worker));
+    if (iter == _loads.end()) return false;
+    if (maxAge.count() > 0 && Clock::now() - iter->second.updateTime > maxAge) return false;
+    load = iter->second;
+    return true;
+}
+
+
+std::map<std::string, WorkerLoadTable::Load> WorkerLoadTable::getAll() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _loads;
+}
+
+
+void WorkerLoadTable::clear() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _loads.clear();
+}
+
+
+void WorkerLoadTable::dump(std::ostream& os) const {
+    auto now = Clock::now();
+    for (auto const& elem : getAll()) {
+        auto const& ld = elem.second.load;
+        auto ageMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - elem.second.updateTime).count();
+        os << elem.first << " ageMs=" << ageMs
+           << " queued(group=" << ld.queuedgroup() << " fast=" << ld.queuedfast()
+           << " med=" << ld.queuedmed() << " slow=" << ld.queuedslow()
+           << " snail=" << ld.queuedsnail() << ") active=" << ld.activethreads()
+           << " lockedBytes=" << ld.lockedbytes() << " outboundBytes=" << ld.outboundbytes()
+           << "\n";
+    }
+}
+
+}}} // namespace lsst::qserv::qdisp
@@ -0,0 +1,104 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_QSERV_QDISP_WORKERLOADTABLE_H
+#define LSST_QSERV_QDISP_WORKERLOADTABLE_H
+
+// System headers
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// The most recent load reported by each worker.
+///
+/// Workers put a proto::WorkerLoad summary in the ProtoHeader of every result
+/// they send, and the czar records it here as the headers are read. Dispatch
+/// and throttling code can then look at how busy a worker was the last time
+/// it was heard from. Entries are never removed, but callers should pass a
+/// maximum age so a worker that has gone quiet is not judged on old figures.
+///
+/// Workers report the name of their host, while dispatch knows them by the
+/// host of their CSS node, and either may or may not include the domain.
+/// Both are reduced to the same key by workerKey().
+class WorkerLoadTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Load {
+        proto::WorkerLoad load;
+        Clock::time_point updateTime;
+        uint64_t reports{0}; ///< Number of headers seen from the worker.
+
+        /// @return the number of Tasks queued on all of the worker's schedulers.
+        uint64_t totalQueued() const {
+            return static_cast<uint64_t>(load.queuedgroup()) + load.queuedfast()
+                   + load.queuedmed() + load.queuedslow() + load.queuedsnail();
+        }
+    };
+
+    static WorkerLoadTable& get();
+
+    /// @return the key of the worker on host, the host name in lower case
+    ///         without its domain, or the host as is if it is an IP address.
+    static std::string workerKey(std::string const& host);
+
+    WorkerLoadTable(WorkerLoadTable const&) = delete;
+    WorkerLoadTable& operator=(WorkerLoadTable const&) = delete;
+
+    /// Record the load reported by worker.
+    void update(std::string const& worker, proto::WorkerLoad const& load);
+
+    /// Get the last load reported by worker.
+    /// @param maxAge - ignore reports older than this, 0 accepts any age.
+    /// @return false if there is no acceptable report for worker.
+    bool getLoad(std::string const& worker, Load& load,
+                 std::chrono::milliseconds maxAge=std::chrono::milliseconds(0)) const;
+
+    /// @return a copy of the whole table.
+    std::map<std::string, Load> getAll() const;
+
+    void clear();
+
+    /// Write one line per worker.
+    void dump(std::ostream& os) const;
+
+private:
+    WorkerLoadTable() = default;
+
+    mutable std::mutex _mtx; ///< Protects _loads.
+    std::map<std::string, Load> _loads; ///< key is workerKey() of the worker.
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_WORKERLOADTABLE_H
@@ -0,0 +1,242 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/WorkerSelector.h"
+
+// System headers
+#include <algorithm>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "qdisp/WorkerLoadTable.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.WorkerSelector");
+
+/// Weight of the newest job in the moving average of job durations.
+double const latencyAlpha = 0.2;
+
+/// Duration assumed for a host no job has completed on yet. Kept low so new
+/// or idle replicas get tried.
+double const unknownLatencyMs = 100.0;
+
+/// A host that failed a job recently has its score multiplied by this.
+double const failurePenalty = 10.0;
+std::chrono::seconds const failurePenaltyTime(60);
+}
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+WorkerSelector& WorkerSelector::get() {
+    static WorkerSelector selector;
+    return selector;
+}
+
+
+void WorkerSelector::configure(bool enabled, int workerPort, std::chrono::milliseconds loadMaxAge) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _enabled = enabled;
+    _workerPort = workerPort;
+    _loadMaxAge = loadMaxAge;
+}
+
+
+bool WorkerSelector::isEnabled() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _enabled;
+}
+
+
+std::string WorkerSelector::getEndpoint(std::string const& host) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return host + ":" + std::to_string(_workerPort);
+}
+
+
+void WorkerSelector::setReplicas(std::string const& dbName, ChunkHosts const& chunkHosts) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& entry = _dbReplicas[dbName];
+    entry.chunkHosts = chunkHosts;
+    entry.loadTime = Clock::now();
+    entry.refreshing = false;
+    LOGS(_log, LOG_LVL_DEBUG, "setReplicas " << dbName << " chunks=" << chunkHosts.size());
+}
+
+
+bool WorkerSelector::replicasStale(std::string const& dbName, std::chrono::seconds maxAge) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _dbReplicas.find(dbName);
+    return iter == _dbReplicas.end() || Clock::now() - iter->second.loadTime > maxAge;
+}
+
+
+bool WorkerSelector::beginRefresh(std::string const& dbName, std::chrono::seconds maxAge) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _dbReplicas.find(dbName);
+    if (iter == _dbReplicas.end()) {
+        _dbReplicas[dbName].refreshing = true;
+        return true;
+    }
+    auto& entry = iter->second;
+    if (entry.refreshing || Clock::now() - entry.loadTime <= maxAge) return false;
+    entry.refreshing = true;
+    return true;
+}
+
+
+void WorkerSelector::abortRefresh(std::string const& dbName) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& entry = _dbReplicas[dbName];
+    entry.loadTime = Clock::now();
+    entry.refreshing = false;
+}
+
+
+std::vector<std::string> WorkerSelector::getReplicas(std::string const& dbName, int chunkId) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto dbIter = _dbReplicas.find(dbName);
+    if (dbIter == _dbReplicas.end()) return std::vector<std::string>();
+    auto chunkIter = dbIter->second.chunkHosts.find(chunkId);
+    if (chunkIter == dbIter->second.chunkHosts.end()) return std::vector<std::string>();
+    return chunkIter->second;
+}
+
+
+std::string WorkerSelector::select(std::string const& dbName, int chunkId,
+                                   std::set<std::string> const& exclude) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_enabled) return std::string();
+    auto dbIter = _dbReplicas.find(dbName);
+    if (dbIter == _dbReplicas.end()) return std::string();
+    auto chunkIter = dbIter->second.chunkHosts.find(chunkId);
+    if (chunkIter == dbIter->second.chunkHosts.end()) return std::string();
+    auto const& hosts = chunkIter->second;
+    if (hosts.empty()) return std::string();
+
+    // Start at a different replica for each chunk so that, with no load or
+    // latency information, chunks are spread evenly across replicas.
+    std::string best;
+    double bestScore = 0.0;
+    std::size_t const sz = hosts.size();
+    std::size_t const first = static_cast<std::size_t>(chunkId < 0 ? -chunkId : chunkId) % sz;
+    for (std::size_t j = 0; j < sz; ++j) {
+        auto const& host = hosts[(first + j) % sz];
+        if (exclude.count(host) > 0) continue;
+        double sc = _score(host, _hostStats[host]);
+        if (best.empty() || sc < bestScore) {
+            best = host;
+            bestScore = sc;
+        }
+    }
+    LOGS(_log, LOG_LVL_DEBUG, "select " << dbName << ":" << chunkId << " -> "
+         << (best.empty() ? "redirector" : best) << " score=" << bestScore);
+    return best;
+}
+
+
+double WorkerSelector::score(std::string const& host) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _score(host, _hostStats[host]);
+}
+
+
+/// Estimated time for a new job on host: the jobs ahead of it times how long
+/// jobs there have been taking.
+/// Precondition: _mtx must be locked.
+double WorkerSelector::_score(std::string const& host, HostStats const& stats) const {
+    double work = 1.0 + stats.inFlight;
+    WorkerLoadTable::Load load;
+    if (WorkerLoadTable::get().getLoad(host, load, _loadMaxAge)) {
+        work += load.totalQueued() + load.load.activethreads();
+    }
+    double latency = (stats.completed > 0) ? std::max(stats.latencyMs, 1.0) : unknownLatencyMs;
+    double sc = work * latency;
+    if (stats.failed > 0 && Clock::now() - stats.lastFailure < failurePenaltyTime) {
+        sc *= failurePenalty;
+    }
+    return sc;
+}
+
+
+void WorkerSelector::jobStarted(std::string const& host) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    ++_hostStats[host].inFlight;
+}
+
+
+void WorkerSelector::jobFinished(std::string const& host, std::chrono::milliseconds duration) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& stats = _hostStats[host];
+    if (stats.inFlight > 0) --stats.inFlight;
+    double ms = static_cast<double>(duration.count());
+    stats.latencyMs = (stats.completed == 0) ? ms : (1.0 - latencyAlpha)*stats.latencyMs + latencyAlpha*ms;
+    ++stats.completed;
+}
+
+
+void WorkerSelector::jobFailed(std::string const& host) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& stats = _hostStats[host];
+    if (stats.inFlight > 0) --stats.inFlight;
+    ++stats.failed;
+    stats.lastFailure = Clock::now();
+}
+
+
+void WorkerSelector::jobAbandoned(std::string const& host) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& stats = _hostStats[host];
+    if (stats.inFlight > 0) --stats.inFlight;
+}
+
+
+WorkerSelector::HostStats WorkerSelector::getHostStats(std::string const& host) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _hostStats.find(host);
+    return (iter == _hostStats.end()) ? HostStats() : iter->second;
+}
+
+
+void WorkerSelector::dump(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto const& elem : _hostStats) {
+        os << elem.first << " inFlight=" << elem.second.inFlight
+           << " latencyMs=" << elem.second.latencyMs
+           << " completed=" << elem.second.completed
+           << " failed=" << elem.second.failed << "\n";
+    }
+}
+
+
+void WorkerSelector::clear() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _dbReplicas.clear();
+    _hostStats.clear();
+}
+
+}}} // namespace lsst::qserv::qdisp
@@ -0,0 +1,145 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_QSERV_QDISP_WORKERSELECTOR_H
+#define LSST_QSERV_QDISP_WORKERSELECTOR_H
+
+// System headers
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// Chooses which worker a job is sent to.
+///
+/// The czar keeps a map of chunk to replica hosts for each database, loaded
+/// from CSS, and for each host the number of jobs this czar has outstanding
+/// there plus a moving average of how long its jobs took. select() combines
+/// these with the load the worker last reported (WorkerLoadTable) and picks
+/// the replica with the lowest score. An empty host means the job should go
+/// through the xrootd redirector, which is what happens when selection is
+/// disabled, the chunk has no known replicas, or every replica was already
+/// tried by earlier attempts of the job.
+class WorkerSelector {
+public:
+    using Clock = std::chrono::steady_clock;
+    using ChunkHosts = std::map<int, std::vector<std::string>>;
+
+    /// Per host statistics kept by the czar.
+    struct HostStats {
+        int inFlight{0};         ///< Jobs sent to the host and not yet finished.
+        double latencyMs{0.0};   ///< Moving average of job duration.
+        uint64_t completed{0};
+        uint64_t failed{0};
+        Clock::time_point lastFailure;
+    };
+
+    static WorkerSelector& get();
+
+    WorkerSelector(WorkerSelector const&) = delete;
+    WorkerSelector& operator=(WorkerSelector const&) = delete;
+
+    /// @param enabled - when false select() always returns an empty host.
+    /// @param workerPort - xrootd port used to address workers directly.
+    /// @param loadMaxAge - reported loads older than this are ignored.
+    void configure(bool enabled, int workerPort, std::chrono::milliseconds loadMaxAge);
+    bool isEnabled() const;
+
+    /// @return the xrootd endpoint ("host:port") of host.
+    std::string getEndpoint(std::string const& host) const;
+
+    /// Replace the chunk replica map of dbName.
+    void setReplicas(std::string const& dbName, ChunkHosts const& chunkHosts);
+
+    /// @return true if the replicas of dbName were never set or were set
+    ///         longer than maxAge ago.
+    bool replicasStale(std::string const& dbName, std::chrono::seconds maxAge) const;
+
+    /// Claim the reload of dbName's replicas.
+    /// @return true if the replicas are stale and no other reload is running,
+    ///         in which case the caller must finish with setReplicas() or
+    ///         abortRefresh().
+    bool beginRefresh(std::string const& dbName, std::chrono::seconds maxAge);
+
+    /// Give up a reload claimed by beginRefresh(). The current replicas are
+    /// kept and the next reload waits for a full interval.
+    void abortRefresh(std::string const& dbName);
+
+    /// @return the replica hosts of chunkId in dbName, empty if unknown.
+    std::vector<std::string> getReplicas(std::string const& dbName, int chunkId) const;
+
+    /// Pick the host to send a job for chunkId of dbName to.
+    /// @param exclude - hosts already tried for this job.
+    /// @return the chosen host, or an empty string to use the redirector.
+    std::string select(std::string const& dbName, int chunkId, std::set<std::string> const& exclude);
+
+    /// @return the score of host, lower is better.
+    double score(std::string const& host);
+
+    /// Record that a job was sent to host.
+    void jobStarted(std::string const& host);
+    /// Record that a job on host completed successfully after duration.
+    void jobFinished(std::string const& host, std::chrono::milliseconds duration);
+    /// Record that a job on host failed.
+    void jobFailed(std::string const& host);
+    /// Record that a job on host was cancelled. Only the in flight count changes.
+    void jobAbandoned(std::string const& host);
+
+    HostStats getHostStats(std::string const& host) const;
+
+    /// Write one line per host.
+    void dump(std::ostream& os) const;
+
+    /// Forget all replicas and statistics (for tests).
+    void clear();
+
+private:
+    WorkerSelector() = default;
+
+    double _score(std::string const& host, HostStats const& stats) const;
+
+    struct DbReplicas {
+        ChunkHosts chunkHosts;
+        Clock::time_point loadTime;
+        bool refreshing{false};
+    };
+
+    mutable std::mutex _mtx; ///< Protects all members.
+    bool _enabled{false};
+    int _workerPort{1094};
+    std::chrono::milliseconds _loadMaxAge{30000};
+    std::map<std::string, DbReplicas> _dbReplicas; ///< key is database name.
+    std::map<std::string, HostStats> _hostStats; ///< key is host name.
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_WORKERSELECTOR_H
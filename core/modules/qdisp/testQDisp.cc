@@ -22,6 +22,9 @@
  */
 
 // System headers
+#include <atomic>
+#include <future>
+#include <mutex>
 #include <string>
 #include <unistd.h>
 
@@ -39,13 +42,21 @@
 #include "ccontrol/MergingHandler.h"
 #include "global/ResourceUnit.h"
 #include "global/MsgReceiver.h"
+#include "proto/ProtoHeaderWrap.h"
+#include "proto/worker.pb.h"
+#include "qdisp/BatchJobQuery.h"
 #include "qdisp/Executive.h"
 #include "qdisp/JobQuery.h"
+#include "qdisp/JobStartExecutor.h"
 #include "qdisp/LargeResultMgr.h"
+#include "qdisp/MemoryGovernor.h"
 #include "qdisp/MessageStore.h"
+#include "qdisp/WorkerLoadTable.h"
+#include "qdisp/WorkerSelector.h"
 #include "qdisp/XrdSsiMocks.h"
 #include "qproc/ChunkQuerySpec.h"
 #include "qproc/TaskMsgFactory.h"
+#include "tests/ReleaseGate.h"
 #include "util/threadSafe.h"
 
 namespace test = boost::test_tools;
@@ -171,6 +182,75 @@ public:
 };
 
 
+/** ResponseHandler reading headers and results the way MergingHandler does,
+ *  recording "H" for each header and "R" for each result.
+ */
+class StreamHandlerTest : public qdisp::ResponseHandler {
+public:
+    std::vector<char>& nextBuffer() override {
+        _vect.resize(nextBufferSize());
+        return _vect;
+    }
+    size_t nextBufferSize() override {
+        return _inHeader ? proto::ProtoHeaderWrap::PROTO_HEADER_SIZE : _resultSize;
+    }
+    bool flush(int bLen, bool& last, bool& largeResult) override {
+        if (_inHeader) {
+            auto response = std::make_shared<proto::WorkerResponse>();
+            if (!proto::ProtoHeaderWrap::unwrap(response, _vect)) return false;
+            _resultSize = response->protoHeader.size();
+            _continues = response->protoHeader.continues();
+            _inHeader = false;
+            received += "H";
+            return true;
+        }
+        _inHeader = true;
+        received += "R";
+        last = !_continues;
+        return bLen == _resultSize && !failResult;
+    }
+    void errorFlush(std::string const& msg, int code) override {}
+    bool finished() const override { return _inHeader && !_continues; }
+    bool reset() override { return true; }
+    qdisp::ResponseHandler::Error getError() const override {
+        return qdisp::ResponseHandler::Error(-1, "testQDisp Error");
+    }
+    std::ostream& print(std::ostream& os) const override { return os; }
+    bool scrubResults(int jobId, int attempt) override { return true; }
+
+    std::string received;
+    bool failResult{false};
+private:
+    std::vector<char> _vect;
+    bool _inHeader{true};
+    int _resultSize{0};
+    bool _continues{false};
+};
+
+
+/** Feed the header and result of a message for jobId to handler.
+ *  @return false if handler rejected either.
+ */
+bool feedMessage(qdisp::ResponseHandler& handler, int jobId, int size, bool continues, bool& last) {
+    proto::ProtoHeader header;
+    header.set_size(size);
+    header.set_largeresult(false);
+    header.set_continues(continues);
+    header.set_jobid(jobId);
+    std::string str;
+    header.SerializeToString(&str);
+    std::string wrapped = proto::ProtoHeaderWrap::wrap(str);
+    bool largeResult = false;
+    if (handler.nextBufferSize() != wrapped.size()) return false;
+    auto& hBuf = handler.nextBuffer();
+    std::copy(wrapped.begin(), wrapped.end(), hBuf.begin());
+    if (!handler.flush(wrapped.size(), last, largeResult)) return false;
+    if (handler.nextBufferSize() != static_cast<size_t>(size)) return false;
+    handler.nextBuffer();
+    return handler.flush(size, last, largeResult);
+}
+
+
 namespace lsst {
 namespace qserv {
 namespace qproc {
@@ -296,10 +376,19 @@ BOOST_AUTO_TEST_CASE(Executive) {
         usleep(10000);
     }
     BOOST_CHECK(ex->getEmpty() == false);
+    // Completion is notified once the last job completes.
+    std::atomic<int> notified{0};
+    ex->notifyOnComplete([&notified]() { ++notified; });
+    BOOST_CHECK_EQUAL(notified.load(), 0);
     qdisp::XrdSsiServiceMock::_go.exchangeNotify(true);
     ex->join();
     LOGS_DEBUG("ex->join() joined");
     BOOST_CHECK(ex->getEmpty() == true);
+    while (notified.load() == 0) {
+        usleep(1000);
+    }
+    ex->notifyOnComplete([&notified]() { ++notified; });
+    BOOST_CHECK_EQUAL(notified.load(), 2);
     done.exchange(true);
     timeoutT.join();
     LOGS_DEBUG("Executive test end");
@@ -320,6 +409,209 @@ BOOST_AUTO_TEST_CASE(MessageStore) {
     LOGS_DEBUG("MessageStore test end");
 }
 
+BOOST_AUTO_TEST_CASE(WorkerLoadTable) {
+    LOGS_DEBUG("WorkerLoadTable test start");
+    auto& table = qdisp::WorkerLoadTable::get();
+    table.clear();
+    qdisp::WorkerLoadTable::Load load;
+    BOOST_CHECK(table.getLoad("worker1", load) == false);
+
+    proto::WorkerLoad wl;
+    wl.set_queuedgroup(2);
+    wl.set_queuedfast(3);
+    wl.set_queuedsnail(1);
+    wl.set_activethreads(7);
+    wl.set_lockedbytes(1000);
+    wl.set_outboundbytes(50);
+    table.update("worker1", wl);
+    wl.set_queuedgroup(4);
+    table.update("worker1", wl);
+    BOOST_CHECK(table.getLoad("worker1", load) == true);
+    BOOST_CHECK(load.reports == 2);
+    BOOST_CHECK(load.totalQueued() == 8);
+    BOOST_CHECK(load.load.activethreads() == 7);
+    BOOST_CHECK(load.load.lockedbytes() == 1000);
+    BOOST_CHECK(table.getLoad("worker1", load, std::chrono::milliseconds(60000)) == true);
+    BOOST_CHECK(table.getLoad("worker2", load) == false);
+    BOOST_CHECK(table.getAll().size() == 1);
+
+    // Workers report their host name, dispatch uses the host of their CSS
+    // node, the domain and case may differ.
+    BOOST_CHECK(qdisp::WorkerLoadTable::workerKey("Worker3.Example.org") == "worker3");
+    BOOST_CHECK(qdisp::WorkerLoadTable::workerKey("worker3") == "worker3");
+    BOOST_CHECK(qdisp::WorkerLoadTable::workerKey("10.1.2.3") == "10.1.2.3");
+    table.update("worker3.example.org", wl);
+    BOOST_CHECK(table.getLoad("worker3", load) == true);
+    BOOST_CHECK(table.getLoad("WORKER3.example.org", load) == true);
+    BOOST_CHECK(load.reports == 1);
+    table.clear();
+    LOGS_DEBUG("WorkerLoadTable test end");
+}
+
+BOOST_AUTO_TEST_CASE(JobStartExecutor) {
+    LOGS_DEBUG("JobStartExecutor test");
+    auto& executor = qdisp::JobStartExecutor::get();
+    executor.configure(1);
+    int queryA = 0;
+    int queryB = 0;
+    int queryC = 0;
+    std::promise<void> started;
+    tests::ReleaseGate gate;
+    executor.queue(&queryA, [&started, &gate]() { started.set_value(); gate.wait(); });
+    started.get_future().wait();
+
+    std::mutex mtx;
+    std::string order;
+    auto record = [&mtx, &order](std::string const& name) {
+        return [&mtx, &order, name]() { std::lock_guard<std::mutex> lock(mtx); order += name; };
+    };
+    executor.queue(&queryA, record("A2 "));
+    executor.queue(&queryA, record("A3 "));
+    executor.queue(&queryB, record("B1 "));
+    executor.queue(&queryC, record("C1 "));
+    executor.queue(&queryC, record("C2 "));
+    BOOST_CHECK_EQUAL(executor.getPending(&queryA), 3);
+    // A squashed query's starts are dropped before they run.
+    BOOST_CHECK_EQUAL(executor.cancel(&queryC), 2);
+    BOOST_CHECK_EQUAL(executor.getPending(&queryC), 0);
+    executor.waitFor(&queryC);
+
+    gate.release();
+    executor.waitFor(&queryA);
+    executor.waitFor(&queryB);
+    // Queries take turns.
+    BOOST_CHECK_EQUAL(order, "A2 B1 A3 ");
+    BOOST_CHECK_EQUAL(executor.getPending(&queryA), 0);
+    executor.configure(10);
+}
+
+BOOST_AUTO_TEST_CASE(MemoryGovernor) {
+    LOGS_DEBUG("MemoryGovernor test start");
+    auto& governor = qdisp::MemoryGovernor::get();
+    std::int64_t const used = governor.getUsed();
+    governor.setBudget(0);
+    BOOST_CHECK(governor.shouldDefer(1000000, 0.0) == false);
+
+    governor.setBudget(used + 1000);
+    {
+        qdisp::MemoryGovernor::Reservation r1(700);
+        BOOST_CHECK_EQUAL(governor.getUsed(), used + 700);
+        BOOST_CHECK(governor.shouldDefer(100, 0.0) == false);
+        // Only nearly complete queries may use the last part of the budget.
+        BOOST_CHECK(governor.shouldDefer(250, 0.5) == true);
+        BOOST_CHECK(governor.shouldDefer(250, 0.95) == false);
+        BOOST_CHECK(governor.shouldDefer(400, 0.95) == true);
+    }
+    BOOST_CHECK_EQUAL(governor.getUsed(), used);
+    if (used == 0) {
+        // A block larger than the budget is read when nothing else is held.
+        BOOST_CHECK(governor.shouldDefer(5000, 0.0) == false);
+    }
+
+    // Deferred reads resume as memory is freed, the most complete query first.
+    std::mutex mtx;
+    std::string order;
+    std::promise<void> resumedA;
+    std::promise<void> resumedB;
+    auto record = [&mtx, &order](std::string const& name, std::promise<void>& resumed) {
+        return [&mtx, &order, name, &resumed]() -> bool {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                order += name;
+            }
+            resumed.set_value();
+            return true;
+        };
+    };
+    {
+        auto r1 = std::make_shared<qdisp::MemoryGovernor::Reservation>(900);
+        BOOST_CHECK(not governor.deferUntilFreed(50, 0.95, []() { return true; }));
+        BOOST_CHECK(governor.deferUntilFreed(200, 0.5, record("A", resumedA)));
+        BOOST_CHECK(governor.deferUntilFreed(200, 0.95, record("B", resumedB)));
+        BOOST_CHECK_EQUAL(governor.getDeferredCount(), 2U);
+        r1.reset();
+        resumedB.get_future().wait();
+        BOOST_CHECK_EQUAL(governor.getDeferredCount(), 1U);
+        {
+            qdisp::MemoryGovernor::Reservation r2(10);
+        }
+        resumedA.get_future().wait();
+        BOOST_CHECK_EQUAL(order, "BA");
+        BOOST_CHECK_EQUAL(governor.getDeferredCount(), 0U);
+
+        // A read that is no longer wanted gives its turn to the next one.
+        auto r3 = std::make_shared<qdisp::MemoryGovernor::Reservation>(900);
+        std::promise<void> resumedC;
+        BOOST_CHECK(governor.deferUntilFreed(200, 0.95, []() { return false; }));
+        BOOST_CHECK(governor.deferUntilFreed(200, 0.5, record("C", resumedC)));
+        r3.reset();
+        resumedC.get_future().wait();
+        BOOST_CHECK_EQUAL(governor.getDeferredCount(), 0U);
+
+        // Removing the budget resumes everything.
+        auto r4 = std::make_shared<qdisp::MemoryGovernor::Reservation>(900);
+        std::promise<void> resumedD;
+        BOOST_CHECK(governor.deferUntilFreed(200, 0.5, record("D", resumedD)));
+        governor.setBudget(0);
+        resumedD.get_future().wait();
+        BOOST_CHECK_EQUAL(order, "BACD");
+    }
+    governor.setBudget(0);
+}
+
+BOOST_AUTO_TEST_CASE(WorkerSelector) {
+    LOGS_DEBUG("WorkerSelector test start");
+    auto& selector = qdisp::WorkerSelector::get();
+    selector.clear();
+    qdisp::WorkerLoadTable::get().clear();
+    selector.configure(true, 1094, std::chrono::seconds(30));
+    BOOST_CHECK(selector.getEndpoint("wA") == "wA:1094");
+    std::set<std::string> none;
+    BOOST_CHECK(selector.select("db", 5, none).empty()); // No replicas, use the redirector.
+
+    BOOST_CHECK(selector.replicasStale("db", std::chrono::seconds(600)));
+    BOOST_CHECK(selector.beginRefresh("db", std::chrono::seconds(600)));
+    BOOST_CHECK(!selector.beginRefresh("db", std::chrono::seconds(600))); // Already refreshing.
+    qdisp::WorkerSelector::ChunkHosts chunkHosts;
+    chunkHosts[5] = {"wA", "wB"};
+    chunkHosts[6] = {"wA", "wB"};
+    selector.setReplicas("db", chunkHosts);
+    BOOST_CHECK(!selector.replicasStale("db", std::chrono::seconds(600)));
+
+    // With nothing known about the workers, chunks are spread across replicas.
+    BOOST_CHECK(selector.select("db", 5, none) == "wB");
+    BOOST_CHECK(selector.select("db", 6, none) == "wA");
+    BOOST_CHECK(selector.select("db", 7, none).empty()); // Unknown chunk.
+
+    // Jobs outstanding on wB push chunk 5 to wA.
+    selector.jobStarted("wB");
+    selector.jobStarted("wB");
+    BOOST_CHECK(selector.select("db", 5, none) == "wA");
+    // Load reported by wA pushes it back.
+    proto::WorkerLoad wl;
+    wl.set_queuedgroup(10);
+    qdisp::WorkerLoadTable::get().update("wA.example.org", wl);
+    BOOST_CHECK(selector.select("db", 5, none) == "wB");
+
+    // Retries avoid workers already tried, then fall back to the redirector.
+    BOOST_CHECK(selector.select("db", 5, {"wB"}) == "wA");
+    BOOST_CHECK(selector.select("db", 5, {"wA", "wB"}).empty());
+
+    selector.jobFinished("wB", std::chrono::milliseconds(50));
+    selector.jobFailed("wB");
+    auto stats = selector.getHostStats("wB");
+    BOOST_CHECK(stats.inFlight == 0);
+    BOOST_CHECK(stats.completed == 1);
+    BOOST_CHECK(stats.failed == 1);
+    BOOST_CHECK(stats.latencyMs == 50.0);
+
+    selector.configure(false, 1094, std::chrono::seconds(30));
+    BOOST_CHECK(selector.select("db", 5, none).empty());
+    selector.clear();
+    qdisp::WorkerLoadTable::get().clear();
+    LOGS_DEBUG("WorkerSelector test end");
+}
+
 BOOST_AUTO_TEST_CASE(QueryResource) {
     // Test that QueryResource::ProvisionDone detects NULL XrdSsiSesion
     LOGS_DEBUG("QueryResource test 1");
@@ -452,6 +744,59 @@ BOOST_AUTO_TEST_CASE(QueryRequest) {
     BOOST_CHECK(!jqTest->retryCalled);
 }
 
+BOOST_AUTO_TEST_CASE(BatchHandler) {
+    LOGS_DEBUG("BatchHandler test");
+    std::string str = qdisp::Executive::Config::getMockStr();
+    qdisp::Executive::Config::Ptr conf = std::make_shared<qdisp::Executive::Config>(str);
+    std::shared_ptr<qdisp::MessageStore> ms = std::make_shared<qdisp::MessageStore>();
+    qdisp::LargeResultMgr::Ptr lgResMgr = std::make_shared<qdisp::LargeResultMgr>();
+    qdisp::Executive::Ptr ex = qdisp::Executive::newExecutive(conf, ms, lgResMgr);
+    ResourceUnit ru;
+    std::vector<std::shared_ptr<StreamHandlerTest>> handlers;
+    std::vector<FinishTest::Ptr> finishes;
+    std::vector<qdisp::JobQuery::Ptr> jobs;
+    for (int jobId = 0; jobId < 4; ++jobId) {
+        handlers.push_back(std::make_shared<StreamHandlerTest>());
+        finishes.push_back(std::make_shared<FinishTest>());
+        auto jobDesc = makeMockJobDescription(ex, jobId, ru, "a message", handlers.back());
+        jobs.push_back(JobQueryTest::getJobQueryTest(ex, jobDesc, finishes.back(), false, nullptr, false));
+    }
+
+    // Messages of two jobs interleaved on one stream.
+    qdisp::BatchHandler batch({jobs[0], jobs[1]});
+    bool last = false;
+    BOOST_CHECK(feedMessage(batch, 0, 4, true, last));
+    BOOST_CHECK(feedMessage(batch, 1, 3, false, last));
+    BOOST_CHECK(finishes[1]->finishCalled);
+    BOOST_CHECK(!finishes[0]->finishCalled);
+    BOOST_CHECK(!last);
+    BOOST_CHECK(feedMessage(batch, 0, 2, false, last));
+    BOOST_CHECK(finishes[0]->finishCalled);
+    BOOST_CHECK(last);
+    BOOST_CHECK(batch.finished());
+    BOOST_CHECK_EQUAL(handlers[0]->received, "HRHR");
+    BOOST_CHECK_EQUAL(handlers[1]->received, "HR");
+    BOOST_CHECK(batch.releaseUnfinished().empty());
+
+    // A failed job is skipped, unknown jobs are errors, and unfinished jobs
+    // are released to be run on their own.
+    handlers[2]->failResult = true;
+    qdisp::BatchHandler batch2({jobs[2], jobs[3]});
+    last = false;
+    BOOST_CHECK(feedMessage(batch2, 2, 5, true, last));
+    BOOST_CHECK(finishes[2]->finishCalled);
+    BOOST_CHECK(jobs[2]->getStatus()->getInfo().state == qdisp::JobStatus::MERGE_ERROR);
+    BOOST_CHECK(feedMessage(batch2, 2, 5, false, last));
+    BOOST_CHECK_EQUAL(handlers[2]->received, "HR");
+    BOOST_CHECK(!feedMessage(batch2, 7, 1, false, last));
+    BOOST_CHECK(!last);
+    auto unfinished = batch2.releaseUnfinished();
+    BOOST_REQUIRE_EQUAL(unfinished.size(), 1U);
+    BOOST_CHECK(unfinished[0] == jobs[3]);
+    BOOST_CHECK(!finishes[3]->finishCalled);
+    BOOST_CHECK(batch2.finished());
+}
+
 BOOST_AUTO_TEST_CASE(ExecutiveCancel) {
     // Test that all JobQueries are cancelled.
     LOGS_DEBUG("Check that executive squash");
@@ -513,6 +858,32 @@ BOOST_AUTO_TEST_CASE(ExecutiveCancel) {
 
 }
 
+BOOST_AUTO_TEST_CASE(ExecutiveSuperfluous) {
+    // Test that jobs squashed once the result is complete are not errors.
+    LOGS_DEBUG("Check that executive squashSuperfluous");
+    std::string str = qdisp::Executive::Config::getMockStr();
+    qdisp::Executive::Config::Ptr conf = std::make_shared<qdisp::Executive::Config>(str);
+    std::shared_ptr<qdisp::MessageStore> ms = std::make_shared<qdisp::MessageStore>();
+    qdisp::LargeResultMgr::Ptr lgResMgr = std::make_shared<qdisp::LargeResultMgr>();
+    qdisp::Executive::Ptr ex = qdisp::Executive::newExecutive(conf, ms, lgResMgr);
+    ResourceUnit ru;
+    std::shared_ptr<ResponseHandlerTest> respReq = std::make_shared<ResponseHandlerTest>();
+    qdisp::XrdSsiServiceMock::_go.exchangeNotify(false);
+    for (int jobId=1; jobId<=5; ++jobId) {
+        auto jobDesc = makeMockJobDescription(ex, jobId, ru, "a message", respReq);
+        ex->add(jobDesc);
+    }
+    ex->squashSuperfluous();
+    ex->squashSuperfluous();
+    for (int jobId=1; jobId<=5; ++jobId) {
+        BOOST_CHECK(ex->getJobQuery(jobId)->isQueryCancelled() == true);
+    }
+    qdisp::XrdSsiServiceMock::_go.exchangeNotify(true);
+    BOOST_CHECK(ex->join() == true);
+    BOOST_CHECK(ex->getSuperfluous() == true);
+    BOOST_CHECK(ex->getEmpty() == true);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
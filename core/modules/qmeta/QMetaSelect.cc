@@ -46,7 +46,7 @@ namespace qmeta {
 
 // Constructors
 QMetaSelect::QMetaSelect(mysql::MySqlConfig const& mysqlConf)
-  : _conn(mysqlConf) {
+  : _pool(sql::SqlConnectionPool::create(mysqlConf)) {
 }
 
 // Destructor
@@ -60,7 +60,8 @@ QMetaSelect::select(std::string const& query) {
     sql::SqlErrorObject errObj;
     std::unique_ptr<sql::SqlResults> results(new sql::SqlResults);
     LOGS(_log, LOG_LVL_DEBUG, "Executing query: " << query);
-    if (not _conn.runQuery(query, *results, errObj)) {
+    auto conn = _pool->acquire();
+    if (not conn->runQuery(query, *results, errObj)) {
         LOGS(_log, LOG_LVL_ERROR, "SQL query failed: " << query);
         throw SqlError(ERR_LOC, errObj);
     }
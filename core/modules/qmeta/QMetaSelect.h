@@ -30,7 +30,7 @@
 
 // Qserv headers
 #include "mysql/MySqlConfig.h"
-#include "sql/SqlConnection.h"
+#include "sql/SqlConnectionPool.h"
 #include "sql/SqlResults.h"
 
 namespace lsst {
@@ -79,7 +79,8 @@ public:
 
 protected:
 
-    sql::SqlConnection _conn;
+    /// Each select leases a connection, so that selects can run concurrently.
+    sql::SqlConnectionPool::Ptr _pool;
 
 };
 
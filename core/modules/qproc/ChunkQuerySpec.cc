@@ -56,6 +56,9 @@ std::ostream& operator<<(std::ostream& os, ChunkQuerySpec const& c) {
         os << "ChunkQuerySpec(db=" << frag->db << ", chunkId=" << frag->chunkId << ", ";
         os << "sTables=" << util::printable(frag->subChunkTables) << ", ";
         os << "queries=" << util::printable(frag->queries) << ", ";
+        if (!frag->subChunkTemplates.empty()) {
+            os << "subChunkTemplates=" << frag->subChunkTemplates.size() << ", ";
+        }
         os << "subChunkIds=" << util::printable(frag->subChunkIds);
         os << ")";
     }
@@ -70,6 +70,11 @@ public:
     DbTableSet subChunkTables;
     std::vector<int> subChunkIds;
     std::vector<std::string> queries;
+    /// Queries of a subchunked spec, when the worker is to build them, with
+    /// the chunk number substituted and cut where the subchunk number goes.
+    /// queries is empty then, in this spec and its fragments, which use the
+    /// templates of the first spec.
+    std::vector<std::vector<std::string>> subChunkTemplates;
     // Consider promoting the concept of container of ChunkQuerySpec
     // in the hopes of increased code cleanliness.
     std::shared_ptr<ChunkQuerySpec> nextFragment; ///< ad-hoc linked list (consider removal)
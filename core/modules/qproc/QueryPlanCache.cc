@@ -0,0 +1,337 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qproc/QueryPlanCache.h"
+
+// System headers
+#include <cctype>
+#include <set>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "query/QueryContext.h"
+#include "query/SelectStmt.h"
+#include "util/Histogram.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qproc.QueryPlanCache");
+
+using lsst::qserv::util::StatsRegistry;
+auto const ctrHits = StatsRegistry::get().counter("qproc.QueryPlanCache.hits");
+auto const ctrParameterizedHits = StatsRegistry::get().counter("qproc.QueryPlanCache.parameterizedHits");
+auto const ctrMisses = StatsRegistry::get().counter("qproc.QueryPlanCache.misses");
+auto const ctrSavedUsec = StatsRegistry::get().counter("qproc.QueryPlanCache.savedUsec");
+auto const ctrEvicted = StatsRegistry::get().counter("qproc.QueryPlanCache.evicted");
+auto const histCompile = StatsRegistry::get().histogram("qproc.QueryPlanCache.compile");
+
+bool isIdChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+bool isDigit(char c) {
+    return std::isdigit(static_cast<unsigned char>(c));
+}
+
+/// @return true if token is a decimal, real or hexadecimal number.
+bool isNumber(std::string const& token) {
+    size_t j = 0;
+    size_t const n = token.size();
+    if (n > 2 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+        for (j = 2; j < n; ++j) {
+            if (!std::isxdigit(static_cast<unsigned char>(token[j]))) return false;
+        }
+        return true;
+    }
+    int digits = 0;
+    for (; j < n && isDigit(token[j]); ++j) ++digits;
+    if (j < n && token[j] == '.') {
+        for (++j; j < n && isDigit(token[j]); ++j) ++digits;
+    }
+    if (digits == 0) return false;
+    if (j < n && (token[j] == 'e' || token[j] == 'E')) {
+        ++j;
+        if (j < n && (token[j] == '+' || token[j] == '-')) ++j;
+        if (j == n) return false;
+        for (; j < n && isDigit(token[j]); ++j) {}
+    }
+    return j == n;
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace qproc {
+
+QueryPlanCache::QueryPlanCache(size_t maxEntries)
+    : _maxEntries(maxEntries) {
+}
+
+std::string QueryPlanCache::normalize(std::string const& sql, std::vector<std::string>& literals) {
+    literals.clear();
+    std::string out;
+    out.reserve(sql.size());
+    bool space = false;   // white space before the next token
+    bool inLimit = false; // numbers of LIMIT and OFFSET are not literals
+    auto append = [&out, &space](std::string const& token) {
+        if (space && !out.empty()) out += ' ';
+        space = false;
+        out += token;
+    };
+
+    size_t const n = sql.size();
+    size_t i = 0;
+    while (i < n) {
+        char const c = sql[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            space = true;
+            ++i;
+        } else if (c == '\'') {
+            // String, with backslash escapes and doubled quotes.
+            size_t j = i + 1;
+            while (j < n) {
+                if (sql[j] == '\\') {
+                    j += 2;
+                } else if (sql[j] == '\'' && j + 1 < n && sql[j + 1] == '\'') {
+                    j += 2;
+                } else if (sql[j] == '\'') {
+                    break;
+                } else {
+                    ++j;
+                }
+            }
+            if (j >= n) {
+                // Unterminated, leave it to the parser.
+                append(sql.substr(i));
+                break;
+            }
+            literals.push_back(sql.substr(i, j + 1 - i));
+            append("'?'");
+            inLimit = false;
+            i = j + 1;
+        } else if (c == '"' || c == '`') {
+            // Quoted identifier, as is.
+            size_t j = sql.find(c, i + 1);
+            if (j == std::string::npos) j = n - 1;
+            append(sql.substr(i, j + 1 - i));
+            inLimit = false;
+            i = j + 1;
+        } else if (isDigit(c) || (c == '.' && i + 1 < n && isDigit(sql[i + 1]))) {
+            size_t j = i;
+            while (j < n) {
+                char const d = sql[j];
+                if (isIdChar(d) || d == '.') {
+                    ++j;
+                } else if ((d == '+' || d == '-') && (sql[j - 1] == 'e' || sql[j - 1] == 'E')
+                           && isDigit(sql[i]) && j + 1 < n && isDigit(sql[j + 1])) {
+                    ++j; // exponent sign
+                } else {
+                    break;
+                }
+            }
+            std::string const token = sql.substr(i, j - i);
+            if (!isNumber(token) || inLimit) {
+                append(token);
+            } else {
+                literals.push_back(token);
+                append("?");
+            }
+            i = j;
+        } else if (isIdChar(c)) {
+            size_t j = i;
+            while (j < n && isIdChar(sql[j])) ++j;
+            std::string const word = sql.substr(i, j - i);
+            append(word);
+            std::string upper(word);
+            for (auto& ch : upper) ch = std::toupper(static_cast<unsigned char>(ch));
+            inLimit = (upper == "LIMIT" || upper == "OFFSET");
+            i = j;
+        } else {
+            append(std::string(1, c));
+            // LIMIT offset, count
+            if (c != ',') inLimit = false;
+            ++i;
+        }
+    }
+    while (!out.empty() && (out.back() == ';' || out.back() == ' ')) {
+        out.pop_back();
+    }
+    return out;
+}
+
+std::string QueryPlanCache::makeKey(std::string const& normalized, std::string const& defaultDb,
+                                    std::string const& cssVersion) {
+    std::string key = defaultDb;
+    key += '\0';
+    key += cssVersion;
+    key += '\0';
+    key += normalized;
+    return key;
+}
+
+QuerySession::Plan::Ptr QueryPlanCache::find(std::string const& key, std::vector<std::string> const& literals) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _entries.find(key);
+    if (iter != _entries.end()) {
+        Entry& entry = iter->second;
+        bool const sameLiterals = (entry.plan->literals == literals);
+        if (sameLiterals || (entry.parameterized && _samePinned(*entry.plan, literals))) {
+            _touch(entry);
+            ++_stats.hits;
+            ctrHits->add();
+            if (!sameLiterals) {
+                ++_stats.parameterizedHits;
+                ctrParameterizedHits->add();
+            }
+            _stats.savedUsec += entry.compileTime.count();
+            ctrSavedUsec->add(entry.compileTime.count());
+            return entry.plan;
+        }
+    }
+    ++_stats.misses;
+    ctrMisses->add();
+    return nullptr;
+}
+
+void QueryPlanCache::insert(std::string const& key, QuerySession::Plan::Ptr const& plan,
+                            std::chrono::microseconds compileTime) {
+    histCompile->record(compileTime.count() > 0 ? compileTime.count() : 0);
+    if (!plan || _maxEntries == 0) return;
+
+    QuerySession::Plan::Ptr oldPlan;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto iter = _entries.find(key);
+        if (iter == _entries.end()) {
+            _lru.push_front(key);
+            Entry entry;
+            entry.plan = plan;
+            entry.compileTime = compileTime;
+            entry.lruIter = _lru.begin();
+            _entries.emplace(key, entry);
+            while (_entries.size() > _maxEntries) {
+                _entries.erase(_lru.back());
+                _lru.pop_back();
+                ctrEvicted->add();
+            }
+            return;
+        }
+        Entry& entry = iter->second;
+        _touch(entry);
+        if (entry.parameterized) {
+            // Another query got here first.
+            return;
+        }
+        if (entry.exactOnly || entry.plan->literals == plan->literals) {
+            entry.plan = plan;
+            entry.compileTime = compileTime;
+            return;
+        }
+        oldPlan = entry.plan;
+    }
+
+    // Setting up a session from a plan takes a fraction of the analysis,
+    // but there is no need to hold up other queries.
+    Verdict const verdict = _canParameterize(*oldPlan, *plan);
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _entries.find(key);
+    if (iter == _entries.end() || iter->second.plan != oldPlan) {
+        return;
+    }
+    Entry& entry = iter->second;
+    switch (verdict) {
+    case Verdict::YES:
+        LOGS(_log, LOG_LVL_DEBUG, "plan is valid for any literals: " << plan->stmt->getQueryTemplate());
+        entry.parameterized = true;
+        return;
+    case Verdict::NO:
+        if (++entry.failedChecks >= MAX_FAILED_CHECKS) {
+            LOGS(_log, LOG_LVL_DEBUG, "plan depends on literals: " << plan->stmt->getQueryTemplate());
+            entry.exactOnly = true;
+        }
+        break;
+    case Verdict::UNKNOWN:
+        break;
+    }
+    // Keep the most recent literals, they are the most likely to come again.
+    entry.plan = plan;
+    entry.compileTime = compileTime;
+}
+
+QueryPlanCache::Stats QueryPlanCache::getStats() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    Stats stats = _stats;
+    stats.entries = _entries.size();
+    return stats;
+}
+
+QueryPlanCache::Verdict QueryPlanCache::_canParameterize(QuerySession::Plan const& plan,
+                                                         QuerySession::Plan const& other) {
+    // Literals of plan are replaced by value, so each must be told apart,
+    // and a literal that did not change says nothing.
+    auto const& literals = plan.literals;
+    if (literals.empty() || literals.size() != other.literals.size()) {
+        return Verdict::UNKNOWN;
+    }
+    if (std::set<std::string>(literals.begin(), literals.end()).size() != literals.size()) {
+        return Verdict::UNKNOWN;
+    }
+    // Pinned literals must not change, a plan is never used for other values.
+    if (plan.pinned != other.pinned || !_samePinned(plan, other.literals)) {
+        return Verdict::UNKNOWN;
+    }
+    std::set<size_t> const pinned(plan.pinned.begin(), plan.pinned.end());
+    for (size_t j = 0; j < literals.size(); ++j) {
+        if (literals[j] == other.literals[j] && pinned.count(j) == 0) {
+            return Verdict::UNKNOWN;
+        }
+    }
+
+    auto const& context = *plan.context;
+    QuerySession session(context.css, context.mysqlSchemaConfig, context.defaultDb);
+    session.analyzeQuery(std::string(), plan, other.literals);
+    if (!session.getError().empty()) {
+        LOGS(_log, LOG_LVL_DEBUG, "failed to set up plan: " << session.getError());
+        return Verdict::UNKNOWN;
+    }
+    return (session.getPlanSignature() == other.signature) ? Verdict::YES : Verdict::NO;
+}
+
+bool QueryPlanCache::_samePinned(QuerySession::Plan const& plan, std::vector<std::string> const& literals) {
+    for (auto j : plan.pinned) {
+        if (j >= literals.size() || literals[j] != plan.literals[j]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void QueryPlanCache::_touch(Entry& entry) {
+    _lru.splice(_lru.begin(), _lru, entry.lruIter);
+}
+
+}}} // namespace lsst::qserv::qproc
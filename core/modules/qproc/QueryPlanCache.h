@@ -0,0 +1,137 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QPROC_QUERYPLANCACHE_H
+#define LSST_QSERV_QPROC_QUERYPLANCACHE_H
+
+// System headers
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "qproc/QuerySession.h"
+
+namespace lsst {
+namespace qserv {
+namespace qproc {
+
+/// QueryPlanCache keeps the plans of recently analyzed SELECT queries, so
+/// that a query seen before is set up from its plan, skipping parse and
+/// analysis.
+///
+/// Queries are looked up by their normalized text, in which numbers and
+/// strings are replaced by placeholders, together with the default database
+/// and the CSS data version, so that a plan is never used once the
+/// definitions it was made from change. A plan first serves only queries
+/// with the same literals. When a query differs from it only by literals, the
+/// plan is set up with the literals of that query and compared to the plan
+/// of its actual analysis. If they agree, the plan serves any literals from
+/// then on, except for its pinned literals (QuerySession::Plan::pinned), such
+/// as a near-neighbor radius, which the analysis checks and which must stay
+/// the same. If they disagree a few times, literals matter to the analysis
+/// of the query and its plans are only ever reused for identical literals.
+///
+/// The cache is shared by all user queries, all methods are thread safe.
+class QueryPlanCache {
+public:
+    using Ptr = std::shared_ptr<QueryPlanCache>;
+
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t parameterizedHits{0}; ///< Hits with literals different from the plan.
+        uint64_t misses{0};
+        uint64_t savedUsec{0}; ///< Analysis time of the plans used by hits.
+        size_t entries{0};
+    };
+
+    /// @param maxEntries - number of plans kept, least recently used plans
+    ///                     are dropped beyond it.
+    explicit QueryPlanCache(size_t maxEntries);
+
+    QueryPlanCache(QueryPlanCache const&) = delete;
+    QueryPlanCache& operator=(QueryPlanCache const&) = delete;
+
+    /// Normalize sql: collapse white space outside quotes, drop a trailing
+    /// semicolon, and replace numbers with ? and single-quoted strings with
+    /// '?'. Numbers of LIMIT and OFFSET are left in place, since the
+    /// analysis uses their values.
+    /// @param literals - set to the replaced literals, in order, with the
+    ///                   quotes of strings.
+    /// @return normalized text.
+    static std::string normalize(std::string const& sql, std::vector<std::string>& literals);
+
+    /// @return the key of a query with normalized text, run with defaultDb
+    ///         as default database against CSS data version cssVersion.
+    static std::string makeKey(std::string const& normalized, std::string const& defaultDb,
+                               std::string const& cssVersion);
+
+    /// @return the plan to set up a query with key and literals from, or
+    ///         nullptr if there is none.
+    QuerySession::Plan::Ptr find(std::string const& key, std::vector<std::string> const& literals);
+
+    /// Keep the plan of a query that was not found.
+    /// @param compileTime - time it took to parse and analyze the query.
+    void insert(std::string const& key, QuerySession::Plan::Ptr const& plan,
+                std::chrono::microseconds compileTime);
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        QuerySession::Plan::Ptr plan;
+        std::chrono::microseconds compileTime{0};
+        bool parameterized{false}; ///< Plan is valid for any unpinned literals.
+        bool exactOnly{false}; ///< Plan is only valid for its own literals.
+        int failedChecks{0}; ///< Number of times the plan was not valid for other literals.
+        std::list<std::string>::iterator lruIter;
+    };
+
+    enum class Verdict { YES, NO, UNKNOWN };
+
+    /// Number of failed checks after which an entry becomes exactOnly.
+    static int const MAX_FAILED_CHECKS = 3;
+
+    /// @return whether plan, set up with the literals of other, gives
+    ///         other. UNKNOWN if their literals do not tell.
+    static Verdict _canParameterize(QuerySession::Plan const& plan, QuerySession::Plan const& other);
+
+    /// @return whether literals has the pinned literals of plan.
+    static bool _samePinned(QuerySession::Plan const& plan, std::vector<std::string> const& literals);
+
+    void _touch(Entry& entry);
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    size_t const _maxEntries;
+    std::map<std::string, Entry> _entries;
+    std::list<std::string> _lru; ///< Keys, most recently used first.
+    Stats _stats;
+};
+
+}}} // namespace lsst::qserv::qproc
+
+#endif // LSST_QSERV_QPROC_QUERYPLANCACHE_H
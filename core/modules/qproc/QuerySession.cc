@@ -39,6 +39,8 @@
 #include <cassert>
 #include <cstddef>
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 
@@ -68,13 +70,26 @@
 #include "qana/TablePlugin.h"
 #include "qana/WherePlugin.h"
 #include "qproc/QueryProcessingBug.h"
+#include "query/BoolTerm.h"
 #include "query/Constraint.h"
+#include "query/FromList.h"
+#include "query/FuncExpr.h"
+#include "query/GroupByClause.h"
+#include "query/HavingClause.h"
+#include "query/JoinRef.h"
+#include "query/JoinSpec.h"
+#include "query/Predicate.h"
 #include "query/QsRestrictor.h"
 #include "query/QueryContext.h"
 #include "query/SelectStmt.h"
 #include "query/SelectList.h"
+#include "query/TableRef.h"
 #include "query/typedefs.h"
+#include "query/ValueExpr.h"
+#include "query/ValueFactor.h"
+#include "query/WhereClause.h"
 #include "util/IterableFormatter.h"
+#include "util/Tracer.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.qproc.QuerySession");
@@ -84,6 +99,181 @@ namespace lsst {
 namespace qserv {
 namespace qproc {
 
+namespace {
+
+/// LiteralReplacer replaces the literals of a plan with those of another
+/// query, in the constants of statements and in restrictor parameters.
+class LiteralReplacer {
+public:
+    /// @param literalMap: maps the literals of the plan to new values.
+    explicit LiteralReplacer(std::map<std::string, std::string> const& literalMap)
+        : _literalMap(literalMap) {}
+
+    /// @return the new value of text, which is text itself unless it is one
+    ///         of the literals. A sign is not part of a numeric literal.
+    std::string operator()(std::string const& text) const {
+        auto iter = _literalMap.find(text);
+        if (iter != _literalMap.end()) {
+            return iter->second;
+        }
+        if (text.size() > 1 && (text[0] == '-' || text[0] == '+')) {
+            iter = _literalMap.find(text.substr(1));
+            if (iter != _literalMap.end()) {
+                return text[0] + iter->second;
+            }
+        }
+        return text;
+    }
+
+    void apply(query::SelectStmt& stmt) {
+        if (_literalMap.empty()) return;
+        query::ValueExprPtrVector exprs;
+        auto selectExprs = stmt.getSelectList().getValueExprList();
+        if (selectExprs) {
+            exprs.insert(exprs.end(), selectExprs->begin(), selectExprs->end());
+        }
+        if (stmt.hasWhereClause()) stmt.getWhereClause().findValueExprs(exprs);
+        if (stmt.hasGroupBy()) stmt.getGroupBy().findValueExprs(exprs);
+        if (stmt.hasHaving()) stmt.getHaving().findValueExprs(exprs);
+        if (stmt.hasOrderBy()) stmt.getOrderBy().findValueExprs(exprs);
+        for (auto const& expr : exprs) {
+            if (expr) _apply(*expr);
+        }
+    }
+
+private:
+    void _apply(query::ValueExpr& expr) {
+        for (auto& factorOp : expr.getFactorOps()) {
+            if (factorOp.factor) _apply(*factorOp.factor);
+        }
+    }
+
+    void _apply(query::ValueFactor& factor) {
+        // Statements may share factors, each must be replaced only once.
+        if (!_done.insert(&factor).second) return;
+        switch (factor.getType()) {
+        case query::ValueFactor::CONST:
+            factor.setTableStar((*this)(factor.getTableStar()));
+            break;
+        case query::ValueFactor::FUNCTION: // fall through
+        case query::ValueFactor::AGGFUNC:
+            if (auto funcExpr = factor.getFuncExpr()) {
+                for (auto const& param : funcExpr->params) {
+                    if (param) _apply(*param);
+                }
+            }
+            break;
+        case query::ValueFactor::EXPR:
+            if (auto expr = factor.getExpr()) _apply(*expr);
+            break;
+        default:
+            break;
+        }
+    }
+
+    std::map<std::string, std::string> const& _literalMap;
+    std::set<query::ValueFactor const*> _done;
+};
+
+/// Give context and the WHERE clauses of stmts restrictors of their own,
+/// with the literals replaced. Restrictors that were shared remain shared.
+void copyRestrictors(query::QueryContext& context,
+                     std::vector<query::SelectStmt*> const& stmts,
+                     LiteralReplacer const& replace) {
+    std::map<query::QsRestrictor const*, query::QsRestrictor::Ptr> copies;
+    auto copyAll = [&copies, &replace](query::QsRestrictor::PtrVector const& restrictors) {
+        auto newRestrictors = std::make_shared<query::QsRestrictor::PtrVector>();
+        for (auto const& restrictor : restrictors) {
+            if (!restrictor) {
+                newRestrictors->push_back(restrictor);
+                continue;
+            }
+            auto& copy = copies[restrictor.get()];
+            if (!copy) {
+                copy = std::make_shared<query::QsRestrictor>(*restrictor);
+                for (auto& param : copy->_params) {
+                    param = replace(param);
+                }
+            }
+            newRestrictors->push_back(copy);
+        }
+        return newRestrictors;
+    };
+    if (context.restrictors) {
+        context.restrictors = copyAll(*context.restrictors);
+    }
+    for (auto stmt : stmts) {
+        if (stmt && stmt->hasWhereClause()) {
+            auto& whereClause = stmt->getWhereClause();
+            if (auto restrictors = whereClause.getRestrs()) {
+                whereClause.setRestrs(copyAll(*restrictors));
+            }
+        }
+    }
+}
+
+/// @return true if expr is a call of scisql_angSep().
+bool isAngSep(query::ValueExprPtr const& expr) {
+    if (!expr || expr->getFactorOps().size() != 1) return false;
+    auto const& factor = expr->getFactorOps().front().factor;
+    if (!factor || factor->getType() != query::ValueFactor::FUNCTION) return false;
+    auto const funcExpr = factor->getFuncExpr();
+    return funcExpr && funcExpr->name == "scisql_angSep";
+}
+
+/// Add the constants of expr to values, without their sign.
+void addConsts(query::ValueExpr const& expr, std::set<std::string>& values) {
+    for (auto const& factorOp : expr.getFactorOps()) {
+        auto const& factor = factorOp.factor;
+        if (!factor) continue;
+        if (factor->getType() == query::ValueFactor::CONST) {
+            std::string text = factor->getTableStar();
+            if (text.size() > 1 && (text[0] == '-' || text[0] == '+')) text.erase(0, 1);
+            values.insert(text);
+        } else if (factor->getType() == query::ValueFactor::EXPR && factor->getExpr()) {
+            addConsts(*factor->getExpr(), values);
+        }
+    }
+}
+
+/// Add to values the constants compared with scisql_angSep() in term.
+/// qana::RelationGraph checks them against the partition overlap, so
+/// the outcome of the analysis depends on their values.
+void findAngSepConsts(std::shared_ptr<query::BoolTerm> const& term, std::set<std::string>& values) {
+    if (!term) return;
+    if (auto factor = std::dynamic_pointer_cast<query::BoolFactor>(term)) {
+        for (auto const& factorTerm : factor->_terms) {
+            if (auto comp = std::dynamic_pointer_cast<query::CompPredicate>(factorTerm)) {
+                if (isAngSep(comp->left) && comp->right) addConsts(*comp->right, values);
+                if (isAngSep(comp->right) && comp->left) addConsts(*comp->left, values);
+            } else if (auto nested = std::dynamic_pointer_cast<query::BoolTermFactor>(factorTerm)) {
+                findAngSepConsts(nested->_term, values);
+            }
+        }
+        return;
+    }
+    for (auto iter = term->iterBegin(), end = term->iterEnd(); iter != end; ++iter) {
+        findAngSepConsts(*iter, values);
+    }
+}
+
+void findAngSepConsts(query::TableRef& tableRef, std::set<std::string>& values) {
+    for (auto const& join : tableRef.getJoins()) {
+        if (!join) continue;
+        if (auto spec = join->getSpec()) findAngSepConsts(spec->getOn(), values);
+        if (auto right = join->getRight()) findAngSepConsts(*right, values);
+    }
+}
+
+void findAngSepConsts(query::SelectStmt& stmt, std::set<std::string>& values) {
+    if (stmt.hasWhereClause()) findAngSepConsts(stmt.getWhereClause().getRootTerm(), values);
+    for (auto const& tableRef : stmt.getFromList().getTableRefList()) {
+        if (tableRef) findAngSepConsts(*tableRef, values);
+    }
+}
+
+} // anonymous namespace
+
 ////////////////////////////////////////////////////////////////////////
 // class QuerySession
 ////////////////////////////////////////////////////////////////////////
@@ -105,6 +295,7 @@ void QuerySession::analyzeQuery(std::string const& sql) {
 
 // Analyze SQL query issued by user
 void QuerySession::analyzeQuery(std::string const& sql, std::shared_ptr<query::SelectStmt> const& stmt) {
+    util::TraceSpan span(_traceId, "QuerySession::analyzeQuery");
     _original = sql;
     _stmt = stmt;
     _isFinal = false;
@@ -113,9 +304,15 @@ void QuerySession::analyzeQuery(std::string const& sql, std::shared_ptr<query::S
 
     try {
         _preparePlugins();
-        _applyLogicPlugins();
+        {
+            util::TraceSpan logicSpan(_traceId, "QuerySession::applyLogicPlugins");
+            _applyLogicPlugins();
+        }
         _generateConcrete();
-        _applyConcretePlugins();
+        {
+            util::TraceSpan concreteSpan(_traceId, "QuerySession::applyConcretePlugins");
+            _applyConcretePlugins();
+        }
 
         LOGS(_log, LOG_LVL_DEBUG, "Query Plugins applied:\n " << *this);
         LOGS(_log, LOG_LVL_TRACE, "ORDER BY clause for mysql-proxy: " << getProxyOrderBy());
@@ -137,6 +334,125 @@ void QuerySession::analyzeQuery(std::string const& sql, std::shared_ptr<query::S
     }
 }
 
+// Set up the session from the plan of an earlier analysis
+void QuerySession::analyzeQuery(std::string const& sql, Plan const& plan,
+                                std::vector<std::string> const& literals) {
+    util::TraceSpan span(_traceId, "QuerySession::analyzeQuery");
+    _original = sql;
+    _isFinal = false;
+
+    try {
+        if (literals.size() != plan.literals.size()) {
+            throw QueryProcessingBug("Plan has " + std::to_string(plan.literals.size())
+                                     + " literals, query has " + std::to_string(literals.size()));
+        }
+        std::map<std::string, std::string> literalMap;
+        for (size_t j = 0; j < literals.size(); ++j) {
+            if (literals[j] != plan.literals[j]) {
+                literalMap[plan.literals[j]] = literals[j];
+            }
+        }
+        LiteralReplacer replace(literalMap);
+
+        _stmt = plan.stmt->clone();
+        _stmtParallel.clear();
+        for (auto const& stmt : plan.stmtParallel) {
+            _stmtParallel.push_back(stmt->clone());
+        }
+        _stmtMerge = plan.stmtMerge->clone();
+        _hasMerge = plan.hasMerge;
+        _context = std::make_shared<query::QueryContext>(*plan.context);
+
+        std::vector<query::SelectStmt*> stmts{_stmt.get(), _stmtMerge.get()};
+        for (auto const& stmt : _stmtParallel) {
+            stmts.push_back(stmt.get());
+        }
+        for (auto stmt : stmts) {
+            replace.apply(*stmt);
+        }
+        copyRestrictors(*_context, stmts, replace);
+
+        // Plugins keep no state that later steps need, only fresh ones are needed.
+        _preparePlugins();
+        LOGS(_log, LOG_LVL_DEBUG, "Query set up from plan:\n " << *this);
+    } catch(QueryProcessingBug& b) {
+        _error = std::string("QuerySession bug:") + b.what();
+    } catch(Bug& b) {
+        _error = std::string("Qserv bug:") + b.what();
+    } catch(std::exception const& e) {
+        _error = std::string("analyzeQuery unexpected:") + e.what();
+    }
+}
+
+QuerySession::Plan::Ptr QuerySession::makePlan(std::vector<std::string> const& literals) const {
+    if (!_error.empty() || !_stmt || !_stmtMerge || !_context || _stmtParallel.empty()) {
+        return nullptr;
+    }
+    auto plan = std::make_shared<Plan>();
+    plan->literals = literals;
+    plan->stmt = _stmt->clone();
+    for (auto const& stmt : _stmtParallel) {
+        plan->stmtParallel.push_back(stmt->clone());
+    }
+    plan->stmtMerge = _stmtMerge->clone();
+    plan->hasMerge = _hasMerge;
+    plan->context = std::make_shared<query::QueryContext>(*_context);
+
+    std::vector<query::SelectStmt*> stmts{plan->stmt.get(), plan->stmtMerge.get()};
+    for (auto const& stmt : plan->stmtParallel) {
+        stmts.push_back(stmt.get());
+    }
+    std::map<std::string, std::string> const noLiterals;
+    copyRestrictors(*plan->context, stmts, LiteralReplacer(noLiterals));
+
+    // A literal with the value of a pinned constant is pinned too, the
+    // literals of a plan are replaced by value.
+    std::set<std::string> pinnedValues;
+    findAngSepConsts(*plan->stmt, pinnedValues);
+    for (auto const& stmt : plan->stmtParallel) {
+        findAngSepConsts(*stmt, pinnedValues);
+    }
+    for (size_t j = 0; j < literals.size(); ++j) {
+        if (pinnedValues.count(literals[j]) != 0) {
+            plan->pinned.push_back(j);
+        }
+    }
+
+    plan->signature = getPlanSignature();
+    return plan;
+}
+
+std::string QuerySession::getPlanSignature() const {
+    std::ostringstream os;
+    for (auto const& stmt : _stmtParallel) {
+        os << "parallel: " << stmt->getQueryTemplate().sqlFragment() << "\n";
+    }
+    if (_stmtMerge) {
+        os << "merge: " << _stmtMerge->getQueryTemplate().sqlFragment() << "\n";
+    }
+    if (_stmt) {
+        os << "original: " << _stmt->getQueryTemplate().sqlFragment() << "\n";
+        os << "proxy: " << getProxyOrderBy() << "\n";
+    }
+    if (_context) {
+        auto constraints = getConstraints();
+        if (constraints) {
+            os << "constraints: " << util::printable(*constraints) << "\n";
+        }
+        os << "dominantDb: " << _context->dominantDb
+           << " chunks: " << _context->hasChunks()
+           << " subChunks: " << _context->hasSubChunks()
+           << " needsMerge: " << _context->needsMerge
+           << " hasMerge: " << _hasMerge << "\n";
+        os << "scanRating: " << _context->scanInfo.scanRating;
+        for (auto const& tbl : _context->scanInfo.infoTables) {
+            os << " " << tbl.db << "." << tbl.table << ":" << tbl.lockInMemory << ":" << tbl.scanRating;
+        }
+        os << "\n";
+    }
+    return os.str();
+}
+
 bool QuerySession::needsMerge() const {
     // Aggregate: having an aggregate fct spec in the select list.
     // Stmt itself knows whether aggregation is present. More
@@ -361,6 +677,9 @@ std::vector<query::QueryTemplate> QuerySession::makeQueryTemplates() {
     std::vector<query::QueryTemplate> queryTemplates;
     for(auto stmtIter=_stmtParallel.begin(), e=_stmtParallel.end(); stmtIter != e; ++stmtIter) {
         queryTemplates.push_back((*stmtIter)->getQueryTemplate());
+        if (_context && _context->queryMapping) {
+            _context->queryMapping->compile(queryTemplates.back());
+        }
     }
     return queryTemplates;
 }
@@ -404,8 +723,27 @@ std::ostream& operator<<(std::ostream& out, QuerySession const& querySession) {
 }
 
 
+/// Build the subchunk templates of chunk chunkId, one for each of
+/// queryTemplates, in order.
+/// @return false if some template can not be cut, in which case the queries
+///         have to be built for every subchunk.
+bool QuerySession::_buildSubChunkTemplates(query::QueryTemplate::Vect const& queryTemplates, int chunkId,
+                                           std::vector<std::vector<std::string>>& subChunkTemplates) const {
+    qana::QueryMapping const& queryMapping = *_context->queryMapping;
+    std::vector<std::vector<std::string>> templates(queryTemplates.size());
+    for (size_t j = 0; j < queryTemplates.size(); ++j) {
+        if (!queryMapping.applyChunk(chunkId, queryTemplates[j], templates[j])) {
+            return false;
+        }
+    }
+    subChunkTemplates.swap(templates);
+    return true;
+}
+
+
 ChunkQuerySpec::Ptr QuerySession::buildChunkQuerySpec(query::QueryTemplate::Vect const& queryTemplates,
-                                                 ChunkSpec const& chunkSpec) const {
+                                                 ChunkSpec const& chunkSpec,
+                                                 bool subChunkTemplates) const {
     auto cQSpec = std::make_shared<ChunkQuerySpec>(_context->dominantDb, chunkSpec.chunkId,
                                                   _context->scanInfo, _scanInteractive);
     // Reset subChunkTables
@@ -416,15 +754,21 @@ ChunkQuerySpec::Ptr QuerySession::buildChunkQuerySpec(query::QueryTemplate::Vect
     if (!_context->hasSubChunks()) {
         cQSpec->queries = _buildChunkQueries(queryTemplates, chunkSpec);
     } else {
+        bool const buildQueries = !(subChunkTemplates
+            && _buildSubChunkTemplates(queryTemplates, chunkSpec.chunkId, cQSpec->subChunkTemplates));
         if (chunkSpec.shouldSplit()) {
             ChunkSpecFragmenter frag(chunkSpec);
             ChunkSpec s = frag.get();
-            cQSpec->queries = _buildChunkQueries(queryTemplates, s);
+            if (buildQueries) {
+                cQSpec->queries = _buildChunkQueries(queryTemplates, s);
+            }
             cQSpec->subChunkIds.assign(s.subChunks.begin(), s.subChunks.end());
             frag.next();
-            cQSpec->nextFragment = _buildFragment(queryTemplates, frag);
+            cQSpec->nextFragment = _buildFragment(queryTemplates, frag, buildQueries);
         } else {
-            cQSpec->queries = _buildChunkQueries(queryTemplates, chunkSpec);
+            if (buildQueries) {
+                cQSpec->queries = _buildChunkQueries(queryTemplates, chunkSpec);
+            }
             cQSpec->subChunkIds.assign(chunkSpec.subChunks.begin(),
                                       chunkSpec.subChunks.end());
         }
@@ -435,7 +779,7 @@ ChunkQuerySpec::Ptr QuerySession::buildChunkQuerySpec(query::QueryTemplate::Vect
 
 std::shared_ptr<ChunkQuerySpec>
 QuerySession::_buildFragment(query::QueryTemplate::Vect const& queryTemplates,
-                             ChunkSpecFragmenter& f) const {
+                             ChunkSpecFragmenter& f, bool buildQueries) const {
     std::shared_ptr<ChunkQuerySpec> first;
     std::shared_ptr<ChunkQuerySpec> last;
     while(!f.isDone()) {
@@ -448,7 +792,9 @@ QuerySession::_buildFragment(query::QueryTemplate::Vect const& queryTemplates,
         }
         ChunkSpec s = f.get();
         last->subChunkIds.assign(s.subChunks.begin(), s.subChunks.end());
-        last->queries = _buildChunkQueries(queryTemplates, s);
+        if (buildQueries) {
+            last->queries = _buildChunkQueries(queryTemplates, s);
+        }
         f.next();
     }
     return first;
@@ -74,6 +74,26 @@ class QuerySession {
 public:
     typedef std::shared_ptr<QuerySession> Ptr;
 
+    /// Plan holds the outcome of the analysis of a query, from which a
+    /// QuerySession for the same query, or for the same query with other
+    /// literal values, is made without parsing or analysis. The statements
+    /// and the context of a Plan are never modified, a QuerySession made from
+    /// it works on copies, so a Plan can be shared between threads.
+    struct Plan {
+        using Ptr = std::shared_ptr<Plan const>;
+
+        std::vector<std::string> literals; ///< Literals of the query, in order.
+        /// Positions of the literals which the analysis checks, such as a
+        /// near-neighbor radius, the plan holds only for their values.
+        std::vector<size_t> pinned;
+        std::shared_ptr<query::SelectStmt> stmt;
+        query::SelectStmtPtrVector stmtParallel;
+        std::shared_ptr<query::SelectStmt> stmtMerge;
+        bool hasMerge{false};
+        std::shared_ptr<query::QueryContext> context;
+        std::string signature; ///< getPlanSignature() of the analyzed query.
+    };
+
     QuerySession(std::shared_ptr<css::CssAccess> css,
                  mysql::MySqlConfig const& mysqlSchemaConfig,
                  std::string const& defaultDb)
@@ -99,6 +119,28 @@ public:
      * @param stmt: parsed select statement
      */
     void analyzeQuery(std::string const& sql, std::shared_ptr<query::SelectStmt> const& stmt);
+    /**
+     * @brief Set up the session from the plan of an earlier analysis
+     *
+     * Every literal of the plan which is different in literals is replaced,
+     * wherever the plan has a constant with the same value. Whether this
+     * gives the same result as the analysis of sql is up to the caller.
+     *
+     * @param sql: the sql query text
+     * @param plan: plan of sql, or of a query that differs only by literals
+     * @param literals: literals of sql, in the order of plan.literals
+     */
+    void analyzeQuery(std::string const& sql, Plan const& plan, std::vector<std::string> const& literals);
+
+    /// @return the plan of the analyzed query, or nullptr if the analysis
+    ///         failed.
+    /// @param literals: literals of the query, in order of appearance.
+    Plan::Ptr makePlan(std::vector<std::string> const& literals) const;
+
+    /// @return a description of everything that the execution of the query
+    ///         takes from the analysis. Two sessions with the same
+    ///         signature run the same way.
+    std::string getPlanSignature() const;
     bool needsMerge() const;
     bool hasChunks() const;
 
@@ -133,8 +175,12 @@ public:
 
     std::shared_ptr<query::SelectStmt> getMergeStmt() const;
 
+    /// @param subChunkTemplates - if true, the queries of a subchunked
+    ///        chunkSpec are left to the worker to build, from the
+    ///        subChunkTemplates of the spec, whenever queryTemplates allow it.
     ChunkQuerySpec::Ptr buildChunkQuerySpec(query::QueryTemplate::Vect const& queryTemplates,
-                                       ChunkSpec const& chunkSpec) const;
+                                       ChunkSpec const& chunkSpec,
+                                       bool subChunkTemplates=false) const;
 
     /// Finalize a query after chunk coverage has been updated
     void finalize();
@@ -151,9 +197,18 @@ public:
     explicit QuerySession(Test& t); ///< Debug constructor
     std::shared_ptr<query::QueryContext> dbgGetContext() { return _context; }
 
+    /// @return the templates of the parallel queries, compiled for the
+    ///         query mapping. Make them once per user query.
     query::QueryTemplate::Vect makeQueryTemplates();
 
     void setScanInteractive();
+    /// @return true if the query can be considered interactive, as decided
+    ///         by setScanInteractive().
+    bool getScanInteractive() const { return _scanInteractive; }
+
+    /// Set the id used to trace this query, 0 if the query is not traced.
+    void setTraceId(uint64_t traceId) { _traceId = traceId; }
+    uint64_t getTraceId() const { return _traceId; }
 
     /**
      *  Print query session to stream.
@@ -176,8 +231,10 @@ private:
 
     std::vector<std::string> _buildChunkQueries(query::QueryTemplate::Vect const& queryTemplates,
                                                 ChunkSpec const& chunkSpec) const;
+    bool _buildSubChunkTemplates(query::QueryTemplate::Vect const& queryTemplates, int chunkId,
+                                 std::vector<std::vector<std::string>>& subChunkTemplates) const;
     std::shared_ptr<ChunkQuerySpec> _buildFragment(query::QueryTemplate::Vect const& queryTemplates,
-                                                   ChunkSpecFragmenter& f) const;
+                                                   ChunkSpecFragmenter& f, bool buildQueries) const;
 
     // Fields
     std::shared_ptr<css::CssAccess> _css; ///< Metadata access
@@ -229,6 +286,7 @@ private:
     /// Maximum number of chunks in an interactive query. TODO: DM-10273 put in config file.
     int const _interactiveChunkLimit{10};
     bool _scanInteractive{true}; ///< True if the query can be considered interactive.
+    uint64_t _traceId{0}; ///< Trace id for util::Tracer, 0 if not traced.
 
 };
 
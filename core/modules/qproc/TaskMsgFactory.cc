@@ -63,10 +63,15 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
     // shared
     taskMsg->set_session(_session);
     taskMsg->set_db(chunkQuerySpec.db);
-    taskMsg->set_protocol(2);
+    // Workers that can not expand query templates reject protocol 3, see
+    // proto/worker.proto.
+    taskMsg->set_protocol(chunkQuerySpec.subChunkTemplates.empty() ? 2 : 3);
     taskMsg->set_queryid(queryId);
     taskMsg->set_jobid(jobId);
     taskMsg->set_attemptcount(attemptCount);
+    if (_traceId != 0) {
+        taskMsg->set_traceid(_traceId);
+    }
     // scanTables (for shared scans)
     // check if more than 1 db in scanInfo
     std::string db;
@@ -90,15 +95,18 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
     // TODO refactor to simplify
     if (chunkQuerySpec.nextFragment.get()) {
         ChunkQuerySpec const* sPtr = &chunkQuerySpec;
+        std::vector<std::vector<std::string>> const noTemplates;
         while(sPtr) {
             LOGS(_log, LOG_LVL_DEBUG, "nextFragment");
             for(unsigned int t=0;t<(sPtr->queries).size();t++){
                 LOGS(_log, LOG_LVL_DEBUG, (sPtr->queries).at(t));
             }
             // Linked fragments will not have valid subChunkTables vectors,
-            // So, we reuse the root fragment's vector.
+            // So, we reuse the root fragment's vector. The templates are
+            // only sent with the first fragment.
             _addFragment(*taskMsg, resultTable, chunkQuerySpec.subChunkTables,
-                         sPtr->subChunkIds, sPtr->queries);
+                         sPtr->subChunkIds, sPtr->queries,
+                         (sPtr == &chunkQuerySpec) ? chunkQuerySpec.subChunkTemplates : noTemplates);
             sPtr = sPtr->nextFragment.get();
         }
     } else {
@@ -107,7 +115,8 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
             LOGS(_log, LOG_LVL_DEBUG, (chunkQuerySpec.queries).at(t));
         }
         _addFragment(*taskMsg, resultTable, chunkQuerySpec.subChunkTables,
-                     chunkQuerySpec.subChunkIds, chunkQuerySpec.queries);
+                     chunkQuerySpec.subChunkIds, chunkQuerySpec.queries,
+                     chunkQuerySpec.subChunkTemplates);
     }
     return taskMsg;
 }
@@ -116,7 +125,8 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
 void TaskMsgFactory::_addFragment(proto::TaskMsg& taskMsg, std::string const& resultName,
                                   DbTableSet const& subChunkTables,
                                   std::vector<int> const& subChunkIds,
-                                  std::vector<std::string> const& queries) {
+                                  std::vector<std::string> const& queries,
+                                  std::vector<std::vector<std::string>> const& subChunkTemplates) {
      proto::TaskMsg::Fragment* frag = taskMsg.add_fragment();
      frag->set_resulttable(resultName);
 
@@ -124,6 +134,14 @@ void TaskMsgFactory::_addFragment(proto::TaskMsg& taskMsg, std::string const& re
          frag->add_query(qry);
      }
 
+     // The worker builds the query of each subchunk from the templates.
+     for(auto& pieces : subChunkTemplates) {
+         proto::TaskMsg_QueryTemplate* qTemplate = frag->add_querytemplate();
+         for(auto& piece : pieces) {
+             qTemplate->add_piece(piece);
+         }
+     }
+
      proto::TaskMsg_Subchunk sc;
 
      // Add the db+table pairs to the subchunk.
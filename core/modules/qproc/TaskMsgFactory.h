@@ -51,7 +51,8 @@ class TaskMsgFactory {
 public:
     using Ptr = std::shared_ptr<TaskMsgFactory>;
 
-    TaskMsgFactory(uint64_t session) : _session(session) {}
+    /// @param traceId - trace id to propagate to workers, 0 if the query is not traced.
+    TaskMsgFactory(uint64_t session, uint64_t traceId=0) : _session(session), _traceId(traceId) {}
     virtual ~TaskMsgFactory() {}
 
     /// Construct a TaskMsg and serialize it to a stream
@@ -67,10 +68,12 @@ private:
 
     void _addFragment(proto::TaskMsg& taskMsg, std::string const& resultName,
                       DbTableSet const& subChunkTables, std::vector<int> const& subChunkIds,
-                      std::vector<std::string> const& queries);
+                      std::vector<std::string> const& queries,
+                      std::vector<std::vector<std::string>> const& subChunkTemplates);
 
     /// All member variable need to be thread safe.
     uint64_t const _session;
+    uint64_t const _traceId;
 };
 
 }}} // namespace lsst::qserv::qproc
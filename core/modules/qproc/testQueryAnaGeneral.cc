@@ -34,11 +34,15 @@
 
 // System headers
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <iterator>
 #include <map>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 // Third-party headers
 #include "boost/algorithm/string.hpp"
@@ -50,10 +54,14 @@
 // Qserv headers
 #include "parser/ParseException.h"
 #include "parser/SelectParser.h"
+#include "proto/worker.pb.h"
 #include "qdisp/ChunkMeta.h"
+#include "qana/QueryMapping.h"
 #include "qproc/QuerySession.h"
+#include "qproc/TaskMsgFactory.h"
 #include "query/QsRestrictor.h"
 #include "query/QueryContext.h"
+#include "query/QueryTemplate.h"
 #include "query/SelectStmt.h"
 #include "tests/QueryAnaFixture.h"
 
@@ -61,9 +69,12 @@
 using lsst::qserv::parser::SelectParser;
 using lsst::qserv::qproc::ChunkQuerySpec;
 using lsst::qserv::qproc::ChunkSpec;
+using lsst::qserv::qproc::ChunkSpecSingle;
 using lsst::qserv::qproc::QuerySession;
+using lsst::qserv::qproc::TaskMsgFactory;
 using lsst::qserv::query::QsRestrictor;
 using lsst::qserv::query::QueryContext;
+using lsst::qserv::query::QueryTemplate;
 using lsst::qserv::query::SelectStmt;
 using lsst::qserv::StringPair;
 using lsst::qserv::tests::QueryAnaFixture;
@@ -701,6 +712,173 @@ BOOST_AUTO_TEST_CASE(FuncExprPred) {
     BOOST_CHECK_EQUAL(queries[0], expected);
 }
 
+BOOST_AUTO_TEST_CASE(CompiledTemplates) {
+    // Subchunked near-neighbor query, its queries are generated per subchunk.
+    std::string stmt = "select count(*) from Object as o1, Object as o2 "
+        "where qserv_areaspec_box(6,6,7,7) AND rFlux_PS<0.005 AND "
+        "scisql_angSep(o1.ra_Test,o1.decl_Test,o2.ra_Test,o2.decl_Test) < 0.001;";
+    std::shared_ptr<QuerySession> qs = queryAnaHelper.buildQuerySession(qsTest, stmt);
+    std::shared_ptr<QueryContext> context = qs->dbgGetContext();
+    BOOST_REQUIRE(context);
+    BOOST_REQUIRE(context->queryMapping);
+    auto const& mapping = *context->queryMapping;
+    auto compiled = qs->makeQueryTemplates();
+    QueryTemplate::Vect entryByEntry;
+    for (auto const& parallel : qs->getStmtParallel()) {
+        entryByEntry.push_back(parallel->getQueryTemplate());
+    }
+    BOOST_REQUIRE_EQUAL(compiled.size(), entryByEntry.size());
+    for (auto const& t : compiled) {
+        BOOST_REQUIRE(t.getCompiledPatterns() != nullptr);
+    }
+
+    int const chunkCount = 100000;
+    // Compiled templates generate the same queries, checked on a sample of chunks.
+    for (int chunkId = 0; chunkId < chunkCount; chunkId += 997) {
+        ChunkSpecSingle s;
+        s.chunkId = chunkId;
+        s.subChunkId = chunkId % 1000;
+        for (size_t j = 0; j < compiled.size(); ++j) {
+            BOOST_CHECK_EQUAL(mapping.apply(s, compiled[j]), mapping.apply(s, entryByEntry[j]));
+        }
+    }
+
+    // Benchmark.
+    auto generateAll = [&mapping, chunkCount](QueryTemplate::Vect const& templates) {
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        for (int chunkId = 0; chunkId < chunkCount; ++chunkId) {
+            ChunkSpecSingle s;
+            s.chunkId = chunkId;
+            s.subChunkId = chunkId % 1000;
+            for (auto const& t : templates) {
+                bytes += mapping.apply(s, t).size();
+            }
+        }
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+        return std::make_pair(secs.count(), bytes);
+    };
+    auto compiledRun = generateAll(compiled);
+    auto entryRun = generateAll(entryByEntry);
+    BOOST_CHECK_EQUAL(compiledRun.second, entryRun.second);
+    std::cout << chunkCount << " chunks: compiled templates " << compiledRun.first
+              << "s, entry by entry " << entryRun.first << "s\n";
+}
+
+BOOST_AUTO_TEST_CASE(SubChunkTemplates) {
+    std::string stmt = "select count(*) from Object as o1, Object as o2 "
+        "where qserv_areaspec_box(6,6,7,7) AND rFlux_PS<0.005 AND "
+        "scisql_angSep(o1.ra_Test,o1.decl_Test,o2.ra_Test,o2.decl_Test) < 0.001;";
+    std::shared_ptr<QuerySession> qs = queryAnaHelper.buildQuerySession(qsTest, stmt);
+    auto queryTemplates = qs->makeQueryTemplates();
+    // Enough subchunks for the spec to be split in fragments.
+    ChunkSpec chunkSpec;
+    chunkSpec.chunkId = 100;
+    for (int sc = 0; sc < 500; ++sc) {
+        chunkSpec.subChunks.push_back(100000 + sc);
+    }
+    auto expanded = qs->buildChunkQuerySpec(queryTemplates, chunkSpec);
+    auto templated = qs->buildChunkQuerySpec(queryTemplates, chunkSpec, true);
+    BOOST_CHECK(expanded->subChunkTemplates.empty());
+    BOOST_REQUIRE_EQUAL(templated->subChunkTemplates.size(), queryTemplates.size());
+    BOOST_REQUIRE(templated->nextFragment);
+
+    // Queries built from the templates, the way a worker does, are the same.
+    int fragments = 0;
+    for (ChunkQuerySpec const *e = expanded.get(), *t = templated.get();
+         e != nullptr || t != nullptr; e = e->nextFragment.get(), t = t->nextFragment.get()) {
+        BOOST_REQUIRE(e != nullptr && t != nullptr);
+        BOOST_CHECK(t->queries.empty());
+        BOOST_CHECK(t->subChunkIds == e->subChunkIds);
+        std::vector<std::string> built;
+        for (int subChunk : t->subChunkIds) {
+            for (auto const& pieces : templated->subChunkTemplates) {
+                built.push_back(boost::algorithm::join(pieces, std::to_string(subChunk)));
+            }
+        }
+        BOOST_CHECK_EQUAL_COLLECTIONS(built.begin(), built.end(), e->queries.begin(), e->queries.end());
+        ++fragments;
+    }
+    BOOST_CHECK(fragments > 1);
+
+    TaskMsgFactory factory(1);
+    std::ostringstream expandedMsg;
+    factory.serializeMsg(*expanded, "r_1", 1, 1, 0, expandedMsg);
+    std::ostringstream templatedMsg;
+    factory.serializeMsg(*templated, "r_1", 1, 1, 0, templatedMsg);
+    std::cout << chunkSpec.subChunks.size() << " subchunks: TaskMsg of " << expandedMsg.str().size()
+              << " bytes, " << templatedMsg.str().size() << " bytes with templates\n";
+    BOOST_CHECK(10 * templatedMsg.str().size() < expandedMsg.str().size());
+
+    // Workers that can not expand the templates refuse the protocol.
+    lsst::qserv::proto::TaskMsg msg;
+    BOOST_REQUIRE(msg.ParseFromString(templatedMsg.str()));
+    BOOST_CHECK_EQUAL(msg.protocol(), 3);
+    BOOST_REQUIRE(msg.fragment_size() > 1);
+    BOOST_CHECK_EQUAL(msg.fragment(0).query_size(), 0);
+    lsst::qserv::proto::TaskMsg expandedTaskMsg;
+    BOOST_REQUIRE(expandedTaskMsg.ParseFromString(expandedMsg.str()));
+    BOOST_CHECK_EQUAL(expandedTaskMsg.protocol(), 2);
+    BOOST_CHECK_EQUAL(msg.fragment(0).querytemplate_size(), static_cast<int>(queryTemplates.size()));
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentAnalysis) {
+    // Queries are analyzed concurrently, sharing one CssAccess, the way the
+    // czar does for its clients. Each thread must get what a single thread gets.
+    std::vector<std::pair<std::string, bool>> const stmts = {
+        {"SELECT * FROM Object WHERE someField > 5.0;", false},
+        {"select * from Object where qserv_areaspec_box(0,0,1,1);", false},
+        {"select count(*) from Object as o1, Object as o2 "
+         "where qserv_areaspec_box(6,6,7,7) AND rFlux_PS<0.005 AND "
+         "scisql_angSep(o1.ra_Test,o1.decl_Test,o2.ra_Test,o2.decl_Test) < 0.001;", true},
+        {" SELECT count(*) AS n, AVG(ra_PS), AVG(decl_PS), _chunkId FROM Object GROUP BY _chunkId;", false},
+        {"select * from LSST.Object WHERE ra_PS BETWEEN 150 AND 150.2 and decl_PS between 1.6 and 1.7 "
+         "ORDER BY objectId;", false}
+    };
+    auto firstQuery = [this](std::string const& stmt, bool withSubChunks) {
+        auto qs = std::make_shared<QuerySession>(qsTest);
+        qs->analyzeQuery(stmt);
+        if (!qs->getError().empty()) return "error: " + qs->getError();
+        qs->addChunk(ChunkSpec::makeFake(100, withSubChunks));
+        auto queryTemplates = qs->makeQueryTemplates();
+        auto spec = qs->buildChunkQuerySpec(queryTemplates, *qs->cQueryBegin());
+        std::string merge = qs->needsMerge() ? qs->getMergeStmt()->getQueryTemplate().sqlFragment() : "";
+        return spec->queries.at(0) + " | " + merge;
+    };
+    std::vector<std::string> expected;
+    for (auto const& stmt : stmts) {
+        expected.push_back(firstQuery(stmt.first, stmt.second));
+        BOOST_CHECK(expected.back().compare(0, 6, "error:") != 0);
+    }
+
+    int const threadCount = 8;
+    int const rounds = 20;
+    std::atomic<int> mismatches{0};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int r = 0; r < rounds; ++r) {
+                // Threads go through the statements in different orders.
+                size_t j = (t + r) % stmts.size();
+                try {
+                    if (firstQuery(stmts[j].first, stmts[j].second) != expected[j]) ++mismatches;
+                } catch (...) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << threadCount * rounds << " queries analyzed on " << threadCount
+              << " threads in " << elapsed.count() << " ms\n";
+    BOOST_CHECK_EQUAL(mismatches, 0);
+    BOOST_CHECK_EQUAL(failures, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 ////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,244 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+/**
+  * @file
+  *
+  * @brief Test the cache of query plans, and the sessions set up from them.
+  */
+
+// System headers
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Boost unit test header
+#define BOOST_TEST_MODULE QueryPlanCache
+#include "boost/test/included/unit_test.hpp"
+
+// Qserv headers
+#include "qproc/ChunkQuerySpec.h"
+#include "qproc/ChunkSpec.h"
+#include "qproc/QueryPlanCache.h"
+#include "qproc/QuerySession.h"
+#include "query/SelectStmt.h"
+#include "tests/QueryAnaFixture.h"
+#include "util/IterableFormatter.h"
+
+using lsst::qserv::qproc::ChunkSpec;
+using lsst::qserv::qproc::QueryPlanCache;
+using lsst::qserv::qproc::QuerySession;
+using lsst::qserv::tests::QueryAnaFixture;
+
+namespace util = lsst::qserv::util;
+
+namespace {
+
+std::chrono::microseconds const compileTime(1000);
+
+/// @return the first chunk query, merge query and constraints of qs.
+std::string firstQuery(QuerySession& qs) {
+    if (!qs.getError().empty()) return "error: " + qs.getError();
+    qs.addChunk(ChunkSpec::makeFake(100, false));
+    auto queryTemplates = qs.makeQueryTemplates();
+    auto spec = qs.buildChunkQuerySpec(queryTemplates, *qs.cQueryBegin());
+    std::string merge = qs.needsMerge() ? qs.getMergeStmt()->getQueryTemplate().sqlFragment() : "";
+    std::string constraints;
+    if (auto cv = qs.getConstraints()) {
+        std::ostringstream os;
+        os << util::printable(*cv);
+        constraints = os.str();
+    }
+    return spec->queries.at(0) + " | " + merge + " | " + constraints;
+}
+
+} // anonymous namespace
+
+struct PlanCacheFixture : public QueryAnaFixture {
+
+    /// Analyze sql and keep its plan in cache.
+    /// @return the session of the analysis.
+    std::shared_ptr<QuerySession> analyze(std::string const& sql, std::string& key) {
+        std::vector<std::string> literals;
+        key = QueryPlanCache::makeKey(QueryPlanCache::normalize(sql, literals), qsTest.defaultDb, "");
+        auto qs = std::make_shared<QuerySession>(qsTest);
+        qs->analyzeQuery(sql);
+        BOOST_REQUIRE_EQUAL(qs->getError(), "");
+        cache.insert(key, qs->makePlan(literals), compileTime);
+        return qs;
+    }
+
+    /// @return the session set up from the cached plan of sql, nullptr if
+    ///         there is none.
+    std::shared_ptr<QuerySession> fromCache(std::string const& sql) {
+        std::vector<std::string> literals;
+        auto key = QueryPlanCache::makeKey(QueryPlanCache::normalize(sql, literals), qsTest.defaultDb, "");
+        auto plan = cache.find(key, literals);
+        if (!plan) return nullptr;
+        auto qs = std::make_shared<QuerySession>(qsTest);
+        qs->analyzeQuery(sql, *plan, literals);
+        return qs;
+    }
+
+    /// Check that the session set up from cache for sql runs like its analysis.
+    void checkSame(std::string const& sql) {
+        auto cached = fromCache(sql);
+        BOOST_REQUIRE(cached);
+        QuerySession analyzed(qsTest);
+        analyzed.analyzeQuery(sql);
+        BOOST_CHECK_EQUAL(cached->getPlanSignature(), analyzed.getPlanSignature());
+        BOOST_CHECK_EQUAL(firstQuery(*cached), firstQuery(analyzed));
+    }
+
+    QueryPlanCache cache{10};
+};
+
+BOOST_FIXTURE_TEST_SUITE(PlanCache, PlanCacheFixture)
+
+BOOST_AUTO_TEST_CASE(Normalize) {
+    std::vector<std::string> literals;
+    BOOST_CHECK_EQUAL(QueryPlanCache::normalize("SELECT  *\n FROM Object WHERE objectId = 12345 ;", literals),
+                      "SELECT * FROM Object WHERE objectId = ?");
+    BOOST_REQUIRE_EQUAL(literals.size(), 1U);
+    BOOST_CHECK_EQUAL(literals[0], "12345");
+
+    BOOST_CHECK_EQUAL(QueryPlanCache::normalize("select a from T where x between -1.5e+3 and .5 "
+                                                "and s = 'it''s' and `c 1`=\"d 2\" LIMIT 10, 20", literals),
+                      "select a from T where x between -? and ? and s = '?' and `c 1`=\"d 2\" LIMIT 10, 20");
+    std::vector<std::string> const expected{"1.5e+3", ".5", "'it''s'"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(literals.begin(), literals.end(), expected.begin(), expected.end());
+
+    BOOST_CHECK_EQUAL(QueryPlanCache::normalize("SELECT t1.c2 FROM t1 WHERE c2 IN (1,0x1F) LIMIT 5 OFFSET 7",
+                                                literals),
+                      "SELECT t1.c2 FROM t1 WHERE c2 IN (?,?) LIMIT 5 OFFSET 7");
+    BOOST_CHECK_EQUAL(literals.size(), 2U);
+
+    // Default database and CSS version are part of the key.
+    BOOST_CHECK(QueryPlanCache::makeKey("q", "LSST", "1") != QueryPlanCache::makeKey("q", "LSST", "2"));
+    BOOST_CHECK(QueryPlanCache::makeKey("q", "LSST", "1") != QueryPlanCache::makeKey("q", "Other", "1"));
+}
+
+BOOST_AUTO_TEST_CASE(ExactHit) {
+    std::string const sql = "select * from LSST.Object WHERE ra_PS BETWEEN 150 AND 150.2 "
+                            "and decl_PS between 1.6 and 1.7 ORDER BY objectId;";
+    std::string key;
+    analyze(sql, key);
+    checkSame(sql);
+    // Until a query with other literals confirms it, the plan is only used
+    // for the same literals.
+    BOOST_CHECK(!fromCache("select * from LSST.Object WHERE ra_PS BETWEEN 151 AND 151.2 "
+                           "and decl_PS between 1.6 and 1.7 ORDER BY objectId;"));
+    auto stats = cache.getStats();
+    BOOST_CHECK_EQUAL(stats.hits, 1U);
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+    BOOST_CHECK_EQUAL(stats.savedUsec, 1000U);
+}
+
+BOOST_AUTO_TEST_CASE(Parameterized) {
+    std::string key;
+    analyze("select * from Object where qserv_areaspec_box(2.5,3.5,4.5,5.5) AND rFlux_PS<0.005;", key);
+    analyze("select * from Object where qserv_areaspec_box(6.25,7.25,8.25,9.25) AND rFlux_PS<0.0075;", key);
+    // Both plans agreed, any literals now hit, including repeated ones.
+    checkSame("select * from Object where qserv_areaspec_box(0,5,1,5) AND rFlux_PS<1;");
+    checkSame("select * from Object where qserv_areaspec_box(10.5,11.5,12.5,13.5) AND rFlux_PS<0.1;");
+
+    // Secondary index constraints follow the literals.
+    analyze("select * from Object where objectIdObjTest in (2,3145,9999);", key);
+    analyze("select * from Object where objectIdObjTest in (3,4,5);", key);
+    checkSame("select * from Object where objectIdObjTest in (7,7,386950783579546);");
+
+    auto stats = cache.getStats();
+    BOOST_CHECK_EQUAL(stats.hits, 3U);
+    BOOST_CHECK_EQUAL(stats.parameterizedHits, 3U);
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(LiteralsMatter) {
+    // The areaspec restriction becomes "s2PtInBox(...) = 1", which a
+    // literal 1 of the plan can not be told apart from.
+    std::string const sql1 = "select * from Object where qserv_areaspec_box(1,2,3,4);";
+    std::string const sql2 = "select * from Object where qserv_areaspec_box(5,1,6,7);";
+    std::string key;
+    auto qs1 = analyze(sql1, key);
+    std::vector<std::string> literals;
+    QueryPlanCache::normalize(sql2, literals);
+    QuerySession fromPlan(qsTest);
+    fromPlan.analyzeQuery(sql2, *qs1->makePlan({"1", "2", "3", "4"}), literals);
+    QuerySession analyzed(qsTest);
+    analyzed.analyzeQuery(sql2);
+    BOOST_CHECK(fromPlan.getPlanSignature() != analyzed.getPlanSignature());
+
+    // Each plan is checked against the next query, and fails.
+    analyze(sql2, key);
+    analyze("select * from Object where qserv_areaspec_box(8,9,1,10);", key);
+    analyze("select * from Object where qserv_areaspec_box(11,12,13,1);", key);
+    BOOST_CHECK(!fromCache("select * from Object where qserv_areaspec_box(20,21,22,23);"));
+    // Plans of the same literals are still used.
+    checkSame("select * from Object where qserv_areaspec_box(11,12,13,1);");
+}
+
+BOOST_AUTO_TEST_CASE(NearNeighborRadius) {
+    // The radius is checked against the partition overlap (0.025), a plan
+    // never serves another radius.
+    std::string const prefix = "select count(*) from Object as o1, Object as o2 where o1.rFlux_PS<";
+    std::string const angSep = " AND scisql_angSep(o1.ra_Test,o1.decl_Test,o2.ra_Test,o2.decl_Test) < ";
+    std::string key;
+    auto qs = analyze(prefix + "0.005" + angSep + "0.001;", key);
+    std::vector<std::string> literals;
+    QueryPlanCache::normalize(prefix + "0.005" + angSep + "0.001;", literals);
+    std::vector<size_t> const pinned{1};
+    auto const plan = qs->makePlan(literals);
+    BOOST_CHECK_EQUAL_COLLECTIONS(plan->pinned.begin(), plan->pinned.end(), pinned.begin(), pinned.end());
+
+    analyze(prefix + "0.0075" + angSep + "0.002;", key);
+    BOOST_CHECK(!fromCache(prefix + "0.01" + angSep + "0.003;"));
+
+    // Other literals are parameters.
+    analyze(prefix + "0.0075" + angSep + "0.001;", key);
+    analyze(prefix + "0.006" + angSep + "0.001;", key);
+    checkSame(prefix + "0.1" + angSep + "0.001;");
+
+    // A radius larger than the overlap must be analyzed, and fail.
+    std::string const tooLarge = prefix + "0.1" + angSep + "10;";
+    BOOST_CHECK(!fromCache(tooLarge));
+    QuerySession analyzed(qsTest);
+    analyzed.analyzeQuery(tooLarge);
+    BOOST_CHECK(!analyzed.getError().empty());
+}
+
+BOOST_AUTO_TEST_CASE(Eviction) {
+    QueryPlanCache small(1);
+    std::string const sql = "SELECT * FROM Object WHERE someField > 5.0;";
+    std::vector<std::string> literals;
+    auto key = QueryPlanCache::makeKey(QueryPlanCache::normalize(sql, literals), "LSST", "");
+    QuerySession qs(qsTest);
+    qs.analyzeQuery(sql);
+    small.insert(key, qs.makePlan(literals), compileTime);
+    BOOST_CHECK(small.find(key, literals));
+    small.insert("other", qs.makePlan(literals), compileTime);
+    BOOST_CHECK(!small.find(key, literals));
+    BOOST_CHECK_EQUAL(small.getStats().entries, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -97,6 +97,10 @@ OrderByTerm::renderTo(QueryTemplate& qt) const {
     }
 }
 
+OrderByTerm::Order OrderByTerm::getOrder() const {
+    return _order;
+}
+
 std::string OrderByTerm::sqlFragment() const {
     std::ostringstream oss;
     oss << *this;
@@ -151,7 +155,15 @@ OrderByClause::renderTo(QueryTemplate& qt) const {
 }
 
 std::shared_ptr<OrderByClause> OrderByClause::clone() const {
-    return std::make_shared<OrderByClause>(*this); // FIXME
+    auto newClause = std::make_shared<OrderByClause>();
+    for (auto const& term : *_terms) {
+        OrderByTerm newTerm(term);
+        if (newTerm.getExpr()) {
+            newTerm.getExpr() = newTerm.getExpr()->clone();
+        }
+        newClause->_addTerm(newTerm);
+    }
+    return newClause;
 }
 std::shared_ptr<OrderByClause> OrderByClause::copySyntax() {
     return std::make_shared<OrderByClause>(*this);
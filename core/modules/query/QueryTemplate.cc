@@ -35,8 +35,11 @@
 #include "query/QueryTemplate.h"
 
 // System headers
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
 // Third-party headers
 
@@ -123,17 +126,20 @@ std::ostream& operator<<(std::ostream& os, QueryTemplate const& queryTemplate) {
 void QueryTemplate::append(std::string const& s) {
     std::shared_ptr<Entry> e = std::make_shared<StringEntry>(s);
     _entries.push_back(e);
+    _compiled.reset();
 }
 
 
 void QueryTemplate::append(ColumnRef const& cr) {
     std::shared_ptr<Entry> e = std::make_shared<ColumnEntry>(cr);
     _entries.push_back(e);
+    _compiled.reset();
 }
 
 
 void QueryTemplate::append(QueryTemplate::Entry::Ptr const& e) {
     _entries.push_back(e);
+    _compiled.reset();
 }
 
 
@@ -149,6 +155,120 @@ std::string QueryTemplate::generate(EntryMapping const& em) const {
 void
 QueryTemplate::clear() {
     _entries.clear();
+    _compiled.reset();
+}
+
+
+bool QueryTemplate::compile(std::vector<std::string> const& patterns) {
+    // Values are digits, so a pattern without digits can neither match
+    // inside a value nor across one, and the patterns replaced in one entry
+    // can be found in the entry's original text.
+    for (auto const& pat : patterns) {
+        if (pat.empty() || std::any_of(pat.begin(), pat.end(), ::isdigit)) {
+            LOGS(_log, LOG_LVL_DEBUG, "not compiling template for pattern " << pat);
+            _compiled.reset();
+            return false;
+        }
+    }
+    auto compiled = std::make_shared<Compiled>();
+    compiled->patterns = patterns;
+    compiled->counts.assign(patterns.size(), 0);
+    auto& spans = compiled->spans;
+    auto appendLiteral = [&spans](std::string const& text) {
+        if (text.empty()) return;
+        if (spans.empty() || spans.back().placeholder >= 0) {
+            spans.push_back(Span{text, -1});
+        } else {
+            spans.back().text += text;
+        }
+    };
+
+    std::string lastEntry;
+    for (auto const& entry : _entries) {
+        std::vector<Span> parts{Span{entry->getValue(), -1}};
+        for (size_t p = 0; p < patterns.size(); ++p) {
+            std::vector<Span> split;
+            for (auto const& part : parts) {
+                if (part.placeholder >= 0) {
+                    split.push_back(part);
+                    continue;
+                }
+                size_t i = 0;
+                while (true) {
+                    size_t j = part.text.find(patterns[p], i);
+                    split.push_back(Span{part.text.substr(i, j - i), -1});
+                    if (j == std::string::npos) {
+                        break;
+                    }
+                    split.push_back(Span{std::string(), static_cast<int>(p)});
+                    i = j + patterns[p].size();
+                }
+            }
+            parts.swap(split);
+        }
+        // The entry as it would be mapped, with a digit for every value, to
+        // place separators the way operator<< does.
+        std::string entryStr;
+        for (auto const& part : parts) {
+            entryStr += (part.placeholder < 0) ? part.text : std::string("0");
+        }
+        if (entryStr.empty()) {
+            break;
+        }
+        if (!lastEntry.empty()
+          && lsst::qserv::sql::sqlShouldSeparate(lastEntry, *lastEntry.rbegin(), entryStr.at(0))) {
+            appendLiteral(" ");
+        }
+        for (auto const& part : parts) {
+            if (part.placeholder < 0) {
+                appendLiteral(part.text);
+            } else {
+                spans.push_back(part);
+                ++compiled->counts[part.placeholder];
+            }
+        }
+        lastEntry = entryStr;
+    }
+    for (auto const& span : spans) {
+        compiled->literalSize += span.text.size();
+    }
+    _compiled = compiled;
+    return true;
+}
+
+
+std::string QueryTemplate::generate(std::vector<std::string> const& values) const {
+    if (_compiled == nullptr || values.size() != _compiled->patterns.size()) {
+        throw std::logic_error("QueryTemplate::generate values do not match compiled template");
+    }
+    size_t size = _compiled->literalSize;
+    for (size_t p = 0; p < values.size(); ++p) {
+        size += _compiled->counts[p] * values[p].size();
+    }
+    std::string str;
+    str.reserve(size);
+    for (auto const& span : _compiled->spans) {
+        str += (span.placeholder < 0) ? span.text : values[span.placeholder];
+    }
+    return str;
+}
+
+
+std::vector<std::string> QueryTemplate::generatePieces(std::vector<std::string> const& values) const {
+    if (_compiled == nullptr || values.size() != _compiled->patterns.size()) {
+        throw std::logic_error("QueryTemplate::generatePieces values do not match compiled template");
+    }
+    std::vector<std::string> pieces(1);
+    for (auto const& span : _compiled->spans) {
+        if (span.placeholder < 0) {
+            pieces.back() += span.text;
+        } else if (values[span.placeholder].empty()) {
+            pieces.emplace_back();
+        } else {
+            pieces.back() += values[span.placeholder];
+        }
+    }
+    return pieces;
 }
 
 }}} // namespace lsst::qserv::query
@@ -135,6 +135,35 @@ public:
     std::string generate(EntryMapping const& em) const;
     void clear();
 
+    /// Compile the template for generate(values), so that producing a query
+    /// for a chunk is a single pre-sized append instead of mapping every
+    /// entry. The text of the entries, with the separators sqlFragment() puts
+    /// between them, is split into literal spans and placeholders, where
+    /// placeholder i stands for patterns[i]. Patterns are replaced in order,
+    /// like applying a mapping that replaces them one after the other.
+    /// Appending to the template discards the compiled form.
+    /// @return false, leaving the template uncompiled, if a pattern is empty
+    ///         or contains a digit.
+    bool compile(std::vector<std::string> const& patterns);
+
+    /// @return the patterns the template was compiled for, nullptr if it
+    ///         is not compiled.
+    std::vector<std::string> const* getCompiledPatterns() const {
+        return (_compiled == nullptr) ? nullptr : &_compiled->patterns;
+    }
+
+    /// Generate a query from the compiled template, replacing placeholder i
+    /// with values[i]. The query is the same as the one generate() produces
+    /// with a mapping that replaces the patterns with the values, as long as
+    /// every value is a non-empty string of digits, like a chunk number.
+    std::string generate(std::vector<std::string> const& values) const;
+
+    /// Generate a query from the compiled template like generate(values),
+    /// but cut it at the placeholders whose value is empty, so that a number
+    /// can be put there later.
+    /// @return the pieces of the query, one more than the cuts.
+    std::vector<std::string> generatePieces(std::vector<std::string> const& values) const;
+
     template <class T>
     static std::ostream& renderDbg(std::ostream& os, T const& t) {
         QueryTemplate qt;
@@ -143,7 +172,20 @@ public:
     }
 
 private:
+    /// A span of literal text, or a placeholder.
+    struct Span {
+        std::string text;
+        int placeholder; ///< Index of the pattern, -1 for literal text.
+    };
+    struct Compiled {
+        std::vector<std::string> patterns;
+        std::vector<Span> spans;
+        size_t literalSize{0}; ///< Size of all the literal text.
+        std::vector<size_t> counts; ///< Number of spans of each placeholder.
+    };
+
     EntryPtrVector _entries;
+    std::shared_ptr<Compiled const> _compiled; ///< Shared by copies of the template.
 };
 
 }}} // namespace lsst::qserv::query
@@ -80,6 +80,7 @@ public:
     void findValueExprs(ValueExprPtrVector& list);
 
     void resetRestrs();
+    void setRestrs(std::shared_ptr<QsRestrictor::PtrVector> const& restrs) { _restrs = restrs; }
     void prependAndTerm(std::shared_ptr<BoolTerm> t);
 
 private:
@@ -0,0 +1,705 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/HashAggregator.h"
+
+// System headers
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "query/ColumnRef.h"
+#include "query/FuncExpr.h"
+#include "query/GroupByClause.h"
+#include "query/SelectList.h"
+#include "query/SelectStmt.h"
+#include "query/ValueExpr.h"
+#include "query/ValueFactor.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.HashAggregator");
+
+using Int128 = __int128;
+
+/// Extra digits after the decimal point MySQL gives the result of a
+/// division (div_precision_increment).
+int const DIV_PRECISION_INCREMENT = 4;
+
+/// @return the column name if ve is a plain column reference, otherwise "".
+std::string columnName(lsst::qserv::query::ValueExpr const& ve) {
+    auto cr = ve.getColumnRef();
+    return cr ? cr->column : std::string();
+}
+
+/// @return the upper case function name and column argument of a factor of
+///         the form FUNC(column), or false.
+bool funcOfColumn(lsst::qserv::query::ValueFactor const& vf, std::string& name, std::string& col) {
+    using lsst::qserv::query::ValueFactor;
+    if (vf.getType() != ValueFactor::FUNCTION && vf.getType() != ValueFactor::AGGFUNC) {
+        return false;
+    }
+    auto fe = vf.getFuncExpr();
+    if (!fe || fe->params.size() != 1 || !fe->params.front()) {
+        return false;
+    }
+    name = fe->name;
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    col = columnName(*fe->params.front());
+    return !col.empty();
+}
+
+/// Parse a decimal or integer string into an integer scaled by 10^scale.
+/// @param overflow - set if the value is well formed, but too large.
+bool parseExact(std::string const& str, int scale, Int128& out, bool& overflow) {
+    size_t j = 0;
+    bool negative = false;
+    if (j < str.size() && (str[j] == '-' || str[j] == '+')) {
+        negative = (str[j] == '-');
+        ++j;
+    }
+    Int128 val = 0;
+    int fracDigits = -1;
+    bool hasDigits = false;
+    for (; j < str.size(); ++j) {
+        char c = str[j];
+        if (c == '.' && fracDigits < 0) {
+            fracDigits = 0;
+            continue;
+        }
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        hasDigits = true;
+        if (fracDigits >= 0) {
+            if (fracDigits == scale) continue; // More digits than the column holds.
+            ++fracDigits;
+        }
+        if (__builtin_mul_overflow(val, 10, &val) || __builtin_add_overflow(val, c - '0', &val)) {
+            overflow = true;
+            return false;
+        }
+    }
+    if (!hasDigits) {
+        return false;
+    }
+    for (int k = (fracDigits < 0 ? 0 : fracDigits); k < scale; ++k) {
+        if (__builtin_mul_overflow(val, 10, &val)) {
+            overflow = true;
+            return false;
+        }
+    }
+    out = negative ? -val : val;
+    return true;
+}
+
+/// Format an integer scaled by 10^scale as a decimal string.
+std::string formatExact(Int128 val, int scale) {
+    bool negative = val < 0;
+    unsigned __int128 u = negative ? -static_cast<unsigned __int128>(val) : val;
+    std::string digits; // Least significant first.
+    do {
+        digits.push_back('0' + static_cast<int>(u % 10));
+        u /= 10;
+    } while (u != 0);
+    while (static_cast<int>(digits.size()) <= scale) {
+        digits.push_back('0');
+    }
+    std::string out;
+    if (negative) out.push_back('-');
+    for (size_t j = digits.size(); j-- > 0;) {
+        out.push_back(digits[j]);
+        if (scale > 0 && j == static_cast<size_t>(scale)) out.push_back('.');
+    }
+    return out;
+}
+
+std::string formatReal(double val) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", val);
+    return buf;
+}
+
+/// @return the number of digits after the decimal point of a DECIMAL(p,s) type.
+int decimalScale(std::string const& sqlType) {
+    auto pos = sqlType.find(',');
+    if (pos == std::string::npos) return 0;
+    return std::atoi(sqlType.c_str() + pos + 1);
+}
+
+/// @return true if values of sqlType are compared with a character set
+///         collation, which may treat different strings as equal.
+bool isCollated(std::string const& sqlType) {
+    return sqlType.find("CHAR") != std::string::npos || sqlType.find("TEXT") != std::string::npos
+           || sqlType.find("ENUM") != std::string::npos || sqlType.find("SET") != std::string::npos;
+}
+
+void addColumnSchema(lsst::qserv::proto::RowSchema& schema, std::string const& name,
+                     std::string const& sqlType, int mysqlType) {
+    auto cs = schema.add_columnschema();
+    cs->set_name(name);
+    cs->set_hasdefault(false);
+    cs->set_sqltype(sqlType);
+    cs->set_mysqltype(mysqlType);
+}
+
+void addValue(lsst::qserv::proto::RowBundle& row, bool isNull, std::string const& val) {
+    row.add_column(isNull ? std::string() : val);
+    row.add_isnull(isNull);
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+HashAggregator::Ptr HashAggregator::newHashAggregator(query::SelectStmt const& mergeStmt,
+                                                      size_t maxGroups) {
+    if (mergeStmt.getDistinct() || mergeStmt.hasLimit() || mergeStmt.hasHaving()
+        || mergeStmt.hasWhereClause()) {
+        return nullptr;
+    }
+    std::vector<std::string> keyNames;
+    if (mergeStmt.hasGroupBy()) {
+        query::ValueExprPtrVector terms;
+        mergeStmt.getGroupBy().clone()->findValueExprs(terms);
+        for (auto const& term : terms) {
+            std::string name = term ? columnName(*term) : std::string();
+            if (name.empty()) return nullptr;
+            keyNames.push_back(name);
+        }
+    }
+
+    std::vector<Output> outputs;
+    auto selectList = mergeStmt.getSelectList().getValueExprList();
+    if (!selectList || selectList->empty()) {
+        return nullptr;
+    }
+    for (auto const& ve : *selectList) {
+        if (!ve || ve->isStar() || ve->getFactorOps().size() != 1) {
+            return nullptr;
+        }
+        Output output;
+        output.name = ve->getAlias();
+        if (output.name.empty()) {
+            // MySQL names the column with the text of the expression.
+            output.name = ve->sqlFragment();
+        }
+        auto const& factor = ve->getFactorOps().front().factor;
+        if (!factor) return nullptr;
+        std::string func;
+        if (ve->isColumnRef()) {
+            output.op = Output::COLUMN;
+            output.colName = columnName(*ve);
+        } else if (funcOfColumn(*factor, func, output.colName)) {
+            if (func == "SUM") output.op = Output::SUM;
+            else if (func == "MIN") output.op = Output::MIN;
+            else if (func == "MAX") output.op = Output::MAX;
+            else return nullptr;
+        } else if (factor->getType() == query::ValueFactor::EXPR && factor->getExpr()) {
+            // AVG merges as SUM(s)/SUM(c)
+            auto const& ops = factor->getExpr()->getFactorOps();
+            std::string func2;
+            if (ops.size() != 2 || ops[0].op != query::ValueExpr::DIVIDE
+                || !ops[0].factor || !ops[1].factor
+                || !funcOfColumn(*ops[0].factor, func, output.colName)
+                || !funcOfColumn(*ops[1].factor, func2, output.countName)
+                || func != "SUM" || func2 != "SUM") {
+                return nullptr;
+            }
+            output.op = Output::AVG;
+        } else {
+            return nullptr;
+        }
+        if (output.colName.empty()) return nullptr;
+        outputs.push_back(output);
+    }
+    return Ptr(new HashAggregator(outputs, keyNames, maxGroups));
+}
+
+
+HashAggregator::HashAggregator(std::vector<Output> const& outputs,
+                               std::vector<std::string> const& keyNames, size_t maxGroups)
+    : _maxGroups(maxGroups), _outputs(outputs), _keyNames(keyNames) {
+}
+
+
+bool HashAggregator::_setCombine(int col, Combine combine) {
+    if (col < 0) return false;
+    Combine& current = _columns[col].combine;
+    if (current == Combine::NONE || current == combine) {
+        current = combine;
+        return true;
+    }
+    // A key column may also be selected as is.
+    return current == Combine::KEY && combine == Combine::FIRST;
+}
+
+
+bool HashAggregator::setSchema(proto::RowSchema const& schema) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_schemaSet) return _active;
+    _schemaSet = true;
+    _schema = schema;
+    std::map<std::string, int> colIndex;
+    for (int j = 0; j < schema.columnschema_size(); ++j) {
+        auto const& cs = schema.columnschema(j);
+        Column col;
+        col.name = cs.name();
+        col.sqlType = cs.sqltype();
+        col.mysqlType = cs.has_mysqltype() ? cs.mysqltype() : -1;
+        switch (col.mysqlType) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_INT24:
+            col.kind = Kind::EXACT;
+            break;
+        case MYSQL_TYPE_DECIMAL:
+        case MYSQL_TYPE_NEWDECIMAL:
+            col.kind = Kind::EXACT;
+            col.scale = decimalScale(col.sqlType);
+            break;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            col.kind = Kind::REAL;
+            break;
+        default:
+            col.kind = Kind::OTHER;
+        }
+        // A name appearing twice cannot be resolved.
+        if (!colIndex.insert(std::make_pair(col.name, j)).second) {
+            colIndex[col.name] = -1;
+        }
+        _columns.push_back(col);
+    }
+    auto findCol = [&colIndex](std::string const& name) -> int {
+        auto iter = colIndex.find(name);
+        return iter == colIndex.end() ? -1 : iter->second;
+    };
+
+    bool ok = true;
+    for (auto const& name : _keyNames) {
+        int col = findCol(name);
+        ok = ok && _setCombine(col, Combine::KEY);
+        // Grouping is done on the bytes received, which would not match
+        // MySQL for strings that compare equal under a collation.
+        ok = ok && !isCollated(_columns[col].sqlType);
+        _keyCols.push_back(col);
+    }
+    for (auto& output : _outputs) {
+        output.col = findCol(output.colName);
+        switch (output.op) {
+        case Output::COLUMN:
+            ok = ok && _setCombine(output.col, Combine::FIRST);
+            break;
+        case Output::SUM:
+            ok = ok && _setCombine(output.col, Combine::SUM)
+                 && _columns[output.col].kind != Kind::OTHER;
+            break;
+        case Output::MIN:
+        case Output::MAX:
+            ok = ok && _setCombine(output.col, output.op == Output::MIN ? Combine::MIN : Combine::MAX)
+                 && _columns[output.col].kind != Kind::OTHER;
+            break;
+        case Output::AVG:
+            output.countCol = findCol(output.countName);
+            ok = ok && _setCombine(output.col, Combine::SUM) && _setCombine(output.countCol, Combine::SUM)
+                 && _columns[output.col].kind != Kind::OTHER
+                 && _columns[output.countCol].kind == Kind::EXACT
+                 && _columns[output.countCol].scale == 0;
+            break;
+        }
+        if (!ok) break;
+    }
+    if (!ok) {
+        LOGS(_log, LOG_LVL_DEBUG, "HashAggregator unsupported result schema, merging with MySQL");
+        _active = false;
+    }
+    return _active;
+}
+
+
+void HashAggregator::_makeCell(Cell& cell, Column const& col, proto::RowBundle const& row, int j,
+                               std::string& error, bool& overflow) const {
+    cell.isNull = (j < row.isnull_size() && row.isnull(j)) || j >= row.column_size();
+    if (cell.isNull) return;
+    std::string const& val = row.column(j);
+    if (col.combine != Combine::SUM) {
+        cell.str = val;
+    }
+    if (col.combine == Combine::SUM || col.combine == Combine::MIN || col.combine == Combine::MAX) {
+        if (col.kind == Kind::EXACT) {
+            if (!parseExact(val, col.scale, cell.exact, overflow) && !overflow && error.empty()) {
+                error = "HashAggregator could not read '" + val + "' in " + col.name;
+            }
+        } else {
+            char* end = nullptr;
+            cell.real = strtod(val.c_str(), &end);
+            if (end == val.c_str() && error.empty()) {
+                error = "HashAggregator could not read '" + val + "' in " + col.name;
+            }
+        }
+    }
+}
+
+
+bool HashAggregator::_combine(Cell& dest, Cell const& src, Column const& col) const {
+    if (src.isNull) return true;
+    if (dest.isNull) {
+        dest = src;
+        return true;
+    }
+    bool const exact = (col.kind == Kind::EXACT);
+    switch (col.combine) {
+    case Combine::SUM:
+        if (exact) return !__builtin_add_overflow(dest.exact, src.exact, &dest.exact);
+        dest.real += src.real;
+        break;
+    case Combine::MIN:
+        if (exact ? src.exact < dest.exact : src.real < dest.real) dest = src;
+        break;
+    case Combine::MAX:
+        if (exact ? src.exact > dest.exact : src.real > dest.real) dest = src;
+        break;
+    default:
+        break; // KEY and FIRST keep the first value.
+    }
+    return true;
+}
+
+
+bool HashAggregator::_canCombineGroup(Group const& dest, Group const& src) const {
+    for (size_t j = 0; j < _columns.size(); ++j) {
+        Column const& col = _columns[j];
+        if (col.combine != Combine::SUM || col.kind != Kind::EXACT) continue;
+        if (dest[j].isNull || src[j].isNull) continue;
+        Int128 sum;
+        if (__builtin_add_overflow(dest[j].exact, src[j].exact, &sum)) return false;
+    }
+    return true;
+}
+
+
+void HashAggregator::_combineGroup(Group& dest, Group const& src) const {
+    for (size_t j = 0; j < _columns.size(); ++j) {
+        _combine(dest[j], src[j], _columns[j]);
+    }
+}
+
+
+bool HashAggregator::add(proto::Result const& result, int jobIdAttempt) {
+    if (!isActive()) return false;
+
+    // Reduce the rows without holding the mutex.
+    GroupMap local;
+    std::string error;
+    bool overflow = false;
+    std::string key;
+    Cell cell;
+    for (auto const& row : result.row()) {
+        key.clear();
+        for (int col : _keyCols) {
+            bool isNull = (col < row.isnull_size() && row.isnull(col)) || col >= row.column_size();
+            key.push_back(isNull ? 'N' : 'V');
+            if (!isNull) {
+                std::string const& val = row.column(col);
+                uint32_t len = val.size();
+                key.append(reinterpret_cast<char const*>(&len), sizeof(len));
+                key.append(val);
+            }
+        }
+        Group& group = local[key];
+        if (group.empty()) group.resize(_columns.size());
+        for (size_t j = 0; j < _columns.size(); ++j) {
+            Column const& col = _columns[j];
+            if (col.combine == Combine::NONE) continue;
+            cell = Cell();
+            _makeCell(cell, col, row, j, error, overflow);
+            overflow = !_combine(group[j], cell, col) || overflow;
+        }
+        if (overflow) break;
+    }
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_active) return false;
+    if (!error.empty() && _error.empty()) {
+        _error = error;
+        LOGS(_log, LOG_LVL_ERROR, _error);
+    }
+    GroupMap& groups = _attempts[jobIdAttempt];
+    // Nothing is combined unless all of it can be, so the rows can be
+    // merged by MySQL instead.
+    std::vector<Group*> dests;
+    dests.reserve(local.size());
+    for (auto const& elem : local) {
+        if (overflow) break;
+        auto iter = groups.find(elem.first);
+        dests.push_back(iter == groups.end() ? nullptr : &iter->second);
+        overflow = dests.back() && !_canCombineGroup(*dests.back(), elem.second);
+    }
+    if (overflow) {
+        LOGS(_log, LOG_LVL_INFO, "HashAggregator sum out of range, to be merged with MySQL");
+        _overflow = true;
+        return false;
+    }
+    auto dest = dests.begin();
+    for (auto& elem : local) {
+        if (*dest == nullptr) {
+            groups.emplace(elem.first, std::move(elem.second));
+            ++_groupCount;
+        } else {
+            _combineGroup(**dest, elem.second);
+        }
+        ++dest;
+    }
+    return true;
+}
+
+
+bool HashAggregator::overLimit() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _active && (_overflow || _groupCount > _maxGroups);
+}
+
+
+bool HashAggregator::isActive() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _active;
+}
+
+
+std::string HashAggregator::getError() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _error;
+}
+
+
+std::string HashAggregator::_formatSum(Cell const& cell, Column const& col) const {
+    return col.kind == Kind::EXACT ? formatExact(cell.exact, col.scale) : formatReal(cell.real);
+}
+
+
+std::map<int, std::shared_ptr<proto::Result>> HashAggregator::spill() {
+    std::map<int, std::shared_ptr<proto::Result>> results;
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_active) return results;
+    _active = false;
+    LOGS(_log, LOG_LVL_INFO, "HashAggregator spilling " << _groupCount << " groups of "
+         << _attempts.size() << " job attempts");
+    for (auto const& attempt : _attempts) {
+        auto result = std::make_shared<proto::Result>();
+        *result->mutable_rowschema() = _schema;
+        for (auto const& elem : attempt.second) {
+            Group const& group = elem.second;
+            auto row = result->add_row();
+            for (size_t j = 0; j < _columns.size(); ++j) {
+                Column const& col = _columns[j];
+                Cell const& cell = group[j];
+                bool isNull = cell.isNull || col.combine == Combine::NONE;
+                addValue(*row, isNull, col.combine == Combine::SUM ? _formatSum(cell, col) : cell.str);
+            }
+        }
+        result->set_continues(false);
+        result->set_queryid(0);
+        result->set_jobid(attempt.first);
+        result->set_largeresult(false);
+        result->set_rowcount(result->row_size());
+        result->set_transmitsize(0);
+        result->set_attemptcount(0);
+        results[attempt.first] = result;
+    }
+    _attempts.clear();
+    _groupCount = 0;
+    return results;
+}
+
+
+void HashAggregator::dropAttempt(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _attempts.find(jobIdAttempt);
+    if (iter != _attempts.end()) {
+        _groupCount -= iter->second.size();
+        _attempts.erase(iter);
+    }
+}
+
+
+bool HashAggregator::checkTotals() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_active || !_schemaSet) return true;
+    std::vector<bool> isSum(_columns.size(), false);
+    bool anySum = false;
+    for (size_t j = 0; j < _columns.size(); ++j) {
+        isSum[j] = _columns[j].combine == Combine::SUM && _columns[j].kind == Kind::EXACT;
+        anySum = anySum || isSum[j];
+    }
+    if (!anySum) return true;
+
+    bool overflow = false;
+    std::unordered_map<std::string, std::vector<Int128>> totals;
+    for (auto const& attempt : _attempts) {
+        for (auto const& elem : attempt.second) {
+            auto& total = totals[elem.first];
+            if (total.empty()) total.resize(_columns.size(), 0);
+            for (size_t j = 0; j < _columns.size() && !overflow; ++j) {
+                if (!isSum[j] || elem.second[j].isNull) continue;
+                overflow = __builtin_add_overflow(total[j], elem.second[j].exact, &total[j]);
+            }
+        }
+    }
+    // finish() scales the sums of averages.
+    Int128 avgScale = 1;
+    for (int k = 0; k < DIV_PRECISION_INCREMENT; ++k) avgScale *= 10;
+    for (auto const& elem : totals) {
+        for (auto const& output : _outputs) {
+            if (overflow) break;
+            if (output.op != Output::AVG || !isSum[output.col]) continue;
+            Int128 num;
+            overflow = __builtin_mul_overflow(elem.second[output.col], avgScale, &num);
+        }
+    }
+    if (overflow) {
+        LOGS(_log, LOG_LVL_INFO, "HashAggregator totals out of range, to be merged with MySQL");
+        _overflow = true;
+    }
+    return !overflow;
+}
+
+
+bool HashAggregator::finish(proto::Result& out) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_active || !_schemaSet) return false;
+    if (!_error.empty()) return false;
+
+    GroupMap total;
+    for (auto& attempt : _attempts) {
+        for (auto& elem : attempt.second) {
+            auto iter = total.find(elem.first);
+            if (iter == total.end()) {
+                total.emplace(elem.first, std::move(elem.second));
+            } else {
+                _combineGroup(iter->second, elem.second);
+            }
+        }
+    }
+    _attempts.clear();
+    _groupCount = 0;
+    // Without GROUP BY there is always exactly one row.
+    if (_keyCols.empty() && total.empty()) {
+        total[std::string()].resize(_columns.size());
+    }
+
+    auto& schema = *out.mutable_rowschema();
+    schema.Clear();
+    for (auto const& output : _outputs) {
+        Column const& col = _columns[output.col];
+        switch (output.op) {
+        case Output::COLUMN:
+        case Output::MIN:
+        case Output::MAX:
+            addColumnSchema(schema, output.name, col.sqlType, col.mysqlType);
+            break;
+        case Output::SUM:
+            if (col.kind == Kind::EXACT) {
+                addColumnSchema(schema, output.name, "DECIMAL(65," + std::to_string(col.scale) + ")",
+                                MYSQL_TYPE_NEWDECIMAL);
+            } else {
+                addColumnSchema(schema, output.name, "DOUBLE", MYSQL_TYPE_DOUBLE);
+            }
+            break;
+        case Output::AVG:
+            if (col.kind == Kind::EXACT) {
+                int scale = col.scale + DIV_PRECISION_INCREMENT;
+                addColumnSchema(schema, output.name, "DECIMAL(65," + std::to_string(scale) + ")",
+                                MYSQL_TYPE_NEWDECIMAL);
+            } else {
+                addColumnSchema(schema, output.name, "DOUBLE", MYSQL_TYPE_DOUBLE);
+            }
+            break;
+        }
+    }
+
+    for (auto const& elem : total) {
+        Group const& group = elem.second;
+        auto row = out.add_row();
+        for (auto const& output : _outputs) {
+            Column const& col = _columns[output.col];
+            Cell const& cell = group[output.col];
+            switch (output.op) {
+            case Output::COLUMN:
+            case Output::MIN:
+            case Output::MAX:
+                addValue(*row, cell.isNull, cell.str);
+                break;
+            case Output::SUM:
+                addValue(*row, cell.isNull, cell.isNull ? std::string() : _formatSum(cell, col));
+                break;
+            case Output::AVG: {
+                Cell const& count = group[output.countCol];
+                if (cell.isNull || count.isNull || count.exact == 0) {
+                    addValue(*row, true, std::string());
+                } else if (col.kind == Kind::EXACT) {
+                    // Round half away from zero, as MySQL does.
+                    Int128 num = cell.exact;
+                    for (int k = 0; k < DIV_PRECISION_INCREMENT; ++k) num *= 10;
+                    Int128 quot = num / count.exact;
+                    Int128 rem = num % count.exact;
+                    if (rem < 0) rem = -rem;
+                    Int128 absCount = count.exact < 0 ? -count.exact : count.exact;
+                    if (2*rem >= absCount) {
+                        quot += ((num < 0) != (count.exact < 0)) ? -1 : 1;
+                    }
+                    addValue(*row, false, formatExact(quot, col.scale + DIV_PRECISION_INCREMENT));
+                } else {
+                    addValue(*row, false, formatReal(cell.real/static_cast<double>(count.exact)));
+                }
+                break;
+            }
+            }
+        }
+    }
+    out.set_continues(false);
+    out.set_queryid(0);
+    out.set_jobid(0);
+    out.set_largeresult(false);
+    out.set_rowcount(out.row_size());
+    out.set_transmitsize(0);
+    out.set_attemptcount(0);
+    // The aggregator cannot be used again.
+    _active = false;
+    return true;
+}
+
+}}} // namespace lsst::qserv::rproc
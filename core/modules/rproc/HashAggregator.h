@@ -0,0 +1,180 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_RPROC_HASHAGGREGATOR_H
+#define LSST_QSERV_RPROC_HASHAGGREGATOR_H
+
+// System headers
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+// Forward declarations
+namespace lsst {
+namespace qserv {
+namespace query {
+    class SelectStmt;
+    class ValueExpr;
+}
+}} // End of forward declarations
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// HashAggregator evaluates the merge statement of an aggregate query in
+/// memory, directly from the rows of chunk results, so that only the final
+/// rows need to be written to the result table.
+///
+/// Supported merge statements have a select list made of column references
+/// and the merge forms of the query::AggOp functions: SUM(x) (used for both
+/// COUNT and SUM), MIN(x), MAX(x), and SUM(s)/SUM(c) for AVG. They may have
+/// GROUP BY column references and ORDER BY, which is applied by the proxy.
+/// Anything else (LIMIT, HAVING, DISTINCT, other expressions) is left to
+/// MySQL.
+///
+/// Rows are aggregated separately for each job attempt so that the rows of
+/// an invalid attempt can be dropped. If too many groups are held, spill()
+/// hands the partial aggregates back as rows in the chunk result schema,
+/// and merging continues through MySQL.
+class HashAggregator {
+public:
+    using Ptr = std::shared_ptr<HashAggregator>;
+
+    /// @return an aggregator for mergeStmt, or nullptr if mergeStmt is not
+    ///         supported.
+    /// @param maxGroups - number of groups that can be held before the
+    ///                    aggregator should be spilled.
+    static Ptr newHashAggregator(query::SelectStmt const& mergeStmt, size_t maxGroups);
+
+    HashAggregator(HashAggregator const&) = delete;
+    HashAggregator& operator=(HashAggregator const&) = delete;
+
+    /// Resolve the merge statement against the schema of the chunk results.
+    /// The aggregator is deactivated if the column types are not supported.
+    /// @return true if the aggregator is active.
+    bool setSchema(proto::RowSchema const& schema);
+
+    /// Aggregate the rows of a chunk result.
+    /// @return false if the aggregator is not active, or if a value or sum
+    ///         of the rows does not fit in the aggregator, in which case the
+    ///         rows must be merged some other way.
+    bool add(proto::Result const& result, int jobIdAttempt);
+
+    /// @return true if the aggregator should be spilled: more than maxGroups
+    ///         groups are held, or a sum did not fit.
+    bool overLimit() const;
+
+    /// Deactivate the aggregator.
+    /// @return the partial aggregates of each job attempt as rows in the
+    ///         schema given to setSchema().
+    std::map<int, std::shared_ptr<proto::Result>> spill();
+
+    /// Discard the rows added for jobIdAttempt.
+    void dropAttempt(int jobIdAttempt);
+
+    bool isActive() const;
+
+    /// Check that the sums of all attempts, and the averages computed from
+    /// them, are in range. If not, the aggregator has to be spilled.
+    /// @return false if the aggregator has to be spilled.
+    bool checkTotals();
+
+    /// Compute the final rows and their schema.
+    /// @return false if the aggregator is not active or some values could
+    ///         not be read.
+    bool finish(proto::Result& out);
+
+    /// @return a description of the first error encountered.
+    std::string getError() const;
+
+private:
+    /// Type of value held by a chunk result column.
+    enum class Kind { EXACT, REAL, OTHER };
+    /// How values of a chunk result column are combined within a group.
+    enum class Combine { NONE, KEY, FIRST, SUM, MIN, MAX };
+
+    struct Column {
+        std::string name;
+        std::string sqlType;
+        int mysqlType{0};
+        Kind kind{Kind::OTHER};
+        int scale{0}; ///< Digits after the decimal point of EXACT values.
+        Combine combine{Combine::NONE};
+    };
+
+    /// An item of the merge select list.
+    struct Output {
+        enum Op { COLUMN, SUM, MIN, MAX, AVG };
+        Op op{COLUMN};
+        std::string name;       ///< Name of the result column.
+        std::string colName;    ///< Argument, the SUM(s) term for AVG.
+        std::string countName;  ///< SUM(c) term for AVG.
+        int col{-1};
+        int countCol{-1};
+    };
+
+    /// Partial aggregate of one column in one group.
+    struct Cell {
+        bool isNull{true};
+        __int128 exact{0}; ///< EXACT value scaled by 10^scale.
+        double real{0.0};
+        std::string str;   ///< Value as received, for KEY, FIRST, MIN and MAX.
+    };
+    using Group = std::vector<Cell>;
+    using GroupMap = std::unordered_map<std::string, Group>;
+
+    HashAggregator(std::vector<Output> const& outputs, std::vector<std::string> const& keyNames,
+                   size_t maxGroups);
+
+    bool _setCombine(int col, Combine combine);
+    void _makeCell(Cell& cell, Column const& col, proto::RowBundle const& row, int j,
+                   std::string& error, bool& overflow) const;
+    bool _combine(Cell& dest, Cell const& src, Column const& col) const;
+    bool _canCombineGroup(Group const& dest, Group const& src) const;
+    void _combineGroup(Group& dest, Group const& src) const;
+    std::string _formatSum(Cell const& cell, Column const& col) const;
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    bool _active{true};
+    bool _overflow{false}; ///< True once rows had values or sums out of range.
+    bool _schemaSet{false};
+    size_t const _maxGroups;
+    std::vector<Output> _outputs;
+    std::vector<std::string> _keyNames;
+    std::vector<int> _keyCols;
+    std::vector<Column> _columns;
+    proto::RowSchema _schema; ///< Schema of the chunk results.
+    std::map<int, GroupMap> _attempts; ///< Groups of each job attempt.
+    size_t _groupCount{0}; ///< Sum of the sizes of the maps in _attempts.
+    std::string _error;
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_HASHAGGREGATOR_H
@@ -39,6 +39,7 @@
 #include "rproc/InfileMerger.h"
 
 // System headers
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
 #include <iostream>
@@ -60,24 +61,54 @@
 #include "proto/WorkerResponse.h"
 #include "proto/ProtoImporter.h"
 #include "qdisp/LargeResultMgr.h"
+#include "query/SelectList.h"
 #include "query/SelectStmt.h"
+#include "query/ValueExpr.h"
+#include "rproc/HashAggregator.h"
 #include "rproc/ProtoRowBuffer.h"
+#include "rproc/TopKHeap.h"
 #include "sql/Schema.h"
 #include "sql/SqlConnection.h"
-#include "sql/SqlResults.h"
 #include "sql/SqlErrorObject.h"
 #include "sql/statement.h"
+#include "util/Histogram.h"
 #include "util/StringHash.h"
+#include "util/Tracer.h"
 
 namespace { // File-scope helpers
 
 LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.InfileMerger");
 
+using lsst::qserv::util::StatsRegistry;
+auto const histMerge = StatsRegistry::get().histogram("rproc.InfileMerger.merge");
+auto const histFinalize = StatsRegistry::get().histogram("rproc.InfileMerger.finalize");
+auto const ctrMergedRows = StatsRegistry::get().counter("rproc.InfileMerger.mergedRows");
+auto const ctrAggregatedRows = StatsRegistry::get().counter("rproc.InfileMerger.aggregatedRows");
+auto const ctrAggregateSpills = StatsRegistry::get().counter("rproc.InfileMerger.aggregateSpills");
+auto const ctrTopKRows = StatsRegistry::get().counter("rproc.InfileMerger.topKRows");
+auto const ctrStagedAttempts = StatsRegistry::get().counter("rproc.InfileMerger.stagedAttempts");
+auto const ctrDroppedStaging = StatsRegistry::get().counter("rproc.InfileMerger.droppedStaging");
+auto const ctrResultBytes = StatsRegistry::get().counter("rproc.InfileMerger.resultBytes");
+auto const histResultMB = StatsRegistry::get().histogram("rproc.InfileMerger.resultMB");
+
 using lsst::qserv::mysql::MySqlConfig;
 using lsst::qserv::rproc::InfileMergerConfig;
 using lsst::qserv::rproc::InfileMergerError;
 using lsst::qserv::util::ErrorCode;
 
+/// A chunk result set is expected for roughly every this many chunks per shard.
+/// Fewer chunks than this are merged into a single table.
+int const CHUNKS_PER_MERGE_SHARD = 100;
+
+/// Results expected to be smaller than this many rows are merged into a single table.
+long long const MIN_ROWS_FOR_MERGE_SHARDS = 100000;
+
+size_t const MB_SIZE_BYTES = 1024*1024;
+
+/// The growth of a result is logged each time it grows by this fraction of
+/// the maximum result size.
+size_t const SIZE_REPORTS = 10;
+
 /// @return a timestamp id for use in generating temporary result table names.
 std::string getTimeStampId() {
     struct timeval now;
@@ -92,6 +123,30 @@ std::string getTimeStampId() {
     // Alternative (for production?) Use boost::uuid to construct ids that are
     // guaranteed to be unique.
 }
+
+/// @return the sql::Schema equivalent of a proto::RowSchema.
+lsst::qserv::sql::Schema schemaFromProto(lsst::qserv::proto::RowSchema const& rs) {
+    lsst::qserv::sql::Schema sch;
+    for(int i=0, e=rs.columnschema_size(); i != e; ++i) {
+        lsst::qserv::proto::ColumnSchema const& cs = rs.columnschema(i);
+        lsst::qserv::sql::ColSchema scs;
+        scs.name = cs.name();
+        if (cs.hasdefault()) {
+            scs.defaultValue = cs.defaultvalue();
+            scs.hasDefault = true;
+        } else {
+            scs.hasDefault = false;
+        }
+        if (cs.has_mysqltype()) {
+            scs.colType.mysqlType = cs.mysqltype();
+        }
+        scs.colType.sqlType = cs.sqltype();
+
+        sch.columns.push_back(scs);
+    }
+    return sch;
+}
+
 } // anonymous namespace
 
 namespace lsst {
@@ -103,24 +158,33 @@ namespace rproc {
 // InfileMerger public
 ////////////////////////////////////////////////////////////////////////
 InfileMerger::InfileMerger(InfileMergerConfig const& c)
-    : _config(c),
-      _mysqlConn(_config.mySqlConfig) {
+    : _config(c) {
     _alterJobIdColName(); // initialize jobIdColName.
     _fixupTargetName();
+    int nShards = chooseMergeShards(_config.maxMergeShards, _config.expectedChunks,
+                                    _config.chunkRowLimit);
+    for (auto const& shardTable : mergeShardTables(_mergeTable, nShards)) {
+        _shards.emplace_back(new MergeShard(_config.mySqlConfig, shardTable));
+    }
+    // Rows only need a jobId column if something reads the merge tables
+    // before the result table is made.
+    _jobIdInRows = nShards > 1 || _mergeTable != _config.targetTable;
     _maxResultTableSizeMB = _config.mySqlConfig.maxTableSizeMB;
-
-    // Assume worst case of 10,000 bytes per row, what's the earliest row to test?
-    // Subtract that from the count so the first check doesn't happen for a while.
-    // Subsequent checks should happen at reasonable intervals.
-    // At 5000MB max size, the first check is made at 550,000 rows, with subsequent checks
-    // about every 50,000 rows.
-    _sizeCheckRowCount = -100*(_maxResultTableSizeMB);  //  100 = 1,000,000/10,000
-    _checkSizeEveryXRows = 10*_maxResultTableSizeMB;
+    _nextSizeReport = std::max<size_t>(_maxResultTableSizeMB*MB_SIZE_BYTES/SIZE_REPORTS, 1);
     LOGS(_log, LOG_LVL_DEBUG, "InfileMerger maxResultTableSizeMB=" << _maxResultTableSizeMB
-                              << " sizeCheckRowCount=" << _sizeCheckRowCount
-                              << " checkSizeEveryXRows=" << _checkSizeEveryXRows);
+                              << " mergeShards=" << nShards);
     if (_config.mergeStmt) {
         _config.mergeStmt->setFromListAsTable(_mergeTable);
+        if (_config.aggregateMaxGroups > 0) {
+            _aggregator = HashAggregator::newHashAggregator(*_config.mergeStmt,
+                                                            _config.aggregateMaxGroups);
+        }
+        if (!_aggregator && _config.topKMaxRows > 0) {
+            _topK = TopKHeap::newTopKHeap(*_config.mergeStmt, _config.topKMaxRows);
+        }
+        _rowLimit = unorderedLimit(*_config.mergeStmt);
+        LOGS(_log, LOG_LVL_DEBUG, "InfileMerger native aggregation=" << (_aggregator != nullptr)
+                                  << " topK=" << (_topK != nullptr) << " rowLimit=" << _rowLimit);
     }
 
     _invalidJobAttemptMgr.setDeleteFunc([this](int jobIdAttempt) -> bool {
@@ -132,7 +196,9 @@ InfileMerger::InfileMerger(InfileMergerConfig const& c)
         return !_needCreateTable;
     });
 
-    if (!_setupConnection()) {
+    // Other shards connect when first used.
+    std::lock_guard<std::mutex> lock(_shards[0]->mtx);
+    if (!_shards[0]->connect()) {
         throw InfileMergerError(util::ErrorCode::MYSQLCONNECT, "InfileMerger mysql connect failure.");
     }
 }
@@ -162,6 +228,10 @@ bool InfileMerger::merge(std::shared_ptr<proto::WorkerResponse> response) {
     // TODO: Check session id (once session id mgmt is implemented)
     std::string queryIdJobStr =
         QueryIdHelper::makeIdStr(response->result.queryid(), response->result.jobid());
+    util::TraceSpan span(_config.traceId, "InfileMerger::merge", "rproc");
+    if (span.active()) {
+        span.setDetail(queryIdJobStr + " rows=" + std::to_string(response->result.row_size()));
+    }
     if (!_queryIdStrSet) {
         _setQueryIdStr(QueryIdHelper::makeIdStr(response->result.queryid()));
     }
@@ -188,76 +258,428 @@ bool InfileMerger::merge(std::shared_ptr<proto::WorkerResponse> response) {
         }
     }
 
-    // Nothing to do if size is zero.
+    // Add columns to rows in virtFile.
+    int resultJobId = makeJobIdAttempt(response->result.jobid(), response->result.attemptcount());
+    bool const lastMessage = !response->result.continues();
+
+    // Nothing to do if size is zero, except completing the rows of the attempt.
     if (response->result.row_size() == 0) {
+        if (lastMessage && _rowLimit >= 0) {
+            _countLimitRows(resultJobId, 0, true);
+        }
         return true;
     }
-    _sizeCheckRowCount += response->result.row_size();
 
     bool ret = false;
-    // Add columns to rows in virtFile.
-    int resultJobId = makeJobIdAttempt(response->result.jobid(), response->result.attemptcount());
-    ProtoRowBuffer::Ptr pRowBuffer = std::make_shared<ProtoRowBuffer>(response->result,
-                                     resultJobId, _jobIdColName, _jobIdSqlType, _jobIdMysqlType);
-    std::string const virtFile = _infileMgr.prepareSrc(pRowBuffer, queryIdJobStr);
-    std::string const infileStatement = sql::formLoadInfile(_mergeTable, virtFile);
     auto start = std::chrono::system_clock::now();
     // If the job attempt is invalid, exit without adding rows.
     // It will wait here if rows need to be deleted.
     if (_invalidJobAttemptMgr.incrConcurrentMergeCount(resultJobId)) {
         return true;
     }
-    ret = _applyMysql(infileStatement);
-    _invalidJobAttemptMgr.decrConcurrentMergeCount();
+    bool aggregated = false;
+    bool spilled = true;
+    if (_aggregator) {
+        aggregated = _aggregator->add(response->result, resultJobId);
+        // Too many groups, or sums out of range, are left to MySQL.
+        if (_aggregator->overLimit()) {
+            spilled = _spillAggregator();
+        }
+    }
+    if (aggregated) {
+        ctrAggregatedRows->add(response->result.row_size());
+        ret = spilled;
+    } else if (!spilled) {
+        ret = false;
+    } else if (_topK && _topK->add(response->result, resultJobId)) {
+        ctrTopKRows->add(response->result.row_size());
+        ret = true;
+    } else {
+        auto pRowBuffer = _newRowBuffer(response->result, resultJobId);
+        ret = _applyAttempt(pRowBuffer, queryIdJobStr, resultJobId, response->result.continues());
+        // The size is checked as soon as the rows are in, before other
+        // results can add to a table that is already too large.
+        ret = _addResultBytes(resultJobId, pRowBuffer->getFetchedBytes(), queryIdJobStr) && ret;
+    }
+    _invalidJobAttemptMgr.decrConcurrentMergeCount(resultJobId);
+    if (ret && _rowLimit >= 0) {
+        _countLimitRows(resultJobId, response->result.row_size(), lastMessage);
+    }
     auto end = std::chrono::system_clock::now();
+    histMerge->record(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    ctrMergedRows->add(response->result.row_size());
     auto mergeDur = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     LOGS(_log, LOG_LVL_DEBUG, queryIdJobStr << " mergeDur=" << mergeDur.count());
-    /// Check the size of the result table.
-    if (_sizeCheckRowCount >= _checkSizeEveryXRows) {
-        LOGS(_log, LOG_LVL_DEBUG, queryIdJobStr << "checking ResultTableSize " << _mergeTable
-                                  << " " << _sizeCheckRowCount
-                                  << " max=" << _maxResultTableSizeMB);
-        _sizeCheckRowCount = 0;
-        auto tSize = _getResultTableSizeMB();
-        if (tSize > _maxResultTableSizeMB) {
-            // TODO:DM-11524 Try deleting invalid rows if there are any, then check size again
-            std::ostringstream os;
-            os << queryIdJobStr << " cancelling queryResult table " << _mergeTable
-               << " too large at " << tSize << "MB max allowed=" << _maxResultTableSizeMB;
-            LOGS(_log, LOG_LVL_WARN, os.str());
-            _error = util::Error(-1, os.str(), -1);
-            return false;
+    return ret;
+}
+
+
+int InfileMerger::chooseMergeShards(int maxShards, int expectedChunks, int chunkRowLimit) {
+    if (maxShards <= 1 || expectedChunks < 2*CHUNKS_PER_MERGE_SHARD) {
+        return 1;
+    }
+    if (chunkRowLimit > 0
+        && static_cast<long long>(chunkRowLimit)*expectedChunks < MIN_ROWS_FOR_MERGE_SHARDS) {
+        return 1;
+    }
+    int nShards = expectedChunks/CHUNKS_PER_MERGE_SHARD;
+    return nShards < maxShards ? nShards : maxShards;
+}
+
+
+std::vector<std::string> InfileMerger::mergeShardTables(std::string const& mergeTable, int nShards) {
+    if (nShards <= 1) {
+        return std::vector<std::string>(1, mergeTable);
+    }
+    std::vector<std::string> tables;
+    for (int j = 0; j < nShards; ++j) {
+        tables.push_back(mergeTable + "_s" + std::to_string(j));
+    }
+    return tables;
+}
+
+
+bool InfileMerger::needUnionShards(int nShards, bool tableCreated, bool aggregated, bool topK) {
+    return nShards > 1 && tableCreated && !aggregated && !topK;
+}
+
+
+std::string InfileMerger::unionTableName(std::string const& mergeTable, std::string const& targetTable) {
+    return (mergeTable == targetTable) ? mergeTable + "_u" : mergeTable;
+}
+
+
+std::string InfileMerger::unionShardsStmt(std::string const& unionTable, sql::Schema const& schema,
+                                          std::vector<std::string> const& shardTables) {
+    std::string shardList;
+    for (auto const& table : shardTables) {
+        if (!shardList.empty()) shardList += ",";
+        shardList += table;
+    }
+    return sql::formCreateTable(unionTable, schema)
+        + " ENGINE=MERGE UNION=(" + shardList + ") INSERT_METHOD=NO";
+}
+
+
+bool InfileMerger::MergeShard::connect() {
+    if (mysqlConn.connected()) {
+        return true;
+    }
+    if (mysqlConn.connect()) {
+        infileMgr.attach(mysqlConn.getMySql());
+        return true;
+    }
+    return false;
+}
+
+
+/// @return a buffer for the rows of result, with a jobId column set to
+///         jobIdAttempt if the merge tables have one.
+std::shared_ptr<ProtoRowBuffer> InfileMerger::_newRowBuffer(proto::Result& result, int jobIdAttempt) {
+    if (!_jobIdInRows) {
+        return std::make_shared<ProtoRowBuffer>(result);
+    }
+    return std::make_shared<ProtoRowBuffer>(result, jobIdAttempt, _jobIdColName,
+                                            _jobIdSqlType, _jobIdMysqlType);
+}
+
+
+/// Lock the first idle shard. If all shards are busy, wait for one of them.
+/// @return the index of the locked shard.
+size_t InfileMerger::_lockShard(std::unique_lock<std::mutex>& lock) {
+    size_t const nShards = _shards.size();
+    size_t const first = _nextShard.fetch_add(1, std::memory_order_relaxed) % nShards;
+    size_t index = first;
+    for (size_t j = 0; j < nShards; ++j) {
+        size_t k = (first + j) % nShards;
+        std::unique_lock<std::mutex> tryLock(_shards[k]->mtx, std::try_to_lock);
+        if (tryLock.owns_lock()) {
+            index = k;
+            lock = std::move(tryLock);
+            break;
         }
     }
-    return ret;
+    if (!lock.owns_lock()) {
+        lock = std::unique_lock<std::mutex>(_shards[index]->mtx);
+    }
+    return index;
+}
+
+
+/// Load rowBuffer into the first idle shard.
+bool InfileMerger::_applyMysql(std::shared_ptr<mysql::RowBuffer> const& rowBuffer,
+                               std::string const& queryIdJobStr, int jobIdAttempt) {
+    std::unique_lock<std::mutex> lock;
+    size_t index = _lockShard(lock);
+    MergeShard& shard = *_shards[index];
+    {
+        std::lock_guard<std::mutex> aLock(_attemptShardsMtx);
+        _attemptShards[jobIdAttempt].insert(index);
+    }
+    return _loadInfile(shard, rowBuffer, shard.table, queryIdJobStr);
+}
+
+
+/// Load the rows of a message of jobIdAttempt. Rows of an attempt whose
+/// result continues in later messages go to its staging table, which is moved
+/// into a shard once the last message has been loaded and no other message
+/// of the attempt is being loaded.
+/// Precondition: the caller must hold a concurrent merge count for jobIdAttempt.
+bool InfileMerger::_applyAttempt(std::shared_ptr<mysql::RowBuffer> const& rowBuffer,
+                                 std::string const& queryIdJobStr, int jobIdAttempt, bool continues) {
+    std::string stagingTable;
+    {
+        std::unique_lock<std::mutex> lock(_stagingMtx);
+        auto iter = _staging.find(jobIdAttempt);
+        // Other messages of the attempt wait while its staging table is created.
+        while (iter != _staging.end() && iter->second.creating) {
+            _stagingCv.wait(lock);
+            iter = _staging.find(jobIdAttempt);
+        }
+        if (iter == _staging.end()) {
+            if (!continues) {
+                // The whole result is in this message.
+                lock.unlock();
+                return _applyMysql(rowBuffer, queryIdJobStr, jobIdAttempt);
+            }
+            std::string table = _mergeTable + "_a" + std::to_string(jobIdAttempt);
+            std::string createStmt = sql::formCreateTable(table, _mergeSchema) + " ENGINE=MyISAM";
+            // The entry is reserved, and the table created without holding
+            // the lock, so loading other attempts does not wait for it. The
+            // merge count of the caller keeps the entry from being discarded
+            // meanwhile, and staging is only committed once merging is done.
+            iter = _staging.emplace(jobIdAttempt, Staging()).first;
+            iter->second.table = table;
+            lock.unlock();
+            bool const created = _applySqlLocal(createStmt, "createStaging");
+            lock.lock();
+            if (!created) {
+                _staging.erase(iter);
+                _stagingCv.notify_all();
+                LOGS(_log, LOG_LVL_ERROR, queryIdJobStr << " failed to create staging table " << table);
+                return false;
+            }
+            ctrStagedAttempts->add();
+            iter->second.creating = false;
+            _stagingCv.notify_all();
+        }
+        ++iter->second.loading;
+        stagingTable = iter->second.table;
+    }
+    bool ok = false;
+    {
+        std::unique_lock<std::mutex> lock;
+        size_t index = _lockShard(lock);
+        ok = _loadInfile(*_shards[index], rowBuffer, stagingTable, queryIdJobStr);
+    }
+    bool complete = false;
+    {
+        // The entry cannot have been removed, as rows are only discarded or
+        // committed when nothing is loading them.
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        auto iter = _staging.find(jobIdAttempt);
+        Staging& staging = iter->second;
+        --staging.loading;
+        staging.last = staging.last || !continues;
+        if (staging.last && staging.loading == 0) {
+            _staging.erase(iter);
+            complete = true;
+        }
+    }
+    if (complete) {
+        ok = _commitStaging(jobIdAttempt, stagingTable) && ok;
+    }
+    return ok;
 }
 
 
-bool InfileMerger::_applyMysql(std::string const& query) {
-    std::lock_guard<std::mutex> lock(_mysqlMutex);
-    if (!_mysqlConn.connected()) {
-        // should have connected during construction
-        // Try reconnecting--maybe we timed out.
-        if (!_setupConnection()) {
-            LOGS(_log, LOG_LVL_ERROR, "InfileMerger::_applyMysql _setupConnection() failed!!!");
-            return false; // Reconnection failed. This is an error.
+/// Move the rows of stagingTable into a shard, and drop it.
+bool InfileMerger::_commitStaging(int jobIdAttempt, std::string const& stagingTable) {
+    bool ok = false;
+    {
+        std::unique_lock<std::mutex> lock;
+        size_t index = _lockShard(lock);
+        MergeShard& shard = *_shards[index];
+        {
+            std::lock_guard<std::mutex> aLock(_attemptShardsMtx);
+            _attemptShards[jobIdAttempt].insert(index);
+        }
+        std::string const sqlCopy = "INSERT INTO " + shard.table + " SELECT * FROM " + stagingTable;
+        LOGS(_log, LOG_LVL_DEBUG, "Committing staged rows w/" << sqlCopy);
+        ok = shard.connect()
+             && mysql_real_query(shard.mysqlConn.getMySql(), sqlCopy.data(), sqlCopy.size()) == 0;
+        if (!ok) {
+            LOGS(_log, LOG_LVL_ERROR, "Failed to commit staged rows w/" << sqlCopy);
         }
     }
+    return _dropStaging(stagingTable) && ok;
+}
+
+
+/// Commit the staging tables of every job attempt whose last message was not
+/// seen, or was merged before an earlier message of the attempt.
+/// Precondition: merging is done.
+bool InfileMerger::_commitAllStaging() {
+    std::map<int, Staging> staging;
+    {
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        staging.swap(_staging);
+    }
+    bool ok = true;
+    for (auto const& elem : staging) {
+        ok = _commitStaging(elem.first, elem.second.table) && ok;
+    }
+    return ok;
+}
+
+
+bool InfileMerger::_dropStaging(std::string const& stagingTable) {
+    return _applySqlLocal("DROP TABLE IF EXISTS " + stagingTable, "dropStaging");
+}
+
 
-    int rc = mysql_real_query(_mysqlConn.getMySql(),
-                              query.data(), query.size());
+/// Precondition: shard.mtx must be held.
+bool InfileMerger::_loadInfile(MergeShard& shard, std::shared_ptr<mysql::RowBuffer> const& rowBuffer,
+                               std::string const& table, std::string const& queryIdJobStr) {
+    // Connect, or reconnect if the connection timed out.
+    if (!shard.connect()) {
+        LOGS(_log, LOG_LVL_ERROR, "InfileMerger::_loadInfile connect failed for " << table);
+        return false; // Reconnection failed. This is an error.
+    }
+    std::string const virtFile = shard.infileMgr.prepareSrc(rowBuffer, queryIdJobStr);
+    std::string const query = sql::formLoadInfile(table, virtFile);
+    int rc = mysql_real_query(shard.mysqlConn.getMySql(), query.data(), query.size());
     return rc == 0;
 }
 
 
+/// Load the partial aggregates held by _aggregator into the merge tables,
+/// after which results are merged by MySQL.
+bool InfileMerger::_spillAggregator() {
+    auto results = _aggregator->spill();
+    if (results.empty()) {
+        return true; // Another thread spilled.
+    }
+    ctrAggregateSpills->add();
+    bool ok = true;
+    for (auto const& elem : results) {
+        if (elem.second->row_size() == 0) continue;
+        // Rows of other attempts are loaded, and must not be loaded once
+        // those attempts are invalid.
+        if (_invalidJobAttemptMgr.incrConcurrentMergeCount(elem.first)) continue;
+        auto rowBuffer = _newRowBuffer(*elem.second, elem.first);
+        ok = _applyMysql(rowBuffer, _getQueryIdStr(), elem.first) && ok;
+        ok = _addResultBytes(elem.first, rowBuffer->getFetchedBytes(), _getQueryIdStr()) && ok;
+        _invalidJobAttemptMgr.decrConcurrentMergeCount(elem.first);
+    }
+    return ok;
+}
+
+
+/// Write the rows computed by _aggregator to the target table.
+bool InfileMerger::_finalizeAggregator() {
+    proto::Result result;
+    if (!_aggregator->finish(result)) {
+        _error = InfileMergerError(util::ErrorCode::MERGEWRITE,
+                                   _getQueryIdStr() + " aggregation failed " + _aggregator->getError());
+        LOGS(_log, LOG_LVL_ERROR, _error.getMsg());
+        return false;
+    }
+    return _writeTargetTable(result);
+}
+
+
+/// Write the rows kept by _topK to the target table.
+bool InfileMerger::_finalizeTopK() {
+    proto::Result result;
+    if (!_topK->finish(result)) {
+        _error = InfileMergerError(util::ErrorCode::MERGEWRITE,
+                                   _getQueryIdStr() + " ORDER BY LIMIT failed " + _topK->getError());
+        LOGS(_log, LOG_LVL_ERROR, _error.getMsg());
+        return false;
+    }
+    LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << " kept " << result.row_size()
+                              << " rows, discarded " << _topK->getDiscarded());
+    return _writeTargetTable(result);
+}
+
+
+/// Create the target table with the schema of result and load its rows.
+bool InfileMerger::_writeTargetTable(proto::Result& result) {
+    std::string createStmt = sql::formCreateTable(_config.targetTable, schemaFromProto(result.rowschema()))
+                           + " ENGINE=MyISAM";
+    LOGS(_log, LOG_LVL_DEBUG, "Writing w/" << createStmt << " rows=" << result.row_size());
+    if (!_applySqlLocal(createStmt, "createTarget")) {
+        return false;
+    }
+    if (result.row_size() == 0) {
+        return true;
+    }
+    auto rowBuffer = std::make_shared<ProtoRowBuffer>(result);
+    MergeShard& shard = *_shards[0];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (!_loadInfile(shard, rowBuffer, _config.targetTable, _getQueryIdStr())) {
+        _error = InfileMergerError(util::ErrorCode::MYSQLEXEC,
+                                   _getQueryIdStr() + " failed to load rows into "
+                                   + _config.targetTable);
+        LOGS(_log, LOG_LVL_ERROR, _error.getMsg());
+        return false;
+    }
+    return true;
+}
+
+
 bool InfileMerger::finalize() {
+    util::TraceSpan span(_config.traceId, "InfileMerger::finalize", "rproc");
+    util::HistogramTimer finalizeTimer(histFinalize);
     bool finalizeOk = true;
     // TODO: Should check for error condition before continuing.
     if (_isFinished) {
         LOGS(_log, LOG_LVL_ERROR, "InfileMerger::finalize(), but _isFinished == true");
     }
     // TODO:DM-11524   delete all invalid rows in the table.
-    if (_mergeTable != _config.targetTable) {
+    bool sharded = false;
+    bool aggregated = false;
+    bool topK = false;
+    std::string unionTable = _mergeTable;
+    bool const committed = _commitAllStaging();
+    if (!committed) {
+        _error = InfileMergerError(util::ErrorCode::MYSQLEXEC,
+                                   _getQueryIdStr() + " failed to commit staged rows");
+        LOGS(_log, LOG_LVL_ERROR, _error.getMsg());
+        finalizeOk = false;
+    }
+    // Totals the aggregator can not hold are computed by MySQL.
+    if (committed && _aggregator && !_aggregator->checkTotals() && !_spillAggregator()) {
+        _error = InfileMergerError(util::ErrorCode::MYSQLEXEC,
+                                   _getQueryIdStr() + " failed to spill aggregates");
+        LOGS(_log, LOG_LVL_ERROR, _error.getMsg());
+        finalizeOk = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        aggregated = !_needCreateTable && _aggregator && _aggregator->isActive();
+        topK = !_needCreateTable && _topK && _topK->isActive();
+        sharded = needUnionShards(_shards.size(), !_needCreateTable, aggregated, topK);
+    }
+    if (!finalizeOk) {
+        // The results are incomplete, there is nothing to produce.
+    } else if (aggregated) {
+        // The rows never went through the merge tables.
+        finalizeOk = _finalizeAggregator();
+    } else if (topK) {
+        finalizeOk = _finalizeTopK();
+    } else if (sharded) {
+        // Without aggregation the union is copied into the target table.
+        unionTable = unionTableName(_mergeTable, _config.targetTable);
+        finalizeOk = _unionShards(unionTable);
+        if (!finalizeOk) {
+            LOGS(_log, LOG_LVL_ERROR, "Failed to combine merge shards into " << unionTable);
+        }
+    }
+    if (!finalizeOk || aggregated || topK) {
+        // Failed, or done above.
+    } else if (_mergeTable != _config.targetTable) {
         // Aggregation needed: Do the aggregation.
         std::string mergeSelect = _config.mergeStmt->getQueryTemplate().sqlFragment();
         // Using MyISAM as single thread writing with no need to recover from errors.
@@ -280,37 +702,228 @@ bool InfileMerger::finalize() {
         if (!cleanupOk) {
             LOGS(_log, LOG_LVL_DEBUG, "Failure cleaning up table " << _mergeTable);
         }
+    } else if (sharded) {
+        // Copy everything but the jobId column into the target table.
+        std::string columns;
+        for (auto const& col : _mergeSchema.columns) {
+            if (col.name == _jobIdColName) continue;
+            if (!columns.empty()) columns += ",";
+            columns += "`" + col.name + "`";
+        }
+        std::string createTarget = "CREATE TABLE " + _config.targetTable
+            + " ENGINE=MyISAM SELECT " + columns + " FROM " + unionTable;
+        LOGS(_log, LOG_LVL_DEBUG, "Copying w/" << createTarget);
+        finalizeOk = _applySqlLocal(createTarget, "createTarget");
+        sql::SqlErrorObject eObj;
+        if (!_sqlConn->dropTable(unionTable, eObj, false, _config.mySqlConfig.dbName)) {
+            LOGS(_log, LOG_LVL_DEBUG, "Failure cleaning up table " << unionTable);
+        }
     } else {
-        // Remove jobId and attemptCount information from the result table.
-        // Returning a view could be faster, but is more complicated.
-        std::string sqlDropCol = std::string("ALTER TABLE ") + _mergeTable
-                               + " DROP COLUMN " +  _jobIdColName;
-        LOGS(_log, LOG_LVL_DEBUG, "Removing w/" << sqlDropCol);
-        finalizeOk = _applySqlLocal(sqlDropCol, "dropCol Removing");
-    }
-    LOGS(_log, LOG_LVL_DEBUG, "Merged " << _mergeTable << " into " << _config.targetTable);
+        // The rows were loaded without a jobId column, so the merge table is
+        // the result table as is.
+    }
+    if (_invalidRowsKept) {
+        _error = InfileMergerError(util::ErrorCode::MERGEWRITE,
+                                   _getQueryIdStr() + " rows of an invalid job attempt are in "
+                                   + _mergeTable);
+        LOGS(_log, LOG_LVL_ERROR, _error.getMsg());
+        finalizeOk = false;
+    }
+    if (sharded || aggregated || topK) {
+        _dropShards();
+    }
+    histResultMB->record(_resultBytes/MB_SIZE_BYTES);
+    LOGS(_log, LOG_LVL_DEBUG, "Merged " << _mergeTable << " into " << _config.targetTable
+         << " resultBytes=" << _resultBytes);
     _isFinished = true;
     return finalizeOk;
 }
 
+/// Create unionTable as a MERGE table over all the shard tables, so that it
+/// can be read as if all results had been loaded into one table.
+bool InfileMerger::_unionShards(std::string const& unionTable) {
+    std::vector<std::string> shardTables;
+    for (auto const& shard : _shards) {
+        shardTables.push_back(shard->table);
+    }
+    std::string createUnion = unionShardsStmt(unionTable, _mergeSchema, shardTables);
+    LOGS(_log, LOG_LVL_DEBUG, "Union w/" << createUnion);
+    return _applySqlLocal(createUnion, "unionShards");
+}
+
+
+void InfileMerger::_dropShards() {
+    for (auto const& shard : _shards) {
+        sql::SqlErrorObject eObj;
+        if (!_sqlConn->dropTable(shard->table, eObj, false, _config.mySqlConfig.dbName)) {
+            LOGS(_log, LOG_LVL_DEBUG, "Failure cleaning up table " << shard->table);
+        }
+    }
+}
+
+
 bool InfileMerger::isFinished() const {
     return _isFinished;
 }
 
 
-bool InfileMerger::_deleteInvalidRows(int jobIdAttempt) {
-    std::string sqlDelRows = std::string("DELETE FROM ") + _mergeTable
-                             + " WHERE " +  _jobIdColName + "=" + std::to_string(jobIdAttempt);
-    LOGS(_log, LOG_LVL_DEBUG, "Deleting invalid rows w/" << sqlDelRows);
-    bool ok = _applySqlLocal(sqlDelRows, "deleteInvalidRows");
-    if (!ok) {
-        LOGS(_log, LOG_LVL_ERROR, "Failed to drop columns w/" << sqlDelRows);
+int InfileMerger::unorderedLimit(query::SelectStmt const& mergeStmt) {
+    // Rows are only counted as they arrive if each chunk result row is a
+    // result row, and any of them will do.
+    if (!mergeStmt.hasLimit() || mergeStmt.hasOrderBy() || mergeStmt.getDistinct()
+        || mergeStmt.hasGroupBy() || mergeStmt.hasHaving()) {
+        return -1;
+    }
+    auto selectList = mergeStmt.getSelectList().getValueExprList();
+    if (!selectList) {
+        return -1;
+    }
+    for (auto const& ve : *selectList) {
+        if (!ve || !(ve->isStar() || ve->isColumnRef())) {
+            return -1; // Possibly an aggregate.
+        }
+    }
+    return mergeStmt.getLimit();
+}
+
+
+void InfileMerger::setLimitReachedFunc(std::function<void()> func) {
+    std::lock_guard<std::mutex> lock(_limitMtx);
+    _limitReachedFunc = func;
+}
+
+
+/// Count rows merged for jobIdAttempt towards _rowLimit. Only the rows of an
+/// attempt whose last message was merged count, as until then the attempt can
+/// still be scrubbed, and squashing the other jobs would leave the result short.
+void InfileMerger::_countLimitRows(int jobIdAttempt, int rows, bool lastMessage) {
+    std::function<void()> func;
+    size_t merged = 0;
+    {
+        std::lock_guard<std::mutex> lock(_limitMtx);
+        if (!lastMessage) {
+            _limitAttemptRows[jobIdAttempt] += rows;
+            return;
+        }
+        _limitRows += rows;
+        auto iter = _limitAttemptRows.find(jobIdAttempt);
+        if (iter != _limitAttemptRows.end()) {
+            _limitRows += iter->second;
+            _limitAttemptRows.erase(iter);
+        }
+        if (_limitReached || _limitRows < static_cast<size_t>(_rowLimit)) {
+            return;
+        }
+        _limitReached = true;
+        func = _limitReachedFunc;
+        merged = _limitRows;
+    }
+    LOGS(_log, LOG_LVL_INFO, _getQueryIdStr() << " merged " << merged
+         << " rows, LIMIT " << _rowLimit << " reached");
+    if (func) {
+        func();
+    }
+}
+
+
+/// Add the bytes of rows loaded for jobIdAttempt to the result size, logging
+/// its growth, and set _error if the result is now larger than allowed.
+/// @return false if the result is too large.
+bool InfileMerger::_addResultBytes(int jobIdAttempt, size_t bytes, std::string const& queryIdJobStr) {
+    size_t total = 0;
+    bool report = false;
+    {
+        std::lock_guard<std::mutex> lock(_resultBytesMtx);
+        _attemptBytes[jobIdAttempt] += bytes;
+        total = (_resultBytes += bytes);
+        if (total >= _nextSizeReport) {
+            report = true;
+            size_t step = std::max<size_t>(_maxResultTableSizeMB*MB_SIZE_BYTES/SIZE_REPORTS, 1);
+            _nextSizeReport = (total/step + 1)*step;
+        }
+    }
+    ctrResultBytes->add(bytes);
+    if (report) {
+        LOGS(_log, LOG_LVL_INFO, queryIdJobStr << " result " << _mergeTable << " at "
+             << total/MB_SIZE_BYTES << "MB max allowed=" << _maxResultTableSizeMB);
+    }
+    if (total > _maxResultTableSizeMB*MB_SIZE_BYTES) {
+        std::ostringstream os;
+        os << queryIdJobStr << " cancelling queryResult table " << _mergeTable
+           << " too large at " << total/MB_SIZE_BYTES << "MB max allowed=" << _maxResultTableSizeMB;
+        LOGS(_log, LOG_LVL_WARN, os.str());
+        _error = util::Error(-1, os.str(), -1);
         return false;
     }
     return true;
 }
 
 
+bool InfileMerger::_deleteInvalidRows(int jobIdAttempt) {
+    if (_aggregator) {
+        _aggregator->dropAttempt(jobIdAttempt);
+    }
+    if (_topK) {
+        _topK->dropAttempt(jobIdAttempt);
+    }
+    if (_rowLimit >= 0) {
+        std::lock_guard<std::mutex> lock(_limitMtx);
+        _limitAttemptRows.erase(jobIdAttempt);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_resultBytesMtx);
+        auto iter = _attemptBytes.find(jobIdAttempt);
+        if (iter != _attemptBytes.end()) {
+            _resultBytes -= iter->second;
+            _attemptBytes.erase(iter);
+        }
+    }
+    // Rows still in staging are discarded with their table.
+    std::string stagingTable;
+    {
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        auto iter = _staging.find(jobIdAttempt);
+        if (iter != _staging.end()) {
+            stagingTable = iter->second.table;
+            _staging.erase(iter);
+        }
+    }
+    bool ok = true;
+    if (!stagingTable.empty()) {
+        LOGS(_log, LOG_LVL_DEBUG, "Dropping staged rows of " << jobIdAttempt << " in " << stagingTable);
+        ctrDroppedStaging->add();
+        ok = _dropStaging(stagingTable);
+    }
+    // Only the shards the attempt was committed to can hold its rows.
+    std::set<size_t> shardIndexes;
+    {
+        std::lock_guard<std::mutex> lock(_attemptShardsMtx);
+        auto iter = _attemptShards.find(jobIdAttempt);
+        if (iter != _attemptShards.end()) {
+            shardIndexes.swap(iter->second);
+            _attemptShards.erase(iter);
+        }
+    }
+    if (!_jobIdInRows && !shardIndexes.empty()) {
+        // The attempt was complete when it was loaded, so this should not happen.
+        LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << " cannot delete rows of " << jobIdAttempt
+             << " without a jobId column");
+        _invalidRowsKept = true;
+        return false;
+    }
+    for (auto index : shardIndexes) {
+        std::string sqlDelRows = std::string("DELETE FROM ") + _shards[index]->table
+                                 + " WHERE " +  _jobIdColName + "=" + std::to_string(jobIdAttempt);
+        LOGS(_log, LOG_LVL_DEBUG, "Deleting invalid rows w/" << sqlDelRows);
+        if (!_applySqlLocal(sqlDelRows, "deleteInvalidRows")) {
+            LOGS(_log, LOG_LVL_ERROR, "Failed to delete rows w/" << sqlDelRows);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+
 int InfileMerger::makeJobIdAttempt(int jobId, int attemptCount) {
     int jobIdAttempt = jobId * MAX_JOB_ATTEMPTS;
     if (attemptCount >= MAX_JOB_ATTEMPTS) {
@@ -376,42 +989,6 @@ bool InfileMerger::_sqlConnect(sql::SqlErrorObject& errObj) {
 }
 
 
-size_t InfileMerger::_getResultTableSizeMB() {
-    std::string tableSizeSql = std::string("SELECT table_name, ")
-                             + "round(((data_length + index_length) / 1048576), 2) as 'MB' "
-                             + "FROM information_schema.TABLES "
-                             + "WHERE table_schema = '" + _config.mySqlConfig.dbName
-                             + "' AND table_name = '" + _mergeTable + "'";
-    LOGS(_log, LOG_LVL_DEBUG, "Checking ResultTableSize " << tableSizeSql);
-    std::lock_guard<std::mutex> m(_sqlMutex);
-    sql::SqlErrorObject errObj;
-    sql::SqlResults results;
-    if (not _sqlConnect(errObj)) {
-        return 0;
-    }
-    if (not _sqlConn->runQuery(tableSizeSql, results, errObj)) {
-        _error = util::Error(errObj.errNo(), "error getting size sql: " + errObj.printErrMsg(),
-                       util::ErrorCode::MYSQLEXEC);
-        LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << "result table size error: " << _error.getMsg());
-        return 0;
-    }
-
-    // There should only be 1 row
-    auto iter = results.begin();
-    if (iter == results.end()) {
-        LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << " result table size no rows returned " << _mergeTable);
-        return 0;
-    }
-    auto& row = *iter;
-    std::string tbName = row[0].first;
-    std::string tbSize = row[1].first;
-    size_t sz = std::stoul(tbSize);
-    LOGS(_log, LOG_LVL_DEBUG,
-         _getQueryIdStr() << " ResultTableSizeMB tbl=" << tbName << " tbSize=" << tbSize);
-    return sz;
-}
-
-
 /// Read a ProtoHeader message from a buffer and return the number of bytes
 /// consumed.
 int InfileMerger::_readHeader(proto::ProtoHeader& header, char const* buffer, int length) {
@@ -454,25 +1031,7 @@ bool InfileMerger::_setupTable(proto::WorkerResponse const& response) {
     std::lock_guard<std::mutex> lock(_createTableMutex);
     if (_needCreateTable) {
         // create schema
-        proto::RowSchema const& rs = response.result.rowschema();
-        sql::Schema sch;
-        for(int i=0, e=rs.columnschema_size(); i != e; ++i) {
-            proto::ColumnSchema const& cs = rs.columnschema(i);
-            sql::ColSchema scs;
-            scs.name = cs.name();
-            if (cs.hasdefault()) {
-                scs.defaultValue = cs.defaultvalue();
-                scs.hasDefault = true;
-            } else {
-                scs.hasDefault = false;
-            }
-            if (cs.has_mysqltype()) {
-                scs.colType.mysqlType = cs.mysqltype();
-            }
-            scs.colType.sqlType = cs.sqltype();
-
-            sch.columns.push_back(scs);
-        }
+        sql::Schema sch = schemaFromProto(response.result.rowschema());
         // Add jobId column that does not conflict with existing columns.
         for (auto iter = sch.columns.begin(), end = sch.columns.end(); iter != end; ++iter) {
             auto const& col = *iter;
@@ -484,33 +1043,44 @@ bool InfileMerger::_setupTable(proto::WorkerResponse const& response) {
 
 
         sql::Schema schema;
-        {
+        if (_jobIdInRows) {
             sql::ColSchema scs;
             scs.name              = _jobIdColName;
             scs.hasDefault        = false;
             scs.colType.mysqlType = _jobIdMysqlType;
             scs.colType.sqlType   = _jobIdSqlType;
             schema.columns.push_back(scs);
-            schema.columns.insert(schema.columns.end(), sch.columns.begin(), sch.columns.end());
-        }
-        std::string createStmt = sql::formCreateTable(_mergeTable, schema);
-        // Specifying engine. There is some question about whether InnoDB or MyISAM is the better
-        // choice when multiple threads are writing to the result table.
-        createStmt += " ENGINE=MyISAM";
-        LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << "InfileMerger query prepared: " << createStmt);
-
-        if (not _applySqlLocal(createStmt, "setupTable")) {
-            _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
-                                       "Error creating table (" + _mergeTable + ")");
-            _isFinished = true; // Cannot continue.
-            LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << "InfileMerger sql error: " << _error.getMsg());
-            return false;
+        }
+        schema.columns.insert(schema.columns.end(), sch.columns.begin(), sch.columns.end());
+        // Shards must be MyISAM to be combined with a MERGE table in finalize().
+        for (auto const& shard : _shards) {
+            std::string createStmt = sql::formCreateTable(shard->table, schema);
+            // Specifying engine. There is some question about whether InnoDB or MyISAM is the better
+            // choice when multiple threads are writing to the result table.
+            createStmt += " ENGINE=MyISAM";
+            LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << "InfileMerger query prepared: " << createStmt);
+
+            if (not _applySqlLocal(createStmt, "setupTable")) {
+                _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
+                                           "Error creating table (" + shard->table + ")");
+                _isFinished = true; // Cannot continue.
+                LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << "InfileMerger sql error: " << _error.getMsg());
+                return false;
+            }
+        }
+        _mergeSchema = schema;
+        if (_aggregator) {
+            _aggregator->setSchema(response.result.rowschema());
+        }
+        if (_topK) {
+            _topK->setSchema(response.result.rowschema());
         }
         _needCreateTable = false;
     } else {
         // Do nothing, table already created.
     }
-    LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << "InfileMerger table " << _mergeTable << " ready");
+    LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << "InfileMerger table " << _mergeTable
+                              << " ready shards=" << _shards.size());
     return true;
 }
 
@@ -534,55 +1104,40 @@ void InfileMerger::_fixupTargetName() {
 
 
 bool InvalidJobAttemptMgr::incrConcurrentMergeCount(int jobIdAttempt) {
-    std::unique_lock<std::mutex> uLock(_iJAMtx);
+    std::lock_guard<std::mutex> uLock(_iJAMtx);
     if (_isJobAttemptInvalid(jobIdAttempt)) {
         LOGS(_log, LOG_LVL_INFO, jobIdAttempt << " invalid, not merging");
         return true;
     }
-    if (_waitFlag) {
-        /// wait for flag to clear
-        _cv.wait(uLock, [this](){ return !_waitFlag; });
-        // Since wait lets the mutex go, this must be checked again.
-        if (_isJobAttemptInvalid(jobIdAttempt)) {
-            LOGS(_log, LOG_LVL_INFO, jobIdAttempt << " invalid after wait, not merging");
-            return true;
-        }
-    }
     _jobIdAttemptsHaveRows.insert(jobIdAttempt);
-    ++_concurrentMergeCount;
-    // No rows can be deleted until after decrConcurrentMergeCount() is called, which
-    // should ensure that all rows added for this job attempt can be deleted by
-    // calls to holdMergingForRowDelete() if needed.
+    ++_mergeCounts[jobIdAttempt];
+    // No rows of this job attempt can be deleted until after
+    // decrConcurrentMergeCount(jobIdAttempt) is called, which should ensure that
+    // all rows added for it can be deleted by holdMergingForRowDelete() if needed.
     return false;
 }
 
 
-void InvalidJobAttemptMgr::decrConcurrentMergeCount() {
+void InvalidJobAttemptMgr::decrConcurrentMergeCount(int jobIdAttempt) {
     std::lock_guard<std::mutex> uLock(_iJAMtx);
-    --_concurrentMergeCount;
-    assert(_concurrentMergeCount >= 0);
-    if (_concurrentMergeCount == 0) {
-        // Notify any threads waiting that no merging is occurring.
+    auto iter = _mergeCounts.find(jobIdAttempt);
+    assert(iter != _mergeCounts.end() && iter->second > 0);
+    if (--iter->second == 0) {
+        _mergeCounts.erase(iter);
+        // Notify any threads waiting that this job attempt is not being merged.
         _cv.notify_all();
     }
 }
 
 
 bool InvalidJobAttemptMgr::holdMergingForRowDelete(int jobIdAttempt) {
-    auto cleanup = [this](){
-        _waitFlag = false;
-        _cv.notify_all();
-    };
-
     std::unique_lock<std::mutex> lockJA(_iJAMtx);
-    _waitFlag = true;
     // Prevent rows belonging to jobIdAttempt from being added to the table.
     _invalidJobAttempts.insert(jobIdAttempt);
 
     // If this jobAttempt hasn't had any rows added, no need to delete rows.
     if (_jobIdAttemptsHaveRows.find(jobIdAttempt) == _jobIdAttemptsHaveRows.end()) {
         LOGS(_log, LOG_LVL_INFO, jobIdAttempt << " should not have any rows, not deleting.");
-        cleanup();
         return true;
     }
     lockJA.unlock();
@@ -590,20 +1145,18 @@ bool InvalidJobAttemptMgr::holdMergingForRowDelete(int jobIdAttempt) {
     /// Rows with jobIdAttempt should be prevented from joining the result table.
     if (!_tableExistsFunc()) {
         LOGS(_log, LOG_LVL_INFO, "Nothing to do as no table yet made for " << jobIdAttempt);
-        cleanup();
         return true;
     }
 
     lockJA.lock();
-    if (_concurrentMergeCount > 0) {
-        _cv.wait(lockJA, [this](){ return _concurrentMergeCount == 0;});
-    }
+    _cv.wait(lockJA, [this, jobIdAttempt](){
+        return _mergeCounts.find(jobIdAttempt) == _mergeCounts.end();
+    });
+    lockJA.unlock();
 
+    // Other job attempts continue merging while the rows are deleted.
     LOGS(_log, LOG_LVL_INFO, "Deleting rows for " << jobIdAttempt);
-    bool res = _deleteFunc(jobIdAttempt);
-    // Table scrubbed, continue merging results.
-    cleanup();
-    return res;
+    return _deleteFunc(jobIdAttempt);
 }
 
 
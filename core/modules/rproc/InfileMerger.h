@@ -30,15 +30,20 @@
 /// (see individual class documentation for more information)
 
 // System headers
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 // Qserv headers
 #include "mysql/LocalInfile.h"
 #include "mysql/MySqlConfig.h"
 #include "mysql/MySqlConnection.h"
+#include "sql/Schema.h"
 #include "sql/SqlConnection.h"
 #include "util/Error.h"
 #include "util/EventThread.h"
@@ -60,6 +65,11 @@ namespace qdisp {
 namespace query {
     class SelectStmt;
 }
+namespace rproc {
+    class HashAggregator;
+    class ProtoRowBuffer;
+    class TopKHeap;
+}
 namespace sql {
     class SqlConnection;
 }
@@ -91,6 +101,16 @@ public:
     mysql::MySqlConfig const mySqlConfig;
     std::string targetTable;
     std::shared_ptr<query::SelectStmt> mergeStmt;
+    uint64_t traceId{0}; ///< util::Tracer trace id, 0 if the query is not traced.
+    int maxMergeShards{1}; ///< Upper limit on the number of tables results are loaded into.
+    int expectedChunks{0}; ///< Number of chunk results expected, 0 if unknown.
+    int chunkRowLimit{0};  ///< Maximum rows in each chunk result, 0 if unlimited.
+    /// Groups aggregation may hold in memory before merging falls back to
+    /// MySQL, 0 to always aggregate with MySQL.
+    size_t aggregateMaxGroups{0};
+    /// Largest LIMIT for which the best rows of ORDER BY ... LIMIT queries
+    /// are kept in memory, 0 to always sort with MySQL.
+    size_t topKMaxRows{0};
 };
 
 
@@ -99,11 +119,11 @@ public:
 /// so steps are taken to only do it when rows are known to exist in the
 /// result table.
 ///
-/// The rows can only be safely deleted from the result table when
-/// nothing is writing to the table. To minimize the time locking the mutex
-/// and allow multiple entities to write to the table concurrently, the
-/// number of task writing to the table is tracked with _concurrentMergeCount.
-/// Deletes are only to be allowed when _concurrentMergeCount is 0.
+/// The rows of a job attempt can only be safely deleted when nothing is
+/// writing rows of that attempt. The number of merges in progress is tracked
+/// for each job attempt in _mergeCounts, and rows of an attempt are only
+/// deleted once its count is 0. Merging of other job attempts continues
+/// while the rows are deleted.
 class InvalidJobAttemptMgr {
 public:
     InvalidJobAttemptMgr() {}
@@ -111,14 +131,15 @@ public:
     void setTableExistsFunc(std::function<bool(void)> func) {_tableExistsFunc = func; }
 
     /// @return true if jobIdAttempt is invalid.
-    /// Wait if rows need to be deleted.
-    /// Then, add job-attempt to _jobIdAttemptsHaveRows and increment
-    /// _concurrentMergeCount to keep rows from being deleted before
-    /// decrConcurrentMergeCount is called.
+    /// Otherwise, add job-attempt to _jobIdAttemptsHaveRows and increment
+    /// its merge count to keep its rows from being deleted before
+    /// decrConcurrentMergeCount(jobIdAttempt) is called.
     bool incrConcurrentMergeCount(int jobIdAttempt);
-    void decrConcurrentMergeCount();
-
+    void decrConcurrentMergeCount(int jobIdAttempt);
 
+    /// Make jobIdAttempt invalid, wait for merges of its rows in progress,
+    /// and delete its rows if it has any.
+    /// @return false if the rows could not be deleted.
     bool holdMergingForRowDelete(int jobIdAttempt);
 
     /// @return true if jobIdAttempt is in the invalid set.
@@ -131,8 +152,7 @@ private:
     std::mutex _iJAMtx;
     std::set<int> _invalidJobAttempts;
     std::set<int> _jobIdAttemptsHaveRows;
-    int _concurrentMergeCount{0};
-    bool _waitFlag{false};
+    std::map<int, int> _mergeCounts; ///< Merges in progress for each job attempt.
     std::condition_variable  _cv;
     std::function<bool(int)> _deleteFunc;
     std::function<bool(void)> _tableExistsFunc;
@@ -150,6 +170,25 @@ private:
 /// Bytes 1 - size_ph : ProtoHeader message (containing size of result message)
 /// Bytes size_ph - size_ph + size_rm : Result message
 /// At present, Result messages are not chained.
+///
+/// Results can be loaded into several identical shard tables, each with its
+/// own connection, so that responses arriving on different threads are
+/// loaded concurrently. finalize() combines the shards through a MERGE
+/// engine table before aggregating or producing the target table.
+///
+/// Without a merge statement or shards, rows are loaded without the jobId
+/// column, so that the merge table is the result table as is. Rows of a job
+/// attempt are then only kept apart while the attempt is in staging.
+///
+/// The rows of a job attempt whose result spans several messages are loaded
+/// into a staging table of the attempt until its last message is loaded, and
+/// then moved into a shard. If the attempt is invalidated before then, its
+/// rows are discarded by dropping the staging table instead of deleting them
+/// from a shard.
+///
+/// When the merge statement is simple enough, aggregation is instead done in
+/// memory by a HashAggregator, and [ORDER BY ...] LIMIT by a TopKHeap, and
+/// only the final rows are written.
 class InfileMerger {
 public:
     explicit InfileMerger(InfileMergerConfig const& c);
@@ -178,8 +217,90 @@ public:
     bool scrubResults(int jobId, int attempt);
     int makeJobIdAttempt(int jobId, int attemptCount);
 
+    /// @return the number of shard tables to load results into.
+    /// @param maxShards - configured upper limit.
+    /// @param expectedChunks - number of chunk results expected, 0 if unknown.
+    /// @param chunkRowLimit - maximum rows per chunk result, 0 if unlimited.
+    static int chooseMergeShards(int maxShards, int expectedChunks, int chunkRowLimit);
+
+    /// @return the names of the nShards tables results are loaded into,
+    ///         mergeTable itself if there is only one.
+    static std::vector<std::string> mergeShardTables(std::string const& mergeTable, int nShards);
+
+    /// @return true if finalize() combines the merge shards in a union table,
+    ///         which it does when there are several and rows were loaded into
+    ///         them, rather than into a HashAggregator or TopKHeap.
+    static bool needUnionShards(int nShards, bool tableCreated, bool aggregated, bool topK);
+
+    /// @return the table the merge shards are combined into: mergeTable,
+    ///         unless it is also the result table, which is then copied from
+    ///         the union without the jobId column.
+    static std::string unionTableName(std::string const& mergeTable, std::string const& targetTable);
+
+    /// @return the statement creating unionTable, with the columns of schema,
+    ///         as a MERGE table over shardTables.
+    static std::string unionShardsStmt(std::string const& unionTable, sql::Schema const& schema,
+                                       std::vector<std::string> const& shardTables);
+
+    /// @return the number of shard tables results are loaded into.
+    int getMergeShardCount() const { return _shards.size(); }
+
+    /// @return the number of bytes of rows loaded into the merge tables, less
+    ///         those of invalid job attempts.
+    size_t getResultSize() const { return _resultBytes; }
+
+    /// Set the function called, once, when an unordered LIMIT query has
+    /// merged enough rows that the remaining chunk results are not needed.
+    void setLimitReachedFunc(std::function<void()> func);
+
+    /// @return the LIMIT of the merge statement if any set of that many rows
+    ///         is a complete result, or -1.
+    static int unorderedLimit(query::SelectStmt const& mergeStmt);
+
 private:
-    bool _applyMysql(std::string const& query);
+    /// A table results are loaded into, with its own connection so that
+    /// loads into different shards can run at the same time.
+    struct MergeShard {
+        MergeShard(mysql::MySqlConfig const& config, std::string const& table_)
+            : table(table_), mysqlConn(config) {}
+        MergeShard(MergeShard const&) = delete;
+        MergeShard& operator=(MergeShard const&) = delete;
+
+        /// Precondition: mtx must be held.
+        /// @return true if connected.
+        bool connect();
+
+        std::string const table;
+        std::mutex mtx; ///< Held while loading into the table.
+        mysql::MySqlConnection mysqlConn;
+        lsst::qserv::mysql::LocalInfile::Mgr infileMgr;
+    };
+
+    /// The staging table of a job attempt.
+    struct Staging {
+        std::string table;
+        bool creating{true}; ///< True until the table has been created.
+        int loading{0};   ///< Messages being loaded into the table.
+        bool last{false}; ///< True once the last message of the attempt was loaded.
+    };
+
+    std::shared_ptr<ProtoRowBuffer> _newRowBuffer(proto::Result& result, int jobIdAttempt);
+    size_t _lockShard(std::unique_lock<std::mutex>& lock);
+    bool _applyMysql(std::shared_ptr<mysql::RowBuffer> const& rowBuffer,
+                     std::string const& queryIdJobStr, int jobIdAttempt);
+    bool _applyAttempt(std::shared_ptr<mysql::RowBuffer> const& rowBuffer,
+                       std::string const& queryIdJobStr, int jobIdAttempt, bool continues);
+    bool _commitStaging(int jobIdAttempt, std::string const& stagingTable);
+    bool _commitAllStaging();
+    bool _dropStaging(std::string const& stagingTable);
+    bool _loadInfile(MergeShard& shard, std::shared_ptr<mysql::RowBuffer> const& rowBuffer,
+                     std::string const& table, std::string const& queryIdJobStr);
+    bool _spillAggregator();
+    bool _finalizeAggregator();
+    bool _finalizeTopK();
+    bool _writeTargetTable(proto::Result& result);
+    bool _unionShards(std::string const& unionTable);
+    void _dropShards();
     bool _merge(std::shared_ptr<proto::WorkerResponse>& response);
     int _readHeader(proto::ProtoHeader& header, char const* buffer, int length);
     int _readResult(proto::Result& result, char const* buffer, int length);
@@ -194,14 +315,6 @@ private:
     void _setQueryIdStr(std::string const& qIdStr);
     void _fixupTargetName();
 
-    bool _setupConnection() {
-        if (_mysqlConn.connect()) {
-            _infileMgr.attach(_mysqlConn.getMySql());
-            return true;
-        }
-        return false;
-    }
-
     InfileMergerConfig _config; ///< Configuration
     std::shared_ptr<sql::SqlConnection> _sqlConn; ///< SQL connection
     std::string _mergeTable; ///< Table for result loading
@@ -210,16 +323,23 @@ private:
     std::mutex _createTableMutex; ///< protection from creating tables
     std::mutex _sqlMutex; ///< Protection for SQL connection
     bool _needCreateTable{true}; ///< Does the target table need creating?
-    size_t _getResultTableSizeMB(); ///< Return the size of the result table in MB.
     /// Alter the jobId column name in hopes that it will be unique.
     void _alterJobIdColName() {
         _jobIdColName = "jobId" + std::to_string(_jobIdColNameAdj++);
     }
 
-    mysql::MySqlConnection _mysqlConn;
+    std::vector<std::unique_ptr<MergeShard>> _shards; ///< Tables results are loaded into.
+    std::atomic<unsigned int> _nextShard{0}; ///< Where the search for an idle shard starts.
+    sql::Schema _mergeSchema; ///< Schema of the shard tables, set with _needCreateTable.
+    std::shared_ptr<HashAggregator> _aggregator; ///< In memory aggregation, may be null.
+    std::shared_ptr<TopKHeap> _topK; ///< In memory ORDER BY ... LIMIT, may be null.
+
+    std::mutex _attemptShardsMtx; ///< Protects _attemptShards
+    std::map<int, std::set<size_t>> _attemptShards; ///< Shards holding rows of each job attempt.
 
-    std::mutex _mysqlMutex;
-    lsst::qserv::mysql::LocalInfile::Mgr _infileMgr;
+    std::mutex _stagingMtx; ///< Protects _staging
+    std::condition_variable _stagingCv; ///< Notified when a staging table has been created.
+    std::map<int, Staging> _staging; ///< Staging tables of incomplete job attempts.
 
     std::mutex _queryIdStrMtx; ///< protects _queryIdStr
     std::atomic<bool> _queryIdStrSet{false};
@@ -228,16 +348,30 @@ private:
     /// Name of the jobId column in the result table. Protected by _createTableMutex
     std::string _jobIdColName;
     int _jobIdColNameAdj{0}; ///< Adjustment to make if _jobIdColName is not unique.
+    bool _jobIdInRows{true}; ///< True if the merge tables have a jobId column.
+    /// Set if rows of an invalid job attempt could not be removed.
+    std::atomic<bool> _invalidRowsKept{false};
     int const _jobIdMysqlType{MYSQL_TYPE_LONG}; ///< 4 byte integer.
     std::string const _jobIdSqlType{"INT(9)"}; ///< The 9 only affects '0' padding with ZEROFILL.
 
     InvalidJobAttemptMgr _invalidJobAttemptMgr;
     bool _deleteInvalidRows(int jobIdAttempt);
+    void _countLimitRows(int jobIdAttempt, int rows, bool lastMessage);
+    bool _addResultBytes(int jobIdAttempt, size_t bytes, std::string const& queryIdJobStr);
+
+    int _rowLimit{-1}; ///< Rows that complete the result, -1 if all results are needed.
+    std::mutex _limitMtx; ///< Protects the members below.
+    std::map<int, size_t> _limitAttemptRows; ///< Rows merged for each incomplete job attempt.
+    size_t _limitRows{0}; ///< Rows merged for complete job attempts.
+    bool _limitReached{false};
+    std::function<void()> _limitReachedFunc;
 
 
-    int _sizeCheckRowCount{0}; ///< Number of rows read since last size check.
-    int _checkSizeEveryXRows{1000}; ///< Check the size of the result table after every x number of rows.
     size_t _maxResultTableSizeMB{5000}; ///< Max result table size.
+    std::mutex _resultBytesMtx; ///< Protects _attemptBytes and _nextSizeReport.
+    std::map<int, size_t> _attemptBytes; ///< Bytes loaded for each job attempt.
+    std::atomic<size_t> _resultBytes{0}; ///< Sum of _attemptBytes.
+    size_t _nextSizeReport{0}; ///< Result size at which growth is next logged.
 };
 
 }}} // namespace lsst::qserv::rproc
@@ -23,10 +23,14 @@
 #include "rproc/ProtoRowBuffer.h"
 
 // System headers
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 #include <stdexcept>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Third-party headers
 #include <mysql/mysql.h>
@@ -47,10 +51,14 @@ namespace {
 
 LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.ProtoRowBuffer");
 
-// Print the contents of a char vector, using ascii values for non-printing characters.
-std::string printCharVect(std::vector<char> const& cVect) {
+/// Formatting stops adding rows to a batch once it is this large.
+size_t const BATCH_BYTES = 1 << 20;
+
+// Print a char buffer, using ascii values for non-printing characters.
+std::string printChars(char const* chars, size_t len) {
     std::string str;
-    for (char c : cVect) {
+    for (size_t j = 0; j < len; ++j) {
+        char c = chars[j];
         if (std::isprint(c)) {
             str += c;
         } else {
@@ -60,6 +68,52 @@ std::string printCharVect(std::vector<char> const& cVect) {
     return str;
 }
 
+/// @return the character following the backslash in the escape sequence
+///         for c, or 0 if c is copied as is.
+inline char escapeCode(char c) {
+    switch(c) {
+      case '\0':   return '0';
+      case '\b':   return 'b';
+      case '\n':   return 'n';
+      case '\r':   return 'r';
+      case '\t':   return 't';
+      case '\032': return 'Z';
+      default:     return 0;
+    }
+}
+
+/// @return the position of the first byte in src[pos, len) that needs
+///         escaping, or len if there is none.
+inline size_t findEscape(char const* src, size_t pos, size_t len) {
+#if defined(__SSE2__)
+    // Every byte that needs escaping is <= 26, which rules out most blocks
+    // with a single comparison.
+    __m128i const maxEscaped = _mm_set1_epi8(26);
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + pos));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, maxEscaped), v)) == 0) {
+            continue;
+        }
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\0')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\b'))),
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\032')))));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; pos < len; ++pos) {
+        if (escapeCode(src[pos]) != 0) return pos;
+    }
+    return len;
+}
+
 } // namespace
 
 
@@ -75,35 +129,50 @@ ProtoRowBuffer::ProtoRowBuffer(proto::Result& res, int jobId, std::string const&
       _result(res),
       _rowIdx(0),
       _rowTotal(res.row_size()),
-      _currentRow(0),
       _jobIdColName(jobIdColName),
       _jobIdSqlType(jobIdSqlType),
       _jobIdMysqlType(jobIdMysqlType) {
     _jobIdStr = std::string("'") + std::to_string(jobId) + "'";
     _initSchema();
-    if (_result.row_size() > 0) {
-        _initCurrentRow();
+}
+
+
+ProtoRowBuffer::ProtoRowBuffer(proto::Result& res)
+    : ProtoRowBuffer(res, 0, std::string(), std::string(), 0) {
+}
+
+
+size_t ProtoRowBuffer::escapeSpan(char* dest, char const* src, size_t len) {
+    char* destI = dest;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t next = findEscape(src, pos, len);
+        memcpy(destI, src + pos, next - pos);
+        destI += next - pos;
+        if (next == len) break;
+        *destI++ = '\\';
+        *destI++ = escapeCode(src[next]);
+        pos = next + 1;
     }
+    return destI - dest;
 }
 
 
-/// Fetch a up to a single row from from the Result message
+/// Fetch up to bufLen bytes of formatted rows, formatting the next batch of
+/// rows whenever the current one has been consumed.
 unsigned ProtoRowBuffer::fetch(char* buffer, unsigned bufLen) {
     unsigned fetched = 0;
-    if (bufLen <= _currentRow.size()) {
-        memcpy(buffer, &_currentRow[0], bufLen);
-        _currentRow.erase(_currentRow.begin(), _currentRow.begin() + bufLen);
-        fetched = bufLen;
-    } else { // Want more than we have.
-        if (_currentRow.size()) {
-            memcpy(buffer, &_currentRow[0], _currentRow.size());
-            fetched = _currentRow.size();
-            _currentRow.clear();
+    while (fetched < bufLen) {
+        if (_bufPos == _bufLen) {
+            if (_rowIdx >= _rowTotal) break;
+            _fillBuffer();
         }
+        size_t len = std::min<size_t>(bufLen - fetched, _bufLen - _bufPos);
+        memcpy(buffer + fetched, _buf.get() + _bufPos, len);
+        _bufPos += len;
+        fetched += len;
     }
-    if ((_currentRow.size() == 0) && (_rowIdx < _rowTotal)) {
-        _readNextRow();
-    }
+    _fetchedBytes += fetched;
     return fetched;
 }
 
@@ -112,12 +181,14 @@ void ProtoRowBuffer::_initSchema() {
     _schema.columns.clear();
 
     // Set jobId and attemptCount
-    sql::ColSchema jobIdCol;
-    jobIdCol.name = _jobIdColName;
-    jobIdCol.hasDefault = false;
-    jobIdCol.colType.sqlType = _jobIdSqlType;
-    jobIdCol.colType.mysqlType = _jobIdMysqlType;
-    _schema.columns.push_back(jobIdCol);
+    if (!_jobIdColName.empty()) {
+        sql::ColSchema jobIdCol;
+        jobIdCol.name = _jobIdColName;
+        jobIdCol.hasDefault = false;
+        jobIdCol.colType.sqlType = _jobIdSqlType;
+        jobIdCol.colType.mysqlType = _jobIdMysqlType;
+        _schema.columns.push_back(jobIdCol);
+    }
 
     proto::RowSchema const& prs = _result.rowschema();
     for(int i=0, e=prs.columnschema_size(); i != e; ++i) {
@@ -148,32 +219,78 @@ std::string ProtoRowBuffer::dump() const {
     }
     str += ") ";
     str += "Row " + std::to_string(_rowIdx) + "(";
-    str += printCharVect(_currentRow);
+    str += printChars(_buf.get() + _bufPos, _bufLen - _bufPos);
     str += ")";
     return str;
 }
 
 
-/// Import the next row into the buffer
-void ProtoRowBuffer::_readNextRow() {
-    ++_rowIdx;
-    if (_rowIdx >= _rowTotal) {
-        return;
+/// Format the next batch of rows into the buffer, replacing its contents.
+void ProtoRowBuffer::_fillBuffer() {
+    _bufLen = 0;
+    _bufPos = 0;
+    int first = _rowIdx;
+    while (_rowIdx < _rowTotal && _bufLen < BATCH_BYTES) {
+        _appendRow(_result.row(_rowIdx));
+        ++_rowIdx;
+    }
+    LOGS(_log, LOG_LVL_TRACE, "formatted rows " << first << " to " << _rowIdx
+         << " in " << _bufLen << " bytes");
+}
+
+
+/// Make room for extra more bytes in the buffer.
+void ProtoRowBuffer::_reserve(size_t extra) {
+    if (_bufLen + extra <= _bufCap) return;
+    size_t cap = std::max(_bufLen + extra, 2 * _bufCap);
+    std::unique_ptr<char[]> buf(new char[cap]);
+    if (_bufLen > 0) {
+        memcpy(buf.get(), _buf.get(), _bufLen);
     }
-    _currentRow.clear();
-    // Start the new row with a row separator.
-    _currentRow.insert(_currentRow.end(), _rowSep.begin(), _rowSep.end());
-    _copyRowBundle(_currentRow, _result.row(_rowIdx));
-    LOGS(_log, LOG_LVL_TRACE, "_currentrow=" << printCharVect(_currentRow));
+    _buf = std::move(buf);
+    _bufCap = cap;
 }
 
 
-/// Setup the row byte buffer
-void ProtoRowBuffer::_initCurrentRow() {
-    // Copy row and reserve 2x size.
-    int rowSize = _copyRowBundle(_currentRow, _result.row(_rowIdx));
-    LOGS(_log, LOG_LVL_TRACE, "init _rowIdx=" <<_rowIdx << " _currentrow=" << printCharVect(_currentRow));
-    _currentRow.reserve(rowSize*2); // for future usage
+/// Append a row, preceded by a row separator unless it is the first row,
+/// to the buffer.
+void ProtoRowBuffer::_appendRow(proto::RowBundle const& rb) {
+    int const colCount = rb.column_size();
+    // Reserve for the worst case, where every byte is escaped.
+    size_t bound = _rowSep.size() + _jobIdStr.size()
+                 + colCount * (_colSep.size() + std::max<size_t>(2, _nullToken.size()));
+    for (int ci = 0; ci != colCount; ++ci) {
+        bound += 2 * rb.column(ci).size();
+    }
+    _reserve(bound);
+    char* dest = _buf.get() + _bufLen;
+    auto append = [&dest](std::string const& str) {
+        memcpy(dest, str.data(), str.size());
+        dest += str.size();
+    };
+    if (_rowIdx > 0) {
+        append(_rowSep);
+    }
+    bool needSep = false;
+    if (!_jobIdColName.empty()) {
+        append(_jobIdStr);
+        needSep = true;
+    }
+    for (int ci = 0; ci != colCount; ++ci) {
+        if (needSep) {
+            append(_colSep);
+        }
+        needSep = true;
+        if (!rb.isnull(ci)) {
+            std::string const& col = rb.column(ci);
+            *dest++ = '\'';
+            dest += escapeSpan(dest, col.data(), col.size());
+            *dest++ = '\'';
+        } else {
+            append(_nullToken);
+        }
+    }
+    _bufLen = dest - _buf.get();
 }
 
 
@@ -25,6 +25,8 @@
 
 // System headers
 #include <limits>
+#include <memory>
+#include <string>
 
 
 // Qserv headers
@@ -43,9 +45,14 @@ class ProtoRowBuffer : public mysql::RowBuffer {
 public:
     ProtoRowBuffer(proto::Result& res, int jobId, std::string const& jobIdColName,
                    std::string const& jobIdSqlType, int jobIdMysqlType);
+    /// Construct a buffer for rows that are loaded without a jobId column.
+    explicit ProtoRowBuffer(proto::Result& res);
     virtual unsigned fetch(char* buffer, unsigned bufLen);
     std::string dump() const override;
 
+    /// @return the number of bytes returned by fetch() so far.
+    size_t getFetchedBytes() const { return _fetchedBytes; }
+
     /// Escape a bytestring for LOAD DATA INFILE, as specified by MySQL doc:
     /// https://dev.mysql.com/doc/refman/5.1/en/load-data.html
     /// This is limited to:
@@ -82,40 +89,30 @@ public:
         return destI - destBegin;
     }
 
-    /// Copy a rawColumn to an STL container
+    /// Escape len bytes of src into dest exactly as escapeString() does, but
+    /// scanning for the bytes that need escaping a block at a time and
+    /// copying the spans in between with memcpy.
+    /// dest must have room for 2*len bytes.
+    /// @return the number of bytes written to dest
+    static size_t escapeSpan(char* dest, char const* src, size_t len);
+
+    /// Copy a rawColumn to a contiguous STL container
     template <typename T>
     static inline int copyColumn(T& dest, std::string const& rawColumn) {
         int existingSize = dest.size();
         dest.resize(existingSize + 2 + 2 * rawColumn.size());
         dest[existingSize] = '\'';
-        int valSize = escapeString(dest.begin() + existingSize + 1,
-                                   rawColumn.begin(), rawColumn.end());
+        int valSize = escapeSpan(&dest[existingSize + 1], rawColumn.data(), rawColumn.size());
         dest[existingSize + 1 + valSize] = '\'';
         dest.resize(existingSize + 2 + valSize);
         return 2 + valSize;
     }
 
 private:
-    void _initCurrentRow();
     void _initSchema();
-    void _readNextRow();
-    // Copy a row bundle into a destination STL char container
-    template <typename T>
-    int _copyRowBundle(T& dest, proto::RowBundle const& rb) {
-        int sizeBefore = dest.size();
-        // Add jobId
-        dest.insert(dest.end(), _jobIdStr.begin(), _jobIdStr.end());
-        for(int ci=0, ce=rb.column_size(); ci != ce; ++ci) {
-            dest.insert(dest.end(), _colSep.begin(), _colSep.end());
-            if (!rb.isnull(ci)) {
-                copyColumn(dest, rb.column(ci));
-            } else {
-                dest.insert(dest.end(), _nullToken.begin(), _nullToken.end() );
-            }
-        }
-        return dest.size() - sizeBefore;
-    }
-
+    void _fillBuffer();
+    void _reserve(size_t extra);
+    void _appendRow(proto::RowBundle const& rb);
 
     std::string _colSep; ///< Column separator
     std::string _rowSep; ///< Row separator
@@ -123,9 +120,17 @@ private:
     proto::Result& _result; ///< Ref to Resultmessage
 
     sql::Schema _schema; ///< Schema object
-    int _rowIdx; ///< Row index
+    int _rowIdx; ///< Index of the next row to format
     int _rowTotal; ///< Total row count
-    std::vector<char> _currentRow; ///< char buffer representing current row.
+
+    /// Formatted rows that have not been fetched yet are _buf[_bufPos, _bufLen).
+    /// The buffer is refilled with a batch of rows once they are all fetched,
+    /// reusing its storage.
+    std::unique_ptr<char[]> _buf;
+    size_t _bufCap{0};
+    size_t _bufLen{0};
+    size_t _bufPos{0};
+    size_t _fetchedBytes{0}; ///< Sum of the bytes returned by fetch().
 
     /// Name and type for jobId column in result table. Passed from InfileMerger.
     std::string _jobIdStr; ///< String form of jobId.
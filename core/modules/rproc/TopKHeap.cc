@@ -0,0 +1,428 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/TopKHeap.h"
+
+// System headers
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "query/ColumnRef.h"
+#include "query/OrderByClause.h"
+#include "query/SelectList.h"
+#include "query/SelectStmt.h"
+#include "query/ValueExpr.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.TopKHeap");
+
+/// The digits of a decimal or integer string, without leading or trailing
+/// zeros.
+struct DecimalParts {
+    bool negative{false};
+    std::string intDigits;
+    std::string fracDigits;
+};
+
+bool splitDecimal(std::string const& str, DecimalParts& parts) {
+    size_t j = 0;
+    if (j < str.size() && (str[j] == '-' || str[j] == '+')) {
+        parts.negative = (str[j] == '-');
+        ++j;
+    }
+    size_t const intBegin = j;
+    while (j < str.size() && str[j] >= '0' && str[j] <= '9') ++j;
+    size_t const intEnd = j;
+    size_t fracBegin = j;
+    if (j < str.size() && str[j] == '.') {
+        fracBegin = ++j;
+        while (j < str.size() && str[j] >= '0' && str[j] <= '9') ++j;
+    }
+    if (j != str.size() || (intEnd == intBegin && j == fracBegin)) {
+        return false;
+    }
+    size_t first = intBegin;
+    while (first < intEnd && str[first] == '0') ++first;
+    parts.intDigits = str.substr(first, intEnd - first);
+    size_t last = j;
+    while (last > fracBegin && str[last - 1] == '0') --last;
+    parts.fracDigits = (last > fracBegin) ? str.substr(fracBegin, last - fracBegin) : std::string();
+    if (parts.intDigits.empty() && parts.fracDigits.empty()) {
+        parts.negative = false; // -0 == 0
+    }
+    return true;
+}
+
+/// Compare two decimal or integer strings exactly.
+/// @return a negative value if a < b, 0 if a == b, positive if a > b.
+int compareDecimal(std::string const& a, std::string const& b) {
+    DecimalParts pa, pb;
+    splitDecimal(a, pa);
+    splitDecimal(b, pb);
+    if (pa.negative != pb.negative) {
+        return pa.negative ? -1 : 1;
+    }
+    int cmp = 0;
+    if (pa.intDigits.size() != pb.intDigits.size()) {
+        cmp = pa.intDigits.size() < pb.intDigits.size() ? -1 : 1;
+    } else {
+        cmp = pa.intDigits.compare(pb.intDigits);
+        if (cmp == 0) {
+            cmp = pa.fracDigits.compare(pb.fracDigits);
+        }
+    }
+    return pa.negative ? -cmp : cmp;
+}
+
+bool isNullAt(lsst::qserv::proto::RowBundle const& row, int j) {
+    return (j < row.isnull_size() && row.isnull(j)) || j >= row.column_size();
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+TopKHeap::Ptr TopKHeap::newTopKHeap(query::SelectStmt const& mergeStmt, size_t maxRows) {
+    if (!mergeStmt.hasLimit() || mergeStmt.getLimit() < 0
+        || static_cast<size_t>(mergeStmt.getLimit()) > maxRows) {
+        return nullptr;
+    }
+    if (mergeStmt.getDistinct() || mergeStmt.hasGroupBy() || mergeStmt.hasHaving()
+        || mergeStmt.hasWhereClause()) {
+        return nullptr;
+    }
+    std::vector<Output> outputs;
+    auto selectList = mergeStmt.getSelectList().getValueExprList();
+    if (!selectList || selectList->empty()) {
+        return nullptr;
+    }
+    for (auto const& ve : *selectList) {
+        if (!ve) return nullptr;
+        Output output;
+        if (ve->isStar()) {
+            if (!ve->getAlias().empty()) return nullptr;
+        } else {
+            auto cr = ve->getColumnRef();
+            if (!cr || cr->column.empty()) return nullptr;
+            output.colName = cr->column;
+            output.name = ve->getAlias().empty() ? cr->column : ve->getAlias();
+        }
+        outputs.push_back(output);
+    }
+
+    std::vector<SortKey> keys;
+    if (mergeStmt.hasOrderBy()) {
+        auto terms = mergeStmt.getOrderBy().clone()->getTerms();
+        for (auto const& term : *terms) {
+            auto const& expr = term.getExpr();
+            auto cr = expr ? expr->getColumnRef() : nullptr;
+            if (!cr || cr->column.empty()
+                || term.sqlFragment().find(" COLLATE ") != std::string::npos) {
+                return nullptr;
+            }
+            SortKey key;
+            key.name = cr->column;
+            key.descending = (term.getOrder() == query::OrderByTerm::DESC);
+            keys.push_back(key);
+        }
+    }
+    return Ptr(new TopKHeap(outputs, keys, mergeStmt.getLimit()));
+}
+
+
+TopKHeap::TopKHeap(std::vector<Output> const& outputs, std::vector<SortKey> const& keys, size_t limit)
+    : _limit(limit), _outputs(outputs), _keys(keys) {
+}
+
+
+bool TopKHeap::setSchema(proto::RowSchema const& schema) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_schemaSet) return _active;
+    _schemaSet = true;
+    _schema = schema;
+    std::map<std::string, int> colIndex;
+    for (int j = 0; j < schema.columnschema_size(); ++j) {
+        // A name appearing twice cannot be resolved.
+        if (!colIndex.insert(std::make_pair(schema.columnschema(j).name(), j)).second) {
+            colIndex[schema.columnschema(j).name()] = -1;
+        }
+    }
+    auto findCol = [&colIndex](std::string const& name) -> int {
+        auto iter = colIndex.find(name);
+        return iter == colIndex.end() ? -1 : iter->second;
+    };
+
+    bool ok = true;
+    std::vector<Output> outputs;
+    for (auto const& output : _outputs) {
+        if (output.colName.empty()) {
+            // * selects every column.
+            for (int j = 0; j < schema.columnschema_size(); ++j) {
+                Output col;
+                col.name = schema.columnschema(j).name();
+                col.colName = col.name;
+                col.col = j;
+                outputs.push_back(col);
+            }
+            continue;
+        }
+        Output col = output;
+        // Chunk results name aliased columns with the alias.
+        col.col = findCol(col.name);
+        if (col.col < 0) {
+            col.col = findCol(col.colName);
+        }
+        ok = ok && col.col >= 0;
+        outputs.push_back(col);
+    }
+    _outputs = outputs;
+
+    for (auto& key : _keys) {
+        // ORDER BY may name a select list alias.
+        for (auto const& output : _outputs) {
+            if (output.name == key.name) {
+                key.col = output.col;
+                break;
+            }
+        }
+        if (key.col < 0) {
+            key.col = findCol(key.name);
+        }
+        if (key.col < 0) {
+            ok = false;
+            break;
+        }
+        auto const& cs = schema.columnschema(key.col);
+        std::string const& sqlType = cs.sqltype();
+        switch (cs.has_mysqltype() ? cs.mysqltype() : -1) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_YEAR:
+        case MYSQL_TYPE_DECIMAL:
+        case MYSQL_TYPE_NEWDECIMAL:
+            key.kind = Kind::EXACT;
+            break;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            key.kind = Kind::REAL;
+            break;
+        case MYSQL_TYPE_DATE:
+        case MYSQL_TYPE_NEWDATE:
+        case MYSQL_TYPE_DATETIME:
+        case MYSQL_TYPE_TIMESTAMP:
+            // Fixed width text that sorts like the values.
+            key.kind = Kind::BYTES;
+            break;
+        case MYSQL_TYPE_STRING:
+        case MYSQL_TYPE_VAR_STRING:
+        case MYSQL_TYPE_VARCHAR:
+        case MYSQL_TYPE_TINY_BLOB:
+        case MYSQL_TYPE_MEDIUM_BLOB:
+        case MYSQL_TYPE_LONG_BLOB:
+        case MYSQL_TYPE_BLOB: {
+            // Only binary strings compare byte by byte.
+            bool binary = sqlType.find("BINARY") != std::string::npos
+                          || sqlType.find("BLOB") != std::string::npos;
+            key.kind = binary ? Kind::BYTES : Kind::OTHER;
+            break;
+        }
+        default:
+            key.kind = Kind::OTHER;
+        }
+        ok = ok && key.kind != Kind::OTHER;
+    }
+    if (!ok) {
+        LOGS(_log, LOG_LVL_DEBUG, "TopKHeap unsupported result schema, merging with MySQL");
+        _active = false;
+    }
+    return _active;
+}
+
+
+bool TopKHeap::_parseKeys(proto::RowBundle const& row, std::vector<double>& reals,
+                          std::string& error) const {
+    reals.assign(_keys.size(), 0.0);
+    for (size_t k = 0; k < _keys.size(); ++k) {
+        SortKey const& key = _keys[k];
+        if (isNullAt(row, key.col)) continue;
+        std::string const& val = row.column(key.col);
+        if (key.kind == Kind::REAL) {
+            char* end = nullptr;
+            reals[k] = strtod(val.c_str(), &end);
+            if (end == val.c_str()) {
+                error = "TopKHeap could not read '" + val + "' in " + key.name;
+                return false;
+            }
+        } else if (key.kind == Kind::EXACT) {
+            DecimalParts parts;
+            if (!splitDecimal(val, parts)) {
+                error = "TopKHeap could not read '" + val + "' in " + key.name;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+int TopKHeap::_compare(proto::RowBundle const& a, std::vector<double> const& aReals,
+                       proto::RowBundle const& b, std::vector<double> const& bReals) const {
+    for (size_t k = 0; k < _keys.size(); ++k) {
+        SortKey const& key = _keys[k];
+        bool aNull = isNullAt(a, key.col);
+        bool bNull = isNullAt(b, key.col);
+        int cmp = 0;
+        // NULL sorts before any value, as in MySQL.
+        if (aNull || bNull) {
+            cmp = (aNull == bNull) ? 0 : (aNull ? -1 : 1);
+        } else if (key.kind == Kind::REAL) {
+            cmp = (aReals[k] < bReals[k]) ? -1 : (bReals[k] < aReals[k] ? 1 : 0);
+        } else if (key.kind == Kind::EXACT) {
+            cmp = compareDecimal(a.column(key.col), b.column(key.col));
+        } else {
+            cmp = a.column(key.col).compare(b.column(key.col));
+        }
+        if (cmp != 0) {
+            return key.descending ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+
+bool TopKHeap::add(proto::Result const& result, int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_active) return false;
+    auto before = [this](Entry const& a, Entry const& b) { return _compare(a, b) < 0; };
+    std::vector<double> reals;
+    std::string error;
+    for (auto const& row : result.row()) {
+        if (!_parseKeys(row, reals, error)) {
+            if (_error.empty()) {
+                _error = error;
+                LOGS(_log, LOG_LVL_ERROR, _error);
+            }
+            ++_discarded;
+            continue;
+        }
+        bool const full = (_heap.size() >= _limit);
+        if (full) {
+            // Only copy rows that displace the worst row held.
+            if (_heap.empty() || _compare(row, reals, _heap.front().row, _heap.front().reals) >= 0) {
+                ++_discarded;
+                continue;
+            }
+            std::pop_heap(_heap.begin(), _heap.end(), before);
+            _heap.pop_back();
+            ++_discarded;
+        }
+        Entry entry;
+        entry.row.mutable_column()->CopyFrom(row.column());
+        entry.row.mutable_isnull()->CopyFrom(row.isnull());
+        entry.reals.swap(reals);
+        entry.jobIdAttempt = jobIdAttempt;
+        _heap.push_back(std::move(entry));
+        std::push_heap(_heap.begin(), _heap.end(), before);
+    }
+    return true;
+}
+
+
+void TopKHeap::dropAttempt(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = std::remove_if(_heap.begin(), _heap.end(),
+                               [jobIdAttempt](Entry const& e) { return e.jobIdAttempt == jobIdAttempt; });
+    if (iter == _heap.end()) return;
+    _heap.erase(iter, _heap.end());
+    std::make_heap(_heap.begin(), _heap.end(),
+                   [this](Entry const& a, Entry const& b) { return _compare(a, b) < 0; });
+}
+
+
+bool TopKHeap::isActive() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _active;
+}
+
+
+size_t TopKHeap::getDiscarded() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _discarded;
+}
+
+
+std::string TopKHeap::getError() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _error;
+}
+
+
+bool TopKHeap::finish(proto::Result& out) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_active || !_schemaSet) return false;
+    if (!_error.empty()) return false;
+
+    auto& schema = *out.mutable_rowschema();
+    schema.Clear();
+    for (auto const& output : _outputs) {
+        auto cs = schema.add_columnschema();
+        *cs = _schema.columnschema(output.col);
+        cs->set_name(output.name);
+    }
+    for (auto const& entry : _heap) {
+        auto row = out.add_row();
+        for (auto const& output : _outputs) {
+            bool isNull = isNullAt(entry.row, output.col);
+            row->add_column(isNull ? std::string() : entry.row.column(output.col));
+            row->add_isnull(isNull);
+        }
+    }
+    _heap.clear();
+    out.set_continues(false);
+    out.set_queryid(0);
+    out.set_jobid(0);
+    out.set_largeresult(false);
+    out.set_rowcount(out.row_size());
+    out.set_transmitsize(0);
+    out.set_attemptcount(0);
+    // The heap cannot be used again.
+    _active = false;
+    return true;
+}
+
+}}} // namespace lsst::qserv::rproc
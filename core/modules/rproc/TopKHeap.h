@@ -0,0 +1,146 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_RPROC_TOPKHEAP_H
+#define LSST_QSERV_RPROC_TOPKHEAP_H
+
+// System headers
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+// Forward declarations
+namespace lsst {
+namespace qserv {
+namespace query {
+    class SelectStmt;
+}
+}} // End of forward declarations
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// TopKHeap evaluates the merge statement of a non-aggregate
+/// [ORDER BY ...] LIMIT k query while chunk results arrive, keeping only the
+/// best k rows seen so far. Every other row is discarded, so memory is bounded
+/// by k rather than by the number of chunks times k.
+///
+/// Supported merge statements select column references (or *) and order by
+/// column references. Without ORDER BY, the first k rows are kept. Ordering
+/// columns must be numeric, temporal or binary strings, since collations are
+/// not reproduced. Anything else is left to MySQL.
+///
+/// Rows are tagged with the job attempt they came from, so that the rows of
+/// an invalid attempt can be dropped. Rows that were discarded in favor of
+/// them are not recovered, which is correct as long as the retried attempt
+/// returns the same rows, as it does for the same chunk query.
+class TopKHeap {
+public:
+    using Ptr = std::shared_ptr<TopKHeap>;
+
+    /// @return a heap for mergeStmt, or nullptr if mergeStmt is not
+    ///         supported or its LIMIT is larger than maxRows.
+    static Ptr newTopKHeap(query::SelectStmt const& mergeStmt, size_t maxRows);
+
+    TopKHeap(TopKHeap const&) = delete;
+    TopKHeap& operator=(TopKHeap const&) = delete;
+
+    /// Resolve the merge statement against the schema of the chunk results.
+    /// The heap is deactivated if the column types are not supported.
+    /// @return true if the heap is active.
+    bool setSchema(proto::RowSchema const& schema);
+
+    /// Offer the rows of a chunk result.
+    /// @return false if the heap is not active, in which case the rows must
+    ///         be merged some other way.
+    bool add(proto::Result const& result, int jobIdAttempt);
+
+    /// Discard the rows added for jobIdAttempt.
+    void dropAttempt(int jobIdAttempt);
+
+    bool isActive() const;
+
+    /// @return the number of rows that were offered and discarded.
+    size_t getDiscarded() const;
+
+    /// Compute the final rows, in no particular order, and their schema.
+    /// @return false if the heap is not active or some values could not be
+    ///         read.
+    bool finish(proto::Result& out);
+
+    /// @return a description of the first error encountered.
+    std::string getError() const;
+
+private:
+    /// How values of an ordering column are compared.
+    enum class Kind { EXACT, REAL, BYTES, OTHER };
+
+    struct SortKey {
+        std::string name;
+        bool descending{false};
+        int col{-1};
+        Kind kind{Kind::OTHER};
+    };
+
+    struct Output {
+        std::string name;    ///< Name of the result column.
+        std::string colName; ///< Chunk result column, "" for *.
+        int col{-1};
+    };
+
+    struct Entry {
+        proto::RowBundle row;
+        std::vector<double> reals; ///< Parsed REAL sort values.
+        int jobIdAttempt{0};
+    };
+
+    TopKHeap(std::vector<Output> const& outputs, std::vector<SortKey> const& keys, size_t limit);
+
+    bool _parseKeys(proto::RowBundle const& row, std::vector<double>& reals, std::string& error) const;
+    /// @return a negative value if row a sorts before row b, positive if after.
+    int _compare(proto::RowBundle const& a, std::vector<double> const& aReals,
+                 proto::RowBundle const& b, std::vector<double> const& bReals) const;
+    int _compare(Entry const& a, Entry const& b) const {
+        return _compare(a.row, a.reals, b.row, b.reals);
+    }
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    bool _active{true};
+    bool _schemaSet{false};
+    size_t const _limit;
+    std::vector<Output> _outputs;
+    std::vector<SortKey> _keys;
+    proto::RowSchema _schema; ///< Schema of the chunk results.
+    /// Best rows, as a heap with the row that would be discarded next on top.
+    std::vector<Entry> _heap;
+    size_t _discarded{0};
+    std::string _error;
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_TOPKHEAP_H
@@ -0,0 +1,210 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/HashAggregator.h"
+
+// System headers
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Third-party headers
+#include "mysql/mysql.h"
+
+// Qserv headers
+#include "proto/worker.pb.h"
+#include "query/SelectStmt.h"
+#include "tests/FakeResultFixture.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE HashAggregator_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+namespace qserv = lsst::qserv;
+
+using lsst::qserv::tests::FakeResultFixture;
+using lsst::qserv::rproc::HashAggregator;
+
+struct Fixture : public FakeResultFixture {
+    Fixture(void) {}
+    ~Fixture(void) {}
+};
+
+BOOST_FIXTURE_TEST_SUITE(suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(GroupBy) {
+    auto mergeStmt = mergeStmtFor("SELECT objectId, COUNT(x), AVG(y), MIN(z), SUM(w) "
+                                  "FROM LSST.Object GROUP BY objectId", true);
+    auto agg = HashAggregator::newHashAggregator(*mergeStmt, 100);
+    BOOST_REQUIRE(agg);
+    qserv::proto::RowSchema schema;
+    addColumn(schema, "objectId", "BIGINT(20)", MYSQL_TYPE_LONGLONG);
+    addColumn(schema, "QS1_COUNT", "BIGINT(21)", MYSQL_TYPE_LONGLONG);
+    addColumn(schema, "QS2_COUNT", "BIGINT(21)", MYSQL_TYPE_LONGLONG);
+    addColumn(schema, "QS3_SUM", "DECIMAL(32,2)", MYSQL_TYPE_NEWDECIMAL);
+    addColumn(schema, "QS4_MIN", "DOUBLE", MYSQL_TYPE_DOUBLE);
+    addColumn(schema, "QS5_SUM", "DOUBLE", MYSQL_TYPE_DOUBLE);
+    BOOST_REQUIRE(agg->setSchema(schema));
+
+    qserv::proto::Result r1;
+    *r1.mutable_rowschema() = schema;
+    addRow(r1, {"1", "2", "2", "3.50", "1.5", "0.25"});
+    addRow(r1, {"2", "1", "1", "-1.00", "NULL", "1"});
+    qserv::proto::Result r2;
+    *r2.mutable_rowschema() = schema;
+    addRow(r2, {"1", "3", "1", "1.01", "-2", "0.5"});
+    addRow(r2, {"NULL", "5", "0", "NULL", "7", "NULL"});
+    qserv::proto::Result invalid;
+    *invalid.mutable_rowschema() = schema;
+    addRow(invalid, {"1", "100", "100", "100", "-100", "100"});
+
+    BOOST_CHECK(agg->add(r1, 10));
+    BOOST_CHECK(agg->add(r2, 20));
+    BOOST_CHECK(agg->add(invalid, 31));
+    agg->dropAttempt(31);
+    BOOST_CHECK(!agg->overLimit());
+
+    qserv::proto::Result out;
+    BOOST_REQUIRE(agg->finish(out));
+    BOOST_CHECK_EQUAL(dump(out, true),
+        "objectId:BIGINT(20) SUM(QS1_COUNT):DECIMAL(65,0) "
+        "(SUM(QS3_SUM)/SUM(QS2_COUNT)):DECIMAL(65,6) MIN(QS4_MIN):DOUBLE SUM(QS5_SUM):DOUBLE |"
+        " 1,5,1.503333,-2,0.75, 2,1,-1.000000,NULL,1, NULL,5,NULL,7,NULL,");
+}
+
+BOOST_AUTO_TEST_CASE(NoGroupBy) {
+    auto mergeStmt = mergeStmtFor("SELECT COUNT(*), MAX(z) FROM LSST.Object", true);
+    qserv::proto::RowSchema schema;
+    addColumn(schema, "QS1_COUNT", "BIGINT(21)", MYSQL_TYPE_LONGLONG);
+    addColumn(schema, "QS2_MAX", "INT(11)", MYSQL_TYPE_LONG);
+
+    // Without GROUP BY, an aggregate query has one row even with no input.
+    auto empty = HashAggregator::newHashAggregator(*mergeStmt, 1);
+    BOOST_REQUIRE(empty);
+    BOOST_REQUIRE(empty->setSchema(schema));
+    qserv::proto::Result out;
+    BOOST_REQUIRE(empty->finish(out));
+    BOOST_CHECK_EQUAL(dump(out, true), "SUM(QS1_COUNT):DECIMAL(65,0) MAX(QS2_MAX):INT(11) | NULL,NULL,");
+
+    // Partial aggregates are handed back per attempt once over the limit.
+    auto agg = HashAggregator::newHashAggregator(*mergeStmt, 1);
+    BOOST_REQUIRE(agg);
+    BOOST_REQUIRE(agg->setSchema(schema));
+    qserv::proto::Result r1;
+    *r1.mutable_rowschema() = schema;
+    addRow(r1, {"4", "9"});
+    qserv::proto::Result r2;
+    *r2.mutable_rowschema() = schema;
+    addRow(r2, {"6", "12"});
+    addRow(r2, {"1", "3"});
+    BOOST_CHECK(agg->add(r1, 1));
+    BOOST_CHECK(!agg->overLimit());
+    BOOST_CHECK(agg->add(r2, 2));
+    BOOST_CHECK(agg->overLimit());
+    auto spilled = agg->spill();
+    BOOST_REQUIRE_EQUAL(spilled.size(), 2U);
+    BOOST_CHECK_EQUAL(dump(*spilled[2], true), "QS1_COUNT:BIGINT(21) QS2_MAX:INT(11) | 7,12,");
+    BOOST_CHECK(!agg->isActive());
+    BOOST_CHECK(!agg->add(r1, 3));
+}
+
+BOOST_AUTO_TEST_CASE(SumOutOfRange) {
+    // Sums are held in 128 bits, MySQL DECIMAL sums have up to 65 digits.
+    auto mergeStmt = mergeStmtFor("SELECT SUM(w) FROM LSST.Object", true);
+    qserv::proto::RowSchema schema;
+    addColumn(schema, "QS1_SUM", "DECIMAL(65,0)", MYSQL_TYPE_NEWDECIMAL);
+    auto resultOf = [&schema](std::string const& val) {
+        qserv::proto::Result result;
+        *result.mutable_rowschema() = schema;
+        addRow(result, {val});
+        return result;
+    };
+    std::string const near = "170141183460469231731687303715884105000"; // 2^127 - 728
+    std::string const max = "170141183460469231731687303715884105727"; // 2^127 - 1
+
+    // Up to the largest value, the aggregator computes the sum.
+    auto agg = HashAggregator::newHashAggregator(*mergeStmt, 100);
+    BOOST_REQUIRE(agg);
+    BOOST_REQUIRE(agg->setSchema(schema));
+    BOOST_CHECK(agg->add(resultOf(near), 1));
+    BOOST_CHECK(agg->add(resultOf("727"), 2));
+    BOOST_CHECK(agg->checkTotals());
+    BOOST_CHECK(!agg->overLimit());
+    qserv::proto::Result out;
+    BOOST_REQUIRE(agg->finish(out));
+    BOOST_CHECK_EQUAL(dump(out), "SUM(QS1_SUM) | " + max + ",");
+
+    // A sum of one attempt out of range is not added, and the partial sums
+    // held so far are handed back for MySQL to add.
+    agg = HashAggregator::newHashAggregator(*mergeStmt, 100);
+    BOOST_REQUIRE(agg->setSchema(schema));
+    BOOST_CHECK(agg->add(resultOf(near), 1));
+    BOOST_CHECK(!agg->add(resultOf("728"), 1));
+    BOOST_CHECK(agg->overLimit());
+    BOOST_CHECK(agg->getError().empty());
+    auto spilled = agg->spill();
+    BOOST_REQUIRE_EQUAL(spilled.size(), 1U);
+    BOOST_CHECK_EQUAL(dump(*spilled[1]), "QS1_SUM | " + near + ",");
+
+    // So are the sums of attempts whose total is out of range.
+    agg = HashAggregator::newHashAggregator(*mergeStmt, 100);
+    BOOST_REQUIRE(agg->setSchema(schema));
+    BOOST_CHECK(agg->add(resultOf(near), 1));
+    BOOST_CHECK(agg->add(resultOf("728"), 2));
+    BOOST_CHECK(!agg->overLimit());
+    BOOST_CHECK(!agg->checkTotals());
+    BOOST_CHECK(agg->overLimit());
+    spilled = agg->spill();
+    BOOST_REQUIRE_EQUAL(spilled.size(), 2U);
+    BOOST_CHECK_EQUAL(dump(*spilled[2]), "QS1_SUM | 728,");
+
+    // A value that does not fit is not an error either.
+    agg = HashAggregator::newHashAggregator(*mergeStmt, 100);
+    BOOST_REQUIRE(agg->setSchema(schema));
+    BOOST_CHECK(!agg->add(resultOf("-" + max + "0"), 1));
+    BOOST_CHECK(agg->overLimit());
+    BOOST_CHECK(agg->getError().empty());
+}
+
+BOOST_AUTO_TEST_CASE(Unsupported) {
+    BOOST_CHECK(!HashAggregator::newHashAggregator(
+        *mergeStmtFor("SELECT objectId, COUNT(*) FROM LSST.Object GROUP BY objectId "
+                      "ORDER BY objectId LIMIT 10", true), 100));
+    BOOST_CHECK(!HashAggregator::newHashAggregator(
+        *mergeStmtFor("SELECT objectId, COUNT(*) AS n FROM LSST.Object GROUP BY objectId "
+                      "HAVING n > 2", true), 100));
+
+    // Collated GROUP BY keys are left to MySQL.
+    auto agg = HashAggregator::newHashAggregator(
+        *mergeStmtFor("SELECT name, COUNT(*) FROM LSST.Object GROUP BY name", true), 100);
+    BOOST_REQUIRE(agg);
+    qserv::proto::RowSchema schema;
+    addColumn(schema, "name", "VARCHAR(20)", MYSQL_TYPE_VAR_STRING);
+    addColumn(schema, "QS1_COUNT", "BIGINT(21)", MYSQL_TYPE_LONGLONG);
+    BOOST_CHECK(!agg->setSchema(schema));
+    BOOST_CHECK(!agg->isActive());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+
+// Class header
+#include "rproc/InfileMerger.h"
+
+// System headers
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "sql/Schema.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE InfileMerger_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::rproc::InfileMerger;
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(ChooseMergeShards) {
+    // Sharding is off, or there are too few chunks for more than one shard.
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(1, 10000, 0), 1);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(0, 10000, 0), 1);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 0, 0), 1);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 199, 0), 1);
+    // About one shard per hundred chunks, up to maxShards.
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 200, 0), 2);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 399, 0), 3);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 400, 0), 4);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 100000, 0), 4);
+    // Small results, by their row limit, go into one table.
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 1000, 10), 1);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 1000, 99), 1);
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(4, 1000, 100), 4);
+    // The row estimate must not overflow.
+    BOOST_CHECK_EQUAL(InfileMerger::chooseMergeShards(8, 100000, 1000000000), 8);
+}
+
+BOOST_AUTO_TEST_CASE(MergeShardTables) {
+    std::vector<std::string> tables = InfileMerger::mergeShardTables("r_1_m", 1);
+    BOOST_REQUIRE_EQUAL(tables.size(), 1U);
+    BOOST_CHECK_EQUAL(tables[0], "r_1_m");
+    tables = InfileMerger::mergeShardTables("r_1_m", 3);
+    std::vector<std::string> const expected = {"r_1_m_s0", "r_1_m_s1", "r_1_m_s2"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(tables.begin(), tables.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(UnionShards) {
+    // Only several shards that rows were loaded into are combined.
+    BOOST_CHECK(InfileMerger::needUnionShards(4, true, false, false));
+    BOOST_CHECK(!InfileMerger::needUnionShards(1, true, false, false));
+    BOOST_CHECK(!InfileMerger::needUnionShards(4, false, false, false));
+    BOOST_CHECK(!InfileMerger::needUnionShards(4, true, true, false));
+    BOOST_CHECK(!InfileMerger::needUnionShards(4, true, false, true));
+
+    // The union is the merge table the merge statement reads, unless the
+    // merge table is the result table.
+    BOOST_CHECK_EQUAL(InfileMerger::unionTableName("r_1_m", "r_1"), "r_1_m");
+    BOOST_CHECK_EQUAL(InfileMerger::unionTableName("r_1", "r_1"), "r_1_u");
+
+    lsst::qserv::sql::Schema schema;
+    schema.columns.push_back({"objectId", false, "", {"BIGINT", 8}});
+    schema.columns.push_back({"jobId", false, "", {"INT(9)", 3}});
+    std::string const stmt = InfileMerger::unionShardsStmt(
+        "r_1_m", schema, InfileMerger::mergeShardTables("r_1_m", 2));
+    BOOST_CHECK_EQUAL(stmt, "CREATE TABLE r_1_m (`objectId` BIGINT,`jobId` INT(9)) "
+                            "ENGINE=MERGE UNION=(r_1_m_s0,r_1_m_s1) INSERT_METHOD=NO");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,221 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+/**
+  * @file
+  *
+  * @brief Test merging job attempts into several merge shards with MySQL.
+  *
+  * The test requires ~/.lsst/InfileMerger-testRemote.txt config file with the following:
+  * [mysql]
+  * user     = <username>
+  * passwd = <passwd> # this is optional
+  * host     = <host>
+  * port     = <port>
+  *
+  * The user must be allowed to create a database, and the server to load
+  * local files.
+  */
+
+// Class header
+#include "rproc/InfileMerger.h"
+
+// System headers
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Third-party headers
+#include "boost/property_tree/ini_parser.hpp"
+#include "boost/property_tree/ptree.hpp"
+
+// Qserv headers
+#include "mysql/MySqlConfig.h"
+#include "mysql/mysql.h"
+#include "proto/WorkerResponse.h"
+#include "proto/worker.pb.h"
+#include "sql/SqlConnection.h"
+#include "sql/SqlErrorObject.h"
+#include "sql/SqlResults.h"
+#include "tests/FakeResultFixture.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE InfileMergerMySql_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+namespace qserv = lsst::qserv;
+
+using lsst::qserv::mysql::MySqlConfig;
+using lsst::qserv::rproc::InfileMerger;
+using lsst::qserv::rproc::InfileMergerConfig;
+using lsst::qserv::sql::SqlConnection;
+using lsst::qserv::sql::SqlErrorObject;
+using lsst::qserv::sql::SqlResults;
+using lsst::qserv::tests::FakeResultFixture;
+
+namespace {
+
+struct TestDBGuard {
+    TestDBGuard()
+    : connected(false) {
+        boost::property_tree::ptree pt;
+        std::string iniFileLoc = std::getenv("HOME") + std::string("/.lsst/InfileMerger-testRemote.txt");
+        boost::property_tree::ini_parser::read_ini(iniFileLoc, pt);
+        sqlConfig.hostname = pt.get<std::string>("mysql.host");
+        sqlConfig.port = pt.get<unsigned int>("mysql.port");
+        sqlConfig.username = pt.get<std::string>("mysql.user");
+        bool gotPassword(false);
+        try {
+            sqlConfig.password = pt.get<std::string>("mysql.passwd");
+            gotPassword = true;
+        } catch (boost::property_tree::ptree_bad_path& ex) {
+        } catch (boost::property_tree::ptree_bad_data& ex) {
+        }
+
+        if (not gotPassword) {
+            std::cout << "enter password:" << std::flush;
+            std::cin >> sqlConfig.password;
+        }
+
+        sqlConfig.dbName = "testInfileMergerZ012sdrt";
+        sqlConfig.maxTableSizeMB = 100;
+
+        // need config without database name
+        MySqlConfig sqlConfigLocal = sqlConfig;
+        sqlConfigLocal.dbName = "";
+        SqlConnection sqlConn(sqlConfigLocal);
+
+        SqlErrorObject errObj;
+        if (sqlConn.createDb(sqlConfig.dbName, errObj, false)) {
+            connected = true;
+        }
+    }
+
+    ~TestDBGuard() {
+        SqlConnection sqlConn(sqlConfig);
+        SqlErrorObject errObj;
+        sqlConn.dropDb(sqlConfig.dbName, errObj);
+    }
+
+    MySqlConfig sqlConfig;
+    bool connected;
+};
+
+} // namespace
+
+struct PerTestFixture : FakeResultFixture {
+    PerTestFixture() {
+        sqlConn = std::make_shared<SqlConnection>(testDB.sqlConfig);
+    }
+
+    bool isConnected() const { return testDB.connected; }
+
+    /// @return a response of jobId, attempt, with a row for each objectId.
+    static std::shared_ptr<qserv::proto::WorkerResponse> response(int jobId, int attempt, bool continues,
+                                                                  std::vector<std::string> const& objectIds) {
+        auto resp = std::make_shared<qserv::proto::WorkerResponse>();
+        qserv::proto::Result& result = resp->result;
+        addColumn(*result.mutable_rowschema(), "objectId", "BIGINT(20)", MYSQL_TYPE_LONGLONG);
+        for (auto const& objectId : objectIds) {
+            addRow(result, {objectId});
+        }
+        result.set_continues(continues);
+        result.set_queryid(1);
+        result.set_jobid(jobId);
+        result.set_largeresult(false);
+        result.set_rowcount(objectIds.size());
+        result.set_transmitsize(0);
+        result.set_attemptcount(attempt);
+        resp->headerSize = 0;
+        return resp;
+    }
+
+    /// @return the values of the first column of query, empty on error.
+    std::vector<std::string> select(std::string const& query) {
+        SqlResults results;
+        SqlErrorObject errObj;
+        std::vector<std::string> values;
+        if (!sqlConn->runQuery(query, results, errObj) || !results.extractFirstColumn(values, errObj)) {
+            BOOST_ERROR("failed: " << query << ": " << errObj.errMsg());
+        }
+        return values;
+    }
+
+    static TestDBGuard testDB;
+    std::shared_ptr<SqlConnection> sqlConn;
+};
+
+TestDBGuard PerTestFixture::testDB;
+
+
+#define CHECK_CONNECTION() if (not isConnected()) { BOOST_WARN_MESSAGE(false, "Not connected, can not run test case."); return; }
+
+
+BOOST_FIXTURE_TEST_SUITE(InfileMergerMySqlTestSuite, PerTestFixture)
+
+BOOST_AUTO_TEST_CASE(ScrubShardedAttempts) {
+    CHECK_CONNECTION();
+
+    InfileMergerConfig config(testDB.sqlConfig);
+    config.targetTable = "result_scrub";
+    config.maxMergeShards = 2;
+    config.expectedChunks = 200;
+    InfileMerger merger(config);
+    BOOST_REQUIRE_EQUAL(merger.getMergeShardCount(), 2);
+
+    // Complete attempts go into the shards in turn.
+    BOOST_CHECK(merger.merge(response(1, 0, false, {"1", "2"})));
+    BOOST_CHECK(merger.merge(response(2, 0, false, {"3", "4"})));
+    BOOST_CHECK(merger.merge(response(3, 0, false, {"5", "6"})));
+    BOOST_CHECK(merger.merge(response(4, 0, false, {"7", "8"})));
+    for (auto const& shard : InfileMerger::mergeShardTables(config.targetTable, 2)) {
+        BOOST_CHECK_EQUAL(select("SELECT objectId FROM " + shard).size(), 4U);
+    }
+
+    // Job 3 is retried, the rows of its first attempt are deleted from its shard.
+    BOOST_CHECK(merger.merge(response(3, 1, false, {"5", "6"})));
+    BOOST_CHECK(merger.scrubResults(3, 0));
+
+    // An attempt in staging is discarded with its staging table, and the
+    // rows of its retry spanning two messages are kept.
+    BOOST_CHECK(merger.merge(response(5, 0, true, {"9"})));
+    BOOST_CHECK(merger.scrubResults(5, 0));
+    BOOST_CHECK(merger.merge(response(5, 0, false, {"10"}))); // ignored
+    BOOST_CHECK(merger.merge(response(5, 1, true, {"9"})));
+    BOOST_CHECK(merger.merge(response(5, 1, false, {"10"})));
+
+    BOOST_REQUIRE(merger.finalize());
+    auto const rows = select("SELECT objectId FROM " + config.targetTable + " ORDER BY objectId");
+    std::vector<std::string> const expected = {"1", "2", "3", "4", "5", "6", "7", "8", "9", "10"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(), expected.begin(), expected.end());
+
+    // Shards and staging tables are dropped, only the result is left.
+    auto const tables = select("SHOW TABLES");
+    std::vector<std::string> const resultTables = {config.targetTable};
+    BOOST_CHECK_EQUAL_COLLECTIONS(tables.begin(), tables.end(), resultTables.begin(), resultTables.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
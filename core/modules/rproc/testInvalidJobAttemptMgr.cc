@@ -26,7 +26,9 @@
 #include "rproc/InfileMerger.h"
 
 // System Headers
+#include <future>
 #include <set>
+#include <thread>
 
 // LSST headers
 #include "lsst/log/Log.h"
@@ -61,6 +63,7 @@ public:
 
     bool deleteFunc(int id) {
         deleteCalled_ = true;
+        std::lock_guard<std::mutex> lck(mtx);
         testSet.erase(id);
         return deleteSuccess_;
     }
@@ -80,7 +83,7 @@ public:
                     std::lock_guard<std::mutex> lck(mtx);
                     testSet.insert(j);
                 }
-                iJAMgr.decrConcurrentMergeCount();
+                iJAMgr.decrConcurrentMergeCount(j);
             }
         }
     }
@@ -175,6 +178,48 @@ BOOST_AUTO_TEST_CASE(InvalidJob) {
     // LOGS_DEBUG("testSet=" << mRes.dumpTestSet());
 }
 
+BOOST_AUTO_TEST_CASE(MergeDuringDelete) {
+    MockResult mRes;
+    mRes.insert(0, 9);
+
+    LOGS_DEBUG("Other job attempts can be merged while rows are being deleted.");
+    std::promise<void> deleting;
+    std::promise<void> merged;
+    auto mergedFuture = merged.get_future();
+    mRes.iJAMgr.setDeleteFunc([&](int id) -> bool {
+        deleting.set_value();
+        bool ok = mergedFuture.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+        return mRes.deleteFunc(id) && ok;
+    });
+    bool deleteOk = false;
+    std::thread deleter([&mRes, &deleteOk]() {
+        deleteOk = mRes.iJAMgr.holdMergingForRowDelete(3);
+    });
+    deleting.get_future().wait();
+    mRes.insert(10, 12);
+    merged.set_value();
+    deleter.join();
+    BOOST_CHECK(deleteOk);
+    BOOST_CHECK_EQUAL(mRes.testSet.size(), 12U);
+    BOOST_CHECK(mRes.testSet.find(3) == mRes.testSet.end());
+    BOOST_CHECK(mRes.testSet.find(12) != mRes.testSet.end());
+
+    LOGS_DEBUG("A delete waits for merges of its own job attempt.");
+    BOOST_CHECK(!mRes.iJAMgr.incrConcurrentMergeCount(5));
+    std::atomic<bool> deleted{false};
+    mRes.iJAMgr.setDeleteFunc([&](int id) -> bool {
+        deleted = true;
+        return mRes.deleteFunc(id);
+    });
+    std::thread deleter2([&mRes]() { mRes.iJAMgr.holdMergingForRowDelete(5); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    BOOST_CHECK(!deleted);
+    mRes.iJAMgr.decrConcurrentMergeCount(5);
+    deleter2.join();
+    BOOST_CHECK(deleted);
+    BOOST_CHECK(mRes.testSet.find(5) == mRes.testSet.end());
+}
+
 
 
 BOOST_AUTO_TEST_SUITE_END()
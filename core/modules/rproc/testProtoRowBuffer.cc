@@ -25,9 +25,15 @@
 // Class header
 #include "rproc/ProtoRowBuffer.h"
 
+// System headers
+#include <cstdlib>
+#include <string>
+#include <vector>
+
 // Qserv headers
 #include "proto/worker.pb.h"
 #include "proto/FakeProtocolFixture.h"
+#include "util/Timer.h"
 
 // Boost unit test header
 #define BOOST_TEST_MODULE ProtoRowBuffer_1
@@ -38,6 +44,64 @@ namespace gio = google::protobuf::io;
 
 using lsst::qserv::rproc::ProtoRowBuffer;
 
+namespace {
+
+/// @return all the bytes fetched from buf, bufLen at a time.
+std::string fetchAll(ProtoRowBuffer& buf, unsigned bufLen) {
+    std::string str;
+    std::vector<char> chunk(bufLen);
+    while (unsigned fetched = buf.fetch(chunk.data(), bufLen)) {
+        str.append(chunk.data(), fetched);
+    }
+    return str;
+}
+
+/// @return the rows of result formatted one column at a time with
+///         escapeString(), as ProtoRowBuffer used to.
+std::string formatRowwise(lsst::qserv::proto::Result const& result) {
+    std::string str;
+    for (int ri = 0; ri < result.row_size(); ++ri) {
+        if (ri > 0) str += "\n";
+        auto const& row = result.row(ri);
+        for (int ci = 0; ci < row.column_size(); ++ci) {
+            if (ci > 0) str += "\t";
+            if (row.isnull(ci)) {
+                str += "\\N";
+                continue;
+            }
+            std::string const& col = row.column(ci);
+            std::string escaped(2 * col.size(), '\0');
+            escaped.resize(ProtoRowBuffer::escapeString(escaped.begin(), col.begin(), col.end()));
+            str += "'" + escaped + "'";
+        }
+    }
+    return str;
+}
+
+/// @return a result resembling rows of an Object catalog table.
+lsst::qserv::proto::Result catalogRows(int rowCount) {
+    lsst::qserv::proto::Result result;
+    std::srand(1234);
+    for (int ri = 0; ri < rowCount; ++ri) {
+        auto row = result.add_row();
+        row->add_column(std::to_string(433327840428032LL + ri));
+        row->add_isnull(false);
+        for (int ci = 0; ci < 16; ++ci) {
+            double value = std::rand() / (RAND_MAX + 1.0) * 360.0 - 90.0;
+            bool isNull = (std::rand() % 20 == 0);
+            row->add_column(isNull ? std::string() : std::to_string(value));
+            row->add_isnull(isNull);
+        }
+        row->add_column(ri % 100 == 0 ? std::string("name\twith\ttabs") : std::string("NGC ") + std::to_string(ri));
+        row->add_isnull(false);
+        row->add_column(std::string(1, static_cast<char>(ri % 3)));
+        row->add_isnull(false);
+    }
+    return result;
+}
+
+} // anonymous namespace
+
 struct Fixture {
     Fixture(void) {}
     ~Fixture(void) { }
@@ -80,4 +144,69 @@ BOOST_AUTO_TEST_CASE(TestCopyColumn) {
     BOOST_CHECK_EQUAL(target, eSimple);
 }
 
+BOOST_AUTO_TEST_CASE(TestEscapeSpan) {
+    // Escapes at every position in and around a block.
+    std::string const specials("\0\b\n\r\t\032", 6);
+    for (size_t len = 0; len < 40; ++len) {
+        for (size_t pos = 0; pos <= len; ++pos) {
+            std::string src(len, 'a');
+            if (pos < len) src[pos] = specials[(len + pos) % specials.size()];
+            src += "\xff\x80\x1b\x1a";
+            std::string expected(2 * src.size(), 'X');
+            expected.resize(ProtoRowBuffer::escapeString(expected.begin(), src.begin(), src.end()));
+            std::string target(2 * src.size(), 'X');
+            target.resize(ProtoRowBuffer::escapeSpan(&target[0], src.data(), src.size()));
+            BOOST_REQUIRE_EQUAL(target, expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFetch) {
+    lsst::qserv::proto::Result result;
+    auto row = result.add_row();
+    row->add_column("1");
+    row->add_isnull(false);
+    row->add_column("");
+    row->add_isnull(true);
+    row = result.add_row();
+    row->add_column("a\tb");
+    row->add_isnull(false);
+    row->add_column("");
+    row->add_isnull(false);
+
+    std::string const expected("'1'\t\\N\n'a\\tb'\t''");
+    for (unsigned bufLen : {1U, 3U, 7U, 4096U}) {
+        ProtoRowBuffer buf(result);
+        BOOST_CHECK_EQUAL(fetchAll(buf, bufLen), expected);
+        BOOST_CHECK_EQUAL(buf.getFetchedBytes(), expected.size());
+    }
+    ProtoRowBuffer withJobId(result, 42, "jobId", "INT(9)", MYSQL_TYPE_LONG);
+    BOOST_CHECK_EQUAL(fetchAll(withJobId, 5), "'42'\t'1'\t\\N\n'42'\t'a\\tb'\t''");
+
+    lsst::qserv::proto::Result empty;
+    ProtoRowBuffer emptyBuf(empty);
+    BOOST_CHECK_EQUAL(fetchAll(emptyBuf, 16), "");
+}
+
+/// Microbenchmark of formatting catalog rows, compared to formatting them a
+/// column at a time with escapeString().
+BOOST_AUTO_TEST_CASE(BenchmarkFetch) {
+    auto result = catalogRows(20000);
+    lsst::qserv::util::Timer rowwiseTimer;
+    rowwiseTimer.start();
+    std::string expected = formatRowwise(result);
+    rowwiseTimer.stop();
+
+    lsst::qserv::util::Timer batchTimer;
+    batchTimer.start();
+    ProtoRowBuffer buf(result);
+    std::string fetched = fetchAll(buf, 64*1024);
+    batchTimer.stop();
+
+    BOOST_CHECK(fetched == expected);
+    BOOST_TEST_MESSAGE("formatted " << result.row_size() << " rows, " << fetched.size()
+                       << " bytes: rowwise " << rowwiseTimer.getElapsed()
+                       << "s, batch " << batchTimer.getElapsed() << "s");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
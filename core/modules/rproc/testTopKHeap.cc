@@ -0,0 +1,167 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/TopKHeap.h"
+
+// System headers
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Third-party headers
+#include "mysql/mysql.h"
+
+// Qserv headers
+#include "proto/worker.pb.h"
+#include "query/SelectStmt.h"
+#include "tests/FakeResultFixture.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE TopKHeap_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+namespace qserv = lsst::qserv;
+
+using lsst::qserv::tests::FakeResultFixture;
+using lsst::qserv::rproc::TopKHeap;
+
+namespace {
+
+qserv::proto::RowSchema objectSchema() {
+    qserv::proto::RowSchema schema;
+    FakeResultFixture::addColumn(schema, "objectId", "BIGINT(20)", MYSQL_TYPE_LONGLONG);
+    FakeResultFixture::addColumn(schema, "flux", "DECIMAL(10,3)", MYSQL_TYPE_NEWDECIMAL);
+    FakeResultFixture::addColumn(schema, "ra", "DOUBLE", MYSQL_TYPE_DOUBLE);
+    return schema;
+}
+
+} // anonymous namespace
+
+struct Fixture : public FakeResultFixture {
+    Fixture(void) {}
+    ~Fixture(void) {}
+};
+
+BOOST_FIXTURE_TEST_SUITE(suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(OrderByLimit) {
+    auto mergeStmt = mergeStmtFor("SELECT objectId, flux FROM LSST.Object "
+                                  "ORDER BY flux DESC, objectId LIMIT 3");
+    auto topK = TopKHeap::newTopKHeap(*mergeStmt, 100);
+    BOOST_REQUIRE(topK);
+    auto schema = objectSchema();
+    BOOST_REQUIRE(topK->setSchema(schema));
+
+    qserv::proto::Result r1;
+    *r1.mutable_rowschema() = schema;
+    addRow(r1, {"1", "10.500", "1.0"});
+    addRow(r1, {"2", "9.000", "2.0"});
+    addRow(r1, {"3", "-4.000", "3.0"});
+    qserv::proto::Result r2;
+    *r2.mutable_rowschema() = schema;
+    addRow(r2, {"4", "100.000", "4.0"});
+    addRow(r2, {"5", "9.000", "5.0"});
+    addRow(r2, {"6", "NULL", "6.0"});
+    // A job attempt that turns out to be invalid, and its retry.
+    qserv::proto::Result r3;
+    *r3.mutable_rowschema() = schema;
+    addRow(r3, {"7", "99999.000", "7.0"});
+
+    BOOST_CHECK(topK->add(r3, 30));
+    BOOST_CHECK(topK->add(r1, 10));
+    topK->dropAttempt(30);
+    BOOST_CHECK(topK->add(r3, 31));
+    BOOST_CHECK(topK->add(r2, 20));
+
+    qserv::proto::Result out;
+    BOOST_REQUIRE(topK->finish(out));
+    BOOST_CHECK_EQUAL(dump(out), "objectId flux | 1,10.500, 4,100.000, 7,99999.000,");
+    BOOST_CHECK(!topK->isActive());
+
+    // Equal flux is ordered by objectId, and NULL sorts last with DESC.
+    topK = TopKHeap::newTopKHeap(*mergeStmt, 100);
+    BOOST_REQUIRE(topK->setSchema(schema));
+    BOOST_CHECK(topK->add(r1, 10));
+    BOOST_CHECK(topK->add(r2, 20));
+    qserv::proto::Result out2;
+    BOOST_REQUIRE(topK->finish(out2));
+    BOOST_CHECK_EQUAL(dump(out2), "objectId flux | 1,10.500, 2,9.000, 4,100.000,");
+}
+
+BOOST_AUTO_TEST_CASE(ExactAndReal) {
+    auto mergeStmt = mergeStmtFor("SELECT * FROM LSST.Object ORDER BY objectId LIMIT 2");
+    auto topK = TopKHeap::newTopKHeap(*mergeStmt, 100);
+    BOOST_REQUIRE(topK);
+    auto schema = objectSchema();
+    BOOST_REQUIRE(topK->setSchema(schema));
+    qserv::proto::Result r1;
+    *r1.mutable_rowschema() = schema;
+    // Values beyond the range of a double still compare exactly.
+    addRow(r1, {"18446744073709551615", "0", "0"});
+    addRow(r1, {"18446744073709551614", "0", "0"});
+    addRow(r1, {"-9", "0", "0"});
+    BOOST_CHECK(topK->add(r1, 1));
+    qserv::proto::Result out;
+    BOOST_REQUIRE(topK->finish(out));
+    BOOST_CHECK_EQUAL(dump(out), "objectId flux ra | -9,0,0, 18446744073709551614,0,0,");
+
+    auto byRa = TopKHeap::newTopKHeap(*mergeStmtFor("SELECT objectId, ra AS r FROM LSST.Object "
+                                                    "ORDER BY r LIMIT 1"), 100);
+    BOOST_REQUIRE(byRa);
+    qserv::proto::RowSchema aliased;
+    addColumn(aliased, "objectId", "BIGINT(20)", MYSQL_TYPE_LONGLONG);
+    addColumn(aliased, "r", "DOUBLE", MYSQL_TYPE_DOUBLE);
+    BOOST_REQUIRE(byRa->setSchema(aliased));
+    qserv::proto::Result r2;
+    *r2.mutable_rowschema() = aliased;
+    addRow(r2, {"1", "10"});
+    addRow(r2, {"2", "9.5e0"});
+    addRow(r2, {"3", "1e1"});
+    BOOST_CHECK(byRa->add(r2, 1));
+    BOOST_CHECK_EQUAL(byRa->getDiscarded(), 2U);
+    qserv::proto::Result outRa;
+    BOOST_REQUIRE(byRa->finish(outRa));
+    BOOST_CHECK_EQUAL(dump(outRa), "objectId r | 2,9.5e0,");
+}
+
+BOOST_AUTO_TEST_CASE(Unsupported) {
+    // LIMIT larger than the configured maximum.
+    BOOST_CHECK(!TopKHeap::newTopKHeap(*mergeStmtFor("SELECT objectId FROM LSST.Object "
+                                                     "ORDER BY objectId LIMIT 1000"), 100));
+    // Expressions are left to MySQL.
+    BOOST_CHECK(!TopKHeap::newTopKHeap(*mergeStmtFor("SELECT objectId FROM LSST.Object "
+                                                     "ORDER BY ABS(objectId) LIMIT 10"), 100));
+    // Collated strings are left to MySQL.
+    auto topK = TopKHeap::newTopKHeap(*mergeStmtFor("SELECT name FROM LSST.Object "
+                                                    "ORDER BY name LIMIT 10"), 100);
+    BOOST_REQUIRE(topK);
+    qserv::proto::RowSchema schema;
+    addColumn(schema, "name", "VARCHAR(20)", MYSQL_TYPE_VAR_STRING);
+    BOOST_CHECK(!topK->setSchema(schema));
+    qserv::proto::Result r1;
+    BOOST_CHECK(!topK->add(r1, 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
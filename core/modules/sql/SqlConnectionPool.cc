@@ -0,0 +1,83 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "sql/SqlConnectionPool.h"
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.sql.SqlConnectionPool");
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace sql {
+
+std::shared_ptr<SqlConnection> SqlConnectionPool::acquire() {
+    std::unique_ptr<SqlConnection> conn;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (not _idle.empty()) {
+            conn = std::move(_idle.back());
+            _idle.pop_back();
+        } else {
+            ++_created;
+            LOGS(_log, LOG_LVL_DEBUG, "new connection, created=" << _created);
+        }
+    }
+    if (conn == nullptr) {
+        conn.reset(new SqlConnection(_config, _useThreadMgmt));
+    }
+    std::weak_ptr<SqlConnectionPool> pool = shared_from_this();
+    return std::shared_ptr<SqlConnection>(conn.release(),
+                                          [pool](SqlConnection* c) { _release(pool, c); });
+}
+
+
+void SqlConnectionPool::_release(std::weak_ptr<SqlConnectionPool> const& pool, SqlConnection* conn) {
+    std::unique_ptr<SqlConnection> owned(conn);
+    auto self = pool.lock();
+    if (self == nullptr) return;
+    std::lock_guard<std::mutex> lock(self->_mtx);
+    if (self->_idle.size() < self->_maxIdle) {
+        self->_idle.push_back(std::move(owned));
+    }
+}
+
+
+unsigned int SqlConnectionPool::getIdleCount() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _idle.size();
+}
+
+
+unsigned int SqlConnectionPool::getCreatedCount() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _created;
+}
+
+}}} // namespace lsst::qserv::sql
@@ -0,0 +1,87 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_SQL_SQLCONNECTIONPOOL_H
+#define LSST_QSERV_SQL_SQLCONNECTIONPOOL_H
+
+// System headers
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Qserv headers
+#include "mysql/MySqlConfig.h"
+#include "sql/SqlConnection.h"
+
+namespace lsst {
+namespace qserv {
+namespace sql {
+
+/// SqlConnectionPool hands out SqlConnection objects for one configuration
+/// to threads that need one for a short while, so that objects shared
+/// between threads can run queries without serializing on a single
+/// connection. A connection is leased with acquire() and goes back to the
+/// pool when the last copy of the returned pointer is released. At most
+/// maxIdle connections are kept between leases, the others are closed.
+///
+/// A leased connection must be left as it was found: no open transaction
+/// and the default database selected.
+class SqlConnectionPool : public std::enable_shared_from_this<SqlConnectionPool> {
+public:
+    using Ptr = std::shared_ptr<SqlConnectionPool>;
+
+    static Ptr create(mysql::MySqlConfig const& config, bool useThreadMgmt=false,
+                      unsigned int maxIdle=8) {
+        return Ptr(new SqlConnectionPool(config, useThreadMgmt, maxIdle));
+    }
+
+    SqlConnectionPool(SqlConnectionPool const&) = delete;
+    SqlConnectionPool& operator=(SqlConnectionPool const&) = delete;
+
+    /// @return an idle connection, or a new one if none is idle. The
+    ///         connection is only established when it is first used.
+    std::shared_ptr<SqlConnection> acquire();
+
+    /// @return the number of idle connections.
+    unsigned int getIdleCount() const;
+
+    /// @return the number of connections created so far.
+    unsigned int getCreatedCount() const;
+
+private:
+    SqlConnectionPool(mysql::MySqlConfig const& config, bool useThreadMgmt, unsigned int maxIdle)
+        : _config(config), _useThreadMgmt(useThreadMgmt), _maxIdle(maxIdle) {}
+
+    static void _release(std::weak_ptr<SqlConnectionPool> const& pool, SqlConnection* conn);
+
+    mysql::MySqlConfig const _config;
+    bool const _useThreadMgmt;
+    unsigned int const _maxIdle;
+
+    mutable std::mutex _mtx; ///< Protects _idle and _created.
+    std::vector<std::unique_ptr<SqlConnection>> _idle;
+    unsigned int _created{0};
+};
+
+}}} // namespace lsst::qserv::sql
+
+#endif // LSST_QSERV_SQL_SQLCONNECTIONPOOL_H
@@ -0,0 +1,99 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "sql/SqlConnectionPool.h"
+
+// System headers
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Boost unit test header
+#define BOOST_TEST_MODULE SqlConnectionPool_1
+#include "boost/test/included/unit_test.hpp"
+
+using lsst::qserv::mysql::MySqlConfig;
+using lsst::qserv::sql::SqlConnection;
+using lsst::qserv::sql::SqlConnectionPool;
+
+// Connections are only established when first used, none of these
+// tests need a server.
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(Reuse) {
+    auto pool = SqlConnectionPool::create(MySqlConfig(), false, 2);
+    std::set<SqlConnection*> created;
+    {
+        auto c1 = pool->acquire();
+        auto c2 = pool->acquire();
+        auto c3 = pool->acquire();
+        BOOST_CHECK(c1.get() != c2.get() && c2.get() != c3.get());
+        BOOST_CHECK_EQUAL(pool->getCreatedCount(), 3U);
+        BOOST_CHECK_EQUAL(pool->getIdleCount(), 0U);
+        created = {c1.get(), c2.get(), c3.get()};
+    }
+    // Only maxIdle connections are kept.
+    BOOST_CHECK_EQUAL(pool->getIdleCount(), 2U);
+    std::set<SqlConnection*> leased;
+    {
+        auto c1 = pool->acquire();
+        auto c2 = pool->acquire();
+        BOOST_CHECK_EQUAL(pool->getCreatedCount(), 3U);
+        leased.insert(c1.get());
+        leased.insert(c2.get());
+    }
+    BOOST_CHECK_EQUAL(leased.size(), 2U);
+    for (auto c : leased) {
+        BOOST_CHECK(created.count(c) == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(OutlivePool) {
+    auto pool = SqlConnectionPool::create(MySqlConfig());
+    auto conn = pool->acquire();
+    pool.reset();
+    // Released after the pool is gone, the connection is simply closed.
+    conn.reset();
+}
+
+BOOST_AUTO_TEST_CASE(Concurrent) {
+    auto pool = SqlConnectionPool::create(MySqlConfig(), false, 4);
+    std::atomic<int> failed{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([pool, &failed]() {
+            for (int j = 0; j < 1000; ++j) {
+                auto c = pool->acquire();
+                if (c == nullptr) ++failed;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    BOOST_CHECK_EQUAL(failed, 0);
+    BOOST_CHECK(pool->getIdleCount() <= 4U);
+    BOOST_CHECK(pool->getCreatedCount() >= pool->getIdleCount());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_QSERV_TESTS_FAKERESULTFIXTURE_H
+#define LSST_QSERV_TESTS_FAKERESULTFIXTURE_H
+
+// System headers
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "mysql/MySqlConfig.h"
+#include "parser/SelectParser.h"
+#include "proto/worker.pb.h"
+#include "qana/AggregatePlugin.h"
+#include "qana/QueryPlugin.h"
+#include "query/QueryContext.h"
+#include "query/SelectStmt.h"
+
+namespace lsst {
+namespace qserv {
+namespace tests {
+
+/// FakeResultFixture holds the code the result merging tests share to build
+/// merge statements and chunk results, and to print what was merged. It is
+/// only meant for test code.
+struct FakeResultFixture {
+
+    /// @return the merge statement that the czar would use for sql, which for
+    ///         non-aggregate queries has the select list, ORDER BY and LIMIT
+    ///         of sql.
+    /// @param aggregate - if true, rewrite the aggregates of sql as the
+    ///        AggregatePlugin does, to merge the partial aggregates of chunks.
+    static std::shared_ptr<query::SelectStmt> mergeStmtFor(std::string const& sql,
+                                                           bool aggregate=false) {
+        auto parser = parser::SelectParser::newInstance(sql);
+        parser->setup();
+        auto stmt = parser->getSelectStmt();
+        auto mergeStmt = stmt->copyMerge();
+        if (aggregate) {
+            query::SelectStmtPtrVector parallel;
+            parallel.push_back(stmt->clone());
+            qana::QueryPlugin::Plan plan(*stmt, parallel, *mergeStmt, false);
+            query::QueryContext context("LSST", nullptr, mysql::MySqlConfig());
+            qana::AggregatePlugin().applyPhysical(plan, context);
+        }
+        return mergeStmt;
+    }
+
+    static void addColumn(proto::RowSchema& schema, std::string const& name,
+                          std::string const& sqlType, int mysqlType) {
+        auto cs = schema.add_columnschema();
+        cs->set_name(name);
+        cs->set_hasdefault(false);
+        cs->set_sqltype(sqlType);
+        cs->set_mysqltype(mysqlType);
+    }
+
+    /// Add a row of values to result, "NULL" standing for a null value.
+    static void addRow(proto::Result& result, std::vector<std::string> const& values) {
+        auto row = result.add_row();
+        for (auto const& v : values) {
+            bool isNull = (v == "NULL");
+            row->add_column(isNull ? "" : v);
+            row->add_isnull(isNull);
+        }
+    }
+
+    /// @return the column names, with their types if withTypes is true,
+    ///         followed by the sorted rows of result.
+    static std::string dump(proto::Result const& result, bool withTypes=false) {
+        std::string str;
+        for (auto const& cs : result.rowschema().columnschema()) {
+            str += cs.name() + (withTypes ? ":" + cs.sqltype() : std::string()) + " ";
+        }
+        str += "|";
+        std::vector<std::string> rows;
+        for (auto const& row : result.row()) {
+            std::string r;
+            for (int j = 0; j < row.column_size(); ++j) {
+                r += (row.isnull(j) ? std::string("NULL") : row.column(j)) + ",";
+            }
+            rows.push_back(r);
+        }
+        std::sort(rows.begin(), rows.end());
+        for (auto const& r : rows) {
+            str += " " + r;
+        }
+        return str;
+    }
+};
+
+}}} // namespace lsst::qserv::tests
+
+#endif // LSST_QSERV_TESTS_FAKERESULTFIXTURE_H
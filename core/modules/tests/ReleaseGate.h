@@ -0,0 +1,58 @@
+/*
+ * LSST Data Management System
+ * Copyright 2015 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_QSERV_TESTS_RELEASEGATE_H
+#define LSST_QSERV_TESTS_RELEASEGATE_H
+
+// System headers
+#include <future>
+
+namespace lsst {
+namespace qserv {
+namespace tests {
+
+/// ReleaseGate holds back test work running on other threads until the
+/// test has checked what it needs to and calls release().
+class ReleaseGate {
+public:
+    ReleaseGate() : _released(_release.get_future()) {}
+    ReleaseGate(ReleaseGate const&) = delete;
+    ReleaseGate& operator=(ReleaseGate const&) = delete;
+
+    /// Let every waiter through. Call at most once.
+    void release() { _release.set_value(); }
+
+    /// Block until release() is called.
+    void wait() const { _released.wait(); }
+
+    /// @return a future that becomes ready on release(), for code
+    ///         that holds on to it after the gate is gone.
+    std::shared_future<void> const& released() const { return _released; }
+
+private:
+    std::promise<void> _release;
+    std::shared_future<void> _released;
+};
+
+}}} // namespace lsst::qserv::tests
+
+#endif // LSST_QSERV_TESTS_RELEASEGATE_H
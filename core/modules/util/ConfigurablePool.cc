@@ -0,0 +1,78 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "util/ConfigurablePool.h"
+
+// System headers
+#include <algorithm>
+
+namespace lsst {
+namespace qserv {
+namespace util {
+
+void ConfigurablePool::configure(int threads) {
+    CommandQueue::Ptr oldQueue;
+    ThreadPool::Ptr oldPool;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _threads = std::max(0, threads);
+        if (_threads > 0) {
+            if (_pool == nullptr) {
+                _queue = std::make_shared<CommandQueue>();
+                _pool = ThreadPool::newThreadPool(_threads, _queue);
+            } else {
+                _pool->resize(_threads);
+            }
+        } else {
+            oldQueue = std::move(_queue);
+            oldPool = std::move(_pool);
+        }
+    }
+    if (oldPool != nullptr) {
+        // Nothing can be queued anymore, and what already is still has to run.
+        while (auto cmd = oldQueue->getCmd(false)) {
+            cmd->runAction(nullptr);
+        }
+        oldPool->endAll();
+        oldPool->waitForResize(0);
+    }
+}
+
+
+int ConfigurablePool::getThreads() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _threads;
+}
+
+
+bool ConfigurablePool::queCmd(Command::Ptr const& cmd) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_queue == nullptr) {
+        return false;
+    }
+    _queue->queCmd(cmd);
+    return true;
+}
+
+}}} // namespace lsst::qserv::util
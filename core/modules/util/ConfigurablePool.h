@@ -0,0 +1,65 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_UTIL_CONFIGURABLEPOOL_H
+#define LSST_QSERV_UTIL_CONFIGURABLEPOOL_H
+
+// System headers
+#include <mutex>
+
+// Qserv headers
+#include "util/EventThread.h"
+
+namespace lsst {
+namespace qserv {
+namespace util {
+
+/// ConfigurablePool is a CommandQueue served by a ThreadPool whose number of
+/// threads can be changed at any time, down to none. Without threads there is
+/// no queue, and the users of the pool do their work on their own threads.
+class ConfigurablePool {
+public:
+    ConfigurablePool() = default;
+    ConfigurablePool(ConfigurablePool const&) = delete;
+    ConfigurablePool& operator=(ConfigurablePool const&) = delete;
+
+    /// Set the number of threads. Going down to 0 runs the commands that
+    /// are already queued on the calling thread, then stops the threads.
+    void configure(int threads);
+
+    /// @return the number of threads, 0 if there is no queue.
+    int getThreads() const;
+
+    /// Queue cmd to run on one of the threads.
+    /// @return false, without queuing cmd, if there are no threads.
+    bool queCmd(Command::Ptr const& cmd);
+
+private:
+    mutable std::mutex _mtx; ///< Protects all members.
+    CommandQueue::Ptr _queue;
+    ThreadPool::Ptr _pool;
+    int _threads{0};
+};
+
+}}} // namespace lsst::qserv::util
+
+#endif // LSST_QSERV_UTIL_CONFIGURABLEPOOL_H
@@ -0,0 +1,167 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "util/Histogram.h"
+
+// System headers
+#include <cstdint>
+
+namespace lsst {
+namespace qserv {
+namespace util {
+
+constexpr unsigned int Histogram::BUCKETS;
+
+
+unsigned int statsShardIndex() {
+    static std::atomic<unsigned int> nextIndex{0};
+    thread_local unsigned int index = nextIndex.fetch_add(1, std::memory_order_relaxed) % STATS_SHARDS;
+    return index;
+}
+
+
+int64_t Counter::get() const {
+    int64_t total = 0;
+    for (auto const& shard : _shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+
+unsigned int Histogram::bucketFor(uint64_t value) {
+    if (value == 0) return 0;
+    unsigned int bucket = 64 - __builtin_clzll(value);
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+
+void Histogram::record(uint64_t value) {
+    Shard& shard = _shards[statsShardIndex()];
+    shard.buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t oldMax = shard.max.load(std::memory_order_relaxed);
+    while (value > oldMax &&
+           !shard.max.compare_exchange_weak(oldMax, value, std::memory_order_relaxed)) {
+    }
+}
+
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    for (auto const& shard : _shards) {
+        snap.count += shard.count.load(std::memory_order_relaxed);
+        snap.sum += shard.sum.load(std::memory_order_relaxed);
+        uint64_t mx = shard.max.load(std::memory_order_relaxed);
+        if (mx > snap.max) snap.max = mx;
+        for (unsigned int j = 0; j < BUCKETS; ++j) {
+            snap.buckets[j] += shard.buckets[j].load(std::memory_order_relaxed);
+        }
+    }
+    return snap;
+}
+
+
+uint64_t Histogram::Snapshot::percentile(double p) const {
+    // Shards are read without a lock, so count and the bucket totals may
+    // disagree slightly. Use the bucket totals.
+    uint64_t total = 0;
+    for (auto b : buckets) total += b;
+    if (total == 0) return 0;
+    if (p < 0.0) p = 0.0;
+    if (p > 1.0) p = 1.0;
+    uint64_t target = static_cast<uint64_t>(p * total);
+    if (target == 0) target = 1;
+    uint64_t cumulative = 0;
+    for (unsigned int j = 0; j < BUCKETS; ++j) {
+        cumulative += buckets[j];
+        if (cumulative >= target) {
+            uint64_t upper = (j == 0) ? 0 : ((j >= 63) ? UINT64_MAX : (uint64_t(1) << j) - 1);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+
+StatsRegistry& StatsRegistry::get() {
+    static StatsRegistry registry;
+    return registry;
+}
+
+
+Counter::Ptr StatsRegistry::counter(std::string const& name) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& ptr = _counters[name];
+    if (ptr == nullptr) {
+        ptr = std::make_shared<Counter>(name);
+    }
+    return ptr;
+}
+
+
+Histogram::Ptr StatsRegistry::histogram(std::string const& name) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& ptr = _histograms[name];
+    if (ptr == nullptr) {
+        ptr = std::make_shared<Histogram>(name);
+    }
+    return ptr;
+}
+
+
+std::vector<Counter::Ptr> StatsRegistry::getCounters() const {
+    std::vector<Counter::Ptr> vect;
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto const& elem : _counters) {
+        vect.push_back(elem.second);
+    }
+    return vect;
+}
+
+
+std::vector<Histogram::Ptr> StatsRegistry::getHistograms() const {
+    std::vector<Histogram::Ptr> vect;
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto const& elem : _histograms) {
+        vect.push_back(elem.second);
+    }
+    return vect;
+}
+
+
+void StatsRegistry::print(std::ostream& os) const {
+    for (auto const& ctr : getCounters()) {
+        os << ctr->getName() << " count=" << ctr->get() << "\n";
+    }
+    for (auto const& hist : getHistograms()) {
+        auto snap = hist->snapshot();
+        os << hist->getName() << " count=" << snap.count << " mean=" << snap.mean()
+           << " p50=" << snap.percentile(0.50) << " p90=" << snap.percentile(0.90)
+           << " p99=" << snap.percentile(0.99) << " max=" << snap.max << "\n";
+    }
+}
+
+}}} // namespace lsst::qserv::util
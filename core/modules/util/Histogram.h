@@ -0,0 +1,186 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_UTIL_HISTOGRAM_H
+#define LSST_QSERV_UTIL_HISTOGRAM_H
+
+// System headers
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace lsst {
+namespace qserv {
+namespace util {
+
+/// Number of independent slots counters and histograms are spread across.
+/// Each thread is assigned one slot the first time it records anything, so
+/// writers on different threads rarely touch the same cache line. Reads
+/// merge all slots.
+constexpr unsigned int STATS_SHARDS = 16;
+
+/// @return the shard index assigned to the calling thread.
+unsigned int statsShardIndex();
+
+
+/// A monotonic counter. add() is lock-free.
+class Counter {
+public:
+    using Ptr = std::shared_ptr<Counter>;
+
+    explicit Counter(std::string const& name) : _name(name) {}
+    Counter(Counter const&) = delete;
+    Counter& operator=(Counter const&) = delete;
+
+    void add(int64_t val=1) {
+        _shards[statsShardIndex()].value.fetch_add(val, std::memory_order_relaxed);
+    }
+
+    /// @return the sum over all shards.
+    int64_t get() const;
+
+    std::string const& getName() const { return _name; }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value{0};
+    };
+    std::string const _name;
+    std::array<Shard, STATS_SHARDS> _shards;
+};
+
+
+/// A histogram of non-negative values (by convention, microseconds) with
+/// power of two bucket boundaries. Bucket 0 holds 0, bucket j holds values
+/// in [2^(j-1), 2^j). record() is lock-free.
+class Histogram {
+public:
+    using Ptr = std::shared_ptr<Histogram>;
+    static constexpr unsigned int BUCKETS = 64;
+
+    /// Merged view of a Histogram.
+    struct Snapshot {
+        uint64_t count{0};
+        uint64_t sum{0};
+        uint64_t max{0};
+        std::array<uint64_t, BUCKETS> buckets{};
+
+        double mean() const { return count ? static_cast<double>(sum)/count : 0.0; }
+
+        /// @return an upper bound estimate of the value at fraction p (0.0-1.0).
+        uint64_t percentile(double p) const;
+    };
+
+    explicit Histogram(std::string const& name) : _name(name) {}
+    Histogram(Histogram const&) = delete;
+    Histogram& operator=(Histogram const&) = delete;
+
+    void record(uint64_t value);
+
+    /// Record the duration since start in microseconds.
+    template <typename TimePoint>
+    void recordSince(TimePoint const& start) {
+        auto dur = std::chrono::duration_cast<std::chrono::microseconds>(TimePoint::clock::now() - start);
+        record(dur.count() > 0 ? dur.count() : 0);
+    }
+
+    Snapshot snapshot() const;
+
+    std::string const& getName() const { return _name; }
+
+    static unsigned int bucketFor(uint64_t value);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets;
+        Shard() { for (auto& b : buckets) b = 0; }
+    };
+    std::string const _name;
+    std::array<Shard, STATS_SHARDS> _shards;
+};
+
+
+/// Records the microseconds between construction and destruction (or stop())
+/// into a Histogram. A null histogram is allowed and records nothing.
+class HistogramTimer {
+public:
+    explicit HistogramTimer(Histogram::Ptr const& hist)
+        : _hist(hist.get()), _start(std::chrono::steady_clock::now()) {}
+    HistogramTimer(HistogramTimer const&) = delete;
+    HistogramTimer& operator=(HistogramTimer const&) = delete;
+    ~HistogramTimer() { stop(); }
+
+    void stop() {
+        if (_hist != nullptr) {
+            _hist->recordSince(_start);
+            _hist = nullptr;
+        }
+    }
+
+private:
+    Histogram* _hist;
+    std::chrono::steady_clock::time_point _start;
+};
+
+
+/// Process-wide registry of named counters and histograms.
+/// Instruments are created on first use and never destroyed, so callers
+/// should look them up once and keep the pointer.
+class StatsRegistry {
+public:
+    static StatsRegistry& get();
+
+    StatsRegistry(StatsRegistry const&) = delete;
+    StatsRegistry& operator=(StatsRegistry const&) = delete;
+
+    Counter::Ptr counter(std::string const& name);
+    Histogram::Ptr histogram(std::string const& name);
+
+    /// @return all counters, sorted by name.
+    std::vector<Counter::Ptr> getCounters() const;
+    /// @return all histograms, sorted by name.
+    std::vector<Histogram::Ptr> getHistograms() const;
+
+    /// Write one line per instrument.
+    void print(std::ostream& os) const;
+
+private:
+    StatsRegistry() = default;
+
+    mutable std::mutex _mtx; ///< Protects _counters and _histograms.
+    std::map<std::string, Counter::Ptr> _counters;
+    std::map<std::string, Histogram::Ptr> _histograms;
+};
+
+}}} // namespace lsst::qserv::util
+
+#endif // LSST_QSERV_UTIL_HISTOGRAM_H
@@ -0,0 +1,290 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "util/Tracer.h"
+
+// System headers
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+size_t const defaultCapacity = 100000;
+
+/// Spans a thread collects before moving them into the ring.
+size_t const threadBatchSize = 64;
+
+/// Write str as the contents of a JSON string.
+void writeJsonString(std::ostream& os, std::string const& str) {
+    os << '"';
+    for (char c : str) {
+        switch (c) {
+        case '"':  os << "\\\""; break;
+        case '\\': os << "\\\\"; break;
+        case '\n': os << "\\n"; break;
+        case '\r': os << "\\r"; break;
+        case '\t': os << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                os << buf;
+            } else {
+                os << c;
+            }
+        }
+    }
+    os << '"';
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace util {
+
+/// Owns a thread's buffer, and moves what is left in it into the ring when
+/// the thread exits.
+class Tracer::ThreadBufferHolder {
+public:
+    ThreadBufferHolder(Tracer& tracer, std::shared_ptr<ThreadBuffer> const& buffer)
+        : _tracer(tracer), _buffer(buffer) {}
+    ~ThreadBufferHolder() { _tracer._retire(_buffer); }
+
+    ThreadBuffer& buffer() { return *_buffer; }
+
+private:
+    Tracer& _tracer;
+    std::shared_ptr<ThreadBuffer> _buffer;
+};
+
+
+Tracer& Tracer::get() {
+    static Tracer tracer;
+    return tracer;
+}
+
+
+Tracer::Tracer() : _capacity(defaultCapacity) {
+    // Seed trace ids with the pid and start time so ids from different czars
+    // and restarts are unlikely to collide. The low bit is forced on so that
+    // 0 is never handed out.
+    uint64_t seed = static_cast<uint64_t>(::getpid()) << 40;
+    seed ^= static_cast<uint64_t>(toMicros(Clock::now())) << 8;
+    _traceIdSeq = seed | 1;
+}
+
+
+void Tracer::configure(bool enabled, size_t capacity) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (capacity > 0 && capacity != _capacity) {
+            _capacity = capacity;
+            _clear();
+            _ring.shrink_to_fit();
+        }
+    }
+    _enabled = enabled;
+}
+
+
+uint64_t Tracer::newTraceId() {
+    if (!isEnabled()) return 0;
+    return _traceIdSeq.fetch_add(2, std::memory_order_relaxed);
+}
+
+
+void Tracer::record(TraceEvent&& event) {
+    if (event.traceId == 0) return;
+    if (event.threadId == 0) {
+        event.threadId = std::hash<std::thread::id>()(std::this_thread::get_id());
+    }
+    _recorded.fetch_add(1, std::memory_order_relaxed);
+    ThreadBuffer& buffer = _threadBuffer();
+    std::vector<TraceEvent> batch;
+    {
+        std::lock_guard<std::mutex> lock(buffer.mtx);
+        buffer.events.push_back(std::move(event));
+        if (buffer.events.size() < threadBatchSize) return;
+        batch.swap(buffer.events);
+    }
+    _addToRing(batch);
+}
+
+
+/// @return the buffer of the calling thread, registered on first use.
+Tracer::ThreadBuffer& Tracer::_threadBuffer() {
+    thread_local std::unique_ptr<ThreadBufferHolder> holder;
+    if (holder == nullptr) {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.reserve(threadBatchSize);
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _buffers.push_back(buffer);
+        }
+        holder.reset(new ThreadBufferHolder(*this, buffer));
+    }
+    return holder->buffer();
+}
+
+
+/// Move the spans left in the buffer of an exiting thread into the ring.
+void Tracer::_retire(std::shared_ptr<ThreadBuffer> const& buffer) {
+    std::vector<TraceEvent> batch;
+    {
+        std::lock_guard<std::mutex> lock(buffer->mtx);
+        batch.swap(buffer->events);
+    }
+    _addToRing(batch);
+    std::lock_guard<std::mutex> lock(_mtx);
+    _buffers.erase(std::remove(_buffers.begin(), _buffers.end(), buffer), _buffers.end());
+}
+
+
+void Tracer::_addToRing(std::vector<TraceEvent>& events) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto& event : events) {
+        if (_ring.size() < _capacity) {
+            _ring.push_back(std::move(event));
+        } else {
+            _ring[_next % _capacity] = std::move(event);
+        }
+        ++_next;
+    }
+}
+
+
+void Tracer::record(uint64_t traceId, std::string const& name, std::string const& category,
+                    Clock::time_point start, Clock::time_point end, std::string const& detail) {
+    if (traceId == 0) return;
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.detail = detail;
+    event.traceId = traceId;
+    event.startUs = toMicros(start);
+    event.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    record(std::move(event));
+}
+
+
+/// @return copies of the newest spans of traceId, or of all traces if 0,
+///         oldest first, from the ring and then from the thread buffers. No
+///         more than the capacity of the ring are returned.
+std::vector<TraceEvent> Tracer::_collect(uint64_t traceId) const {
+    std::vector<TraceEvent> events;
+    std::vector<TraceEvent> pending;
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto const& buffer : _buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mtx);
+        pending.insert(pending.end(), buffer->events.begin(), buffer->events.end());
+    }
+    // Spans that the pending ones would push out of the ring are skipped.
+    size_t const sz = _ring.size();
+    size_t const first = (sz < _capacity) ? 0 : _next % _capacity;
+    size_t const skip = (sz + pending.size() > _capacity) ? sz + pending.size() - _capacity : 0;
+    for (size_t j = skip; j < sz; ++j) {
+        auto const& ev = _ring[(first + j) % sz];
+        if (traceId == 0 || ev.traceId == traceId) {
+            events.push_back(ev);
+        }
+    }
+    for (size_t j = (skip > sz) ? skip - sz : 0; j < pending.size(); ++j) {
+        if (traceId == 0 || pending[j].traceId == traceId) {
+            events.push_back(std::move(pending[j]));
+        }
+    }
+    return events;
+}
+
+
+void Tracer::dumpChromeJson(std::ostream& os, uint64_t traceId) const {
+    // Copied out so the mutexes are not held while writing.
+    std::vector<TraceEvent> events = _collect(traceId);
+
+    auto const pid = ::getpid();
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (auto const& ev : events) {
+        if (!first) os << ",";
+        first = false;
+        os << "\n{\"name\":";
+        writeJsonString(os, ev.name);
+        os << ",\"cat\":";
+        writeJsonString(os, ev.category);
+        os << ",\"ph\":\"X\",\"ts\":" << ev.startUs
+           << ",\"dur\":" << ev.durationUs
+           << ",\"pid\":" << pid
+           << ",\"tid\":" << ev.threadId
+           << ",\"args\":{\"traceId\":\"" << ev.traceId << "\"";
+        if (!ev.detail.empty()) {
+            os << ",\"detail\":";
+            writeJsonString(os, ev.detail);
+        }
+        os << "}}";
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+
+bool Tracer::dumpChromeJsonFile(std::string const& path, uint64_t traceId) const {
+    std::ofstream os(path);
+    if (!os) return false;
+    dumpChromeJson(os, traceId);
+    return bool(os);
+}
+
+
+size_t Tracer::size() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    size_t sz = _ring.size();
+    for (auto const& buffer : _buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mtx);
+        sz += buffer->events.size();
+    }
+    return std::min(sz, _capacity);
+}
+
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _clear();
+}
+
+
+/// Precondition: _mtx must be locked.
+void Tracer::_clear() {
+    for (auto const& buffer : _buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mtx);
+        buffer->events.clear();
+    }
+    _ring.clear();
+    _next = 0;
+}
+
+}}} // namespace lsst::qserv::util
@@ -0,0 +1,180 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_UTIL_TRACER_H
+#define LSST_QSERV_UTIL_TRACER_H
+
+// System headers
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace lsst {
+namespace qserv {
+namespace util {
+
+/// One completed span. Times are microseconds since the epoch so that
+/// spans recorded on the czar and on workers line up in a single view.
+struct TraceEvent {
+    std::string name;
+    std::string category;
+    std::string detail;
+    uint64_t traceId{0};
+    int64_t startUs{0};
+    int64_t durationUs{0};
+    uint64_t threadId{0};
+};
+
+
+/// Process-wide recorder of trace spans.
+///
+/// Spans are kept in a fixed size ring buffer, the oldest spans being
+/// overwritten once it is full, and can be written out as Chrome trace-event
+/// JSON (load the file in chrome://tracing or Perfetto). Each thread first
+/// collects its spans in a small buffer of its own and moves them into the
+/// ring in batches, so threads recording spans rarely wait for each other.
+///
+/// A span is only recorded when its trace id is non-zero. newTraceId() returns
+/// 0 while tracing is disabled, so a query that was not traced carries no id
+/// through the system and every span along its path costs a single branch.
+/// Workers record spans for any task whose TaskMsg carries a trace id.
+class Tracer {
+public:
+    using Clock = std::chrono::system_clock;
+
+    static Tracer& get();
+
+    Tracer(Tracer const&) = delete;
+    Tracer& operator=(Tracer const&) = delete;
+
+    /// Enable or disable tracing and set the ring buffer capacity (in spans).
+    /// Changing the capacity discards spans already recorded.
+    void configure(bool enabled, size_t capacity);
+
+    bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+    /// @return a new trace id, or 0 if tracing is disabled.
+    uint64_t newTraceId();
+
+    /// Record a completed span.
+    void record(TraceEvent&& event);
+
+    /// Record a span covering [start, end].
+    void record(uint64_t traceId, std::string const& name, std::string const& category,
+                Clock::time_point start, Clock::time_point end,
+                std::string const& detail=std::string());
+
+    /// Write the recorded spans as Chrome trace-event JSON.
+    /// @param traceId - only write spans of this trace, 0 writes all spans.
+    void dumpChromeJson(std::ostream& os, uint64_t traceId=0) const;
+
+    /// Write dumpChromeJson() output to a file.
+    /// @return false if the file could not be written.
+    bool dumpChromeJsonFile(std::string const& path, uint64_t traceId=0) const;
+
+    /// @return the number of spans currently held in the ring buffer.
+    size_t size() const;
+
+    /// @return the number of spans recorded since the Tracer was created.
+    uint64_t getRecordedCount() const { return _recorded.load(std::memory_order_relaxed); }
+
+    /// Discard all recorded spans.
+    void clear();
+
+    static int64_t toMicros(Clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+    }
+
+private:
+    /// Spans of one thread not yet moved into the ring.
+    struct ThreadBuffer {
+        std::mutex mtx; ///< Only contended while spans are dumped or cleared.
+        std::vector<TraceEvent> events;
+    };
+    class ThreadBufferHolder;
+
+    Tracer();
+
+    ThreadBuffer& _threadBuffer();
+    void _retire(std::shared_ptr<ThreadBuffer> const& buffer);
+    void _addToRing(std::vector<TraceEvent>& events);
+    void _clear();
+    std::vector<TraceEvent> _collect(uint64_t traceId) const;
+
+    std::atomic<bool> _enabled{false};
+    std::atomic<uint64_t> _traceIdSeq;
+    std::atomic<uint64_t> _recorded{0};
+
+    mutable std::mutex _mtx; ///< Protects _ring, _capacity, _next, and _buffers.
+    std::vector<TraceEvent> _ring;
+    size_t _capacity;
+    size_t _next{0}; ///< Total number of spans moved into the ring since the last clear.
+    std::vector<std::shared_ptr<ThreadBuffer>> _buffers; ///< Of the threads that recorded spans.
+};
+
+
+/// RAII span. Records the time between construction and destruction under
+/// the given trace id. Does nothing if traceId is 0.
+class TraceSpan {
+public:
+    TraceSpan(uint64_t traceId, char const* name, char const* category="czar")
+        : _traceId(traceId), _name(name), _category(category) {
+        if (_traceId != 0) {
+            _start = Tracer::Clock::now();
+        }
+    }
+
+    TraceSpan(TraceSpan const&) = delete;
+    TraceSpan& operator=(TraceSpan const&) = delete;
+
+    ~TraceSpan() { end(); }
+
+    /// @return true if this span will be recorded. Use this to avoid
+    ///         building detail strings for spans that will be discarded.
+    bool active() const { return _traceId != 0; }
+
+    void setDetail(std::string const& detail) { _detail = detail; }
+
+    /// Close the span early. Further calls have no effect.
+    void end() {
+        if (_traceId != 0) {
+            Tracer::get().record(_traceId, _name, _category, _start, Tracer::Clock::now(), _detail);
+            _traceId = 0;
+        }
+    }
+
+private:
+    uint64_t _traceId;
+    char const* _name;
+    char const* _category;
+    std::string _detail;
+    Tracer::Clock::time_point _start;
+};
+
+}}} // namespace lsst::qserv::util
+
+#endif // LSST_QSERV_UTIL_TRACER_H
@@ -28,6 +28,7 @@
  */
 
 // System headers
+#include <atomic>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -38,6 +39,7 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "util/ConfigurablePool.h"
 #include "util/EventThread.h"
 #include "util/InstanceCount.h"
 
@@ -267,4 +269,34 @@ BOOST_AUTO_TEST_CASE(InstanceCountTest) {
     BOOST_CHECK(ca0.instanceCount.getCount() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(ConfigurablePoolTest) {
+    LOGS_DEBUG("ConfigurablePool test");
+    ConfigurablePool pool;
+    std::atomic<int> ran{0};
+    auto cmd = std::make_shared<Command>([&ran](CmdData*) { ++ran; });
+    // Without threads nothing is queued.
+    BOOST_CHECK_EQUAL(pool.getThreads(), 0);
+    BOOST_CHECK(not pool.queCmd(cmd));
+
+    pool.configure(2);
+    BOOST_CHECK_EQUAL(pool.getThreads(), 2);
+    pool.configure(3);
+    BOOST_CHECK_EQUAL(pool.getThreads(), 3);
+    int const count = 100;
+    for (int j = 0; j < count; ++j) {
+        BOOST_CHECK(pool.queCmd(std::make_shared<Command>([&ran](CmdData*) { ++ran; })));
+    }
+    // Going down to no threads runs everything that was queued.
+    pool.configure(0);
+    BOOST_CHECK_EQUAL(pool.getThreads(), 0);
+    BOOST_CHECK_EQUAL(ran.load(), count);
+    BOOST_CHECK(not pool.queCmd(cmd));
+
+    // The pool can be started again.
+    pool.configure(1);
+    BOOST_CHECK(pool.queCmd(cmd));
+    pool.configure(0);
+    BOOST_CHECK_EQUAL(ran.load(), count + 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
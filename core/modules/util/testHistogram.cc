@@ -0,0 +1,87 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+/**
+ * @brief test Counter, Histogram, and StatsRegistry
+ */
+
+// System headers
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Qserv headers
+#include "util/Histogram.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE Histogram
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using namespace lsst::qserv::util;
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(Buckets) {
+    BOOST_CHECK(Histogram::bucketFor(0) == 0);
+    BOOST_CHECK(Histogram::bucketFor(1) == 1);
+    BOOST_CHECK(Histogram::bucketFor(2) == 2);
+    BOOST_CHECK(Histogram::bucketFor(3) == 2);
+    BOOST_CHECK(Histogram::bucketFor(1024) == 11);
+    BOOST_CHECK(Histogram::bucketFor(UINT64_MAX) == Histogram::BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentRecord) {
+    auto ctr = StatsRegistry::get().counter("test.counter");
+    auto hist = StatsRegistry::get().histogram("test.hist");
+    BOOST_CHECK(ctr == StatsRegistry::get().counter("test.counter"));
+
+    int const threads = 8;
+    int const perThread = 10000;
+    std::vector<std::thread> thrds;
+    for (int t = 0; t < threads; ++t) {
+        thrds.emplace_back([ctr, hist]() {
+            for (int j = 1; j <= perThread; ++j) {
+                ctr->add();
+                hist->record(j % 100 == 0 ? 5000 : 10);
+            }
+        });
+    }
+    for (auto& thrd : thrds) thrd.join();
+
+    BOOST_CHECK(ctr->get() == threads*perThread);
+    auto snap = hist->snapshot();
+    BOOST_CHECK(snap.count == uint64_t(threads*perThread));
+    BOOST_CHECK(snap.max == 5000);
+    // 99% of the values are 10, which is in the [8,16) bucket.
+    BOOST_CHECK(snap.percentile(0.5) == 15);
+    BOOST_CHECK(snap.percentile(0.99) == 15);
+    BOOST_CHECK(snap.percentile(1.0) == 5000);
+
+    std::ostringstream os;
+    StatsRegistry::get().print(os);
+    BOOST_CHECK(os.str().find("test.hist count=80000") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
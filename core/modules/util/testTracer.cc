@@ -0,0 +1,138 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+/**
+ * @brief test Tracer
+ */
+
+// System headers
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Qserv headers
+#include "util/Tracer.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE Tracer
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using namespace lsst::qserv::util;
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(Disabled) {
+    auto& tracer = Tracer::get();
+    tracer.configure(false, 10);
+    tracer.clear();
+    uint64_t traceId = tracer.newTraceId();
+    BOOST_CHECK(traceId == 0);
+    {
+        TraceSpan span(traceId, "nothing");
+        BOOST_CHECK(!span.active());
+    }
+    BOOST_CHECK(tracer.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(RingAndDump) {
+    auto& tracer = Tracer::get();
+    tracer.configure(true, 4);
+    tracer.clear();
+    uint64_t idA = tracer.newTraceId();
+    uint64_t idB = tracer.newTraceId();
+    BOOST_CHECK(idA != 0 && idB != 0 && idA != idB);
+
+    for (int j = 0; j < 6; ++j) {
+        TraceSpan span(idA, "spanA");
+        span.setDetail("n=" + std::to_string(j));
+    }
+    // Only the newest 4 spans are kept.
+    BOOST_CHECK(tracer.size() == 4);
+    {
+        TraceSpan span(idB, "span\"B\"", "worker");
+    }
+    BOOST_CHECK(tracer.size() == 4);
+
+    std::ostringstream osAll;
+    tracer.dumpChromeJson(osAll);
+    std::string all = osAll.str();
+    BOOST_CHECK(all.find("\"traceEvents\"") != std::string::npos);
+    BOOST_CHECK(all.find("n=0") == std::string::npos);
+    BOOST_CHECK(all.find("n=1") == std::string::npos);
+    BOOST_CHECK(all.find("n=5") != std::string::npos);
+    BOOST_CHECK(all.find("span\\\"B\\\"") != std::string::npos);
+
+    std::ostringstream osB;
+    tracer.dumpChromeJson(osB, idB);
+    std::string onlyB = osB.str();
+    BOOST_CHECK(onlyB.find("spanA") == std::string::npos);
+    BOOST_CHECK(onlyB.find("\"cat\":\"worker\"") != std::string::npos);
+    tracer.configure(false, 4);
+}
+
+BOOST_AUTO_TEST_CASE(Threads) {
+    // Spans collected by each thread are dumped whether they are still in
+    // the thread's buffer, were moved into the ring, or the thread exited.
+    auto& tracer = Tracer::get();
+    tracer.configure(true, 10000);
+    tracer.clear();
+    uint64_t const traceId = tracer.newTraceId();
+    uint64_t const recorded = tracer.getRecordedCount();
+    int const threadCount = 8;
+    int const spansPerThread = 100;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([traceId]() {
+            for (int j = 0; j < spansPerThread; ++j) {
+                TraceSpan span(traceId, "spanT");
+            }
+        });
+    }
+    for (auto& thrd : threads) {
+        thrd.join();
+    }
+    {
+        TraceSpan span(traceId, "spanMain");
+    }
+    size_t const expected = threadCount*spansPerThread + 1;
+    BOOST_CHECK_EQUAL(tracer.size(), expected);
+    BOOST_CHECK_EQUAL(tracer.getRecordedCount() - recorded, expected);
+
+    std::ostringstream os;
+    tracer.dumpChromeJson(os, traceId);
+    std::string const dump = os.str();
+    size_t count = 0;
+    for (auto pos = dump.find("\"spanT\""); pos != std::string::npos; pos = dump.find("\"spanT\"", pos + 1)) {
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, static_cast<size_t>(threadCount*spansPerThread));
+    BOOST_CHECK(dump.find("spanMain") != std::string::npos);
+
+    tracer.clear();
+    BOOST_CHECK_EQUAL(tracer.size(), 0U);
+    tracer.configure(false, 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
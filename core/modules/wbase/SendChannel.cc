@@ -25,6 +25,7 @@
 // System headers
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <unistd.h>
 #include <vector>
@@ -123,4 +124,88 @@ SendChannel::Ptr SendChannel::newStringChannel(std::string& d) {
 
 }
 
+
+/// SharedStream is the stream that SharedStreamChannels write to.
+struct SharedStream {
+    SharedStream(SendChannel::Ptr const& channel_, int remaining_)
+        : channel(channel_), remaining(remaining_) {}
+
+    std::mutex mtx; ///< Protects all members and serializes sends.
+    SendChannel::Ptr const channel;
+    int remaining; ///< Channels that have not sent their last message.
+    bool started{false}; ///< True once anything was streamed.
+    bool failed{false}; ///< True once an error response was sent instead.
+};
+
+
+/// SharedStreamChannel is the share of one Task in a stream. QueryRunner
+/// sends every message as a header followed by its Result, so the header is
+/// held until the Result arrives and the two are sent together, keeping the
+/// messages of other Tasks from coming between them. Only the last message
+/// of the last channel ends the stream.
+class SharedStreamChannel : public SendChannel {
+public:
+    SharedStreamChannel(std::shared_ptr<SharedStream> const& stream) : _stream(stream) {}
+
+    // Whole responses cannot be shared.
+    bool send(char const* buf, int bufLen) override { return false; }
+    bool sendFile(int fd, Size fSize) override { return false; }
+
+    bool sendError(std::string const& msg, int code) override {
+        std::lock_guard<std::mutex> lock(_stream->mtx);
+        if (_ended || _stream->failed) return false;
+        _ended = true;
+        if (!_stream->started) {
+            // The whole request fails, and the czar sends each chunk again on its own.
+            _stream->failed = true;
+            return _stream->channel->sendError(msg, code);
+        }
+        // Too late for an error response. The czar sends the chunks whose
+        // results did not end again on their own.
+        if (--_stream->remaining == 0) {
+            _stream->channel->sendStream("", 0, true);
+        }
+        return false;
+    }
+
+    bool sendStream(char const* buf, int bufLen, bool last) override {
+        std::lock_guard<std::mutex> lock(_stream->mtx);
+        if (_ended || _stream->failed) return false;
+        if (!_holding && !last) {
+            _held.assign(buf, bufLen);
+            _holding = true;
+            return true;
+        }
+        bool endStream = false;
+        if (last) {
+            _ended = true;
+            endStream = (--_stream->remaining == 0);
+        }
+        bool sent = true;
+        if (_holding) {
+            sent = _stream->channel->sendStream(_held.data(), _held.size(), false);
+            _held.clear();
+            _holding = false;
+        }
+        _stream->started = true;
+        return _stream->channel->sendStream(buf, bufLen, endStream) && sent;
+    }
+
+private:
+    std::shared_ptr<SharedStream> _stream;
+    std::string _held; ///< Header waiting for its Result.
+    bool _holding{false};
+    bool _ended{false};
+};
+
+std::vector<SendChannel::Ptr> SendChannel::newSharedStreamChannels(SendChannel::Ptr const& channel,
+                                                                   int count) {
+    auto stream = std::make_shared<SharedStream>(channel, count);
+    std::vector<SendChannel::Ptr> channels;
+    for (int j = 0; j < count; ++j) {
+        channels.push_back(std::make_shared<SharedStreamChannel>(stream));
+    }
+    return channels;
+}
+
 }}} // namespace
@@ -29,6 +29,7 @@
 #include <memory>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 // Qserv headers
 #include "global/Bug.h"
@@ -75,6 +76,13 @@ public:
     /// provided by reference at construction.
     static SendChannel::Ptr newStringChannel(std::string& dest);
 
+    /// Construct count channels that share the stream of channel, one for
+    /// each Task of a multi-chunk request. Messages sent on them are passed
+    /// on whole, and the stream ends with the last message of the last of
+    /// them. An error is passed on only if nothing was streamed yet.
+    static std::vector<SendChannel::Ptr> newSharedStreamChannels(SendChannel::Ptr const& channel,
+                                                                 int count);
+
 protected:
     std::function<void(void)> _release = [](){;}; ///< Function to release resources.
 };
@@ -40,6 +40,7 @@
 // Qserv headers
 #include "proto/TaskMsgDigest.h"
 #include "proto/worker.pb.h"
+#include "util/Tracer.h"
 #include "wbase/Base.h"
 #include "wbase/SendChannel.h"
 
@@ -54,6 +55,15 @@ dump(std::ostream& os,
     for(int i=0; i < f.query_size(); ++i) {
         os << f.query(i) << ",";
     }
+    if (f.querytemplate_size() > 0) {
+        os << " qt=";
+        for(auto const& qTemplate : f.querytemplate()) {
+            for(int i=0; i < qTemplate.piece_size(); ++i) {
+                os << ((i > 0) ? "<sc>" : "") << qTemplate.piece(i);
+            }
+            os << ",";
+        }
+    }
     if (f.has_subchunks()) {
         os << " sc=";
         for(int i=0; i < f.subchunks().id_size(); ++i) {
@@ -105,6 +115,7 @@ IdSet Task::allIds{};
 Task::Task(Task::TaskMsgPtr const& t, SendChannel::Ptr const& sc)
     : msg(t), sendChannel(sc),
       _qId(t->queryid()), _jId(t->jobid()), _attemptCount(t->attemptcount()),
+      _traceId(t->has_traceid() ? t->traceid() : 0),
       _idStr(QueryIdHelper::makeIdStr(_qId, _jId)) {
     hash = hashTaskMsg(*t);
 
@@ -192,9 +203,16 @@ Task::State Task::getState() const {
 
 /// Set values associated with the Task being started.
 void Task::started(std::chrono::system_clock::time_point const& now) {
-    std::lock_guard<std::mutex> guard(_stateMtx);
-    _state = State::RUNNING;
-    _startTime = now;
+    std::chrono::system_clock::time_point queueTime;
+    {
+        std::lock_guard<std::mutex> guard(_stateMtx);
+        _state = State::RUNNING;
+        _startTime = now;
+        queueTime = _queueTime;
+    }
+    if (_traceId != 0) {
+        util::Tracer::get().record(_traceId, "Task::queued", "worker", queueTime, now, _idStr);
+    }
 }
 
 
@@ -207,6 +225,10 @@ std::chrono::milliseconds Task::finished(std::chrono::system_clock::time_point c
         _finishTime = now;
         _state = State::FINISHED;
         duration = std::chrono::duration_cast<std::chrono::milliseconds>(_finishTime - _startTime);
+        if (_traceId != 0) {
+            util::Tracer::get().record(_traceId, "Task::run", "worker", _startTime, _finishTime,
+                                       _idStr + " chunkId=" + std::to_string(msg->chunkid()));
+        }
     }
     // Ensure that the duration is greater than 0.
     if (duration.count() < 1) {
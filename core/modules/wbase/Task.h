@@ -146,6 +146,7 @@ public:
     QueryId getQueryId() const { return _qId; }
     int getJobId() const { return _jId; }
     int getAttemptCount() const { return _attemptCount; }
+    uint64_t getTraceId() const { return _traceId; } ///< 0 if the czar is not tracing this query.
     bool getScanInteractive() {return _scanInteractive; }
     proto::ScanInfo& getScanInfo() { return _scanInfo; }
     void setOnInteractive(bool val) { _onInteractive = val; }
@@ -175,6 +176,7 @@ private:
     QueryId  const    _qId{0}; //< queryId from czar
     int      const    _jId{0}; //< jobId from czar
     int      const    _attemptCount{0}; // attemptCount from czar
+    uint64_t const    _traceId{0}; ///< util::Tracer trace id from czar, 0 if not traced.
     std::string const _idStr{QueryIdHelper::makeIdStr(0, 0, true)}; // < for logging only
 
     std::atomic<bool> _cancelled{false};
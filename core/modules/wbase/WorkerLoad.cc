@@ -0,0 +1,66 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "wbase/WorkerLoad.h"
+
+namespace lsst {
+namespace qserv {
+namespace wbase {
+
+WorkerLoad& WorkerLoad::get() {
+    static WorkerLoad workerLoad;
+    return workerLoad;
+}
+
+
+void WorkerLoad::setSource(SourceFunc const& source) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _source = source;
+    _cached.Clear();
+    _lastRefresh = std::chrono::steady_clock::time_point();
+}
+
+
+void WorkerLoad::setRefreshInterval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _refreshInterval = interval;
+}
+
+
+void WorkerLoad::fill(proto::WorkerLoad& load) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto now = std::chrono::steady_clock::now();
+        if (_source != nullptr && now - _lastRefresh >= _refreshInterval) {
+            _cached.Clear();
+            _source(_cached);
+            _lastRefresh = now;
+        }
+        load.CopyFrom(_cached);
+    }
+    int64_t outbound = getOutboundBytes();
+    load.set_outboundbytes(outbound > 0 ? outbound : 0);
+}
+
+}}} // namespace lsst::qserv::wbase
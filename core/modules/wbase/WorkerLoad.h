@@ -0,0 +1,86 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_WBASE_WORKERLOAD_H
+#define LSST_QSERV_WBASE_WORKERLOAD_H
+
+// System headers
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+namespace lsst {
+namespace qserv {
+namespace wbase {
+
+/// Process-wide summary of this worker's load, copied into the ProtoHeader
+/// of every result transmit so czars can see how busy each worker is.
+///
+/// Scheduler and memory figures come from a source function registered by
+/// the service when it builds its schedulers. Calling the source takes the
+/// scheduler mutexes, so its output is cached and refreshed at most once per
+/// refresh interval. Outbound bytes are tracked directly by the channels
+/// and are always current.
+class WorkerLoad {
+public:
+    using SourceFunc = std::function<void(proto::WorkerLoad&)>;
+
+    static WorkerLoad& get();
+
+    WorkerLoad(WorkerLoad const&) = delete;
+    WorkerLoad& operator=(WorkerLoad const&) = delete;
+
+    /// Set the function that fills in scheduler queues, active threads,
+    /// and locked bytes.
+    void setSource(SourceFunc const& source);
+
+    /// Minimum time between calls to the source function.
+    void setRefreshInterval(std::chrono::milliseconds interval);
+
+    /// Adjust the number of result bytes waiting to be sent.
+    void addOutboundBytes(int64_t bytes) { _outboundBytes.fetch_add(bytes, std::memory_order_relaxed); }
+    int64_t getOutboundBytes() const { return _outboundBytes.load(std::memory_order_relaxed); }
+
+    /// Copy the current load summary into load.
+    void fill(proto::WorkerLoad& load);
+
+private:
+    WorkerLoad() = default;
+
+    std::atomic<int64_t> _outboundBytes{0};
+
+    std::mutex _mtx; ///< Protects the members below.
+    SourceFunc _source;
+    proto::WorkerLoad _cached;
+    std::chrono::steady_clock::time_point _lastRefresh;
+    std::chrono::milliseconds _refreshInterval{100};
+};
+
+}}} // namespace lsst::qserv::wbase
+
+#endif // LSST_QSERV_WBASE_WORKERLOAD_H
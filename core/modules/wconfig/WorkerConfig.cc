@@ -54,6 +54,7 @@ WorkerConfig::WorkerConfig(const util::ConfigStore& configStore)
       _memManLocation(configStore.getRequired("memman.location")),
       _threadPoolSize(configStore.getInt("scheduler.thread_pool_size", wsched::BlendScheduler::getMinPoolSize())),
       _maxGroupSize(configStore.getInt("scheduler.group_size", 1)),
+      _groupMaxInFlightPerQuery(configStore.getInt("scheduler.group_max_inflight_per_query", 0)),
       _requiredTasksCompleted(configStore.getInt("scheduler.required_tasks_completed", 25)),
       _prioritySlow(configStore.getInt("scheduler.priority_slow", 2)),
       _prioritySnail(configStore.getInt("scheduler.priority_snail", 1)),
@@ -71,7 +72,10 @@ WorkerConfig::WorkerConfig(const util::ConfigStore& configStore)
       _scanMaxMinutesMed(configStore.getInt("scheduler.scanmaxminutes_med", 60*8)),
       _scanMaxMinutesSlow(configStore.getInt("scheduler.scanmaxminutes_slow", 60*12)),
       _scanMaxMinutesSnail(configStore.getInt("scheduler.scanmaxminutes_snail", 60*24)),
-      _maxTasksBootedPerUserQuery(configStore.getInt("scheduler.maxtasksbootedperuserquery", 5)) {
+      _maxTasksBootedPerUserQuery(configStore.getInt("scheduler.maxtasksbootedperuserquery", 5)),
+      _traceBufferSize(configStore.getInt("tracing.buffer_size", 100000)),
+      _traceDumpFile(configStore.get("tracing.dump_file")),
+      _traceDumpIntervalSecs(configStore.getInt("tracing.dump_interval_secs", 60)) {
 }
 
 std::ostream& operator<<(std::ostream &out, WorkerConfig const& workerConfig) {
@@ -79,7 +83,8 @@ std::ostream& operator<<(std::ostream &out, WorkerConfig const& workerConfig) {
     if (workerConfig._memManClass == "MemManReal") {
         out << "MemManSizeMb=" << workerConfig._memManSizeMb;
     }
-    out << " poolSize=" << workerConfig._threadPoolSize << ", maxGroupSize=" << workerConfig._maxGroupSize;
+    out << " poolSize=" << workerConfig._threadPoolSize << ", maxGroupSize=" << workerConfig._maxGroupSize
+        << " groupMaxInFlightPerQuery=" << workerConfig._groupMaxInFlightPerQuery;
     out << " requiredTasksCompleted=" << workerConfig._requiredTasksCompleted;
 
     out << " priority fast=" << workerConfig._priorityFast
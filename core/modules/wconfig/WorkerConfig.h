@@ -129,6 +129,14 @@ public:
         return _maxGroupSize;
     }
 
+    /* Get maximum number of tasks a single user query may have running in the group scheduler
+     *
+     * @return maximum number of running tasks per user query, 0 is unlimited
+     */
+    unsigned int getGroupMaxInFlightPerQuery() const {
+        return _groupMaxInFlightPerQuery;
+    }
+
     /* Get max thread reserve for fast shared scan
      *
      * @return max thread reserve for fast shared scan
@@ -257,6 +265,32 @@ public:
          return _maxActiveChunksSnail;
      }
 
+    /* Get the number of spans kept by util::Tracer for queries traced by the czar.
+     *
+     * @return trace ring buffer capacity, in spans.
+     */
+    unsigned int getTraceBufferSize() const {
+        return _traceBufferSize;
+    }
+
+    /* Get the file the trace ring buffer is written to, periodically and when
+     * the service stops.
+     *
+     * @return path of the Chrome trace-event JSON file, empty if no file is written.
+     */
+    std::string const& getTraceDumpFile() const {
+        return _traceDumpFile;
+    }
+
+    /* Get how often the trace ring buffer is written to the dump file, if
+     * spans were recorded since it was last written.
+     *
+     * @return interval in seconds, 0 to only write it when the service stops.
+     */
+    unsigned int getTraceDumpIntervalSecs() const {
+        return _traceDumpIntervalSecs;
+    }
+
 
     /** Overload output operator for current class
      *
@@ -278,6 +312,7 @@ private:
 
     unsigned int const _threadPoolSize;
     unsigned int const _maxGroupSize;
+    unsigned int const _groupMaxInFlightPerQuery;
     unsigned int const _requiredTasksCompleted;
 
     unsigned int const _prioritySlow;
@@ -300,6 +335,10 @@ private:
     unsigned int const _scanMaxMinutesSlow;
     unsigned int const _scanMaxMinutesSnail;
     unsigned int const _maxTasksBootedPerUserQuery;
+
+    unsigned int const _traceBufferSize;
+    std::string const _traceDumpFile;
+    unsigned int const _traceDumpIntervalSecs;
 };
 
 }}} // namespace qserv::core::wconfig
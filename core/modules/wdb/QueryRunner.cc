@@ -63,9 +63,12 @@
 #include "util/MultiError.h"
 #include "util/StringHash.h"
 #include "util/threadSafe.h"
+#include "util/Tracer.h"
 #include "wbase/Base.h"
 #include "wbase/SendChannel.h"
+#include "wbase/WorkerLoad.h"
 #include "wdb/ChunkResource.h"
+#include "wdb/QuerySql.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.wdb.QueryRunner");
@@ -141,7 +144,10 @@ bool QueryRunner::runQuery() {
     }
 
     // Wait for memman to finish reserving resources. This can take several seconds.
-    _task->waitForMemMan();
+    {
+        util::TraceSpan span(_task->getTraceId(), "QueryRunner::waitForMemMan", "worker");
+        _task->waitForMemMan();
+    }
 
     if (_task->getCancelled()) {
         LOGS(_log, LOG_LVL_DEBUG, _task->getIdStr() << " runQuery, task was cancelled after locking tables.");
@@ -156,7 +162,10 @@ bool QueryRunner::runQuery() {
     if (_task->msg->has_protocol()) {
         switch(_task->msg->protocol()) {
         case 2:
+        case 3: {
+            util::TraceSpan span(_task->getTraceId(), "QueryRunner::dispatchChannel", "worker");
             return _dispatchChannel(); // Run the query and send the results back.
+        }
         case 1:
             throw UnsupportedError(_task->getIdStr() + " QueryRunner: Expected protocol > 1 in TaskMsg");
         default:
@@ -293,7 +302,7 @@ void QueryRunner::_transmit(bool last, uint rowCount, size_t tSize) {
         LOGS(_log, LOG_LVL_ERROR, msg);
     }
     _result->SerializeToString(&resultString);
-    _transmitHeader(resultString);
+    _transmitHeader(resultString, last);
     LOGS(_log, LOG_LVL_DEBUG, "_transmit last=" << last << " " << _task->getIdStr()
          << " resultString=" << util::prettyCharList(resultString, 5));
     if (!_cancelled) {
@@ -308,7 +317,7 @@ void QueryRunner::_transmit(bool last, uint rowCount, size_t tSize) {
 }
 
 /// Transmit the protoHeader
-void QueryRunner::_transmitHeader(std::string& msg) {
+void QueryRunner::_transmitHeader(std::string& msg, bool last) {
     LOGS(_log, LOG_LVL_DEBUG, "_transmitHeader");
     // Set header
     _protoHeader->set_protocol(2); // protocol 2: row-by-row message
@@ -316,6 +325,10 @@ void QueryRunner::_transmitHeader(std::string& msg) {
     _protoHeader->set_md5(util::StringHash::getMd5(msg.data(), msg.size()));
     _protoHeader->set_wname(getHostname());
     _protoHeader->set_largeresult(_largeResult);
+    // Lets the czar ask for the next message before decoding this one.
+    _protoHeader->set_continues(!last);
+    _protoHeader->set_jobid(_task->getJobId());
+    wbase::WorkerLoad::get().fill(*_protoHeader->mutable_load());
     std::string protoHeaderString;
     _protoHeader->SerializeToString(&protoHeaderString);
 
@@ -399,10 +412,10 @@ bool QueryRunner::_dispatchChannel() {
             }
             proto::TaskMsg_Fragment const& fragment(m.fragment(i));
             ChunkResource cr(req.getResourceFragment(i));
-            // Use query fragment as-is, funnel results.
-            for(int qi=0, qe=fragment.query_size(); qi != qe; ++qi) {
-                LOGS(_log, LOG_LVL_DEBUG, "running fragment=" << fragment.query(qi));
-                MYSQL_RES* res = _primeResult(fragment.query(qi)); // This runs the SQL query.
+            // Use query fragment as-is, or as built from its templates, funnel results.
+            for(auto const& query : QuerySql::getQueries(fragment, m.fragment(0))) {
+                LOGS(_log, LOG_LVL_DEBUG, "running fragment=" << query);
+                MYSQL_RES* res = _primeResult(query); // This runs the SQL query.
                 if (!res) {
                     erred = true;
                     continue;
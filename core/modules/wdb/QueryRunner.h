@@ -86,7 +86,7 @@ private:
     void _initMsgs();
     void _initMsg();
     void _transmit(bool last, uint rowCount, size_t size);
-    void _transmitHeader(std::string& msg);
+    void _transmitHeader(std::string& msg, bool last);
 
     ///< Actual task
     wbase::Task::Ptr _task;
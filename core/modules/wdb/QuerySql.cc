@@ -103,6 +103,7 @@ std::ostream& operator<<(std::ostream& os, QuerySql const& q) {
 QuerySql::QuerySql(std::string const& db,
                    int chunkId,
                    proto::TaskMsg_Fragment const& f,
+                   proto::TaskMsg_Fragment const& first,
                    bool needCreate,
                    std::string const& defaultResultTable) {
 
@@ -114,14 +115,14 @@ QuerySql::QuerySql(std::string const& db,
     // Create executable statement.
     // Obsolete when results marshalling is implemented
     std::stringstream ss;
-    for(int i=0; i < f.query_size(); ++i) {
+    for(auto const& query : getQueries(f, first)) {
         if (needCreate) {
             ss << "CREATE TABLE " + resultTable + " ";
             needCreate = false;
         } else {
             ss << "INSERT INTO " + resultTable + " ";
         }
-        ss << f.query(i);
+        ss << query;
         executeList.push_back(ss.str());
         ss.str("");
     }
@@ -139,4 +140,33 @@ QuerySql::QuerySql(std::string const& db,
     }
 }
 
+std::vector<std::string> QuerySql::getQueries(proto::TaskMsg_Fragment const& f,
+                                              proto::TaskMsg_Fragment const& first) {
+    if (first.querytemplate_size() == 0) {
+        return std::vector<std::string>(f.query().begin(), f.query().end());
+    }
+    std::vector<std::string> queries;
+    int const subChunkCount = f.has_subchunks() ? f.subchunks().id_size() : 0;
+    queries.reserve(subChunkCount * first.querytemplate_size());
+    for(int i=0; i < subChunkCount; ++i) {
+        std::string const subChunk = std::to_string(f.subchunks().id(i));
+        for(auto const& qTemplate : first.querytemplate()) {
+            size_t size = 0;
+            for(auto const& piece : qTemplate.piece()) {
+                size += piece.size() + subChunk.size();
+            }
+            std::string query;
+            query.reserve(size);
+            for(int j=0; j < qTemplate.piece_size(); ++j) {
+                if (j > 0) {
+                    query += subChunk;
+                }
+                query += qTemplate.piece(j);
+            }
+            queries.push_back(std::move(query));
+        }
+    }
+    return queries;
+}
+
 }}} // namespace lsst::qserv::wdb
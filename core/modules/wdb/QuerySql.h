@@ -37,6 +37,7 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <vector>
 
 // Forward declarations
 namespace lsst {
@@ -60,12 +61,23 @@ typedef std::shared_ptr<QuerySql> Ptr;
     typedef lsst::qserv::proto::TaskMsg_Fragment Fragment;
 
     QuerySql() {}
+    /// @param first - the first fragment of the message of f, which has the
+    ///                query templates, if any.
     QuerySql(std::string const& db,
              int chunkId,
              proto::TaskMsg_Fragment const& f,
+             proto::TaskMsg_Fragment const& first,
              bool needCreate,
              std::string const& defaultResultTable);
 
+    /// @return the queries of fragment f, in the order they are run: its
+    ///         queries, or, if the first fragment of the message, first,
+    ///         has query templates, every template with each subchunk id of
+    ///         f in turn, the subchunk ids in the outer loop, as the czar
+    ///         would have built them.
+    static std::vector<std::string> getQueries(proto::TaskMsg_Fragment const& f,
+                                               proto::TaskMsg_Fragment const& first);
+
     StringDeque buildList;
     StringDeque executeList; // Consider using SqlFragmenter to break this up into fragments.
     StringDeque cleanupList;
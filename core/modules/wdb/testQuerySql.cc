@@ -26,6 +26,10 @@
   * @author Daniel L. Wang, SLAC
   */
 
+// System headers
+#include <string>
+#include <vector>
+
 // Third-party headers
 
 // Qserv headers
@@ -84,6 +88,7 @@ BOOST_AUTO_TEST_CASE(Basic) {
     qSql = std::make_shared<QuerySql>(defaultDb,
                                       1001,
                                       frag,
+                                      frag,
                                       true,
                                       defaultResult
                                       );
@@ -98,6 +103,7 @@ BOOST_AUTO_TEST_CASE(QueryBatch) {
                                         defaultDb,
                                         1001,
                                         frag,
+                                        frag,
                                         true,
                                         defaultResult
                                        );
@@ -111,5 +117,51 @@ BOOST_AUTO_TEST_CASE(QueryBatch) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(QueryTemplates) {
+    // The first fragment carries the templates, the second only its subchunks.
+    TaskMsg_Fragment first = makeFragment();
+    first.clear_query();
+    auto qt = first.add_querytemplate();
+    qt->add_piece("SELECT o1.*, o2.* FROM Subchunks_Winter_1001.Object_1001_");
+    qt->add_piece(" o1, Subchunks_Winter_1001.ObjectFullOverlap_1001_");
+    qt->add_piece(" o2");
+    first.add_querytemplate()->add_piece("SELECT 1");
+    TaskMsg_Fragment second;
+    second.mutable_subchunks()->add_id(7);
+
+    std::vector<std::string> queries = QuerySql::getQueries(first, first);
+    std::vector<std::string> expected = {
+        "SELECT o1.*, o2.* FROM Subchunks_Winter_1001.Object_1001_1111 o1, "
+        "Subchunks_Winter_1001.ObjectFullOverlap_1001_1111 o2",
+        "SELECT 1",
+        "SELECT o1.*, o2.* FROM Subchunks_Winter_1001.Object_1001_1222 o1, "
+        "Subchunks_Winter_1001.ObjectFullOverlap_1001_1222 o2",
+        "SELECT 1"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(queries.begin(), queries.end(), expected.begin(), expected.end());
+    queries = QuerySql::getQueries(second, first);
+    BOOST_REQUIRE_EQUAL(queries.size(), 2U);
+    BOOST_CHECK_EQUAL(queries[0], "SELECT o1.*, o2.* FROM Subchunks_Winter_1001.Object_1001_7 o1, "
+                                  "Subchunks_Winter_1001.ObjectFullOverlap_1001_7 o2");
+
+    // Without templates, the queries are used as they are.
+    TaskMsg_Fragment plain = makeFragment();
+    queries = QuerySql::getQueries(plain, plain);
+    BOOST_REQUIRE_EQUAL(queries.size(), 1U);
+    BOOST_CHECK_EQUAL(queries[0], plain.query(0));
+
+    QuerySql qSql(defaultDb, 1001, first, first, true, defaultResult);
+    BOOST_REQUIRE_EQUAL(qSql.executeList.size(), 4U);
+    BOOST_CHECK_EQUAL(qSql.executeList[0], "CREATE TABLE fragResult " + expected[0]);
+    BOOST_CHECK_EQUAL(qSql.executeList[1], "INSERT INTO fragResult " + expected[1]);
+
+    // Later fragments are built from the templates of the first one.
+    second.set_resulttable(first.resulttable());
+    QuerySql secondSql(defaultDb, 1001, second, first, false, defaultResult);
+    BOOST_REQUIRE_EQUAL(secondSql.executeList.size(), 2U);
+    BOOST_CHECK_EQUAL(secondSql.executeList[0], "INSERT INTO fragResult SELECT o1.*, o2.* FROM "
+                      "Subchunks_Winter_1001.Object_1001_7 o1, "
+                      "Subchunks_Winter_1001.ObjectFullOverlap_1001_7 o2");
+    BOOST_CHECK_EQUAL(secondSql.executeList[1], "INSERT INTO fragResult SELECT 1");
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -33,9 +33,11 @@
 #include "wsched/GroupScheduler.h"
 
 // System headers
+#include <algorithm>
 #include <iostream>
 #include <mutex>
 #include <sstream>
+#include <string>
 
 // LSST headers
 #include "lsst/log/Log.h"
@@ -53,18 +55,22 @@ namespace qserv {
 namespace wsched {
 
 
-GroupQueue::GroupQueue(int maxAccepted, wbase::Task::Ptr const& task) : _maxAccepted{maxAccepted} {
+GroupQueue::GroupQueue(int maxAccepted, wbase::Task::Ptr const& task, double startTag,
+                       std::uint64_t seq)
+  : _seq{seq}, _maxAccepted{maxAccepted} {
     assert(task != nullptr);
     _hasChunkId = task->msg->has_chunkid();
     if (_hasChunkId) {
         _chunkId = task->msg->chunkid();
     }
-    assert(queTask(task));
+    bool accepted = queTask(task, startTag, seq);
+    assert(accepted);
+    (void)accepted;
 }
 
 /// Return true if this GroupQueue accepts this task.
 /// The task is acceptable if has the same chunk id.
-bool GroupQueue::queTask(wbase::Task::Ptr const& task) {
+bool GroupQueue::queTask(wbase::Task::Ptr const& task, double startTag, std::uint64_t seq) {
     /// Not having a chunk id is considered an id.
     auto hasChunkId = task->msg->has_chunkid();
     if (hasChunkId != _hasChunkId) {
@@ -77,21 +83,38 @@ bool GroupQueue::queTask(wbase::Task::Ptr const& task) {
     // Accept if not already full
     if (_accepted < _maxAccepted) {
         ++_accepted;
-        _tasks.push_back(task);
+        Entry entry;
+        entry.task = task;
+        entry.startTag = startTag;
+        entry.seq = seq;
+        entry.queueTime = Clock::now();
+        _tasks.push_back(entry);
         return true;
     }
     return false;
 }
 
-/// Get a command off the queue. If no message is available, wait until one is.
+/// Remove and return the task at the front of the queue.
 wbase::Task::Ptr GroupQueue::getTask() {
-    auto task = _tasks.front();
+    auto task = _tasks.front().task;
     _tasks.pop_front();
     return task;
 }
 
 wbase::Task::Ptr GroupQueue::peekTask() {
-    return _tasks.front();
+    return _tasks.front().task;
+}
+
+GroupQueue::Entry GroupQueue::takeEntry(std::uint64_t seq) {
+    // A group holds at most maxGroupSize Tasks.
+    auto iter = std::find_if(_tasks.begin(), _tasks.end(),
+                             [seq](Entry const& entry) { return entry.seq == seq; });
+    if (iter == _tasks.end()) {
+        throw Bug("GroupQueue::takeEntry no Task with seq=" + std::to_string(seq));
+    }
+    Entry entry = *iter;
+    _tasks.erase(iter);
+    return entry;
 }
 
 /// Queue a Task in the GroupScheduler.
@@ -103,41 +126,81 @@ void GroupScheduler::queCmd(util::Command::Ptr const& cmd) {
         return;
     }
     std::lock_guard<std::mutex> lock(util::CommandQueue::_mx);
+    // Assign the virtual start tag. A query that has been idle, or is new,
+    // starts at the current virtual time so it cannot claim credit for the
+    // time it was not competing.
+    auto& qState = _queryStates[t->getQueryId()];
+    double startTag = std::max(_virtualTime, qState.finishTag);
+    qState.finishTag = startTag + 1.0/_weightFor(t);
+    ++qState.queued;
+
     // Start at the front of the queue looking for a group to accept the task.
-    bool queued = false;
-    for(auto iter = _queue.begin(), end = _queue.end(); iter != end && !queued; ++iter) {
+    std::uint64_t const seq = ++_seq;
+    GroupQueue::Ptr queuedIn;
+    for(auto iter = _queue.begin(), end = _queue.end(); iter != end && !queuedIn; ++iter) {
         GroupQueue::Ptr group = *iter;
-        if (group->queTask(t)) {
-            queued = true;
+        if (group->queTask(t, startTag, seq)) {
+            queuedIn = group;
         }
     }
-    if (!queued) {
+    if (!queuedIn) {
         // Wasn't inserted into an existing group, need to make a new group.
-        auto group = std::make_shared<GroupQueue>(_maxGroupSize, t);
-        _queue.push_back(group);
+        queuedIn = std::make_shared<GroupQueue>(_maxGroupSize, t, startTag, seq);
+        _queue.push_back(queuedIn);
+    }
+    TaskKey const key{startTag, queuedIn->getSeq(), seq, t->getQueryId()};
+    qState.pending.push_back(key);
+    if (qState.pending.size() == 1) {
+        _heads.insert(key);
     }
     auto uqCount = _incrCountForUserQuery(t->getQueryId());
     LOGS(_log, LOG_LVL_WARN, getName() << " queCmd " << t->getIdStr()
-         << " uqCount=" << uqCount);
+         << " uqCount=" << uqCount << " startTag=" << startTag);
     util::CommandQueue::_cv.notify_all();
 }
 
-/// Return a Task from the front of the queue. If no message is available, wait until one is.
+/// Return the queued Task with the smallest start tag. If no Task is available, wait until one is.
 util::Command::Ptr GroupScheduler::getCmd(bool wait)  {
     std::unique_lock<std::mutex> lock(util::CommandQueue::_mx);
     if (wait) {
         util::CommandQueue::_cv.wait(lock, [this](){return _ready();});
-    } else if (!_ready()) {
+    }
+    if (_inFlight >= maxInFlight()) {
         return nullptr;
     }
-    auto group = _queue.front();
-    auto task = group->getTask();
+    TaskKey const* next = _findNext();
+    if (next == nullptr) {
+        return nullptr;
+    }
+    TaskKey const key = *next;
+    // Groups are in _queue in the order they were created.
+    auto groupIter = std::lower_bound(_queue.begin(), _queue.end(), key.groupSeq,
+        [](GroupQueue::Ptr const& group, std::uint64_t groupSeq) { return group->getSeq() < groupSeq; });
+    if (groupIter == _queue.end() || (*groupIter)->getSeq() != key.groupSeq) {
+        throw Bug("GroupScheduler::getCmd no group with seq=" + std::to_string(key.groupSeq));
+    }
+    auto group = *groupIter;
+    auto entry = group->takeEntry(key.seq);
     if (group->isEmpty()) {
-        _queue.pop_front();
+        _queue.erase(groupIter);
     }
+    auto task = entry.task;
+    _virtualTime = std::max(_virtualTime, entry.startTag);
+    auto& qState = _queryStates[key.queryId];
+    --qState.queued;
+    ++qState.inFlight;
+    _heads.erase(key);
+    qState.pending.pop_front();
+    if (!qState.pending.empty()) {
+        _heads.insert(qState.pending.front());
+    }
+
     ++_inFlight; // Considered inFlight as soon as it's off the queue.
     _decrCountForUserQuery(task->getQueryId());
     _incrChunkTaskCount(task->getChunkId());
+    lock.unlock();
+
+    getQueueWaitHist(task->user)->recordSince(entry.queueTime);
     return task;
 }
 
@@ -145,13 +208,26 @@ util::Command::Ptr GroupScheduler::getCmd(bool wait)  {
 void GroupScheduler::commandFinish(util::Command::Ptr const& cmd) {
     --_inFlight;
     auto t = std::dynamic_pointer_cast<wbase::Task>(cmd);
-    if (t != nullptr) _decrChunkTaskCount(t->getChunkId());
+    if (t == nullptr) return;
+    _decrChunkTaskCount(t->getChunkId());
+    {
+        std::lock_guard<std::mutex> lock(util::CommandQueue::_mx);
+        auto iter = _queryStates.find(t->getQueryId());
+        if (iter != _queryStates.end()) {
+            if (iter->second.inFlight > 0) --iter->second.inFlight;
+            _eraseIdleQuery(iter);
+        }
+    }
+    // A Task of a query that was at its in flight limit may now be runnable.
+    if (_maxInFlightPerQuery > 0) util::CommandQueue::_cv.notify_all();
 }
 
 
 /// MaxActiveChunks and resource limitations (aside from available threads) are ignored by the GroupScheduler.
-GroupScheduler::GroupScheduler(std::string const& name, int maxThreads, int maxReserve, int maxGroupSize, int priority)
-  : SchedulerBase{name, maxThreads, maxReserve, 0, priority}, _maxGroupSize{maxGroupSize} {
+GroupScheduler::GroupScheduler(std::string const& name, int maxThreads, int maxReserve, int maxGroupSize,
+                               int priority, int maxInFlightPerQuery)
+  : SchedulerBase{name, maxThreads, maxReserve, 0, priority}, _maxGroupSize{maxGroupSize},
+    _maxInFlightPerQuery{maxInFlightPerQuery} {
 }
 
 bool GroupScheduler::empty() {
@@ -168,7 +244,45 @@ bool GroupScheduler::ready() {
 /// Precondition: _mx must be locked.
 bool GroupScheduler::_ready() {
     // GroupScheduler is not limited by resource availability and ignores maxActiveChunks.
-    return !_queue.empty() && _inFlight < maxInFlight();
+    if (_heads.empty() || _inFlight >= maxInFlight()) return false;
+    return _findNext() != nullptr;
+}
+
+
+/// Precondition: _mx must be locked.
+bool GroupScheduler::_eligible(QueryId queryId) {
+    if (_maxInFlightPerQuery <= 0) return true;
+    auto iter = _queryStates.find(queryId);
+    return iter == _queryStates.end() || iter->second.inFlight < _maxInFlightPerQuery;
+}
+
+
+/// All queries currently have the same weight. This is the place to give
+/// particular users or query classes a larger share.
+double GroupScheduler::_weightFor(wbase::Task::Ptr const&) {
+    return 1.0;
+}
+
+
+/// Return the eligible Task with the smallest start tag, ties going to queue
+/// order so Tasks on the same chunk still run back to back. Only the oldest
+/// queued Task of each query is looked at, and only queries at their in flight
+/// limit are stepped over, so this does not grow with the number of Tasks.
+/// Precondition: _mx must be locked.
+GroupScheduler::TaskKey const* GroupScheduler::_findNext() {
+    for (auto const& key : _heads) {
+        if (_eligible(key.queryId)) return &key;
+    }
+    return nullptr;
+}
+
+
+/// Forget a query once it has nothing queued or running.
+/// Precondition: _mx must be locked.
+void GroupScheduler::_eraseIdleQuery(std::map<QueryId, QueryState>::iterator iter) {
+    if (iter->second.queued <= 0 && iter->second.inFlight <= 0) {
+        _queryStates.erase(iter);
+    }
 }
 
 
@@ -178,4 +292,44 @@ std::size_t GroupScheduler::getSize() const {
     return _queue.size();
 }
 
+
+std::size_t GroupScheduler::getTaskCount() const {
+    std::lock_guard<std::mutex> lock(util::CommandQueue::_mx);
+    std::size_t count = 0;
+    for (auto const& elem : _queryStates) {
+        count += elem.second.queued;
+    }
+    return count;
+}
+
+
+util::Histogram::Ptr GroupScheduler::getQueueWaitHist(std::string const& user) {
+    std::lock_guard<std::mutex> lock(_histMtx);
+    auto& hist = _queueWaitHists[user];
+    if (hist == nullptr) {
+        hist = util::StatsRegistry::get().histogram("wsched." + getName() + ".queueWait." + user);
+    }
+    return hist;
+}
+
+
+std::string GroupScheduler::queueWaitStr() {
+    std::ostringstream os;
+    os << getName() << " queueWait(ms)";
+    std::lock_guard<std::mutex> lock(_histMtx);
+    for (auto const& elem : _queueWaitHists) {
+        auto snap = elem.second->snapshot();
+        os << " " << elem.first << ":n=" << snap.count
+           << ",p50=" << snap.percentile(0.50)/1000.0
+           << ",p90=" << snap.percentile(0.90)/1000.0
+           << ",p99=" << snap.percentile(0.99)/1000.0;
+    }
+    return os.str();
+}
+
+
+std::string GroupScheduler::chunkStatusStr() {
+    return SchedulerBase::chunkStatusStr() + "\n" + queueWaitStr();
+}
+
 }}} // namespace lsst::qserv::wsched
@@ -23,8 +23,16 @@
 #ifndef LSST_QSERV_WSCHED_GROUPSCHEDULER_H
 #define LSST_QSERV_WSCHED_GROUPSCHEDULER_H
 
+// System headers
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+
 // Qserv headers
 #include "util/EventThread.h"
+#include "util/Histogram.h"
 #include "wsched/SchedulerBase.h"
 
 namespace lsst {
@@ -33,33 +41,67 @@ namespace wsched {
 
 /// A container to hold commands for a single chunk.
 /// Similar to util::CommandQueue but it doesn't need the condition variable or mutex.
+/// Each task is stored with the virtual start tag GroupScheduler assigned to it,
+/// a sequence number, and the time it was queued. The group's own sequence
+/// number is that of the task it was created for.
 class GroupQueue {
 public:
     using Ptr = std::shared_ptr<GroupQueue>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        wbase::Task::Ptr task;
+        double startTag{0.0};
+        std::uint64_t seq{0};
+        Clock::time_point queueTime;
+    };
 
-    explicit GroupQueue(int maxAccepted, wbase::Task::Ptr const& task);
-    bool queTask(wbase::Task::Ptr const& task);
+    explicit GroupQueue(int maxAccepted, wbase::Task::Ptr const& task, double startTag=0.0,
+                        std::uint64_t seq=0);
+    bool queTask(wbase::Task::Ptr const& task, double startTag=0.0, std::uint64_t seq=0);
     wbase::Task::Ptr getTask();
     wbase::Task::Ptr peekTask();
     bool isEmpty() { return _tasks.empty(); }
 
+    /// Remove and return the entry with sequence number seq.
+    Entry takeEntry(std::uint64_t seq);
+    std::deque<Entry> const& getEntries() const { return _tasks; }
+    std::uint64_t getSeq() const { return _seq; }
+
 protected:
+    std::uint64_t _seq{0};
     bool _hasChunkId{false};
     int _chunkId{0};
     int _maxAccepted{1}; ///< maximum number of commands to accept in this object.
     int _accepted{0}; ///< number of commands accepted.
-    std::deque<wbase::Task::Ptr> _tasks;
+    std::deque<Entry> _tasks;
 };
 
 /// GroupScheduler -- A scheduler that is a cross between FIFO and shared scan.
-/// Tasks are ordered as they come in, except that queries for the
-/// same chunks are grouped together.
+/// Queries for the same chunks are grouped together, and Tasks are ordered
+/// by start-time fair queueing across user queries.
+///
+/// Each Task gets a virtual start tag when it is queued:
+///   start = max(virtualTime, lastFinishTag[queryId]), finish = start + 1/weight
+/// and getCmd() dispatches the queued Task with the smallest start tag, ties going
+/// to the Task nearest the front of the queue. The start tags of a query's Tasks
+/// increase in queue order, so only the oldest queued Task of each query is a
+/// candidate; these are kept ordered, and finding the next Task only steps over
+/// queries that are at their in flight limit. A query with thousands of chunks
+/// therefore cannot hold back a small query that arrives after it; the small query's
+/// Tasks are interleaved with the large query's. When every query has one Task
+/// (or all Tasks were queued at once by distinct queries) the order is plain FIFO by
+/// group, as before.
+///
+/// maxInFlightPerQuery, when greater than 0, bounds the number of Tasks a single
+/// user query may have running in this scheduler.
 class GroupScheduler : public SchedulerBase {
 public:
     typedef std::shared_ptr<GroupScheduler> Ptr;
 
     GroupScheduler(std::string const& name,
-                   int maxThreads, int maxReserve, int maxGroupSize, int priority);
+                   int maxThreads, int maxReserve, int maxGroupSize, int priority,
+                   int maxInFlightPerQuery=0);
     virtual ~GroupScheduler() {}
 
     bool empty();
@@ -72,13 +114,62 @@ public:
     // SchedulerBase overrides
     bool ready() override;
     std::size_t getSize() const override;
+    std::string chunkStatusStr() override;
+
+    /// @return the number of Tasks (not groups) in the queue.
+    std::size_t getTaskCount() const;
+
+    int getMaxInFlightPerQuery() const { return _maxInFlightPerQuery; }
+
+    /// @return a string with queue wait percentiles (milliseconds) for each user.
+    std::string queueWaitStr();
 
+    /// @return the queue wait histogram for user, creating it if needed.
+    util::Histogram::Ptr getQueueWaitHist(std::string const& user);
 
 private:
+    /// Position of a queued Task in dispatch order: by start tag, then by
+    /// group and place in the group, which is queue order.
+    struct TaskKey {
+        double startTag;
+        std::uint64_t groupSeq;
+        std::uint64_t seq;
+        QueryId queryId;
+        bool operator<(TaskKey const& other) const {
+            if (startTag != other.startTag) return startTag < other.startTag;
+            if (groupSeq != other.groupSeq) return groupSeq < other.groupSeq;
+            return seq < other.seq;
+        }
+    };
+
+    /// Fair queueing state for one user query.
+    struct QueryState {
+        double finishTag{0.0}; ///< Finish tag of the most recently queued Task.
+        int queued{0};         ///< Tasks in the queue.
+        int inFlight{0};       ///< Tasks handed out and not yet finished.
+        std::deque<TaskKey> pending; ///< Queued Tasks, oldest first.
+    };
+
     bool _ready();
+    bool _eligible(QueryId queryId);
+    double _weightFor(wbase::Task::Ptr const& task);
+
+    /// Find the next Task to run.
+    /// @return nullptr if no Task may run now.
+    TaskKey const* _findNext();
+    void _eraseIdleQuery(std::map<QueryId, QueryState>::iterator iter);
 
     std::deque<GroupQueue::Ptr> _queue;
     int _maxGroupSize{1};
+    int _maxInFlightPerQuery{0}; ///< 0 is unlimited.
+
+    double _virtualTime{0.0}; ///< Start tag of the last Task dispatched.
+    std::map<QueryId, QueryState> _queryStates; ///< protected by CommandQueue::_mx
+    std::set<TaskKey> _heads; ///< Oldest queued Task of each query, protected by CommandQueue::_mx
+    std::uint64_t _seq{0};    ///< Last Task sequence number, protected by CommandQueue::_mx
+
+    std::mutex _histMtx; ///< protects _queueWaitHists
+    std::map<std::string, util::Histogram::Ptr> _queueWaitHists; ///< key is user name
 };
 
 }}} // namespace lsst::qserv::wsched
@@ -100,7 +100,7 @@ public:
     /// Return maximum number of Tasks this scheduler can have inFlight.
     virtual int maxInFlight() { return std::min(_maxThreads, _maxThreadsAdj); }
 
-    std::string chunkStatusStr(); //< @return a string
+    virtual std::string chunkStatusStr(); //< @return a string
 
     /// Remove task from this scheduler.
     /// @return - If task was still in the queue, return true.
@@ -243,6 +243,78 @@ BOOST_AUTO_TEST_CASE(GroupMaxThread) {
     BOOST_CHECK(gs.ready() == false);
 }
 
+
+BOOST_AUTO_TEST_CASE(GroupFairShare) {
+    // A large query queued first should not keep a later small query waiting
+    // until all of its Tasks have run.
+    wsched::GroupScheduler gs{"GroupSchedFair", 100, 0, 1, 0};
+    lsst::qserv::QueryId bigQ = 7;
+    lsst::qserv::QueryId smallQ = 8;
+    std::vector<Task::Ptr> bigTasks;
+    for (int j=0; j<10; ++j) {
+        bigTasks.push_back(queMsgWithChunkId(gs, 100+j, bigQ, j));
+    }
+    // The first 2 Tasks of the large query run.
+    auto t1 = gs.getCmd(false);
+    auto t2 = gs.getCmd(false);
+    BOOST_CHECK(t1.get() == bigTasks[0].get());
+    BOOST_CHECK(t2.get() == bigTasks[1].get());
+
+    // The small query arrives and gets the next slot instead of waiting for
+    // the other 8 Tasks of the large query.
+    Task::Ptr s1 = queMsgWithChunkId(gs, 200, smallQ, 0);
+    Task::Ptr s2 = queMsgWithChunkId(gs, 201, smallQ, 1);
+    std::vector<Task::Ptr> order;
+    for (int j=0; j<4; ++j) {
+        order.push_back(std::dynamic_pointer_cast<Task>(gs.getCmd(false)));
+    }
+    // Tasks alternate between the two queries, the earlier queued Task
+    // winning ties.
+    BOOST_CHECK(order[0].get() == s1.get());
+    BOOST_CHECK(order[1].get() == bigTasks[2].get());
+    BOOST_CHECK(order[2].get() == s2.get());
+    BOOST_CHECK(order[3].get() == bigTasks[3].get());
+    int count = 0;
+    while (gs.ready()) {
+        BOOST_CHECK(gs.getCmd(false) != nullptr);
+        ++count;
+    }
+    BOOST_CHECK(count == 6);
+    BOOST_CHECK(gs.empty() == true);
+    BOOST_CHECK(gs.getQueueWaitHist(bigTasks[0]->user)->snapshot().count == 12);
+}
+
+
+BOOST_AUTO_TEST_CASE(GroupMaxInFlightPerQuery) {
+    // Test that a single query cannot use more than maxInFlightPerQuery threads.
+    wsched::GroupScheduler gs{"GroupSchedLimit", 10, 0, 100, 0, 2};
+    lsst::qserv::QueryId qA = 1;
+    lsst::qserv::QueryId qB = 2;
+    Task::Ptr a1 = queMsgWithChunkId(gs, 42, qA, 0);
+    Task::Ptr a2 = queMsgWithChunkId(gs, 42, qA, 1);
+    Task::Ptr a3 = queMsgWithChunkId(gs, 42, qA, 2);
+    auto aa1 = gs.getCmd(false);
+    auto aa2 = gs.getCmd(false);
+    BOOST_CHECK(a1.get() == aa1.get());
+    BOOST_CHECK(a2.get() == aa2.get());
+    BOOST_CHECK(gs.ready() == false);
+    BOOST_CHECK(gs.getCmd(false) == nullptr);
+
+    // Another query can still run.
+    Task::Ptr b1 = queMsgWithChunkId(gs, 43, qB, 0);
+    BOOST_CHECK(gs.ready() == true);
+    auto bb1 = gs.getCmd(false);
+    BOOST_CHECK(b1.get() == bb1.get());
+    BOOST_CHECK(gs.ready() == false);
+
+    gs.commandFinish(a1);
+    BOOST_CHECK(gs.ready() == true);
+    auto aa3 = gs.getCmd(false);
+    BOOST_CHECK(a3.get() == aa3.get());
+    BOOST_CHECK(gs.getInFlight() == 3);
+    BOOST_CHECK(gs.empty() == true);
+}
+
 BOOST_AUTO_TEST_CASE(DiskMinHeap) {
     wsched::ChunkDisk::MinHeap minHeap{};
     lsst::qserv::QueryId qIdInc = 1;
@@ -34,6 +34,7 @@
 #include "global/Bug.h"
 #include "global/debugUtil.h"
 #include "util/common.h"
+#include "wbase/WorkerLoad.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.xrdsvc.ChannelStream");
@@ -79,6 +80,8 @@ ChannelStream::ChannelStream()
 
 /// Destructor
 ChannelStream::~ChannelStream() {
+    // Messages never picked up by XrdSsi are no longer outbound.
+    wbase::WorkerLoad::get().addOutboundBytes(-_queuedBytes);
 #if 0 // Enable to debug ChannelStream lifetime
     try {
         LOGS(_log, LOG_LVL_DEBUG, "Stream (" << (void *) this << ") deleted");
@@ -98,6 +101,8 @@ ChannelStream::append(char const* buf, int bufLen, bool last) {
         LOGS(_log, LOG_LVL_DEBUG, "Trying to append message (flowing)");
 
         _msgs.push_back(std::string(buf, bufLen));
+        _queuedBytes += bufLen;
+        wbase::WorkerLoad::get().addOutboundBytes(bufLen);
         _closed = last; // if last is true, then we are closed.
         _hasDataCondition.notify_one();
     }
@@ -122,6 +127,8 @@ ChannelStream::GetBuff(XrdSsiErrInfo &eInfo, int &dlen, bool &last) {
     SimpleBuffer* sb = new SimpleBuffer(_msgs.front());
     dlen = _msgs.front().size();
     _msgs.pop_front();
+    _queuedBytes -= dlen;
+    wbase::WorkerLoad::get().addOutboundBytes(-dlen);
     last = _closed && _msgs.empty();
     LOGS(_log, LOG_LVL_DEBUG, "returning buffer (" << dlen << ", " << (last ? "(last)" : "(more)") << ")");
     return sb;
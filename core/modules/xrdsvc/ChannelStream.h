@@ -25,6 +25,7 @@
 
 // System headers
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <mutex>
 #include <string>
@@ -55,6 +56,7 @@ private:
     bool _closed; ///< Closed to new append() calls?
     // Can keep a deque of (buf, bufsize) to reduce copying, if needed.
     std::deque<std::string> _msgs; ///< Message queue
+    int64_t _queuedBytes{0}; ///< Bytes in _msgs, counted in wbase::WorkerLoad
     std::mutex _mutex; ///< _msgs protection
     std::condition_variable _hasDataCondition; ///< _msgs condition
 };
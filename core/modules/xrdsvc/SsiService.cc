@@ -26,6 +26,8 @@
 
 // System headers
 #include <cassert>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <string>
 #include <stdlib.h>
@@ -43,7 +45,9 @@
 #include "memman/MemManNone.h"
 #include "mysql/MySqlConnection.h"
 #include "sql/SqlConnection.h"
+#include "util/Tracer.h"
 #include "wbase/Base.h"
+#include "wbase/WorkerLoad.h"
 #include "wconfig/WorkerConfig.h"
 #include "wconfig/WorkerConfigError.h"
 #include "wcontrol/Foreman.h"
@@ -107,7 +111,8 @@ SsiService::SsiService(XrdSsiLogger* log, wconfig::WorkerConfig const& workerCon
     int maxReserve = 2;
     auto group = std::make_shared<wsched::GroupScheduler>(
         "SchedGroup", maxThread, maxReserve,
-        workerConfig.getMaxGroupSize(), wsched::SchedulerBase::getMaxPriority());
+        workerConfig.getMaxGroupSize(), wsched::SchedulerBase::getMaxPriority(),
+        workerConfig.getGroupMaxInFlightPerQuery());
 
     int const fastest = lsst::qserv::proto::ScanInfo::Rating::FASTEST;
     int const fast    = lsst::qserv::proto::ScanInfo::Rating::FAST;
@@ -119,18 +124,16 @@ SsiService::SsiService(XrdSsiLogger* log, wconfig::WorkerConfig const& workerCon
     double slowScanMaxMinutes = (double)workerConfig.getScanMaxMinutesSlow();
     double snailScanMaxMinutes = (double)workerConfig.getScanMaxMinutesSnail();
     int maxTasksBootedPerUserQuery = workerConfig.getMaxTasksBootedPerUserQuery();
-    std::vector<wsched::ScanScheduler::Ptr> scanSchedulers{
-        std::make_shared<wsched::ScanScheduler>(
-            "SchedSlow", maxThread, workerConfig.getMaxReserveSlow(), workerConfig.getPrioritySlow(),
-            workerConfig.getMaxActiveChunksSlow(), memMan, medium+1, slow, slowScanMaxMinutes),
-        std::make_shared<wsched::ScanScheduler>(
-            "SchedMed", maxThread, workerConfig.getMaxReserveMed(), workerConfig.getPriorityMed(),
-            workerConfig.getMaxActiveChunksMed(), memMan, fast+1, medium, medScanMaxMinutes),
-        std::make_shared<wsched::ScanScheduler>(
-            "SchedFast", maxThread, workerConfig.getMaxReserveFast(), workerConfig.getPriorityFast(),
-            workerConfig.getMaxActiveChunksFast(), memMan, fastest, fast, fastScanMaxMinutes),
-
-    };
+    auto schedSlow = std::make_shared<wsched::ScanScheduler>(
+        "SchedSlow", maxThread, workerConfig.getMaxReserveSlow(), workerConfig.getPrioritySlow(),
+        workerConfig.getMaxActiveChunksSlow(), memMan, medium+1, slow, slowScanMaxMinutes);
+    auto schedMed = std::make_shared<wsched::ScanScheduler>(
+        "SchedMed", maxThread, workerConfig.getMaxReserveMed(), workerConfig.getPriorityMed(),
+        workerConfig.getMaxActiveChunksMed(), memMan, fast+1, medium, medScanMaxMinutes);
+    auto schedFast = std::make_shared<wsched::ScanScheduler>(
+        "SchedFast", maxThread, workerConfig.getMaxReserveFast(), workerConfig.getPriorityFast(),
+        workerConfig.getMaxActiveChunksFast(), memMan, fastest, fast, fastScanMaxMinutes);
+    std::vector<wsched::ScanScheduler::Ptr> scanSchedulers{schedSlow, schedMed, schedFast};
 
     auto snail = std::make_shared<wsched::ScanScheduler>(
         "SchedSnail", maxThread, workerConfig.getMaxReserveSnail(), workerConfig.getPrioritySnail(),
@@ -148,10 +151,67 @@ SsiService::SsiService(XrdSsiLogger* log, wconfig::WorkerConfig const& workerCon
 
     _foreman = std::make_shared<wcontrol::Foreman>(
             blendSched, poolSize, workerConfig.getMySqlConfig(), queries);
+
+    // Every result header carries this summary back to the czar.
+    wbase::WorkerLoad::get().setSource(
+        [group, schedFast, schedMed, schedSlow, snail, blendSched, memMan](proto::WorkerLoad& load) {
+            load.set_queuedgroup(group->getTaskCount());
+            load.set_queuedfast(schedFast->getSize());
+            load.set_queuedmed(schedMed->getSize());
+            load.set_queuedslow(schedSlow->getSize());
+            load.set_queuedsnail(snail->getSize());
+            load.set_activethreads(std::max(blendSched->getInFlight(), 0));
+            load.set_lockedbytes(memMan->getStatistics().bytesLocked);
+        });
+
+    // Spans are only recorded for tasks the czar is tracing, so the worker
+    // Tracer itself stays disabled (it never hands out trace ids).
+    util::Tracer::get().configure(false, workerConfig.getTraceBufferSize());
+    _traceDumpFile = workerConfig.getTraceDumpFile();
+    std::chrono::seconds const dumpInterval(workerConfig.getTraceDumpIntervalSecs());
+    if (!_traceDumpFile.empty() && dumpInterval.count() > 0) {
+        _traceDumpThread = std::thread([this, dumpInterval]() {
+            std::unique_lock<std::mutex> lock(_traceDumpMtx);
+            while (!_traceDumpCv.wait_for(lock, dumpInterval, [this]() { return !_loopTraceDump; })) {
+                lock.unlock();
+                _dumpTrace();
+                lock.lock();
+            }
+        });
+    }
 }
 
 SsiService::~SsiService() {
     LOGS(_log, LOG_LVL_DEBUG, "SsiService dying.");
+    wbase::WorkerLoad::get().setSource(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(_traceDumpMtx);
+        _loopTraceDump = false;
+    }
+    _traceDumpCv.notify_all();
+    if (_traceDumpThread.joinable()) {
+        _traceDumpThread.join();
+    }
+    if (!_traceDumpFile.empty()) {
+        _dumpTrace();
+    }
+}
+
+/// Write the trace ring buffer to _traceDumpFile, unless no span was recorded
+/// since it was last written. The file is replaced whole, so that it can be
+/// read at any time.
+void SsiService::_dumpTrace() {
+    auto& tracer = util::Tracer::get();
+    uint64_t const recorded = tracer.getRecordedCount();
+    if (recorded == _traceDumpedCount) {
+        return;
+    }
+    std::string const tmpFile = _traceDumpFile + ".tmp";
+    if (!tracer.dumpChromeJsonFile(tmpFile) || std::rename(tmpFile.c_str(), _traceDumpFile.c_str()) != 0) {
+        LOGS(_log, LOG_LVL_WARN, "Failed to write trace file " << _traceDumpFile);
+        return;
+    }
+    _traceDumpedCount = recorded;
 }
 
 void SsiService::Provision(XrdSsiService::Resource* r,
@@ -25,7 +25,12 @@
 #define LSST_QSERV_XRDSVC_SSISERVICE_H
 
 // System headers
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 // Third-party headers
 #include "XrdSsi/XrdSsiService.hh"
@@ -74,11 +79,20 @@ public:
 private:
     void _initInventory();
     void _configure();
+    void _dumpTrace();
 
     std::shared_ptr<wpublish::ChunkInventory> _chunkInventory;
     std::shared_ptr<wcontrol::Foreman> _foreman;
 
     mysql::MySqlConfig const _mySqlConfig;
+    std::string _traceDumpFile; ///< Where to write the trace ring buffer, may be empty.
+    uint64_t _traceDumpedCount{0}; ///< util::Tracer recorded count at the last dump.
+
+    // Thread writing _traceDumpFile periodically.
+    std::thread _traceDumpThread;
+    std::mutex _traceDumpMtx; ///< Protects _loopTraceDump.
+    std::condition_variable _traceDumpCv;
+    bool _loopTraceDump{true};
 
 }; // class SsiService
 
@@ -29,6 +29,7 @@
 #include <cstddef>
 #include <iostream>
 #include <string>
+#include <vector>
 
 // Third-party headers
 #include "XrdSsi/XrdSsiRequest.hh"
@@ -45,6 +46,25 @@
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.xrdsvc.SsiSession");
+
+// The highest TaskMsg protocol this worker can run, see proto/worker.proto.
+int const MAX_PROTOCOL = 3;
+
+/// @return why the worker can not run msg, or an empty string if it can.
+std::string checkProtocol(lsst::qserv::proto::TaskMsg const& msg) {
+    int const protocol = msg.has_protocol() ? msg.protocol() : 1;
+    if (protocol > MAX_PROTOCOL) {
+        return "Unsupported TaskMsg protocol " + std::to_string(protocol);
+    }
+    if (protocol < 3) {
+        for (auto const& fragment : msg.fragment()) {
+            if (fragment.querytemplate_size() > 0) {
+                return "Query templates in TaskMsg protocol " + std::to_string(protocol);
+            }
+        }
+    }
+    return std::string();
+}
 }
 
 namespace lsst {
@@ -118,11 +138,50 @@ void SsiSession::ProcessRequest(XrdSsiRequest* req, unsigned short timeout) {
         return;
     }
 
+    // Refused here, rather than run without the queries the worker can not build.
+    std::string protocolError = checkProtocol(*taskMsg);
+    for (auto const& chunkMsg : taskMsg->chunkmsg()) {
+        if (!protocolError.empty()) break;
+        protocolError = checkProtocol(chunkMsg);
+    }
+    if (!protocolError.empty()) {
+        std::ostringstream os;
+        os << protocolError << " on resource db=" << ru.db() << " chunkId=" << ru.chunk();
+        LOGS(_log, LOG_LVL_ERROR, os.str());
+        errorFunc(os.str());
+        return;
+    }
+
+    // The request may carry the TaskMsgs of more chunks, which must all be
+    // on this worker. Each is run as its own task on a share of the reply stream.
+    std::vector<std::shared_ptr<proto::TaskMsg>> taskMsgs{taskMsg};
+    for (auto const& chunkMsg : taskMsg->chunkmsg()) {
+        ResourceUnit chunkRu;
+        chunkRu.setAsDbChunk(chunkMsg.db(), chunkMsg.chunkid());
+        if (!chunkMsg.has_db() || !chunkMsg.has_chunkid() || !(*_validator)(chunkRu)) {
+            std::ostringstream os;
+            os << "WARNING: unowned chunk query detected:" << chunkRu.path();
+            LOGS(_log, LOG_LVL_WARN, os.str());
+            errorFunc(os.str());
+            return;
+        }
+        taskMsgs.push_back(std::make_shared<proto::TaskMsg>(chunkMsg));
+    }
+    taskMsg->clear_chunkmsg();
+    std::vector<wbase::SendChannel::Ptr> channels{replyChannel};
+    if (taskMsgs.size() > 1) {
+        channels = wbase::SendChannel::newSharedStreamChannels(replyChannel, taskMsgs.size());
+    }
+
     // Once BindRequest has been called, we don't want to send errors back to xrootd
     // if the task has been cancelled. Also, task needs to exist before binding
     // to avoid any chance of missing the cancel call.
-    auto task = std::make_shared<wbase::Task>(taskMsg, replyChannel);
-    _addTask(task);
+    std::vector<wbase::Task::Ptr> tasks;
+    for (unsigned int j = 0; j < taskMsgs.size(); ++j) {
+        auto task = std::make_shared<wbase::Task>(taskMsgs[j], channels[j]);
+        _addTask(task);
+        tasks.push_back(task);
+    }
     t.start();
     BindRequest(req, this); // Step 5
     t.stop();
@@ -132,11 +191,14 @@ void SsiSession::ProcessRequest(XrdSsiRequest* req, unsigned short timeout) {
     // reference to this SsiSession inside the reply channel for the task,
     // and after the call to BindRequest.
     ReleaseRequestBuffer();
+    LOGS(_log, LOG_LVL_DEBUG, "BindRequest took " << t.getElapsed() << " seconds");
     t.start();
-    _processor->processTask(task); // Queues task to be run later.
+    for (auto const& task : tasks) {
+        _processor->processTask(task); // Queues task to be run later.
+    }
     t.stop();
-    LOGS(_log, LOG_LVL_DEBUG, "BindRequest took " << t.getElapsed() << " seconds");
-    LOGS(_log, LOG_LVL_DEBUG, "Enqueued TaskMsg for " << ru << " in " << t.getElapsed() << " seconds");
+    LOGS(_log, LOG_LVL_DEBUG, "Enqueued " << tasks.size() << " TaskMsg for " << ru
+         << " in " << t.getElapsed() << " seconds");
 }
 
 /// Called by XrdSsi to free resources.